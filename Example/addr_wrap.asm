@@ -0,0 +1,69 @@
+; =============================================================================
+; Отрицательные и переполняющиеся смещения в адресах [Rn + imm]
+; =============================================================================
+; Запуск:
+;   AirVM addr_wrap.bin
+;
+; Адрес [Rn + imm] и [Rn + Rm*scale] считается по модулю 2^32, поэтому
+; отрицательное смещение обходит массив от конца, а база 0xFFFFFFF8 со
+; смещением SLOT + 8 указывает на SLOT. Программа печатает
+;   40 30 20 10 | 7 | 7
+; и затем намеренно читает слово по адресу 0 - 2 = 0xFFFFFFFE: ВМ
+; останавливается с ошибкой
+;   Error: Cannot read uint32 at offset 4294967294 (out of bounds)
+; (запись туда же даёт «Cannot write uint32 ...»), а не выходит за пределы
+; своей памяти.
+; =============================================================================
+
+JUMP MAIN
+
+ARR:
+    .WORD 10
+    .WORD 20
+    .WORD 30
+    .WORD 40
+ARR_END:
+MSG_SP:
+    .ASCIIZ " "
+MSG_BAR:
+    .ASCIIZ " | "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    ; Обход от конца: [R1 - 4], R1 = ARR_END .. ARR + 4
+    LOADI R1, ARR_END
+BACK:
+    LOAD R2, [R1 - 4]
+    PRINT R2
+    SUB R1, R1, 4
+    SUB R3, R1, ARR
+    CMP R3, 0
+    IF EQ, WRAP
+    PRINTS MSG_SP
+    JUMP BACK
+
+WRAP:
+    ; Слово SLOT через базу 0xFFFFFFF8: индексом и смещением
+    LOADI R4, 7
+    LOADI R5, -8
+    LOADI R7, SLOT8
+    STORE [R5 + R7], R4     ; 0xFFFFFFF8 + SLOT + 8 = SLOT
+    LOAD R6, [R5 + SLOT8]
+    PRINTS MSG_BAR
+    PRINT R6
+    LOAD R6, [SLOT]
+    PRINTS MSG_BAR
+    PRINT R6
+    PRINTS MSG_NL
+
+    ; Адрес 0xFFFFFFFE: слово выходит за 32-битное пространство
+    LOAD R8, [R0 - 2]       ; R0 = 0
+    PRINT R8
+    HALT
+
+.SECTION BSS
+SLOT:
+    .SPACE 8
+SLOT8:
+    .SPACE 4
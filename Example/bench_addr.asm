@@ -0,0 +1,104 @@
+; =============================================================================
+; Адресация база+смещение и база+индекс*масштаб на проходе по массиву
+; =============================================================================
+; Ввод: длина массива N, число проходов P и режим M, например:
+;   echo "1000000 20 0" | AirVM bench_addr.bin
+;   echo "1000000 20 1" | AirVM bench_addr.bin
+;
+; Заполняет массив SRC[i] = i, затем P раз копирует DST[i] = SRC[i] + SRC[i+1]
+; и выводит сумму последнего DST. В режиме 0 адрес каждого обращения
+; считается отдельными инструкциями, как раньше разворачивал ассемблер
+; [imm + Rn]: LOADI R30, imm; ADD R30, R30, Rn; LOAD/STORE [R30]. В режиме 1
+; тот же адрес — часть операнда ([R1 + R3*4]): на три обращения к памяти
+; в итерации приходится три инструкции вместо девяти, а вся итерация
+; сокращается с 18 инструкций до 10 (ADD с константой — две инструкции).
+; =============================================================================
+
+JUMP MAIN
+
+MSG_SUM:
+    .ASCIIZ "Sum: "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    INPUT R10               ; N
+    INPUT R11               ; P
+    INPUT R12               ; M
+    SUB R13, R10, 1         ; N - 1 пар соседних элементов
+    LOADI R1, SRC
+    LOADI R7, SRC1          ; SRC + 4
+    LOADI R2, DST
+
+    LOADI R3, 0
+FILL:
+    SUB R4, R3, R10
+    CMP R4, 0
+    IF EQ, PASSES
+    STORE [R1 + R3*4], R3
+    ADD R3, R3, 1
+    JUMP FILL
+
+PASSES:
+    CMP R11, 0
+    IF EQ, SUM
+    SUB R11, R11, 1
+    LOADI R3, 0             ; i
+    LOADI R6, 0             ; 4 * i для режима 0
+    CMP R12, 0
+    IF EQ, COPY_OLD
+
+COPY_NEW:
+    SUB R4, R3, R13
+    CMP R4, 0
+    IF EQ, PASSES
+    LOAD R5, [R1 + R3*4]
+    LOAD R8, [R7 + R3*4]    ; SRC[i + 1]
+    ADD R5, R5, R8
+    STORE [R2 + R3*4], R5
+    ADD R3, R3, 1
+    JUMP COPY_NEW
+
+COPY_OLD:
+    SUB R4, R3, R13
+    CMP R4, 0
+    IF EQ, PASSES
+    LOADI R30, SRC
+    ADD R30, R30, R6
+    LOAD R5, [R30]
+    LOADI R30, SRC1
+    ADD R30, R30, R6
+    LOAD R8, [R30]          ; SRC[i + 1]
+    ADD R5, R5, R8
+    LOADI R30, DST
+    ADD R30, R30, R6
+    STORE [R30], R5
+    ADD R3, R3, 1
+    ADD R6, R6, 4
+    JUMP COPY_OLD
+
+SUM:
+    LOADI R3, 0
+    LOADI R9, 0
+SUM_LOOP:
+    SUB R4, R3, R13
+    CMP R4, 0
+    IF EQ, DONE
+    LOAD R5, [R2 + R3*4]
+    ADD R9, R9, R5
+    ADD R3, R3, 1
+    JUMP SUM_LOOP
+
+DONE:
+    PRINTS MSG_SUM
+    PRINT R9
+    PRINTS MSG_NL
+    HALT
+
+.SECTION BSS
+SRC:
+    .SPACE 4
+SRC1:
+    .SPACE 4000000          ; SRC, до 10^6 элементов
+DST:
+    .SPACE 4000000
@@ -0,0 +1,54 @@
+; =============================================================================
+; Битовые операции: подсчёт единичных битов циклом и инструкцией POPCNT
+; =============================================================================
+; Ввод: число слов N и режим M (0 — цикл по битам, 1 — POPCNT), например:
+;   echo "2000000 0" | AirVM bench_bits.bin
+;   echo "2000000 1" | AirVM bench_bits.bin
+;
+; Перебирает N псевдослучайных слов x = ROL(i * 2654435761, i & 31) и
+; выводит сумму их единичных битов. В режиме 0 биты считаются циклом
+; AND/ADD/SHR, по три инструкции на каждый значащий бит; в режиме 1 —
+; одной инструкцией POPCNT. Оба режима печатают одно и то же число.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_BITS:
+    .ASCIIZ "Bits: "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    INPUT R1                ; N
+    INPUT R2                ; M
+    LOADI R3, 0             ; i
+    LOADI R8, 0             ; сумма битов
+    LOADI R10, -1640531535  ; 2654435761, мультипликативный хеш Кнута
+
+NEXT_WORD:
+    SUB R5, R3, R1
+    CMP R5, 0
+    IF EQ, DONE             ; i == N
+    MUL R4, R3, R10
+    AND R6, R3, 31
+    ROL R4, R4, R6
+    ADD R3, R3, 1
+    CMP R2, 0
+    IF EQ, BIT_LOOP
+    POPCNT R5, R4
+    ADD R8, R8, R5
+    JUMP NEXT_WORD
+
+BIT_LOOP:
+    CMP R4, 0
+    IF EQ, NEXT_WORD
+    AND R5, R4, 1
+    ADD R8, R8, R5
+    SHR R4, R4, 1
+    JUMP BIT_LOOP
+
+DONE:
+    PRINTS MSG_BITS
+    PRINT R8
+    PRINTS MSG_NL
+    HALT
@@ -0,0 +1,93 @@
+; =============================================================================
+; Вычислительный тест: решето Эратосфена и рекурсивное число Фибоначчи
+; =============================================================================
+; Ввод: граница решета N и номер K, например:
+;   echo "5000000 30" | AirVM bench_compute.bin
+;
+; Выводит число простых меньше N и fib(K). Программа почти целиком состоит из
+; арифметики, LOAD/STORE, переходов и CALL/RET, поэтому подходит для сравнения
+; интерпретатора с кодом, полученным airvm-aot.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_PRIMES:
+    .ASCIIZ "Primes: "
+MSG_FIB:
+    .ASCIIZ "Fib: "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    INPUT R1                ; N
+    INPUT R2                ; K
+    LOADI R11, 1
+    LOADI R12, 4
+
+    ; sieve[i] = 0 для всех i < N (память за BSS изначально нулевая).
+    ; CMP сравнивает только с константой, поэтому a < b проверяется по
+    ; знаку a - b (N < 2^31).
+    LOADI R3, 2             ; i
+    LOADI R8, 0             ; счётчик простых
+SIEVE_LOOP:
+    SUB R5, R3, R1
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, SIEVE_DONE       ; i >= N
+    MUL R4, R3, R12
+    ADD R4, R4, SIEVE
+    LOAD R5, [R4]
+    CMP R5, 0
+    IF NE, SIEVE_NEXT
+    ADD R8, R8, R11
+    ; Вычёркивание кратных, начиная с i*i (i < 46341, иначе i*i >= N)
+    CMP R3, 46341
+    IF GT, SIEVE_NEXT
+    IF EQ, SIEVE_NEXT
+    MUL R6, R3, R3          ; j
+    MUL R7, R3, R12         ; шаг в байтах
+    MUL R4, R6, R12
+    ADD R4, R4, SIEVE
+MARK_LOOP:
+    SUB R5, R6, R1
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, SIEVE_NEXT       ; j >= N
+    STORE R11, [R4]
+    ADD R4, R4, R7
+    ADD R6, R6, R3
+    JUMP MARK_LOOP
+SIEVE_NEXT:
+    ADD R3, R3, R11
+    JUMP SIEVE_LOOP
+SIEVE_DONE:
+    PRINTS MSG_PRIMES
+    PRINT R8
+    PRINTS MSG_NL
+
+    MOVE R0, R2
+    CALL FIB
+    PRINTS MSG_FIB
+    PRINT R0
+    PRINTS MSG_NL
+    HALT
+
+; fib(R0) -> R0
+FIB:
+    CMP R0, 2
+    IF LT, FIB_RET
+    PUSH R0
+    SUB R0, R0, R11
+    CALL FIB
+    POP R1
+    PUSH R0
+    SUB R0, R1, 2
+    CALL FIB
+    POP R1
+    ADD R0, R0, R1
+FIB_RET:
+    RET
+
+.SECTION BSS
+SIEVE:
+    .SPACE 4
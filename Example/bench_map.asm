@@ -0,0 +1,165 @@
+; =============================================================================
+; Хеш-таблица: инструкции MAP_* против таблицы на байт-коде
+; =============================================================================
+; Ввод: режим (1 — MAP_*, 2 — таблица на байт-коде), число ключей N и
+; число проходов поиска R:
+;   echo "1 100000 20" | AirVM bench_map.bin
+;   echo "2 100000 20" | AirVM bench_map.bin
+;
+; Вставляет N ключей i * 0x9E3779B1 (i = 1..N) со значением i, затем R раз
+; ищет 2N ключей (половина отсутствует) и печатает сумму найденных значений —
+; в обоих режимах она одинакова (R * N(N+1)/2 по модулю 2^32).
+;
+; Таблица на байт-коде — открытая адресация с линейным пробированием:
+; степень двойки не меньше 2N слотов по 8 байт {ключ, значение}, ключ 0 —
+; пустой слот. Индекс — младшие биты ключа * 0x9E3779B1.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_SUM:
+    .ASCIIZ "Sum: "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    INPUT R1                ; режим
+    INPUT R2                ; N
+    INPUT R17               ; R
+    LOADI R11, 1
+    ADD R15, R2, R2         ; 2N поисков за проход
+    LOADI R16, 0            ; сумма
+    CMP R1, 1
+    IF NE, BYTECODE
+
+    ; --- MAP_* ---
+    MAP_NEW R20, R2
+    LOADI R3, 1
+N_PUT:
+    MUL R4, R3, -1640531535   ; 0x9E3779B1
+    MAP_PUT R20, R4, R3
+    ADD R3, R3, R11
+    SUB R5, R2, R3
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, N_PUT            ; i <= N
+    LOADI R18, 0
+N_ROUND:
+    LOADI R3, 1
+N_GET:
+    MUL R4, R3, -1640531535   ; 0x9E3779B1
+    MAP_GET R20, R4, R9
+    ADD R16, R16, R9
+    ADD R3, R3, R11
+    SUB R5, R15, R3
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, N_GET            ; i <= 2N
+    ADD R18, R18, R11
+    SUB R5, R18, R17
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF NE, N_ROUND          ; ещё проходы
+    MAP_FREE R20
+    JUMP DONE
+
+    ; --- таблица на байт-коде ---
+BYTECODE:
+    LOADI R14, 16           ; число слотов
+CAP_LOOP:
+    SUB R5, R14, R15
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, CAP_DONE         ; слотов >= 2N
+    ADD R14, R14, R14
+    JUMP CAP_LOOP
+CAP_DONE:
+    ; Запись в конец таблицы заранее открывает всю её память
+    MUL R4, R14, 8
+    ADD R4, R4, TABLE
+    SUB R4, R4, 4
+    STORE R16, [R4]
+    SUB R14, R14, R11       ; маска индекса
+    LOADI R3, 1
+B_PUT:
+    MUL R4, R3, -1640531535   ; 0x9E3779B1
+    CALL B_INSERT
+    ADD R3, R3, R11
+    SUB R5, R2, R3
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, B_PUT
+    LOADI R18, 0
+B_ROUND:
+    LOADI R3, 1
+B_GET:
+    MUL R4, R3, -1640531535   ; 0x9E3779B1
+    CALL B_LOOKUP
+    ADD R16, R16, R9
+    ADD R3, R3, R11
+    SUB R5, R15, R3
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, B_GET
+    ADD R18, R18, R11
+    SUB R5, R18, R17
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF NE, B_ROUND
+
+DONE:
+    PRINTS MSG_SUM
+    PRINT R16
+    PRINTS MSG_NL
+    HALT
+
+; Вставка: ключ R4, значение R3
+B_INSERT:
+    MUL R5, R4, -1640531535   ; 0x9E3779B1
+    AND R5, R5, R14         ; индекс слота
+BI_LOOP:
+    MUL R6, R5, 8
+    ADD R6, R6, TABLE
+    LOAD R7, [R6]
+    CMP R7, 0
+    IF EQ, BI_EMPTY
+    SUB R8, R7, R4
+    CMP R8, 0
+    IF EQ, BI_SET
+    ADD R5, R5, R11
+    AND R5, R5, R14
+    JUMP BI_LOOP
+BI_EMPTY:
+    STORE R4, [R6]
+BI_SET:
+    ADD R6, R6, 4
+    STORE R3, [R6]
+    RET
+
+; Поиск: ключ R4 -> значение R9 (0, если ключа нет)
+B_LOOKUP:
+    MUL R5, R4, -1640531535   ; 0x9E3779B1
+    AND R5, R5, R14
+BL_LOOP:
+    MUL R6, R5, 8
+    ADD R6, R6, TABLE
+    LOAD R7, [R6]
+    CMP R7, 0
+    IF EQ, BL_MISS
+    SUB R8, R7, R4
+    CMP R8, 0
+    IF EQ, BL_HIT
+    ADD R5, R5, R11
+    AND R5, R5, R14
+    JUMP BL_LOOP
+BL_MISS:
+    LOADI R9, 0
+    RET
+BL_HIT:
+    ADD R6, R6, 4
+    LOAD R9, [R6]
+    RET
+
+.SECTION BSS
+TABLE:
+    .SPACE 8
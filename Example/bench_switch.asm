@@ -0,0 +1,118 @@
+; =============================================================================
+; Диспетчеризация: цепочка CMP/IF против SWITCH и JUMPR по таблице
+; =============================================================================
+; Ввод: число шагов N и способ диспетчеризации M, например:
+;   echo "20000000 1" | AirVM bench_switch.bin
+;
+; Программа — маленький интерпретатор: на каждом шаге генератор
+; псевдослучайных чисел выбирает одну из восьми операций над аккумулятором.
+; Операция выбирается
+;   M = 0 — цепочкой CMP/IF (в среднем 4-5 сравнений),
+;   M = 1 — SWITCH по таблице HANDLERS,
+;   M = 2 — LOAD адреса из той же таблицы и JUMPR.
+; Результат от способа не зависит: выводится значение аккумулятора.
+;
+; Цели косвенных переходов должны быть началами проверенных инструкций.
+; Обработчики и циклы перечислены в .JUMPTABLE, поэтому ВМ проверяет их при
+; загрузке, а при исполнении SWITCH и JUMPR проверяют цель одним битом.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_ACC:
+    .ASCIIZ "Acc: "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    INPUT R1                ; N
+    INPUT R2                ; M
+    CMP R2, 2
+    IF GT, USE_CHAIN
+    JUMP PICK
+USE_CHAIN:
+    LOADI R2, 0
+PICK:
+    ; R12 — цикл выбранного способа, им заканчивается каждый шаг
+    SHL R7, R2, 2
+    LOADI R10, MODES
+    ADD R7, R7, R10
+    LOAD R12, [R7]
+    LOADI R10, HANDLERS
+    LOADI R4, 0             ; аккумулятор
+    LOADI R5, 1             ; состояние генератора
+    LOADI R8, 1103515245
+    MOVE R3, R1             ; оставшиеся шаги
+
+NEXT:
+    CMP R3, 0
+    IF EQ, DONE
+    SUB R3, R3, 1
+    MUL R5, R5, R8
+    ADD R5, R5, 12345
+    SHR R6, R5, 16
+    AND R6, R6, 7           ; номер операции
+    JUMPR R12
+
+BY_CHAIN:
+    CMP R6, 0
+    IF EQ, H0
+    CMP R6, 1
+    IF EQ, H1
+    CMP R6, 2
+    IF EQ, H2
+    CMP R6, 3
+    IF EQ, H3
+    CMP R6, 4
+    IF EQ, H4
+    CMP R6, 5
+    IF EQ, H5
+    CMP R6, 6
+    IF EQ, H6
+    JUMP H7
+
+BY_SWITCH:
+    SWITCH R6, HANDLERS, 8, H7
+
+BY_JUMPR:
+    SHL R7, R6, 2
+    ADD R7, R7, R10
+    LOAD R7, [R7]
+    JUMPR R7
+
+H0:
+    ADD R4, R4, 1
+    JUMP NEXT
+H1:
+    XOR R4, R4, R5
+    JUMP NEXT
+H2:
+    SHL R4, R4, 1
+    JUMP NEXT
+H3:
+    SUB R4, R4, 7
+    JUMP NEXT
+H4:
+    MUL R4, R4, 3
+    JUMP NEXT
+H5:
+    SHR R4, R4, 1
+    JUMP NEXT
+H6:
+    ADD R4, R4, R3
+    JUMP NEXT
+H7:
+    NOT R4, R4
+    JUMP NEXT
+
+DONE:
+    PRINTS MSG_ACC
+    PRINT R4
+    PRINTS MSG_NL
+    HALT
+
+.SECTION RODATA
+MODES:
+    .JUMPTABLE BY_CHAIN, BY_SWITCH, BY_JUMPR
+HANDLERS:
+    .JUMPTABLE H0, H1, H2, H3, H4, H5, H6, H7
@@ -0,0 +1,100 @@
+; =============================================================================
+; Клоны из прогретого шаблона: решето один раз, запросы — в каждом клоне
+; =============================================================================
+; Общая часть строит решето Эратосфена до 2^20 и доходит до CHECKPOINT.
+; С --clones VM останавливается на нём, и каждый клон продолжает отсюда со
+; своим номером в R9, разделяя память решета с шаблоном (копирование при
+; записи). Клон читает числа со своего stdin до 0 и для каждого печатает,
+; простое ли оно:
+;   AirVM --clones 3 --clone-input queries.%u.txt clone_primes.bin
+;
+; Без --clones CHECKPOINT записывает в R9 ноль, и программа просто
+; обрабатывает stdin.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_CLONE:
+    .ASCIIZ "Clone "
+MSG_SEP:
+    .ASCIIZ ": "
+MSG_PRIME:
+    .ASCIIZ " prime\n"
+MSG_COMPOSITE:
+    .ASCIIZ " composite\n"
+
+MAIN:
+    LOADI R1, 1048576       ; N
+    LOADI R11, 1
+    LOADI R12, 4
+
+    ; sieve[i] != 0 — i составное (память за BSS изначально нулевая).
+    ; Сравнение i < N — по знаку i - N.
+    LOADI R3, 2             ; i
+SIEVE_LOOP:
+    SUB R5, R3, R1
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, SIEVE_DONE       ; i >= N
+    MUL R4, R3, R12
+    ADD R4, R4, SIEVE
+    LOAD R5, [R4]
+    CMP R5, 0
+    IF NE, SIEVE_NEXT
+    CMP R3, 46341
+    IF GT, SIEVE_NEXT
+    IF EQ, SIEVE_NEXT
+    MUL R6, R3, R3          ; j
+    MUL R7, R3, R12         ; шаг в байтах
+    MUL R4, R6, R12
+    ADD R4, R4, SIEVE
+MARK_LOOP:
+    SUB R5, R6, R1
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, SIEVE_NEXT       ; j >= N
+    STORE R11, [R4]
+    ADD R4, R4, R7
+    ADD R6, R6, R3
+    JUMP MARK_LOOP
+SIEVE_NEXT:
+    ADD R3, R3, R11
+    JUMP SIEVE_LOOP
+SIEVE_DONE:
+    ; 0 и 1 не простые
+    LOADI R4, SIEVE
+    STORE R11, [R4]
+    ADD R4, R4, R12
+    STORE R11, [R4]
+
+    CHECKPOINT R9           ; номер клона (0 — без клонов)
+
+QUERY_LOOP:
+    INPUT R2
+    CMP R2, 0
+    IF EQ, QUERY_DONE
+    PRINTS MSG_CLONE
+    PRINT R9
+    PRINTS MSG_SEP
+    PRINT R2
+    ; Числа вне решета считаются составными
+    SUB R5, R2, R1
+    SHR R5, R5, 31
+    CMP R5, 0
+    IF EQ, QUERY_COMPOSITE
+    MUL R4, R2, R12
+    ADD R4, R4, SIEVE
+    LOAD R5, [R4]
+    CMP R5, 0
+    IF NE, QUERY_COMPOSITE
+    PRINTS MSG_PRIME
+    JUMP QUERY_LOOP
+QUERY_COMPOSITE:
+    PRINTS MSG_COMPOSITE
+    JUMP QUERY_LOOP
+QUERY_DONE:
+    HALT
+
+.SECTION BSS
+SIEVE:
+    .SPACE 4
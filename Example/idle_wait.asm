@@ -0,0 +1,94 @@
+; =============================================================================
+; Ожидание ввода без опроса: EVENT_WAIT с тайм-аутом и CLOCK_NS
+; =============================================================================
+; Запуск:
+;   (sleep 1; echo hello; sleep 1; echo world) | AirVM idle_wait.bin
+;
+; Программа читает stdin построчно по мере поступления строк. Пока данных
+; нет, она спит в EVENT_WAIT (ppoll хоста) и раз в 200 мс печатает точку, не
+; тратя процессор на холостой цикл. В конце ввода печатает число строк,
+; число пустых тайм-аутов и время работы в миллисекундах.
+;
+; Готовность stdin означает, что данные уже пришли. READ с дескриптором 0
+; ждёт все запрошенные байты, поэтому строки читаются READLINE: он
+; возвращается, как только получен конец строки.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_TICK:
+    .ASCIIZ "."
+MSG_LINES:
+    .ASCIIZ "\nLines: "
+MSG_TICKS:
+    .ASCIIZ ", idle ticks: "
+MSG_MS:
+    .ASCIIZ ", elapsed ms: "
+MSG_NL:
+    .ASCIIZ "\n"
+HANDLES:
+    .WORD 0                 ; ждём только stdin
+
+MAIN:
+    CLOCK_NS R20            ; начало: R20 — младшее слово, R21 — старшее
+    LOADI R8, 0             ; прочитано строк
+    LOADI R9, 0             ; пустых тайм-аутов
+    LOADI R1, HANDLES
+    LOADI R2, 1
+    LOADI R3, 200000        ; тайм-аут, мкс
+    LOADI R5, BUF
+    LOADI R6, 4096
+
+WAIT:
+    EVENT_WAIT R0, R1, R2, R3
+    IF NE, IDLE
+    READLINE R5, R6, R7
+    CMP R7, -1
+    IF EQ, DONE             ; конец ввода
+    ADD R8, R8, 1
+    JUMP WAIT
+IDLE:
+    ADD R9, R9, 1
+    PRINTS MSG_TICK
+    JUMP WAIT
+
+DONE:
+    CLOCK_NS R22            ; конец: R22 — младшее слово, R23 — старшее
+    ; 64-битная разность D = (R23:R22) - (R21:R20): младшее слово в R24,
+    ; старшее в R25; заём из младшего слова — старший бит выражения
+    ; (~a & b) | (~(a ^ b) & (a - b)) при a = R22, b = R20
+    SUB R24, R22, R20
+    NOT R26, R22
+    AND R26, R26, R20
+    XOR R27, R22, R20
+    NOT R27, R27
+    AND R27, R27, R24
+    OR R26, R26, R27
+    SHR R26, R26, 31
+    SUB R25, R23, R21
+    SUB R25, R25, R26
+    ; D / 10^6 при 2^32 = 4294 * 10^6 + 967296:
+    ; мс = hi * 4294 + (hi * 967296 + lo mod 10^6) / 10^6 + lo / 10^6
+    ; (без переполнения для запусков короче пяти часов)
+    LOADI R10, 1000000
+    DIV R11, R24, R10       ; lo / 10^6
+    MUL R12, R11, R10
+    SUB R12, R24, R12       ; lo mod 10^6
+    MUL R13, R25, 967296
+    ADD R13, R13, R12
+    DIV R13, R13, R10
+    MUL R14, R25, 4294
+    ADD R14, R14, R13
+    ADD R14, R14, R11
+    PRINTS MSG_LINES
+    PRINT R8
+    PRINTS MSG_TICKS
+    PRINT R9
+    PRINTS MSG_MS
+    PRINT R14
+    PRINTS MSG_NL
+    HALT
+
+.SECTION BSS
+BUF:
+    .SPACE 4096
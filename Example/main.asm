@@ -266,17 +266,19 @@ SKIP_BLOCK:
 ; =============================================================================
 ; Подпрограмма: Факториал (рекурсивно)
 ; Вычисляет факториал числа, находящегося в R17, результат возвращается в R1.
-; Используются стековые операции для сохранения промежуточных значений.
+; Промежуточное значение хранится в локальной переменной кадра (ENTER/LEAVE).
 ; =============================================================================
 FACTORIAL:
     CMP R17, 1
     IF EQ, FACT_RET
-    PUSH R17
+    ENTER 1
+    STOREL R17, 0
     LOADI R2, 1
     SUB R17, R17, R2
     CALL FACTORIAL
-    POP R17
+    LOADL R17, 0
     MUL R1, R17, R1
+    LEAVE
     RET
 FACT_RET:
     LOADI R1, 1
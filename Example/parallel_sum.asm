@@ -0,0 +1,172 @@
+; =============================================================================
+; Параллельная сумма массива (потоки гостя)
+; =============================================================================
+; Ввод: число потоков T и число элементов N, например:
+;   echo "8 50000000" | AirVM parallel_sum.bin
+;
+; Каждый поток заполняет свою часть массива значениями a[i] = (i * 0x9E3779B1) >> 8,
+; затем ждёт остальных на барьере (XADD + FUTEX_WAIT/FUTEX_WAKE) и суммирует
+; часть соседнего потока, добавляя результат к общей сумме через XADD.
+; Выводится сумма по модулю 2^32; она не зависит от T.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_SUM:
+    .ASCIIZ "Sum: "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    INPUT R1                ; T
+    INPUT R2                ; N
+    CMP R1, 0
+    IF EQ, BAD_INPUT
+    CMP R1, 64
+    IF GT, BAD_INPUT
+    STORE R1, [PARAM_T]
+    STORE R2, [PARAM_N]
+
+    ; Запуск T потоков, идентификаторы — в массиве IDS
+    LOADI R3, 0             ; k
+    LOADI R4, IDS
+START_LOOP:
+    SUB R5, R1, R3
+    CMP R5, 0
+    IF EQ, JOIN_START
+    THREAD_START R6, WORKER, R3
+    STORE R6, [R4]
+    ADD R3, R3, 1
+    ADD R4, R4, 4
+    JUMP START_LOOP
+
+JOIN_START:
+    LOADI R3, 0
+    LOADI R4, IDS
+JOIN_LOOP:
+    SUB R5, R1, R3
+    CMP R5, 0
+    IF EQ, REPORT
+    LOAD R6, [R4]
+    THREAD_JOIN R7, R6
+    ADD R3, R3, 1
+    ADD R4, R4, 4
+    JUMP JOIN_LOOP
+
+REPORT:
+    LOAD R8, [TOTAL]
+    PRINTS MSG_SUM
+    PRINT R8
+    PRINTS MSG_NL
+    HALT
+
+BAD_INPUT:
+    HALT
+
+; -----------------------------------------------------------------------------
+; Поток: R0 = номер k. Границы части k: [k*N/T, (k+1)*N/T), последняя часть
+; доходит до N.
+; -----------------------------------------------------------------------------
+WORKER:
+    LOAD R20, [PARAM_T]
+    LOAD R21, [PARAM_N]
+    LOADI R11, 1
+    LOADI R12, 4
+    MOVE R9, R0
+    CALL BOUNDS             ; R1 = начало, R4 = длина части R9
+
+    ; Заполнение своей части
+    LOADI R10, -1640531535  ; 0x9E3779B1
+    MOVE R3, R1
+    MUL R3, R3, R12
+    ADD R3, R3, ARRAY
+FILL_LOOP:
+    CMP R4, 0
+    IF EQ, BARRIER
+    MUL R5, R1, R10
+    SHR R5, R5, 8
+    STORE R5, [R3]
+    ADD R1, R1, R11
+    ADD R3, R3, R12
+    SUB R4, R4, R11
+    JUMP FILL_LOOP
+
+    ; Барьер: последний пришедший поток открывает фазу и будит остальных
+BARRIER:
+    MOVE R5, R11
+    XADD R5, [ARRIVED]
+    ADD R5, R5, R11
+    SUB R5, R20, R5
+    CMP R5, 0
+    IF NE, BARRIER_WAIT
+    MOVE R5, R11
+    XCHG R5, [PHASE]
+    LOADI R5, 1000000
+    FUTEX_WAKE [PHASE], R5
+    JUMP SUM_PART
+BARRIER_WAIT:
+    LOADI R6, 0
+BARRIER_SPIN:
+    LOADI R5, 0
+    XADD R5, [PHASE]        ; атомарное чтение фазы
+    CMP R5, 0
+    IF NE, SUM_PART
+    FUTEX_WAIT [PHASE], R6
+    JUMP BARRIER_SPIN
+
+    ; Сумма части соседнего потока (k + 1) mod T
+SUM_PART:
+    FENCE_ACQ
+    ADD R9, R0, R11
+    SUB R5, R20, R9
+    CMP R5, 0
+    IF NE, SUM_BOUNDS
+    LOADI R9, 0
+SUM_BOUNDS:
+    CALL BOUNDS
+    MUL R3, R1, R12
+    ADD R3, R3, ARRAY
+    LOADI R7, 0
+SUM_LOOP:
+    CMP R4, 0
+    IF EQ, SUM_DONE
+    LOAD R5, [R3]
+    ADD R7, R7, R5
+    ADD R3, R3, R12
+    SUB R4, R4, R11
+    JUMP SUM_LOOP
+SUM_DONE:
+    MOVE R5, R7
+    XADD R5, [TOTAL]
+    MOVE R0, R7
+    HALT
+
+; Границы части R9: R1 = R9*N/T, R4 = длина (R20 = T, R21 = N)
+BOUNDS:
+    DIV R13, R21, R20       ; размер части
+    MUL R1, R9, R13
+    ADD R5, R9, R11
+    SUB R5, R20, R5
+    CMP R5, 0
+    IF EQ, BOUNDS_LAST
+    MOVE R4, R13
+    RET
+BOUNDS_LAST:
+    SUB R4, R21, R1
+    RET
+
+.SECTION BSS
+PARAM_T:
+    .SPACE 4
+PARAM_N:
+    .SPACE 4
+TOTAL:
+    .SPACE 4
+ARRIVED:
+    .SPACE 4
+PHASE:
+    .SPACE 4
+IDS:
+    .SPACE 256
+ARRAY:
+    .SPACE 4
@@ -0,0 +1,137 @@
+; =============================================================================
+; Параллельный подсчёт слов (потоки гостя)
+; =============================================================================
+; Ввод: число потоков T, затем текст, например:
+;   (echo 8; cat big.txt) | AirVM parallel_wc.bin
+;
+; Главный поток читает весь stdin в память, делит его на T частей и запускает
+; по потоку на часть. Словом считается последовательность байт больше 0x20;
+; поток считает начала слов в своей части, глядя на байт перед её началом,
+; поэтому границы частей не влияют на результат. Итог — сумма результатов
+; THREAD_JOIN.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_WORDS:
+    .ASCIIZ "Words: "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    INPUT R1                ; T
+    CMP R1, 0
+    IF EQ, DONE
+    CMP R1, 64
+    IF GT, DONE
+    STORE R1, [PARAM_T]
+
+    ; Чтение stdin блоками по 1 МБ
+    LOADI R2, 0             ; дескриптор stdin
+    LOADI R3, TEXT          ; куда читать
+    LOADI R4, 1048576
+READ_LOOP:
+    READ R2, R3, R4, R5
+    CMP R5, 0
+    IF EQ, READ_DONE
+    ADD R3, R3, R5
+    JUMP READ_LOOP
+READ_DONE:
+    SUB R3, R3, TEXT
+    STORE R3, [PARAM_LEN]
+
+    LOADI R3, 0             ; k
+    LOADI R4, IDS
+START_LOOP:
+    SUB R5, R1, R3
+    CMP R5, 0
+    IF EQ, JOIN_START
+    THREAD_START R6, WORKER, R3
+    STORE R6, [R4]
+    ADD R3, R3, 1
+    ADD R4, R4, 4
+    JUMP START_LOOP
+
+JOIN_START:
+    LOADI R3, 0
+    LOADI R4, IDS
+    LOADI R8, 0             ; сумма
+JOIN_LOOP:
+    SUB R5, R1, R3
+    CMP R5, 0
+    IF EQ, REPORT
+    LOAD R6, [R4]
+    THREAD_JOIN R7, R6
+    ADD R8, R8, R7
+    ADD R3, R3, 1
+    ADD R4, R4, 4
+    JUMP JOIN_LOOP
+
+REPORT:
+    PRINTS MSG_WORDS
+    PRINT R8
+    PRINTS MSG_NL
+DONE:
+    HALT
+
+; -----------------------------------------------------------------------------
+; Поток: R0 = номер k, результат — число слов, начинающихся в части k
+; -----------------------------------------------------------------------------
+WORKER:
+    LOAD R20, [PARAM_T]
+    LOAD R21, [PARAM_LEN]
+    LOADI R11, 1
+    LOADI R12, 255
+    DIV R13, R21, R20       ; размер части
+    MUL R1, R0, R13         ; начало
+    MOVE R4, R13            ; длина
+    ADD R5, R0, R11
+    SUB R5, R20, R5
+    CMP R5, 0
+    IF NE, PREV_BYTE
+    SUB R4, R21, R1         ; последняя часть — до конца текста
+PREV_BYTE:
+    ADD R3, R1, TEXT        ; адрес текущего байта
+    LOADI R7, 0             ; внутри слова?
+    CMP R1, 0
+    IF EQ, COUNT_START
+    SUB R5, R3, R11
+    LOAD R5, [R5]
+    AND R5, R5, R12
+    CMP R5, 32
+    IF LT, COUNT_START
+    IF EQ, COUNT_START
+    LOADI R7, 1
+COUNT_START:
+    LOADI R8, 0             ; счётчик слов
+COUNT_LOOP:
+    CMP R4, 0
+    IF EQ, COUNT_DONE
+    LOAD R5, [R3]
+    AND R5, R5, R12
+    CMP R5, 32
+    IF GT, IN_WORD
+    LOADI R7, 0
+    JUMP NEXT_BYTE
+IN_WORD:
+    CMP R7, 0
+    IF NE, NEXT_BYTE
+    LOADI R7, 1
+    ADD R8, R8, R11
+NEXT_BYTE:
+    ADD R3, R3, R11
+    SUB R4, R4, R11
+    JUMP COUNT_LOOP
+COUNT_DONE:
+    MOVE R0, R8
+    HALT
+
+.SECTION BSS
+PARAM_T:
+    .SPACE 4
+PARAM_LEN:
+    .SPACE 4
+IDS:
+    .SPACE 256
+TEXT:
+    .SPACE 4
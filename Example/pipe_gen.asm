@@ -0,0 +1,37 @@
+; =============================================================================
+; Конвейер, стадия 1: генератор пар чисел (см. pipeline.conf)
+; =============================================================================
+; Читает N и отправляет в канал "nums" N сообщений по 8 байт: {i, 3 * i}
+; для i = 1..N. Завершение стадии закрывает канал.
+; =============================================================================
+
+JUMP MAIN
+
+NAME_NUMS:
+    .ASCIIZ "nums"
+
+MAIN:
+    LOADI R1, NAME_NUMS
+    CHAN_OPEN R10, R1
+    INPUT R2                ; оставшиеся сообщения
+    LOADI R11, MSG
+    LOADI R12, 8
+    LOADI R13, MSG
+    ADD R13, R13, 4
+    LOADI R3, 0             ; i
+NEXT:
+    CMP R2, 0
+    IF EQ, DONE
+    SUB R2, R2, 1
+    ADD R3, R3, 1
+    MUL R4, R3, 3
+    STORE R3, [R11]
+    STORE R4, [R13]
+    CHAN_SEND R10, R11, R12
+    JUMP NEXT
+DONE:
+    HALT
+
+.SECTION BSS
+MSG:
+    .SPACE 8
@@ -0,0 +1,44 @@
+; =============================================================================
+; Конвейер, стадия 2: преобразование (см. pipeline.conf)
+; =============================================================================
+; Для каждого сообщения {a, b} из канала "nums" отправляет в канал
+; "squares" слово a * a + b. Когда "nums" закрыт и пуст, стадия
+; завершается и закрывает "squares".
+; =============================================================================
+
+JUMP MAIN
+
+NAME_NUMS:
+    .ASCIIZ "nums"
+NAME_SQUARES:
+    .ASCIIZ "squares"
+
+MAIN:
+    LOADI R1, NAME_NUMS
+    CHAN_OPEN R10, R1
+    LOADI R1, NAME_SQUARES
+    CHAN_OPEN R20, R1
+    LOADI R11, MSG
+    LOADI R12, 64           ; размер буфера приёма
+    LOADI R14, MSG
+    ADD R14, R14, 4
+    LOADI R21, RESULT
+    LOADI R22, 4
+NEXT:
+    CHAN_RECV R10, R11, R12, R13
+    IF NE, DONE             ; канал закрыт
+    LOAD R1, [R11]
+    LOAD R2, [R14]
+    MUL R1, R1, R1
+    ADD R1, R1, R2
+    STORE R1, [R21]
+    CHAN_SEND R20, R21, R22
+    JUMP NEXT
+DONE:
+    HALT
+
+.SECTION BSS
+MSG:
+    .SPACE 64
+RESULT:
+    .SPACE 4
@@ -0,0 +1,43 @@
+; =============================================================================
+; Конвейер, стадия 3: итоги (см. pipeline.conf)
+; =============================================================================
+; Складывает слова из канала "squares" и после его закрытия печатает число
+; сообщений и сумму (по модулю 2^32).
+; =============================================================================
+
+JUMP MAIN
+
+NAME_SQUARES:
+    .ASCIIZ "squares"
+MSG_COUNT:
+    .ASCIIZ "Count: "
+MSG_SUM:
+    .ASCIIZ ", sum: "
+MSG_NL:
+    .ASCIIZ "\n"
+
+MAIN:
+    LOADI R1, NAME_SQUARES
+    CHAN_OPEN R10, R1
+    LOADI R11, VALUE
+    LOADI R12, 4
+    LOADI R2, 0             ; число сообщений
+    LOADI R3, 0             ; сумма
+NEXT:
+    CHAN_RECV R10, R11, R12, R13
+    IF NE, DONE
+    LOAD R1, [R11]
+    ADD R2, R2, 1
+    ADD R3, R3, R1
+    JUMP NEXT
+DONE:
+    PRINTS MSG_COUNT
+    PRINT R2
+    PRINTS MSG_SUM
+    PRINT R3
+    PRINTS MSG_NL
+    HALT
+
+.SECTION BSS
+VALUE:
+    .SPACE 4
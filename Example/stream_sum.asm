@@ -0,0 +1,88 @@
+; =============================================================================
+; Потоковый режим: программа на каждую строку входа (как awk)
+; =============================================================================
+; Запуск:
+;   AirVM --stream stream_sum.bin < data.txt
+;   AirVM --stream --stream-jobs 4 stream_sum.bin < data.txt
+;
+; Каждая строка — "<имя> <число>". Программа печатает строки с числом не
+; меньше 1000 и копит сумму чисел в памяти, которая сохраняется между
+; строками; после конца входа (R0 = 0) печатает число строк и сумму —
+; то же, что awk '$2 >= 1000 { print } { s += $2 } END { print NR, s }'.
+; С --stream-jobs итоги печатает каждая VM для своего участка входа.
+;
+; При входе: R0 — адрес строки (с завершающим нулём), R1 — длина,
+; R2 — номер строки, R3 — номер VM.
+; =============================================================================
+
+JUMP MAIN
+
+MSG_NL:
+    .ASCIIZ "\n"
+MSG_RECORDS:
+    .ASCIIZ "Records: "
+MSG_TOTAL:
+    .ASCIIZ ", total: "
+
+MAIN:
+    CMP R0, 0
+    IF EQ, FINISH
+    LOADI R11, 1
+    MOVE R4, R0             ; текущий байт
+    ADD R5, R0, R1          ; конец строки
+    LOADI R9, 0             ; значение второго поля
+SKIP_NAME:
+    SUB R6, R5, R4
+    CMP R6, 0
+    IF EQ, GOT_VALUE        ; поля нет
+    LOAD R7, [R4]
+    AND R7, R7, 255
+    ADD R4, R4, R11
+    CMP R7, 32
+    IF NE, SKIP_NAME
+DIGITS:
+    SUB R6, R5, R4
+    CMP R6, 0
+    IF EQ, GOT_VALUE
+    LOAD R7, [R4]
+    AND R7, R7, 255
+    SUB R8, R7, 48
+    SHR R8, R8, 31          ; байт < '0'
+    LOADI R10, 57
+    SUB R10, R10, R7
+    SHR R10, R10, 31        ; байт > '9'
+    OR R8, R8, R10
+    CMP R8, 0
+    IF NE, GOT_VALUE
+    SUB R7, R7, 48
+    MUL R9, R9, 10
+    ADD R9, R9, R7
+    ADD R4, R4, R11
+    JUMP DIGITS
+GOT_VALUE:
+    LOAD R12, TOTAL
+    ADD R12, R12, R9
+    STORE R12, TOTAL
+    SUB R8, R9, 1000
+    SHR R8, R8, 31
+    CMP R8, 0
+    IF NE, DONE             ; значение < 1000
+    LOADI R13, 1            ; stdout
+    WRITE R13, R0, R1, R14
+    PRINTS MSG_NL
+DONE:
+    HALT
+
+; Итоги: R2 — число строк
+FINISH:
+    PRINTS MSG_RECORDS
+    PRINT R2
+    PRINTS MSG_TOTAL
+    LOAD R12, TOTAL
+    PRINT R12
+    PRINTS MSG_NL
+    HALT
+
+.SECTION BSS
+TOTAL:
+    .SPACE 4
@@ -6,9 +6,11 @@ import (
 	"encoding/binary"
 	"errors"
 	"fmt"
+	"io"
 	"os"
 	"path/filepath"
 	"regexp"
+	"sort"
 	"strconv"
 	"strings"
 )
@@ -20,42 +22,110 @@ type Opcode struct {
 }
 
 var OPCODES = map[string]Opcode{
-	"NOP":      {0x00, []string{}},
-	"HALT":     {0x01, []string{}},
-	"JUMP":     {0x02, []string{"addr"}},
-	"CALL":     {0x03, []string{"addr"}},
-	"RET":      {0x04, []string{}},
-	"IF":       {0x05, []string{"flags", "addr"}},
-	"LOAD":     {0x10, []string{"reg", "addr"}},
-	"STORE":    {0x11, []string{"reg", "addr"}},
-	"MOVE":     {0x12, []string{"reg", "reg"}},
-	"PUSH":     {0x13, []string{"reg"}},
-	"POP":      {0x14, []string{"reg"}},
-	"LOADI":    {0x15, []string{"reg", "imm"}},
-	"ADD":      {0x20, []string{"reg", "reg", "reg"}},
-	"SUB":      {0x21, []string{"reg", "reg", "reg"}},
-	"MUL":      {0x22, []string{"reg", "reg", "reg"}},
-	"DIV":      {0x23, []string{"reg", "reg", "reg"}},
-	"AND":      {0x24, []string{"reg", "reg", "reg"}},
-	"OR":       {0x25, []string{"reg", "reg", "reg"}},
-	"XOR":      {0x26, []string{"reg", "reg", "reg"}},
-	"NOT":      {0x27, []string{"reg", "reg"}},
-	"CMP":      {0x28, []string{"reg", "imm"}},
-	"FS_LIST":  {0x34, []string{"addr"}},
-	"ENV_LIST": {0x42, []string{"addr"}},
-	"PRINT":    {0x50, []string{"reg"}},
-	"INPUT":    {0x51, []string{"reg"}},
-	"PRINTS":   {0x52, []string{"addr"}},
-	"SHL":      {0x30, []string{"reg", "reg", "imm"}},
-	"SHR":      {0x31, []string{"reg", "reg", "imm"}},
-	"BREAK":    {0x32, []string{}},
-	"SNAPSHOT": {0x60, []string{}},
-	"RESTORE":  {0x61, []string{}},
-	"OPEN":     {0x70, []string{"reg", "reg", "reg"}},
-	"READ":     {0x71, []string{"reg", "reg", "reg", "reg"}},
-	"WRITE":    {0x72, []string{"reg", "reg", "reg", "reg"}},
-	"CLOSE":    {0x73, []string{"reg"}},
-	"SEEK":     {0x74, []string{"reg", "imm", "imm", "reg"}},
+	"NOP":          {0x00, []string{}},
+	"HALT":         {0x01, []string{}},
+	"JUMP":         {0x02, []string{"addr"}},
+	"CALL":         {0x03, []string{"addr"}},
+	"RET":          {0x04, []string{}},
+	"IF":           {0x05, []string{"flags", "addr"}},
+	"ENTER":        {0x06, []string{"imm"}},
+	"LEAVE":        {0x07, []string{}},
+	"SWITCH":       {0x08, []string{"reg", "imm", "imm", "addr"}},
+	"JUMPR":        {0x09, []string{"reg"}},
+	"CALLR":        {0x0A, []string{"reg"}},
+	"LOAD":         {0x10, []string{"reg", "addr"}},
+	"STORE":        {0x11, []string{"reg", "addr"}},
+	"MOVE":         {0x12, []string{"reg", "reg"}},
+	"PUSH":         {0x13, []string{"reg"}},
+	"POP":          {0x14, []string{"reg"}},
+	"LOADI":        {0x15, []string{"reg", "imm"}},
+	"LOADL":        {0x16, []string{"reg", "imm"}},
+	"STOREL":       {0x17, []string{"reg", "imm"}},
+	"PUSHM":        {0x18, []string{"imm"}},
+	"POPM":         {0x19, []string{"imm"}},
+	"ADD":          {0x20, []string{"reg", "reg", "reg"}},
+	"SUB":          {0x21, []string{"reg", "reg", "reg"}},
+	"MUL":          {0x22, []string{"reg", "reg", "reg"}},
+	"DIV":          {0x23, []string{"reg", "reg", "reg"}},
+	"AND":          {0x24, []string{"reg", "reg", "reg"}},
+	"OR":           {0x25, []string{"reg", "reg", "reg"}},
+	"XOR":          {0x26, []string{"reg", "reg", "reg"}},
+	"NOT":          {0x27, []string{"reg", "reg"}},
+	"CMP":          {0x28, []string{"reg", "imm"}},
+	"FS_LIST":      {0x34, []string{"addr"}},
+	"ENV_LIST":     {0x42, []string{"addr"}},
+	"DIR_OPEN":     {0x35, []string{"reg", "reg"}},
+	"DIR_NEXT":     {0x36, []string{"reg", "reg", "reg"}},
+	"DIR_CLOSE":    {0x37, []string{"reg"}},
+	"PRINT":        {0x50, []string{"reg"}},
+	"INPUT":        {0x51, []string{"reg"}},
+	"PRINTS":       {0x52, []string{"addr"}},
+	"READINTS":     {0x53, []string{"reg", "reg", "reg"}},
+	"WRITEINTS":    {0x54, []string{"reg", "reg", "reg"}},
+	"READLINE":     {0x55, []string{"reg", "reg", "reg"}},
+	"SHL":          {0x30, []string{"reg", "reg", "imm"}},
+	"SHR":          {0x31, []string{"reg", "reg", "imm"}},
+	"BREAK":        {0x32, []string{}},
+	"POPCNT":       {0x29, []string{"reg", "reg"}},
+	"CLZ":          {0x2A, []string{"reg", "reg"}},
+	"CTZ":          {0x2B, []string{"reg", "reg"}},
+	"BSWAP":        {0x2C, []string{"reg", "reg"}},
+	"ROL":          {0x2D, []string{"reg", "reg", "reg"}},
+	"ROR":          {0x2E, []string{"reg", "reg", "reg"}},
+	"SAR":          {0x2F, []string{"reg", "reg", "imm"}},
+	"SHLV":         {0x38, []string{"reg", "reg", "reg"}},
+	"SHRV":         {0x39, []string{"reg", "reg", "reg"}},
+	"SARV":         {0x3A, []string{"reg", "reg", "reg"}},
+	"MULW":         {0x3B, []string{"reg", "reg", "reg"}},
+	"SNAPSHOT":     {0x60, []string{}},
+	"RESTORE":      {0x61, []string{}},
+	"CHECKPOINT":   {0x62, []string{"reg"}},
+	"OPEN":         {0x70, []string{"reg", "reg", "reg"}},
+	"READ":         {0x71, []string{"reg", "reg", "reg", "reg"}},
+	"WRITE":        {0x72, []string{"reg", "reg", "reg", "reg"}},
+	"CLOSE":        {0x73, []string{"reg"}},
+	"SEEK":         {0x74, []string{"reg", "imm", "imm", "reg"}},
+	"PREAD":        {0x75, []string{"reg", "reg", "reg", "reg", "reg"}},
+	"PWRITE":       {0x76, []string{"reg", "reg", "reg", "reg", "reg"}},
+	"FSYNC":        {0x77, []string{"reg", "reg"}},
+	"FBUF":         {0x78, []string{"reg", "reg"}},
+	"SEEK64":       {0x79, []string{"reg", "reg", "reg", "reg"}},
+	"NCALL":        {0x80, []string{"imm"}},
+	"CRC32C":       {0x90, []string{"reg", "reg", "reg"}},
+	"HASH64":       {0x91, []string{"reg", "reg", "reg"}},
+	"SORT":         {0x92, []string{"reg", "reg"}},
+	"BSEARCH":      {0x93, []string{"reg", "reg", "reg", "reg"}},
+	"COUNTEQ":      {0x94, []string{"reg", "reg", "reg", "reg"}},
+	"THREAD_START": {0xA0, []string{"reg", "addr", "reg"}},
+	"THREAD_JOIN":  {0xA1, []string{"reg", "reg"}},
+	"CAS":          {0xA2, []string{"reg", "addr", "reg"}},
+	"XADD":         {0xA3, []string{"reg", "addr"}},
+	"XCHG":         {0xA4, []string{"reg", "addr"}},
+	"FENCE_ACQ":    {0xA5, []string{}},
+	"FENCE_REL":    {0xA6, []string{}},
+	"FUTEX_WAIT":   {0xA7, []string{"addr", "reg"}},
+	"FUTEX_WAKE":   {0xA8, []string{"addr", "reg"}},
+	"ALLOC":        {0xB0, []string{"reg", "reg"}},
+	"FREE":         {0xB1, []string{"reg"}},
+	"REALLOC":      {0xB2, []string{"reg", "reg"}},
+	"ARENA_RESET":  {0xB3, []string{}},
+	"HEAP_STATS":   {0xB4, []string{"reg"}},
+	"MAP_NEW":      {0xC0, []string{"reg", "reg"}},
+	"MAP_PUT":      {0xC1, []string{"reg", "reg", "reg"}},
+	"MAP_GET":      {0xC2, []string{"reg", "reg", "reg"}},
+	"MAP_DEL":      {0xC3, []string{"reg", "reg"}},
+	"MAP_ITER":     {0xC4, []string{"reg", "reg", "reg"}},
+	"MAP_SNEW":     {0xC5, []string{"reg", "reg"}},
+	"MAP_SPUT":     {0xC6, []string{"reg", "reg", "reg", "reg"}},
+	"MAP_SGET":     {0xC7, []string{"reg", "reg", "reg", "reg"}},
+	"MAP_SDEL":     {0xC8, []string{"reg", "reg", "reg"}},
+	"MAP_FREE":     {0xC9, []string{"reg"}},
+	"SLEEP_US":     {0xD0, []string{"reg"}},
+	"CLOCK_NS":     {0xD1, []string{"reg"}},
+	"EVENT_WAIT":   {0xD2, []string{"reg", "reg", "reg", "reg"}},
+	"CHAN_OPEN":    {0xD8, []string{"reg", "reg"}},
+	"CHAN_SEND":    {0xD9, []string{"reg", "reg", "reg"}},
+	"CHAN_RECV":    {0xDA, []string{"reg", "reg", "reg", "reg"}},
 }
 
 var FLAGS = map[string]int{
@@ -66,6 +136,117 @@ var FLAGS = map[string]int{
 	"GE": 0x08, // Greater or Equal (синоним GT)
 }
 
+// regAddrOps — инструкции, адрес которых ВМ читает через read_addr_operand:
+// только они принимают операнды [Rn + imm] и [Rn + Rm*scale].
+var regAddrOps = map[string]bool{
+	"LOAD": true, "STORE": true, "CAS": true, "XADD": true, "XCHG": true,
+	"FUTEX_WAIT": true, "FUTEX_WAKE": true,
+}
+
+// Кодирование адресного операнда с регистром (см. VM/include/vm.h):
+// маркер, затем байт (режим << addrModeShift) | регистр базы.
+const (
+	addrMarker     = 0xFF
+	addrModeShift  = 5
+	addrModeReg    = 0 // [Rn]
+	addrModeOffset = 1 // [Rn + imm]: далее 4 байта смещения
+	addrModeIndex  = 2 // [Rn + Rm*scale]: далее байт (log2(scale) << 5) | Rm
+)
+
+var (
+	regPattern    = regexp.MustCompile(`^R(\d+)$`)
+	scaledPattern = regexp.MustCompile(`^R(\d+)\s*\*\s*(\d+)$`)
+)
+
+// addrOperand — адресный операнд, вычисляемый от регистра базы.
+type addrOperand struct {
+	mode   int
+	base   int
+	index  int
+	shift  int    // log2 масштаба индекса
+	offset string // смещение: число или метка
+	negate bool   // смещение вычитается ([Rn - imm])
+}
+
+// size возвращает длину операнда в байтах.
+func (a addrOperand) size() int {
+	switch a.mode {
+	case addrModeOffset:
+		return 6
+	case addrModeIndex:
+		return 3
+	}
+	return 2
+}
+
+// parseAddrOperand разбирает содержимое квадратных скобок: Rn, Rn + imm,
+// imm + Rn, Rn - imm, Rn + Rm и Rn + Rm*scale (scale — 1, 2, 4 или 8).
+// Второе значение false — в выражении нет регистров (абсолютный адрес).
+func parseAddrOperand(inner string) (addrOperand, bool, error) {
+	a := addrOperand{base: -1, index: -1}
+	var terms []string
+	var negs []bool
+	start, neg := 0, false
+	for i := 0; i <= len(inner); i++ {
+		if i < len(inner) && ((inner[i] != '+' && inner[i] != '-') || strings.TrimSpace(inner[start:i]) == "") {
+			continue
+		}
+		terms = append(terms, strings.TrimSpace(inner[start:i]))
+		negs = append(negs, neg)
+		if i < len(inner) {
+			neg = inner[i] == '-'
+			start = i + 1
+		}
+	}
+	for i, t := range terms {
+		if m := regPattern.FindStringSubmatch(t); m != nil || scaledPattern.MatchString(t) {
+			if negs[i] {
+				return a, false, fmt.Errorf("регистр в адресе нельзя вычитать: %s", inner)
+			}
+			scale := 1
+			if m == nil {
+				m = scaledPattern.FindStringSubmatch(t)
+				scale, _ = strconv.Atoi(m[2])
+			}
+			reg, _ := strconv.Atoi(m[1])
+			if reg > 31 {
+				return a, false, fmt.Errorf("неверный регистр в адресе: %s", t)
+			}
+			switch {
+			case a.base < 0 && scale == 1:
+				a.base = reg
+			case a.index >= 0:
+				return a, false, fmt.Errorf("в адресе допускается не больше двух регистров: %s", inner)
+			default:
+				shift := map[int]int{1: 0, 2: 1, 4: 2, 8: 3}
+				s, ok := shift[scale]
+				if !ok {
+					return a, false, fmt.Errorf("масштаб индекса должен быть 1, 2, 4 или 8: %s", t)
+				}
+				a.index, a.shift = reg, s
+			}
+		} else {
+			if a.offset != "" {
+				return a, false, fmt.Errorf("в адресе допускается одно смещение: %s", inner)
+			}
+			a.offset, a.negate = t, negs[i]
+		}
+	}
+	switch {
+	case a.base < 0 && a.index < 0:
+		return a, false, nil
+	case a.base < 0:
+		return a, false, fmt.Errorf("масштабированному индексу нужен регистр базы: %s", inner)
+	case a.index >= 0 && a.offset != "":
+		return a, false, fmt.Errorf("смещение вместе с индексом не поддерживается: %s", inner)
+	case a.index >= 0:
+		a.mode = addrModeIndex
+	case a.offset != "":
+		a.mode = addrModeOffset
+	}
+	return a, true, nil
+}
+
 func argSize(argType string) (int, error) {
 	switch argType {
 	case "reg", "flags":
@@ -108,20 +289,143 @@ func splitLabel(line string) (string, string) {
 	return "", line
 }
 
+// Секции выходного контейнера (см. VM/include/airbin.h).
+const (
+	sectCode   = 1
+	sectRodata = 2
+	sectBss    = 3
+	sectSymtab = 4
+	sectLines  = 5
+	sectJumps  = 6
+)
+
+// Виды символов в таблице символов.
+const (
+	symCode = 0 // метка инструкции
+	symData = 1 // метка данных
+)
+
+const (
+	airbVersion    = 1
+	airbHeaderSize = 32
+	airbEntrySize  = 16
+	pageAlign      = 4096    // выравнивание больших секций
+	bigSection     = 1 << 16 // секции от этого размера выравниваются по странице
+)
+
+type lineEntry struct {
+	addr uint32
+	line uint32
+}
+
+// jumpTable — таблица переходов (.JUMPTABLE): её элементы ВМ проверяет при
+// загрузке как цели SWITCH, JUMPR и CALLR.
+type jumpTable struct {
+	section string
+	addr    int // смещение внутри секции
+	count   int
+}
+
 type AsmCompiler struct {
-	symbols map[string]int
-	code    []byte
-	ip      int
+	symbols  map[string]int
+	code     []byte
+	ip       int
+	section  string          // текущая секция: CODE, RODATA или BSS
+	rodata   []byte          // содержимое секции RODATA
+	bssSize  int             // размер секции BSS
+	entry    string          // метка точки входа (.ENTRY)
+	symKinds map[string]byte // вид каждого символа (symCode/symData)
+	lines    []lineEntry     // адреса инструкций и строки исходника
+	natives  map[string]int  // функции хоста для NCALL: имя -> идентификатор
+	jumps    []jumpTable     // таблицы переходов
 }
 
 func NewAsmCompiler() *AsmCompiler {
 	return &AsmCompiler{
-		symbols: make(map[string]int),
-		code:    []byte{},
-		ip:      0,
+		symbols:  make(map[string]int),
+		code:     []byte{},
+		ip:       0,
+		section:  "CODE",
+		symKinds: make(map[string]byte),
+		natives:  make(map[string]int),
 	}
 }
 
+// loadNatives читает манифест функций хоста (строки "<id> <имя>",
+// комментарии начинаются с '#'); его выводит `AirVM --list-natives`.
+func (ac *AsmCompiler) loadNatives(path string) error {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return err
+	}
+	for i, line := range strings.Split(string(data), "\n") {
+		if idx := strings.Index(line, "#"); idx != -1 {
+			line = line[:idx]
+		}
+		fields := strings.Fields(line)
+		if len(fields) == 0 {
+			continue
+		}
+		if len(fields) != 2 {
+			return fmt.Errorf("манифест %s, строка %d: ожидалось \"<id> <имя>\"", path, i+1)
+		}
+		id, err := strconv.ParseUint(fields[0], 0, 32)
+		if err != nil {
+			return fmt.Errorf("манифест %s, строка %d: неверный идентификатор %s", path, i+1, fields[0])
+		}
+		ac.natives[fields[1]] = int(id)
+	}
+	return nil
+}
+
+// emit дописывает байты в текущую секцию.
+func (ac *AsmCompiler) emit(data ...byte) {
+	if ac.section == "RODATA" {
+		ac.rodata = append(ac.rodata, data...)
+	} else {
+		ac.code = append(ac.code, data...)
+	}
+	ac.ip += len(data)
+}
+
+// sectionDirective распознаёт служебные директивы .SECTION и .ENTRY,
+// которые не занимают места в выходном файле.
+func (ac *AsmCompiler) sectionDirective(instr string, lineNumber int) (bool, error) {
+	tokens := strings.Fields(instr)
+	switch strings.ToUpper(tokens[0]) {
+	case ".SECTION":
+		if len(tokens) != 2 {
+			return true, fmt.Errorf("ожидалось имя секции (Строка %d)", lineNumber)
+		}
+		name := strings.ToUpper(tokens[1])
+		if name != "CODE" && name != "RODATA" && name != "BSS" {
+			return true, fmt.Errorf("неизвестная секция: %s (Строка %d)", tokens[1], lineNumber)
+		}
+		ac.section = name
+		return true, nil
+	case ".ENTRY":
+		if len(tokens) != 2 {
+			return true, fmt.Errorf("ожидалась метка точки входа (Строка %d)", lineNumber)
+		}
+		ac.entry = tokens[1]
+		return true, nil
+	}
+	return false, nil
+}
+
+func alignUp(v, align int) int {
+	return (v + align - 1) / align * align
+}
+
+// sectionAlign возвращает выравнивание секции: большие секции выравниваются
+// по странице, чтобы ВМ могла отобразить их в память без копирования.
+func sectionAlign(size int) int {
+	if size >= bigSection {
+		return pageAlign
+	}
+	return 16
+}
+
 // parseValue преобразует строковое представление аргумента в число.
 func (ac *AsmCompiler) parseValue(arg string) (int, error) {
 	arg = strings.TrimSpace(arg)
@@ -260,8 +564,24 @@ func (ac *AsmCompiler) expandLine(line string, lineNumber int) ([]string, error)
 		return append(extra, newLine), nil
 	}
 
-	// 3. Для READ и WRITE: все операнды должны быть регистрами.
-	if mnemonic == "READ" || mnemonic == "WRITE" {
+	// 2a. SHL, SHR и SAR со сдвигом на регистр записываются как SHLV, SHRV и SARV.
+	if mnemonic == "SHL" || mnemonic == "SHR" || mnemonic == "SAR" {
+		operands := strings.Split(args, ",")
+		if len(operands) == 3 && regexp.MustCompile(`^R\d+$`).MatchString(strings.TrimSpace(operands[2])) {
+			newLine := mnemonic + "V " + args
+			if label != "" {
+				newLine = label + ": " + newLine
+			}
+			return []string{newLine}, nil
+		}
+	}
+
+	// 3. Для READ, WRITE, пакетного ввода-вывода, кучи и циклических сдвигов:
+	// все операнды должны быть регистрами.
+	if mnemonic == "READ" || mnemonic == "WRITE" || mnemonic == "READINTS" ||
+		mnemonic == "WRITEINTS" || mnemonic == "READLINE" ||
+		mnemonic == "ALLOC" || mnemonic == "REALLOC" ||
+		mnemonic == "ROL" || mnemonic == "ROR" || mnemonic == "MULW" {
 		operands := []string{}
 		for _, op := range strings.Split(args, ",") {
 			operands = append(operands, strings.TrimSpace(op))
@@ -293,6 +613,35 @@ func (ac *AsmCompiler) expandLine(line string, lineNumber int) ([]string, error)
 		return append(extra, newLine), nil
 	}
 
+	// 3a. PUSHM/POPM: список регистров (R1, R4-R7) заменяем битовой маской.
+	if mnemonic == "PUSHM" || mnemonic == "POPM" {
+		mask, err := parseRegList(args)
+		if err != nil {
+			return nil, fmt.Errorf("%v (Строка %d)", err, lineNumber)
+		}
+		newLine := fmt.Sprintf("%s %d", mnemonic, int32(mask))
+		if label != "" {
+			newLine = label + ": " + newLine
+		}
+		return []string{newLine}, nil
+	}
+
+	// 3b. NCALL имя: имя функции хоста заменяется идентификатором из манифеста.
+	if mnemonic == "NCALL" {
+		name := strings.TrimSpace(args)
+		if _, err := strconv.ParseUint(name, 0, 32); err != nil {
+			id, ok := ac.natives[name]
+			if !ok {
+				return nil, fmt.Errorf("неизвестная функция хоста: %s (Строка %d)", name, lineNumber)
+			}
+			newLine := fmt.Sprintf("NCALL %d", id)
+			if label != "" {
+				newLine = label + ": " + newLine
+			}
+			return []string{newLine}, nil
+		}
+	}
+
 	// 4. Если STORE записана как STORE [addr], reg – меняем порядок аргументов.
 	if mnemonic == "STORE" {
 		argList := []string{}
@@ -304,7 +653,9 @@ func (ac *AsmCompiler) expandLine(line string, lineNumber int) ([]string, error)
 		}
 	}
 
-	// 5. Обработка адресных операндов вида [imm + Rn].
+	// 5. Обработка адресных операндов вида [imm + Rn]. Инструкции из regAddrOps
+	// кодируют такой адрес сами (см. parseAddrOperand); для остальных он
+	// вычисляется в R30.
 	if _, ok := OPCODES[mnemonic]; ok {
 		_, argTypes := OPCODES[mnemonic].code, OPCODES[mnemonic].types
 		actualArgs := []string{}
@@ -319,7 +670,7 @@ func (ac *AsmCompiler) expandLine(line string, lineNumber int) ([]string, error)
 			if i < len(argTypes) && (argTypes[i] == "addr" || argTypes[i] == "imm") {
 				if strings.HasPrefix(arg, "[") && strings.HasSuffix(arg, "]") {
 					inner := strings.TrimSpace(arg[1 : len(arg)-1])
-					if matched, _ := regexp.MatchString(`^R\d+$`, inner); matched {
+					if matched, _ := regexp.MatchString(`^R\d+$`, inner); matched || regAddrOps[mnemonic] {
 						newArgs = append(newArgs, arg)
 					} else if strings.Contains(inner, "+") {
 						parts := strings.Split(inner, "+")
@@ -357,6 +708,49 @@ func (ac *AsmCompiler) expandLine(line string, lineNumber int) ([]string, error)
 	return []string{line}, nil
 }
 
+// parseRegList разбирает список регистров вида "R1, R4-R7" в битовую маску.
+func parseRegList(args string) (uint32, error) {
+	var mask uint32
+	regRe := regexp.MustCompile(`^R(\d+)$`)
+	parseReg := func(r string) (int, error) {
+		m := regRe.FindStringSubmatch(strings.TrimSpace(r))
+		if m == nil {
+			return 0, fmt.Errorf("ожидался регистр в списке, получено: %s", r)
+		}
+		n, _ := strconv.Atoi(m[1])
+		if n >= 32 {
+			return 0, fmt.Errorf("регистр должен быть в диапазоне 0-31: %s", r)
+		}
+		return n, nil
+	}
+	for _, item := range strings.Split(args, ",") {
+		bounds := strings.Split(item, "-")
+		if len(bounds) > 2 {
+			return 0, fmt.Errorf("неверный диапазон регистров: %s", item)
+		}
+		lo, err := parseReg(bounds[0])
+		if err != nil {
+			return 0, err
+		}
+		hi := lo
+		if len(bounds) == 2 {
+			if hi, err = parseReg(bounds[1]); err != nil {
+				return 0, err
+			}
+		}
+		if hi < lo {
+			return 0, fmt.Errorf("неверный диапазон регистров: %s", item)
+		}
+		for r := lo; r <= hi; r++ {
+			mask |= 1 << uint(r)
+		}
+	}
+	if mask == 0 {
+		return 0, errors.New("пустой список регистров")
+	}
+	return mask, nil
+}
+
 // calculateLineLength вычисляет длину строки в байтах для записи в байт-код.
 func (ac *AsmCompiler) calculateLineLength(line string, lineNumber int) (int, error) {
 	_, instr := ac.preprocessLine(line) // заменили label на _
@@ -367,6 +761,9 @@ func (ac *AsmCompiler) calculateLineLength(line string, lineNumber int) (int, er
 	if strings.HasPrefix(instr, ".") {
 		tokens := strings.Fields(instr)
 		directive := strings.ToUpper(tokens[0])
+		if ac.section == "BSS" && directive != ".SPACE" {
+			return 0, fmt.Errorf("в секции BSS допустима только директива .SPACE (Строка %d)", lineNumber)
+		}
 		switch directive {
 		case ".ASCIIZ":
 			if len(tokens) < 2 {
@@ -392,6 +789,14 @@ func (ac *AsmCompiler) calculateLineLength(line string, lineNumber int) (int, er
 			return 1, nil
 		case ".WORD":
 			return 4, nil
+		case ".JUMPTABLE":
+			if ac.section != "CODE" && ac.section != "RODATA" {
+				return 0, fmt.Errorf(".JUMPTABLE допустима только в секциях CODE и RODATA (Строка %d)", lineNumber)
+			}
+			if len(tokens) < 2 {
+				return 0, fmt.Errorf("отсутствуют метки для .JUMPTABLE (Строка %d)", lineNumber)
+			}
+			return 4 * len(strings.Split(instr[len(tokens[0]):], ",")), nil
 		default:
 			return 0, fmt.Errorf("неизвестная директива: %s", directive)
 		}
@@ -407,6 +812,9 @@ func (ac *AsmCompiler) calculateLineLength(line string, lineNumber int) (int, er
 	if !ok {
 		return 0, fmt.Errorf("неизвестная инструкция: %s", mnemonic)
 	}
+	if ac.section != "CODE" {
+		return 0, fmt.Errorf("инструкции допустимы только в секции CODE (Строка %d)", lineNumber)
+	}
 	length := 1 // опкод занимает 1 байт
 	actualArgs := []string{}
 	if args != "" {
@@ -421,9 +829,12 @@ func (ac *AsmCompiler) calculateLineLength(line string, lineNumber int) (int, er
 			if i < len(actualArgs) {
 				arg := actualArgs[i]
 				if strings.HasPrefix(arg, "[") && strings.HasSuffix(arg, "]") {
-					inner := strings.TrimSpace(arg[1 : len(arg)-1])
-					if matched, _ := regexp.MatchString(`^R\d+$`, inner); matched {
-						length += 2
+					a, ok, err := ac.regAddr(mnemonic, arg, lineNumber)
+					if err != nil {
+						return 0, err
+					}
+					if ok {
+						length += a.size()
 					} else {
 						length += 4
 					}
@@ -440,6 +851,19 @@ func (ac *AsmCompiler) calculateLineLength(line string, lineNumber int) (int, er
 	return length, nil
 }
 
+// regAddr разбирает адресный операнд в скобках; false — абсолютный адрес.
+// Режимы со смещением и индексом допустимы только для regAddrOps.
+func (ac *AsmCompiler) regAddr(mnemonic, arg string, lineNumber int) (addrOperand, bool, error) {
+	a, ok, err := parseAddrOperand(strings.TrimSpace(arg[1 : len(arg)-1]))
+	if err != nil {
+		return a, false, fmt.Errorf("%v (Строка %d)", err, lineNumber)
+	}
+	if ok && a.mode != addrModeReg && !regAddrOps[mnemonic] {
+		return a, false, fmt.Errorf("адрес %s недоступен для '%s' (Строка %d)", arg, mnemonic, lineNumber)
+	}
+	return a, ok, nil
+}
+
 // compileLine генерирует байт-код для одной строки.
 func (ac *AsmCompiler) compileLine(line string, lineNumber int) error {
 	_, instr := ac.preprocessLine(line) // заменили label на _
@@ -458,22 +882,25 @@ func (ac *AsmCompiler) compileLine(line string, lineNumber int) error {
 				return err
 			}
 			data := append([]byte(processed), 0)
-			ac.code = append(ac.code, data...)
-			ac.ip += len(data)
+			ac.emit(data...)
 		case ".SPACE":
 			val, err := ac.parseValue(tokens[1])
 			if err != nil {
 				return err
 			}
-			ac.code = append(ac.code, make([]byte, val)...)
-			ac.ip += val
+			if ac.section == "BSS" {
+				// BSS хранит только размер: нули в файл не пишутся
+				ac.bssSize += val
+				ac.ip += val
+			} else {
+				ac.emit(make([]byte, val)...)
+			}
 		case ".BYTE":
 			val, err := ac.parseValue(tokens[1])
 			if err != nil {
 				return err
 			}
-			ac.code = append(ac.code, byte(val))
-			ac.ip++
+			ac.emit(byte(val))
 		case ".WORD":
 			val, err := ac.parseValue(tokens[1])
 			if err != nil {
@@ -483,8 +910,20 @@ func (ac *AsmCompiler) compileLine(line string, lineNumber int) error {
 			if err := binary.Write(buf, binary.LittleEndian, uint32(val)); err != nil {
 				return err
 			}
-			ac.code = append(ac.code, buf.Bytes()...)
-			ac.ip += 4
+			ac.emit(buf.Bytes()...)
+		case ".JUMPTABLE":
+			labels := strings.Split(instr[len(tokens[0]):], ",")
+			table := jumpTable{section: ac.section, addr: ac.ip, count: len(labels)}
+			buf := new(bytes.Buffer)
+			for _, l := range labels {
+				addr, ok := ac.symbols[strings.TrimSpace(l)]
+				if !ok || ac.symKinds[strings.TrimSpace(l)] != symCode {
+					return fmt.Errorf("элемент .JUMPTABLE должен быть меткой инструкции: %s", strings.TrimSpace(l))
+				}
+				binary.Write(buf, binary.LittleEndian, uint32(addr))
+			}
+			ac.emit(buf.Bytes()...)
+			ac.jumps = append(ac.jumps, table)
 		default:
 			return fmt.Errorf("неизвестная директива: %s", directive)
 		}
@@ -512,9 +951,9 @@ func (ac *AsmCompiler) compileLine(line string, lineNumber int) error {
 			mnemonic, len(op.types), len(actualArgs), lineNumber)
 	}
 
-	// Записываем опкод.
-	ac.code = append(ac.code, op.code)
-	ac.ip++
+	// Записываем опкод и запоминаем строку исходника для таблицы строк.
+	ac.lines = append(ac.lines, lineEntry{uint32(ac.ip), uint32(lineNumber)})
+	ac.emit(op.code)
 
 	// Обработка аргументов.
 	for i, argType := range op.types {
@@ -534,8 +973,7 @@ func (ac *AsmCompiler) compileLine(line string, lineNumber int) error {
 			if regNum < 0 || regNum >= 32 {
 				return fmt.Errorf("регистр должен быть в диапазоне 0-31: %s (Строка %d)", arg, lineNumber)
 			}
-			ac.code = append(ac.code, byte(regNum))
-			ac.ip++
+			ac.emit(byte(regNum))
 		} else if argType == "flags" {
 			flagsVal, err := ac.parseValue(arg)
 			if err != nil {
@@ -545,32 +983,46 @@ func (ac *AsmCompiler) compileLine(line string, lineNumber int) error {
 			if flagsVal & ^0x0F != 0 {
 				return fmt.Errorf("некорректная маска флагов: %s (Строка %d)", arg, lineNumber)
 			}
-			ac.code = append(ac.code, byte(flagsVal))
-			ac.ip++
+			ac.emit(byte(flagsVal))
 		} else if argType == "addr" || argType == "imm" {
 			if strings.HasPrefix(arg, "[") && strings.HasSuffix(arg, "]") {
-				inner := strings.TrimSpace(arg[1 : len(arg)-1])
-				if matched, _ := regexp.MatchString(`^R\d+$`, inner); matched {
-					regNum, err := strconv.Atoi(inner[1:])
-					if err != nil {
-						return err
+				a, ok, err := ac.regAddr(mnemonic, arg, lineNumber)
+				if err != nil {
+					return err
+				}
+				if ok {
+					ac.emit(addrMarker, byte(a.mode<<addrModeShift|a.base))
+					switch a.mode {
+					case addrModeOffset:
+						value, err := ac.parseValue(a.offset)
+						if err != nil {
+							return err
+						}
+						if a.negate {
+							value = -value
+						}
+						if int64(value) < -0x80000000 || int64(value) > 0xFFFFFFFF {
+							return fmt.Errorf("смещение выходит за пределы 32 бит: %s (Строка %d)", arg, lineNumber)
+						}
+						buf := new(bytes.Buffer)
+						binary.Write(buf, binary.LittleEndian, uint32(value))
+						ac.emit(buf.Bytes()...)
+					case addrModeIndex:
+						ac.emit(byte(a.shift<<addrModeShift | a.index))
 					}
-					ac.code = append(ac.code, 0xFF, byte(regNum))
-					ac.ip += 2
 				} else {
 					value, err := ac.parseValue(arg)
 					if err != nil {
 						return err
 					}
-					if value < 0 || value >= 65536 {
-						return fmt.Errorf("адрес превышает 64К: %s (Строка %d)", arg, lineNumber)
+					if value < 0 || int64(value) > 0xFFFFFFFF {
+						return fmt.Errorf("адрес выходит за пределы 32-битного пространства: %s (Строка %d)", arg, lineNumber)
 					}
 					buf := new(bytes.Buffer)
 					if err := binary.Write(buf, binary.LittleEndian, uint32(value)); err != nil {
 						return err
 					}
-					ac.code = append(ac.code, buf.Bytes()...)
-					ac.ip += 4
+					ac.emit(buf.Bytes()...)
 				}
 			} else {
 				value, err := ac.parseValue(arg)
@@ -579,8 +1031,8 @@ func (ac *AsmCompiler) compileLine(line string, lineNumber int) error {
 				}
 				buf := new(bytes.Buffer)
 				if argType == "addr" {
-					if value < 0 || value >= 65536 {
-						return fmt.Errorf("адрес превышает 64К: %s (Строка %d)", arg, lineNumber)
+					if value < 0 || int64(value) > 0xFFFFFFFF {
+						return fmt.Errorf("адрес выходит за пределы 32-битного пространства: %s (Строка %d)", arg, lineNumber)
 					}
 					if err := binary.Write(buf, binary.LittleEndian, uint32(value)); err != nil {
 						return err
@@ -590,8 +1042,7 @@ func (ac *AsmCompiler) compileLine(line string, lineNumber int) error {
 						return err
 					}
 				}
-				ac.code = append(ac.code, buf.Bytes()...)
-				ac.ip += 4
+				ac.emit(buf.Bytes()...)
 			}
 		} else {
 			return fmt.Errorf("неизвестный тип аргумента: %s (Строка %d)", argType, lineNumber)
@@ -618,72 +1069,241 @@ func (ac *AsmCompiler) compile(inputFile, outputFile string) error {
 	}
 
 	// Первый проход: расширяем псевдоинструкции.
+	// srcLines хранит номер исходной строки для каждой расширенной строки.
 	var expanded []string
+	var srcLines []int
 	for i, line := range lines {
 		exLines, err := ac.expandLine(line, i+1)
 		if err != nil {
 			return err
 		}
 		expanded = append(expanded, exLines...)
+		for range exLines {
+			srcLines = append(srcLines, i+1)
+		}
 	}
 
-	// Первый проход: вычисление адресов меток.
-	codeOffset := 0
+	// Первый проход: вычисление смещений меток внутри секций.
+	offsets := map[string]int{"CODE": 0, "RODATA": 0, "BSS": 0}
+	symSection := map[string]string{}
+	var pending []string // метки, вид которых определит следующая строка
+	ac.section = "CODE"
 	for i, line := range expanded {
 		label, instr := ac.preprocessLine(line)
 		if label != "" {
 			if _, exists := ac.symbols[label]; exists {
-				return fmt.Errorf("метка '%s' определена дважды (Строка %d)", label, i+1)
+				return fmt.Errorf("метка '%s' определена дважды (Строка %d)", label, srcLines[i])
 			}
-			ac.symbols[label] = codeOffset
+			ac.symbols[label] = offsets[ac.section]
+			symSection[label] = ac.section
+			pending = append(pending, label)
 		}
 		if instr != "" {
-			length, err := ac.calculateLineLength(line, i+1)
+			if isMeta, err := ac.sectionDirective(instr, srcLines[i]); isMeta {
+				if err != nil {
+					return err
+				}
+				continue
+			}
+			kind := byte(symData)
+			if ac.section == "CODE" && !strings.HasPrefix(instr, ".") {
+				kind = symCode
+			}
+			for _, l := range pending {
+				ac.symKinds[l] = kind
+			}
+			pending = nil
+			length, err := ac.calculateLineLength(line, srcLines[i])
 			if err != nil {
 				return err
 			}
-			codeOffset += length
+			offsets[ac.section] += length
 		}
 	}
+	for _, l := range pending {
+		ac.symKinds[l] = symData
+	}
+
+	// Размещение секций: код с адреса 0, затем RODATA и BSS.
+	bases := map[string]int{"CODE": 0}
+	bases["RODATA"] = alignUp(offsets["CODE"], sectionAlign(offsets["RODATA"]))
+	bases["BSS"] = alignUp(bases["RODATA"]+offsets["RODATA"], sectionAlign(offsets["BSS"]))
+	if int64(bases["BSS"])+int64(offsets["BSS"]) > 0xFFFFFFFF {
+		return errors.New("программа не помещается в 32-битное адресное пространство")
+	}
+	for label, sec := range symSection {
+		ac.symbols[label] += bases[sec]
+	}
 
 	// Второй проход: генерация байт-кода.
 	ac.code = []byte{}
-	ac.ip = 0
+	ac.rodata = []byte{}
+	ac.bssSize = 0
+	ac.lines = nil
+	ac.jumps = nil
+	ac.section = "CODE"
+	sectionIP := map[string]int{"CODE": 0, "RODATA": 0, "BSS": 0}
 	for i, line := range expanded {
-		if err := ac.compileLine(line, i+1); err != nil {
-			return fmt.Errorf("ошибка в строке %d: %v", i+1, err)
+		_, instr := ac.preprocessLine(line)
+		if instr != "" {
+			prev := ac.section
+			if isMeta, _ := ac.sectionDirective(instr, srcLines[i]); isMeta {
+				sectionIP[prev] = ac.ip
+				ac.ip = sectionIP[ac.section]
+				continue
+			}
+		}
+		if err := ac.compileLine(line, srcLines[i]); err != nil {
+			return fmt.Errorf("ошибка в строке %d: %v", srcLines[i], err)
 		}
 	}
+	for i := range ac.lines {
+		ac.lines[i].addr += uint32(bases["CODE"])
+	}
 
-	// Записываем заголовок (4-байтовый размер кода) и сам код в выходной файл.
+	entry := 0
+	if ac.entry != "" {
+		addr, ok := ac.symbols[ac.entry]
+		if !ok || symSection[ac.entry] != "CODE" {
+			return fmt.Errorf("точка входа должна быть меткой в секции CODE: %s", ac.entry)
+		}
+		entry = addr
+	}
+
+	// Записываем контейнер с секциями в выходной файл.
 	outFile, err := os.Create(outputFile)
 	if err != nil {
 		return err
 	}
 	defer outFile.Close()
-	if err := binary.Write(outFile, binary.LittleEndian, uint32(len(ac.code))); err != nil {
-		return err
-	}
-	_, err = outFile.Write(ac.code)
-	if err != nil {
+	if err := ac.writeContainer(outFile, entry, bases); err != nil {
 		return err
 	}
 	fmt.Printf("Компиляция завершена. Байт-код сохранён в %s\n", outputFile)
 	return nil
 }
 
+type sectionOut struct {
+	typ    uint32
+	vaddr  uint32
+	offset uint32
+	size   uint32
+	data   []byte
+}
+
+// writeContainer записывает программу в секционном формате AIRB:
+// заголовок, таблицу секций и содержимое секций (см. VM/include/airbin.h).
+func (ac *AsmCompiler) writeContainer(w io.Writer, entry int, bases map[string]int) error {
+	var sections []sectionOut
+	sections = append(sections, sectionOut{typ: sectCode, vaddr: 0, data: ac.code})
+	if len(ac.rodata) > 0 {
+		sections = append(sections, sectionOut{typ: sectRodata, vaddr: uint32(bases["RODATA"]), data: ac.rodata})
+	}
+	if ac.bssSize > 0 {
+		sections = append(sections, sectionOut{typ: sectBss, vaddr: uint32(bases["BSS"]), size: uint32(ac.bssSize)})
+	}
+
+	// Таблица символов в порядке адресов.
+	names := make([]string, 0, len(ac.symbols))
+	for name := range ac.symbols {
+		if len(name) <= 255 {
+			names = append(names, name)
+		}
+	}
+	sort.Slice(names, func(i, j int) bool {
+		if ac.symbols[names[i]] != ac.symbols[names[j]] {
+			return ac.symbols[names[i]] < ac.symbols[names[j]]
+		}
+		return names[i] < names[j]
+	})
+	symtab := new(bytes.Buffer)
+	for _, name := range names {
+		binary.Write(symtab, binary.LittleEndian, uint32(ac.symbols[name]))
+		symtab.WriteByte(ac.symKinds[name])
+		symtab.WriteByte(byte(len(name)))
+		symtab.WriteString(name)
+	}
+	if symtab.Len() > 0 {
+		sections = append(sections, sectionOut{typ: sectSymtab, data: symtab.Bytes()})
+	}
+	jumpTab := new(bytes.Buffer)
+	for _, t := range ac.jumps {
+		binary.Write(jumpTab, binary.LittleEndian, uint32(bases[t.section]+t.addr))
+		binary.Write(jumpTab, binary.LittleEndian, uint32(t.count))
+	}
+	if jumpTab.Len() > 0 {
+		sections = append(sections, sectionOut{typ: sectJumps, data: jumpTab.Bytes()})
+	}
+	lineTab := new(bytes.Buffer)
+	for _, l := range ac.lines {
+		binary.Write(lineTab, binary.LittleEndian, l.addr)
+		binary.Write(lineTab, binary.LittleEndian, l.line)
+	}
+	if lineTab.Len() > 0 {
+		sections = append(sections, sectionOut{typ: sectLines, data: lineTab.Bytes()})
+	}
+
+	// Смещения содержимого: большие загружаемые секции выравниваются по
+	// странице так же, как их адреса, чтобы ВМ могла отобразить их из файла.
+	offset := airbHeaderSize + airbEntrySize*len(sections)
+	for i := range sections {
+		s := &sections[i]
+		if s.typ == sectBss {
+			continue
+		}
+		align := 1
+		if s.typ == sectCode || s.typ == sectRodata {
+			align = 16
+			if len(s.data) >= bigSection && int(s.vaddr)%pageAlign == 0 {
+				align = pageAlign
+			}
+		}
+		offset = alignUp(offset, align)
+		s.offset = uint32(offset)
+		s.size = uint32(len(s.data))
+		offset += len(s.data)
+	}
+
+	out := new(bytes.Buffer)
+	out.WriteString("AIRB")
+	binary.Write(out, binary.LittleEndian, uint16(airbVersion))
+	binary.Write(out, binary.LittleEndian, uint16(0))
+	binary.Write(out, binary.LittleEndian, uint32(entry))
+	binary.Write(out, binary.LittleEndian, uint16(len(sections)))
+	out.Write(make([]byte, airbHeaderSize-out.Len()))
+	for _, s := range sections {
+		binary.Write(out, binary.LittleEndian, []uint32{s.typ, s.vaddr, s.offset, s.size})
+	}
+	for _, s := range sections {
+		if s.typ == sectBss {
+			continue
+		}
+		out.Write(make([]byte, int(s.offset)-out.Len()))
+		out.Write(s.data)
+	}
+	_, err := w.Write(out.Bytes())
+	return err
+}
+
 func main() {
-	if len(os.Args) != 3 {
+	args := os.Args[1:]
+	compiler := NewAsmCompiler()
+	for len(args) > 2 && args[0] == "-natives" {
+		if err := compiler.loadNatives(args[1]); err != nil {
+			fmt.Printf("Ошибка чтения манифеста: %v\n", err)
+			os.Exit(1)
+		}
+		args = args[2:]
+	}
+	if len(args) != 2 {
 		progName := filepath.Base(os.Args[0])
-		fmt.Printf("Использование: %s [input.asm] [output.bin]\n", progName)
+		fmt.Printf("Использование: %s [-natives manifest.txt] [input.asm] [output.bin]\n", progName)
 		os.Exit(1)
 	}
-	inputFile := os.Args[1]
-	outputFile := os.Args[2]
-	compiler := NewAsmCompiler()
+	inputFile := args[0]
+	outputFile := args[1]
 	if err := compiler.compile(inputFile, outputFile); err != nil {
 		fmt.Printf("Ошибка компиляции: %v\n", err)
 		os.Exit(1)
 	}
 }
-
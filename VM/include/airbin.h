@@ -0,0 +1,47 @@
+#ifndef AIRBIN_H
+#define AIRBIN_H
+
+#include <stdint.h>
+
+// Секционный формат программы (контейнер AIRB).
+//
+// Файл: заголовок AirbHeader, таблица из section_count записей AirbSection,
+// затем содержимое секций. Все числа — little-endian. Загружаемые секции
+// (CODE, RODATA) размещаются в памяти гостя по адресу vaddr; BSS хранит только
+// размер и занимает место лишь в памяти. Если смещение секции в файле и её
+// адрес выровнены по странице, загрузчик отображает её страницы (mmap)
+// вместо копирования.
+//
+// Старый формат (4-байтовый размер кода и сам код) по-прежнему загружается.
+
+#define AIRB_MAGIC "AIRB"
+#define AIRB_VERSION 1
+#define AIRB_PAGE_ALIGN 4096   // Выравнивание больших секций в файле и памяти
+
+typedef struct {
+    char magic[4];           // "AIRB"
+    uint16_t version;        // AIRB_VERSION
+    uint16_t flags;          // Зарезервировано, 0
+    uint32_t entry;          // Точка входа (адрес в секции CODE)
+    uint16_t section_count;  // Число записей в таблице секций
+    uint16_t reserved0;
+    uint32_t reserved[4];
+} AirbHeader;                // 32 байта
+
+typedef struct {
+    uint32_t type;           // AirbSectionType
+    uint32_t vaddr;          // Адрес в памяти гостя (для загружаемых секций и BSS)
+    uint32_t offset;         // Смещение содержимого в файле (для BSS — 0)
+    uint32_t size;           // Размер в байтах
+} AirbSection;               // 16 байт
+
+typedef enum {
+    SECT_CODE = 1,     // Код, всегда по адресу 0
+    SECT_RODATA = 2,   // Данные только для чтения (строки, таблицы)
+    SECT_BSS = 3,      // Обнулённые данные: только размер
+    SECT_SYMTAB = 4,   // Символы: {uint32 addr, uint8 kind, uint8 len, char name[len]}*
+    SECT_LINES = 5,    // Строки: {uint32 addr, uint32 line}*
+    SECT_JUMPTABLE = 6 // Таблицы переходов: {uint32 addr, uint32 count}*
+} AirbSectionType;
+
+#endif // AIRBIN_H
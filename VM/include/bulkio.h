@@ -0,0 +1,37 @@
+#ifndef BULKIO_H
+#define BULKIO_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+// Пакетный ввод-вывод чисел и строк через стандартные потоки.
+// Весь ввод со stdin (INPUT, READINTS, READLINE, READ с дескриптором 0)
+// идёт через общий буфер ВМ, заполняемый крупными вызовами read(), и
+// разбирается собственным парсером без scanf. Вывод WRITEINTS
+// форматируется в локальный буфер и передаётся в stdout блоками.
+
+#define INPUT_BUFFER_SIZE (1u << 20)
+#define OUTPUT_CHUNK_SIZE (1u << 16)
+
+typedef struct InputBuffer {
+    uint8_t *data;
+    uint32_t pos;    // Следующий непрочитанный байт
+    uint32_t len;    // Число байт в буфере
+    int eof;         // Достигнут конец ввода
+    int fd;          // Дескриптор stdin гостя (vm->in)
+    struct Metrics *metrics;  // Учёт прочитанных байт (NULL — метрики выключены)
+} InputBuffer;
+
+// Чтение одного десятичного числа (пробельные символы пропускаются).
+// Возвращает 1 при успехе, 0 — если числа нет (конец ввода или не цифра).
+int input_read_int(VM *vm, uint32_t *value);
+// Копирует до max байт ввода в dst (меньше — только в конце ввода); возвращает число байт
+uint32_t input_read_bytes(VM *vm, uint8_t *dst, uint32_t max);
+void input_buffer_free(VM *vm);
+
+void op_readints(VM *vm);
+void op_writeints(VM *vm);
+void op_readline(VM *vm);
+
+#endif // BULKIO_H
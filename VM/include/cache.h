@@ -0,0 +1,45 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Постоянный кеш проверенных программ.
+// Запись хранит копию кода и битовую карту начал инструкций, построенную
+// vm_verify; ключ — хеш содержимого файла программы. При повторном запуске
+// запись отображается в память только для чтения и проверка не выполняется.
+// Запись хранит и отпечаток правил проверки (таблица op_info и
+// VERIFY_RULES_VERSION): после смены опкодов, длин операндов или корней
+// обхода старые записи отбрасываются без изменения CACHE_VERSION.
+
+#define CACHE_MAGIC "AIRC"
+#define CACHE_VERSION 2
+
+typedef struct {
+    char magic[4];        // "AIRC"
+    uint32_t version;     // CACHE_VERSION
+    uint64_t key;         // Хеш содержимого файла программы
+    uint32_t code_size;   // Размер кода
+    uint32_t entry;       // Точка входа, для которой строилась карта
+    uint64_t checksum;    // Хеш битовой карты
+    uint64_t verifier;    // Отпечаток правил проверки (cache_verifier)
+} CacheHeader;
+
+typedef struct {
+    void *base;                 // Отображение файла кеша
+    size_t length;              // Размер отображения
+    const uint8_t *insn_map;    // Битовая карта внутри отображения
+} CacheEntry;
+
+// Поиск записи. Возвращает 1 при попадании; устаревшая или повреждённая
+// запись удаляется, и возвращается 0.
+int cache_lookup(const char *dir, uint64_t key, const uint8_t *code, uint32_t size,
+                 uint32_t entry, CacheEntry *out);
+
+// Атомарная запись (через временный файл и rename). Возвращает 0 при успехе.
+int cache_store(const char *dir, uint64_t key, const uint8_t *code, uint32_t size,
+                uint32_t entry, const uint8_t *insn_map);
+
+void cache_release(CacheEntry *e);
+
+#endif // CACHE_H
@@ -0,0 +1,33 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "metrics.h"
+
+// Интерфейс командной строки AirVM: разбор опций, загрузка программы,
+// запись/воспроизведение и замер времени. Используется AirVM (main.c) и
+// программами, собранными airvm-aot, поэтому их вывод совпадает.
+
+typedef struct {
+    const uint8_t *image;     // Встроенный образ программы (содержимое файла .bin)
+    size_t image_size;
+    void (*run)(VM *vm);      // Исполнение программы вместо vm_run
+} CliProgram;
+
+// Точка входа. embedded == NULL — путь к программе берётся из аргументов
+// и программа интерпретируется.
+int vm_cli_main(int argc, char *argv[], const CliProgram *embedded);
+
+// Число с необязательным суффиксом K, M или G (степени 1024); 0 — ошибка
+uint64_t cli_parse_size(const char *s);
+
+// Опции квот --max-memory, --max-files, --max-instructions, --max-output:
+// 1 — опция разобрана (значение записано в limits), 0 — это не опция квоты,
+// -1 — неверное или отсутствующее значение (в том числе --max-memory меньше
+// INIT_MEM_SIZE)
+int cli_limit_option(const char *opt, const char *value, uint64_t limits[MET_COUNTERS]);
+
+#endif // CLI_H
@@ -0,0 +1,41 @@
+#ifndef CLONE_H
+#define CLONE_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+// Клонирование VM из прогретого шаблона.
+//
+// Программа выполняет общую инициализацию (таблицы в памяти и т.п.) и
+// доходит до инструкции CHECKPOINT reg. Если у VM взведён
+// stop_at_checkpoint, она на этом останавливается и становится шаблоном;
+// иначе CHECKPOINT записывает в reg ноль и исполнение продолжается.
+//
+// Каждый клон продолжает исполнение после CHECKPOINT со своим номером в reg.
+// vm_clone создаёт клон в том же процессе: память шаблона один раз
+// переписывается в memfd, и шаблон, и клоны отображают его MAP_PRIVATE,
+// так что клон расходует память только на страницы, которые изменил.
+// Клон получает стандартные потоки, но не открытые шаблоном файлы и
+// каталоги; буфер stdin шаблона не наследуется.
+// AirVM --clones использует fork, где то же даёт копирование при записи ядра.
+
+// Клон шаблона, остановленного на CHECKPOINT (или ещё не запускавшейся VM).
+// clone — неинициализированная структура; после работы — vm_free(clone).
+// index записывается в регистр CHECKPOINT. Возвращает 0 или -1 (с сообщением).
+int vm_clone(VM *clone, VM *tmpl, uint32_t index);
+
+// Продолжение VM, остановленной на CHECKPOINT, как клона номер index
+// (для процесса, полученного fork от шаблона)
+void vm_checkpoint_resume(VM *vm, uint32_t index);
+
+// Снимок памяти шаблона (vm_clone делает его при первом клоне). Клоны
+// из разных потоков хоста можно создавать одновременно только после него.
+int vm_template_freeze(VM *vm);
+
+// Отказ от снимка памяти шаблона (перед тем как шаблон продолжит работу)
+void vm_template_release(VM *vm);
+
+void op_checkpoint(VM *vm);
+
+#endif // CLONE_H
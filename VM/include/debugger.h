@@ -0,0 +1,48 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+// Отладчик с протоколом GDB Remote Serial Protocol.
+//
+// Точка останова ставится заменой байта опкода на OP_TRAP; исходный байт
+// хранится в отладчике. Точки наблюдения закрывают страницы памяти гостя
+// через mprotect: обращение к странице вызывает SIGSEGV, обработчик открывает
+// страницу и переключает VM на таблицу-ловушку, которая после инструкции
+// проверяет попадание в наблюдаемый диапазон и снова закрывает страницы.
+// Шаг и прерывание (Ctrl-C в GDB, SIGIO на сокете) работают через ту же
+// таблицу. Пока ничего не взведено, цикл vm_run исполняется без проверок.
+//
+// Останавливается только исходная VM: потоки гостя проходят точки останова,
+// не останавливаясь.
+
+typedef struct Debugger Debugger;
+
+// Ожидание подключения GDB. endpoint — номер TCP-порта на 127.0.0.1 или
+// "unix:<путь>". После подключения VM останавливается перед первой инструкцией.
+int debugger_attach(VM *vm, const char *endpoint);
+void debugger_free(VM *vm);
+
+// Вызываются из vm_run в начале и в конце исполнения
+void debugger_start(VM *vm);
+void debugger_finish(VM *vm);
+
+// Обёртки инструкций ввода-вывода для таблицы обработчиков (нужны, пока
+// взведены точки наблюдения); без отладчика таблица не меняется
+void debugger_patch_table(VM *vm, instruction_fn *table);
+
+// Повторное закрытие наблюдаемых страниц после роста памяти
+void debugger_protect(VM *vm);
+
+// Исходный опкод по адресу, где может стоять OP_TRAP
+uint8_t debugger_opcode_at(VM *vm, uint32_t addr);
+
+// BREAK под отладчиком: остановка в GDB вместо ожидания Enter.
+// Возвращает -1, если GDB не подключён к этой VM.
+int debugger_break(VM *vm);
+
+void op_trap(VM *vm);
+
+#endif // DEBUGGER_H
@@ -0,0 +1,99 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Общая таблица декодирования инструкций.
+// Описывает формат операндов каждого опкода так же, как их читают обработчики
+// op_*; используется проверкой программы при загрузке и внешними инструментами.
+
+// Типы операндов
+typedef enum {
+    OPND_NONE = 0,
+    OPND_REG,      // 1 байт: номер регистра
+    OPND_FLAGS,    // 1 байт: маска флагов
+    OPND_IMM,      // 4 байта: непосредственное значение
+    OPND_TARGET,   // 4 байта: адрес перехода внутри кода
+    OPND_ADDR32,   // 4 байта: абсолютный адрес данных
+    OPND_ADDR      // адрес read_addr_operand: 4 байта или от регистра (см. ADDR_MODE_*)
+} OperandKind;
+
+// Влияние инструкции на поток управления
+typedef enum {
+    FLOW_NEXT = 0,  // переход к следующей инструкции
+    FLOW_JUMP,      // безусловный переход по OPND_TARGET
+    FLOW_BRANCH,    // условный переход: OPND_TARGET или следующая инструкция
+    FLOW_CALL,      // вызов: OPND_TARGET, затем следующая инструкция
+    FLOW_RET,       // возврат из подпрограммы
+    FLOW_HALT,      // остановка
+    FLOW_INDIRECT   // переход по регистру: цель проверяется при исполнении
+} FlowKind;
+
+#define MAX_OPERANDS 6
+
+typedef struct {
+    const char *name;                 // Мнемоника (как в Lang/main.go), NULL — опкод не существует
+    uint8_t flow;                     // FlowKind
+    uint8_t operands[MAX_OPERANDS];   // Типы операндов, завершаются OPND_NONE
+} OpInfo;
+
+extern const OpInfo op_info[256];
+
+// Декодированный операнд
+typedef struct {
+    uint8_t kind;      // OperandKind
+    uint8_t indirect;  // Для OPND_ADDR: адрес вычисляется от регистра reg
+    uint8_t mode;      // Для косвенного OPND_ADDR: ADDR_MODE_*
+    uint8_t reg;       // Номер регистра (OPND_REG или база OPND_ADDR)
+    uint8_t index;     // Для ADDR_MODE_INDEX: индексный регистр
+    uint8_t shift;     // и log2 его масштаба
+    uint32_t value;    // Значение непосредственного операнда (смещение ADDR_MODE_OFFSET)
+} Operand;
+
+// Декодированная инструкция
+typedef struct {
+    uint32_t addr;     // Адрес первого байта
+    uint8_t opcode;
+    uint8_t length;    // Длина в байтах вместе с операндами
+    uint8_t count;     // Число операндов
+    Operand ops[MAX_OPERANDS];
+} Insn;
+
+// Коды ошибок декодирования
+typedef enum {
+    DECODE_OK = 0,
+    DECODE_UNKNOWN_OPCODE = -1,
+    DECODE_TRUNCATED = -2,
+    DECODE_BAD_REGISTER = -3,
+    DECODE_BAD_TARGET = -4,
+    DECODE_BAD_ADDR_MODE = -5
+} DecodeStatus;
+
+// Декодирование одной инструкции по адресу addr
+int decode_insn(const uint8_t *code, uint32_t size, uint32_t addr, Insn *out);
+const char *decode_status_str(int status);
+
+// Размер битовой карты начал инструкций для кода размера size
+static inline size_t insn_map_bytes(uint32_t size) {
+    return ((size_t)size + 7) / 8;
+}
+
+static inline int insn_map_test(const uint8_t *map, uint32_t addr) {
+    return (map[addr >> 3] >> (addr & 7)) & 1;
+}
+
+// Версия правил vm_verify, не описанных таблицей op_info (корни обхода,
+// проверка целей). Увеличивается при их изменении: записи кеша, построенные
+// по старым правилам, перестают совпадать (см. cache.h).
+#define VERIFY_RULES_VERSION 1
+
+// Проверка программы: обход всех достижимых из точки входа и из roots
+// (цели таблиц переходов) инструкций.
+// Заполняет map (insn_map_bytes(size) байт) битами начал инструкций.
+// Возвращает 0 при успехе; иначе адрес и причина ошибки пишутся в err.
+int vm_verify(const uint8_t *code, uint32_t size, uint32_t entry,
+              const uint32_t *roots, size_t root_count, uint8_t *map,
+              char *err, size_t err_len);
+
+#endif // DECODE_H
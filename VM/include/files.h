@@ -0,0 +1,50 @@
+#ifndef FILES_H
+#define FILES_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Таблица открытых файлов гостя.
+// Растёт по мере необходимости (до MAX_FILES); свободные слоты связаны в
+// список, поэтому выделение и освобождение дескриптора — O(1).
+// Дескрипторы 0, 1, 2 — stdin, stdout, stderr.
+
+#define MAX_FILES (1u << 20)    // Предел числа открытых файлов
+#define FILE_NONE UINT32_MAX    // Конец списка свободных слотов / ошибка
+
+typedef struct {
+    FILE *fp;            // NULL — слот свободен
+    char *buf;           // Буфер, заданный FBUF (NULL — буфер stdio по умолчанию)
+    uint32_t next_free;  // Следующий свободный слот (для свободных слотов)
+} FileSlot;
+
+typedef struct FileTable {
+    FileSlot *slots;
+    uint32_t capacity;
+    uint32_t free_head;
+    uint32_t open;       // Число открытых файлов, включая стандартные потоки
+    FILE *std[3];        // Стандартные потоки вызывающего (file_set_std), NULL — потоки процесса
+} FileTable;
+
+int file_table_init(FileTable *t);
+// Закрывает все файлы, кроме стандартных потоков
+void file_table_reset(FileTable *t);
+void file_table_free(FileTable *t);
+// Замена открытых стандартных потоков (дескрипторы 0-2). Эти потоки
+// принадлежат вызывающему: закрытие их дескриптора гостем только сбрасывает
+// буфер, а сами потоки таблица не закрывает.
+void file_set_std(FileTable *t, FILE *in, FILE *out, FILE *err);
+
+// Добавление открытого файла; возвращает дескриптор или FILE_NONE
+uint32_t file_add(FileTable *t, FILE *fp);
+// Закрытие файла; возвращает результат fclose или -1 для неверного дескриптора
+int file_close(FileTable *t, uint32_t handle);
+// Размер буфера stdio для дескриптора (0 — без буферизации).
+// Должен вызываться до первой операции ввода-вывода с файлом.
+int file_set_buffer(FileTable *t, uint32_t handle, uint32_t size);
+
+static inline FILE *file_get(const FileTable *t, uint32_t handle) {
+    return handle < t->capacity ? t->slots[handle].fp : NULL;
+}
+
+#endif // FILES_H
@@ -0,0 +1,12 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Быстрый некриптографический 64-битный хеш (вариант MurmurHash64A).
+// Обрабатывает входные данные словами по 8 байт; результат не зависит
+// от порядка байт хоста.
+uint64_t air_hash64(const void *data, size_t len, uint64_t seed);
+
+#endif // HASH_H
@@ -0,0 +1,58 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+// Куча гостя (ALLOC/FREE/REALLOC/ARENA_RESET/HEAP_STATS).
+//
+// Всё состояние распределителя хранится в памяти гостя, сразу за образом
+// программы (адрес image_size, выровненный на HEAP_ALIGN), поэтому оно
+// попадает в SNAPSHOT и восстанавливается RESTORE. Программа, использующая
+// кучу, не должна сама адресовать память за концом своих секций.
+//
+// Размещение: заголовок HeapHeader, затем блоки. Каждый блок начинается с
+// 8 байт {размер блока, метка}; гость получает адрес сразу за ними.
+// Мелкие запросы (блок до HEAP_MAX_SMALL байт) обслуживаются классами
+// размеров: свободные блоки класса связаны в список, новые нарезаются из
+// пластин по HEAP_SLAB_SIZE байт. Крупные блоки берутся с вершины кучи и
+// после освобождения переиспользуются первым подходящим.
+
+#define HEAP_MAGIC 0x50414548u      // "HEAP"
+#define HEAP_ALIGN 16
+#define HEAP_BLOCK_HEADER 8
+#define HEAP_CLASSES 28
+#define HEAP_MAX_SMALL 4096
+#define HEAP_SLAB_SIZE 65536
+
+// Заголовок кучи в памяти гостя (все поля — little-endian слова)
+typedef struct {
+    uint32_t magic;
+    uint32_t top;                    // Первый не выделенный адрес
+    uint32_t bytes_in_use;           // Байт в занятых блоках (без заголовков)
+    uint32_t peak_bytes;             // Максимум bytes_in_use
+    uint32_t alloc_count;            // Число ALLOC (включая через REALLOC)
+    uint32_t free_count;             // Число FREE (включая через REALLOC)
+    uint32_t large_free;             // Список свободных крупных блоков
+    uint32_t reserved;
+    uint32_t free_list[HEAP_CLASSES];   // Свободные блоки класса
+    uint32_t slab_cur[HEAP_CLASSES];    // Нарезка текущей пластины класса
+    uint32_t slab_end[HEAP_CLASSES];
+} HeapHeader;
+
+// Число слов, записываемых HEAP_STATS
+#define HEAP_STATS_WORDS 5
+
+// Блоки кучи для других модулей (MAP_*): адрес данных или 0, если память
+// исчерпана; при ошибке VM может быть остановлена
+uint32_t vm_heap_alloc(VM *vm, uint32_t size);
+void vm_heap_free(VM *vm, uint32_t addr, const char *op);
+
+void op_alloc(VM *vm);
+void op_free(VM *vm);
+void op_realloc(VM *vm);
+void op_arena_reset(VM *vm);
+void op_heap_stats(VM *vm);
+
+#endif // HEAP_H
@@ -0,0 +1,24 @@
+#ifndef INTRINSICS_H
+#define INTRINSICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "vm.h"
+
+// Встроенные инструкции над диапазонами памяти гостя. Каждая проверяет
+// границы диапазона один раз и затем работает с памятью напрямую.
+// Массивы — слова uint32 в little-endian.
+
+// CRC32C (полином Кастаньоли) в стиле zlib: crc32c(0, ...) — начало,
+// результат можно передавать в следующий вызов для продолжения.
+// На x86-64 с SSE4.2 используется аппаратная инструкция crc32.
+uint32_t air_crc32c(uint32_t crc, const void *data, size_t len);
+
+void op_crc32c(VM *vm);
+void op_hash64(VM *vm);
+void op_sort(VM *vm);
+void op_bsearch(VM *vm);
+void op_counteq(VM *vm);
+
+#endif // INTRINSICS_H
@@ -0,0 +1,21 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+// Параметры загрузки программы
+typedef struct {
+    const char *cache_dir;   // Каталог кеша проверенных программ (NULL — без кеша)
+} LoadOptions;
+
+// Загрузка, проверка и размещение программы в памяти ВМ.
+// Возвращает 0 при успехе, иначе печатает причину в stderr.
+int vm_load_program(VM *vm, const char *path, const LoadOptions *opts);
+
+// То же для образа, уже находящегося в памяти (содержимое файла программы)
+int vm_load_image(VM *vm, const uint8_t *image, size_t size, const LoadOptions *opts);
+
+#endif // LOADER_H
@@ -0,0 +1,49 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+// Хеш-таблицы гостя (MAP_*).
+//
+// Таблица целиком лежит в куче гостя (src/heap.c), поэтому попадает в
+// SNAPSHOT и в клоны. Адрес таблицы — адрес заголовка MapHeader; массив
+// слотов выделяется отдельным блоком и заменяется при росте.
+//
+// Открытая адресация с линейным пробированием по схеме Robin Hood: слот —
+// три слова {meta, ключ, значение}, meta = старшие 16 бит хеша | (расстояние
+// от исходной позиции + 1), 0 — пустой слот. Поиск прекращается, как только
+// расстояние слота меньше пройденного, удаление сдвигает хвост цепочки назад,
+// без надгробий. Таблица растёт удвоением при заполнении больше 7/8.
+//
+// У таблицы с байтовыми ключами (MAP_SNEW) в слоте хранится адрес копии
+// ключа в куче: слово длины, байты ключа и завершающий ноль.
+
+#define MAP_MAGIC 0x3150414Du       // "MAP1"
+#define MAP_KIND_INT 0              // Ключи — 32-битные слова
+#define MAP_KIND_BYTES 1            // Ключи — байтовые строки
+#define MAP_MIN_CAPACITY 16
+#define MAP_SLOT_WORDS 3
+
+// Заголовок таблицы в памяти гостя (слова little-endian)
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;          // MAP_KIND_*
+    uint32_t count;         // Число ключей
+    uint32_t capacity;      // Число слотов (степень двойки)
+    uint32_t slots;         // Адрес массива слотов
+} MapHeader;
+
+void op_map_new(VM *vm);
+void op_map_put(VM *vm);
+void op_map_get(VM *vm);
+void op_map_del(VM *vm);
+void op_map_iter(VM *vm);
+void op_map_snew(VM *vm);
+void op_map_sput(VM *vm);
+void op_map_sget(VM *vm);
+void op_map_sdel(VM *vm);
+void op_map_free(VM *vm);
+
+#endif // MAP_H
@@ -0,0 +1,123 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+// Метрики работающей VM в разделяемой памяти.
+//
+// VM создаёт файл METRICS_DIR/airvm-<pid>[-n] со структурой MetricsPage и
+// обновляет счётчики без блокировок (relaxed-атомарные операции); airvm-top
+// отображает эти файлы и читает их. Число исполненных инструкций считается
+// по базовым блокам: обёртки инструкций перехода прибавляют длину
+// завершившегося блока, которую дают префиксные суммы карты инструкций.
+// Пока метрики не включены, цикл исполнения не меняется.
+//
+// Те же счётчики служат учётом ресурсов для квот (vm_set_limit). Без
+// --metrics страница счётчиков лежит в памяти процесса, а не в файле.
+// Квоты проверяются там, где счётчик и так обновляется: инструкции — на
+// границах блоков (у потоков гостя — при сбросе порции), память — при её
+// росте, файлы — при открытии, вывод — при записи.
+
+#define METRICS_DIR "/dev/shm"
+#define METRICS_PREFIX "airvm-"
+#define METRICS_MAGIC 0x4D524941u   // "AIRM"
+#define METRICS_VERSION 1
+// Потоки гостя копят инструкции локально и сбрасывают их в общий счётчик
+// порциями, чтобы не делить строку кэша на каждом блоке
+#define METRICS_BATCH 65536
+
+typedef enum {
+    MET_INSTRUCTIONS = 0,   // Исполненные инструкции
+    MET_BYTES_READ,         // Байт прочитано (stdin и файлы)
+    MET_BYTES_WRITTEN,      // Байт записано (stdout и файлы)
+    MET_SNAPSHOTS,          // Выполненные SNAPSHOT
+    MET_MEMORY_SIZE,        // Текущий размер памяти гостя
+    MET_OPEN_FILES,         // Открытые файлы, включая стандартные потоки
+    MET_COUNTERS
+} MetricsCounter;
+
+// Содержимое файла метрик
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t running;            // 1 — VM исполняется, 0 — завершилась
+    uint64_t start_ns;           // CLOCK_MONOTONIC запуска vm_run
+    char program[64];            // Имя программы
+    uint64_t counters[MET_COUNTERS];
+    uint32_t ip;                 // ip на последней границе блока
+    uint32_t call_depth;         // Глубина стека возвратов там же
+} MetricsPage;
+
+typedef struct Metrics {
+    MetricsPage *page;
+    char *path;
+    uint32_t *insn_index;        // Число инструкций до адреса (program_size + 1 элементов)
+    instruction_fn base[256];    // Обработчики без обёрток
+    instruction_fn table[256];   // Таблица исходной VM с обёртками
+    const instruction_fn *outer; // Таблица vm_run до подключения метрик
+    uint64_t limits[MET_COUNTERS];  // Квоты, 0 — без предела
+    int exceeded;                // Счётчик, квота которого превышена (-1 — нет)
+} Metrics;
+
+// Учёт ресурсов без файла метрик; вызывается после загрузки программы
+int metrics_enable(VM *vm);
+// Создание файла метрик (включает учёт); вызывается после загрузки программы
+int metrics_attach(VM *vm, const char *program);
+void metrics_free(VM *vm);
+// Собственный файл метрик для процесса, полученного fork
+int metrics_reattach(VM *vm);
+
+// Вызываются из vm_run в начале и в конце исполнения
+void metrics_start(VM *vm);
+void metrics_finish(VM *vm);
+
+// Обёртки инструкций перехода для таблицы обработчиков (для потоков гостя)
+void metrics_patch_table(VM *vm, instruction_fn *table);
+
+// Квоты: предел для MET_INSTRUCTIONS, MET_BYTES_WRITTEN (байт вывода в
+// stdout и файлы), MET_MEMORY_SIZE (байт памяти гостя) и MET_OPEN_FILES
+// (включая стандартные потоки); 0 снимает предел. Включает учёт ресурсов,
+// поэтому вызывается после загрузки программы.
+int vm_set_limit(VM *vm, MetricsCounter c, uint64_t limit);
+// Текущее значение счётчика (без учёта — только память и файлы)
+uint64_t vm_usage(const VM *vm, MetricsCounter c);
+// Счётчик, квота которого остановила VM, или -1
+int vm_limit_exceeded(const VM *vm);
+// Сводка учёта ресурсов после исполнения
+void metrics_print_summary(const VM *vm, FILE *out);
+// Остановка VM с ошибкой, называющей ресурс
+void metrics_limit_error(VM *vm, MetricsCounter c);
+
+static inline uint64_t metrics_limit(const VM *vm, MetricsCounter c) {
+    return vm->metrics ? vm->metrics->limits[c] : 0;
+}
+
+static inline void metrics_add(VM *vm, MetricsCounter c, uint64_t n) {
+    if (vm->metrics) {
+        uint64_t total = __atomic_add_fetch(&vm->metrics->page->counters[c], n, __ATOMIC_RELAXED);
+        if (vm->metrics->limits[c] && total > vm->metrics->limits[c])
+            metrics_limit_error(vm, c);
+    }
+}
+
+// Проверка квоты до операции, которая прибавит к счётчику n:
+// 0 — можно выполнять, -1 — квота была бы превышена (VM остановлена)
+static inline int metrics_reserve(VM *vm, MetricsCounter c, uint64_t n) {
+    if (vm->metrics && vm->metrics->limits[c] &&
+        __atomic_load_n(&vm->metrics->page->counters[c], __ATOMIC_RELAXED) + n > vm->metrics->limits[c]) {
+        metrics_limit_error(vm, c);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void metrics_set(VM *vm, MetricsCounter c, uint64_t value) {
+    if (vm->metrics)
+        __atomic_store_n(&vm->metrics->page->counters[c], value, __ATOMIC_RELAXED);
+}
+
+#endif // METRICS_H
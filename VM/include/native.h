@@ -0,0 +1,44 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+// Интерфейс вызова функций хоста (NCALL).
+// Хост регистрирует C-функции под числовым идентификатором и именем;
+// инструкция NCALL id вызывает функцию напрямую из цикла исполнения.
+// Функция работает с регистрами гостя (vm->registers) и с памятью гостя
+// через vm_guest_ptr. По соглашению аргументы передаются в R1..R6,
+// результат возвращается в R0.
+
+#define MAX_NATIVES 65536   // Идентификаторы функций: 0..MAX_NATIVES-1
+
+// Возвращает 0 при успехе. При ошибке функция может сама вызвать vm_error,
+// иначе ВМ сообщит о сбое функции и остановится.
+typedef int (*native_fn)(VM *vm, void *ctx);
+
+typedef struct NativeEntry {
+    native_fn fn;      // NULL — идентификатор свободен
+    void *ctx;         // Произвольные данные хоста
+    char *name;
+} NativeEntry;
+
+// Регистрация функции. Идентификатор и имя должны быть уникальны.
+int vm_register_native(VM *vm, uint32_t id, const char *name, native_fn fn, void *ctx);
+// Поиск идентификатора по имени (-1, если функции нет)
+int vm_native_id(const VM *vm, const char *name);
+// Манифест для ассемблера: строки "<id> <имя>"
+void vm_write_native_manifest(const VM *vm, FILE *out);
+void vm_free_natives(VM *vm);
+
+// Проверенный указатель на len байт памяти гостя, начиная с addr.
+// Для записи (writable != 0) память при необходимости расширяется.
+// При выходе за границы сообщает об ошибке и возвращает NULL.
+uint8_t *vm_guest_ptr(VM *vm, uint32_t addr, uint32_t len, int writable);
+
+// Стандартный набор функций (mem_copy, mem_fill, mem_compare, str_len)
+void vm_register_builtin_natives(VM *vm);
+
+#endif // NATIVE_H
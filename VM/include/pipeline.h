@@ -0,0 +1,125 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "vm.h"
+#include "loader.h"
+#include "metrics.h"
+
+// Конвейер из нескольких программ в одном процессе (--pipeline).
+//
+// Каждая стадия — отдельная VM со своей памятью в своём потоке хоста.
+// Стадии связаны каналами: канал — ограниченное кольцо байт с одним
+// отправителем и одним получателем (SPSC), без блокировок. Отправитель
+// пишет только head, получатель — только tail; каждая сторона держит
+// копию чужого счётчика и перечитывает его, лишь когда кольцо кажется
+// полным (пустым), поэтому на сообщение приходится одна запись общей
+// строки кэша. Сообщение — слово длины и байты, выровненные на 4; байты
+// копируются прямо из памяти гостя в кольцо и из кольца в память гостя,
+// без промежуточных буферов и выделений памяти.
+//
+// Ждущая сторона сначала коротко крутится, затем уступает процессор
+// (sched_yield) и только потом засыпает на futex; вторая сторона будит её,
+// только если видит флаг ожидания, так что при коротких ожиданиях futex не
+// вызывается вовсе. Когда стадия завершается, её исходящие каналы закрываются (получатель, выбрав
+// оставшиеся сообщения, видит конец), а отправитель в канал завершившейся
+// стадии останавливается с ошибкой, если кольцо заполнено.
+//
+// Файл конвейера — строки
+//   stage <имя> <program.bin>
+//   channel <имя> <стадия-отправитель> <стадия-получатель> [ёмкость]
+// Пустые строки и строки с '#' в начале пропускаются. Ёмкость — байты
+// (суффиксы K, M, G), округляется вверх до степени двойки. stdin процесса
+// получает первая стадия, у остальных ввод пуст; stdout и stderr общие.
+
+#define PIPELINE_MAX_STAGES 256
+#define CHAN_DEFAULT_CAPACITY (1u << 20)
+#define CHAN_MIN_CAPACITY 64u
+#define CHAN_MAX_CAPACITY (1u << 30)
+#define CHAN_CLOSED UINT32_MAX       // Результат CHAN_RECV: канал закрыт и пуст
+#define CHAN_SPIN 256                // Перепроверок перед сном на futex
+#define CHAN_YIELDS 16               // Затем перепроверок с sched_yield
+#define CHAN_SAMPLE_MASK 63u         // Заполнение кольца замеряется раз в 64 сообщения
+#define CACHE_LINE 64
+
+struct PipelineStage;
+
+typedef struct Channel {
+    char *name;
+    uint8_t *data;
+    uint32_t capacity;               // Байт в кольце (степень двойки)
+    uint32_t from, to;               // Стадии отправителя и получателя
+    char pad0[CACHE_LINE];
+    // Строка отправителя
+    uint64_t head;                   // Записано байт (растёт неограниченно)
+    uint64_t tail_cache;             // Последнее прочитанное значение tail
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t fill_sum;               // Сумма замеров заполнения, байт
+    uint64_t fill_samples;
+    uint64_t fill_max;
+    uint64_t full_waits;             // Засыпаний на полном кольце
+    char pad1[CACHE_LINE];
+    // Строка получателя
+    uint64_t tail;                   // Прочитано байт
+    uint64_t head_cache;
+    uint64_t empty_waits;            // Засыпаний на пустом кольце
+    char pad2[CACHE_LINE];
+    // Ожидание и закрытие (меняются редко)
+    uint32_t data_seq;               // futex получателя: растёт при записи, если он ждёт
+    uint32_t space_seq;              // futex отправителя: растёт при чтении, если он ждёт
+    uint32_t recv_waiting;
+    uint32_t send_waiting;
+    uint32_t closed;                 // Отправитель завершился
+    uint32_t abandoned;              // Получатель завершился
+    char pad3[CACHE_LINE];
+} Channel;
+
+typedef struct PipelineStage {
+    VM vm;
+    char *name;
+    char *path;
+    struct Pipeline *pipeline;
+    uint32_t index;
+    pthread_t thread;
+    uint64_t start_ns, end_ns;
+    uint64_t messages_in, messages_out;
+    uint64_t bytes_in, bytes_out;
+    uint64_t send_wait_ns;           // Время в ожидании места в канале
+    uint64_t recv_wait_ns;           // Время в ожидании сообщений
+    int failed;
+} PipelineStage;
+
+typedef struct Pipeline {
+    PipelineStage *stages;
+    uint32_t stage_count;
+    Channel *channels;
+    uint32_t channel_count;
+} Pipeline;
+
+// Параметры запуска, общие для всех стадий
+typedef struct {
+    LoadOptions load;
+    uint32_t stack_size, call_depth;
+    int metrics;                     // Файл метрик для каждой стадии (airvm-top)
+    uint64_t limits[MET_COUNTERS];   // Квоты каждой стадии
+} PipelineOptions;
+
+// Разбор файла конвейера, загрузка программ и создание каналов.
+// Возвращает 0 при успехе, иначе печатает причину в stderr.
+int pipeline_load(Pipeline *p, const char *config, const PipelineOptions *opts);
+// Исполнение всех стадий, каждой в своём потоке, до их завершения.
+// Возвращает 0 или 1, если стадия остановилась с ошибкой или по квоте.
+int pipeline_run(Pipeline *p);
+// Пропускная способность стадий и заполнение каналов
+void pipeline_print_summary(const Pipeline *p, FILE *out);
+void pipeline_free(Pipeline *p);
+
+void op_chan_open(VM *vm);
+void op_chan_send(VM *vm);
+void op_chan_recv(VM *vm);
+
+#endif // PIPELINE_H
@@ -0,0 +1,73 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm.h"
+
+// Журнал внешних входных данных ВМ.
+// В режиме записи каждое значение, полученное от хоста (INPUT, READINTS, READLINE, FILE_*, DIR_*, FS_LIST,
+// ENV_LIST, CLOCK_NS, EVENT_WAIT), дописывается в файл; в режиме воспроизведения те же значения
+// выдаются из журнала без обращения к хосту, поэтому запуск повторяется побитово.
+
+#define REPLAY_MAGIC "AIRR"
+#define REPLAY_VERSION 1
+
+typedef enum {
+    REPLAY_RECORD = 1,
+    REPLAY_PLAY = 2
+} ReplayMode;
+
+// Типы событий журнала
+typedef enum {
+    EV_INPUT = 0x01,       // INPUT: 4 байта значения, пустое событие — ошибка чтения
+    EV_FILE_OPEN = 0x02,   // FILE_OPEN: 4 байта дескриптора
+    EV_FILE_READ = 0x03,   // FILE_READ: прочитанные байты
+    EV_FILE_WRITE = 0x04,  // FILE_WRITE: 4 байта числа записанных байт
+    EV_FILE_SEEK = 0x05,   // FILE_SEEK: 4 байта результата fseek
+    EV_FS_LIST = 0x06,     // FS_LIST: строка с завершающим нулём
+    EV_ENV_LIST = 0x07,    // ENV_LIST: строка с завершающим нулём
+    EV_DIR_OPEN = 0x08,    // DIR_OPEN: 4 байта дескриптора
+    EV_DIR_NEXT = 0x09,    // DIR_NEXT: запись элемента, пустое событие — конец каталога
+    EV_FILE_SEEK64 = 0x0A, // SEEK64: 8 байт новой позиции
+    EV_FILE_SYNC = 0x0B,   // FSYNC: 4 байта результата
+    EV_FILE_PREAD = 0x0C,  // PREAD: байт состояния (0 — успех, 1 — ошибка), затем прочитанные байты
+    EV_READINTS = 0x0D,    // READINTS: прочитанные значения, по 4 байта
+    EV_READLINE = 0x0E,    // READLINE: байт признака конца ввода, затем строка
+    EV_CLOCK = 0x0F,       // CLOCK_NS: 8 байт времени
+    EV_EVENT_WAIT = 0x10   // EVENT_WAIT: 4 байта номера готового дескриптора
+} ReplayEvent;
+
+typedef struct Replay {
+    ReplayMode mode;
+    FILE *out;           // Файл журнала (запись)
+    uint8_t *data;       // Журнал целиком в памяти (воспроизведение)
+    size_t size;         // Размер журнала
+    size_t pos;          // Текущая позиция чтения
+    uint64_t events;     // Число записанных/воспроизведённых событий
+} Replay;
+
+int replay_open_record(Replay *r, const char *path);
+int replay_open_play(Replay *r, const char *path);
+void replay_close(Replay *r);
+
+// Запись события (только в режиме REPLAY_RECORD)
+void replay_put(Replay *r, uint8_t type, const void *data, uint32_t len);
+void replay_put_u32(Replay *r, uint8_t type, uint32_t value);
+
+// Извлечение следующего события заданного типа.
+// При расхождении типа или исчерпании журнала ВМ останавливается с ошибкой.
+const uint8_t *replay_take(VM *vm, uint8_t type, uint32_t *len);
+int replay_take_u32(VM *vm, uint8_t type, uint32_t *value);
+
+static inline int vm_recording(const VM *vm) {
+    return vm->replay && vm->replay->mode == REPLAY_RECORD;
+}
+
+static inline int vm_replaying(const VM *vm) {
+    return vm->replay && vm->replay->mode == REPLAY_PLAY;
+}
+
+#endif // REPLAY_H
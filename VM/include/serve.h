@@ -0,0 +1,64 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "metrics.h"
+#include "loader.h"
+
+// Резидентный режим AirVM (--serve) и его клиент airvm-run.
+//
+// Демон слушает Unix-сокет, держит недавно запущенные программы загруженными
+// и проверенными (шаблоны vm_clone) и исполняет запросы в пуле потоков.
+// Запрос — заголовок ServeRequest с путём программы, квотами и глубиной
+// стеков, за ним путь и окружение клиента (строки с завершающим нулём);
+// вместе с заголовком клиент передаёт (SCM_RIGHTS) свои дескрипторы 0, 1 и
+// 2 и дескриптор текущего каталога. Исполнитель читает stdin клиента и
+// пишет в его stdout и stderr сам, без пересылки данных через сокет,
+// относительные пути гостя разрешает от каталога клиента, а ENV_LIST видит
+// окружение клиента. По завершении демон отвечает ServeReply с кодом
+// возврата. Вывод клиента совпадает с выводом AirVM <program.bin>.
+
+#define SERVE_MAGIC 0x53524941u     // "AIRS"
+#define SERVE_SOCKET_ENV "AIRVM_SOCKET"
+#define SERVE_CACHE_SIZE 32         // Число программ, которые держит демон
+#define SERVE_MAX_PATH 4096
+#define SERVE_MAX_ENV (1u << 20)    // Наибольший размер окружения клиента, байт
+#define SERVE_FDS 4                 // stdin, stdout, stderr и текущий каталог
+
+typedef struct {
+    uint32_t magic;
+    uint32_t path_len;              // Длина пути программы; путь следует за заголовком
+    uint32_t env_len;               // Размер окружения; следует за путём
+    uint32_t stack_size;            // Глубина стека данных, 0 — по умолчанию
+    uint32_t call_depth;            // Глубина стека возвратов, 0 — по умолчанию
+    uint64_t limits[MET_COUNTERS];  // Квоты, 0 — без предела
+} ServeRequest;
+
+typedef struct {
+    uint32_t magic;
+    int32_t status;                 // Код завершения программы
+} ServeReply;
+
+typedef struct {
+    const char *socket_path;
+    unsigned workers;               // Число исполнителей, 0 — по числу процессоров
+    LoadOptions load;
+    uint64_t limits[MET_COUNTERS];  // Квоты демона: запрос может их только уменьшить
+} ServeOptions;
+
+// Путь сокета по умолчанию: $AIRVM_SOCKET или /tmp/airvm-<uid>.sock
+void serve_default_socket(char *buf, size_t len);
+
+// Запуск демона. Возвращает управление при ошибке запуска (1) или после
+// SIGINT/SIGTERM (0).
+int vm_serve(const ServeOptions *opts);
+
+// Исполнение программы демоном с дескрипторами 0-2, текущим каталогом и
+// окружением вызывающего процесса.
+// program — абсолютный путь. Возвращает код завершения программы или -1
+// (с сообщением), если демон недоступен или соединение оборвалось.
+int serve_run(const char *socket_path, const ServeRequest *req, const char *program);
+
+#endif // SERVE_H
@@ -0,0 +1,41 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+// Потоковый режим (--stream): программа исполняется для каждой записи
+// входа, как программа awk, без перезапуска VM.
+//
+// Запись — строка stdin (без '\n') или блок из record_size байт. Перед
+// каждой записью регистры, стеки и флаги возвращаются к состоянию входа,
+// а память сохраняется, так что программа может накапливать состояние.
+// Запись копируется в блок кучи гостя и завершается нулём:
+//   R0 — адрес записи, R1 — её длина, R2 — номер записи у этой VM (с 1),
+//   R3 — номер VM (с 1; 0 — без --stream-jobs).
+// Программа работает до HALT (или до конца кода), после чего блок записи
+// освобождается. Блоком владеет VM: FREE и REALLOC этого адреса, а также
+// ARENA_RESET и RESTORE, которые заменили бы кучу, останавливают программу
+// с ошибкой. После последней записи программа исполняется ещё раз с
+// R0 = 0, R1 = 0 и числом записей в R2 — для итогов.
+//
+// Вход читается крупными блоками, обычный файл отображается в память.
+// Весь stdin отдаётся записям, поэтому stdin гостя (INPUT, чтение
+// дескриптора 0) на время работы пуст.
+// С jobs > 1 вход делится на jobs участков по границам записей, каждый
+// участок обрабатывает свой клон VM (vm_clone) в отдельном потоке хоста, а
+// вывод клонов собирается в порядке участков. Клоны не видят памяти друг
+// друга, поэтому так можно запускать программы, не связывающие записи.
+
+typedef struct {
+    uint32_t record_size;     // 0 — записи-строки
+    uint32_t jobs;            // Число VM, 0 или 1 — одна VM
+    void (*run)(VM *vm);      // Исполнение программы (NULL — vm_run)
+} StreamOptions;
+
+// Исполнение загруженной программы над stdin VM. Возвращает 0 или 1, если
+// программа остановилась с ошибкой (сообщение уже выведено).
+int vm_stream_run(VM *vm, const StreamOptions *opts);
+
+#endif // STREAM_H
@@ -0,0 +1,68 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "vm.h"
+
+// Потоки гостя.
+//
+// THREAD_START запускает поток хоста, исполняющий код гостя над той же памятью
+// vm->memory. Каждый поток — копия структуры VM со своими регистрами и стеками;
+// таблица символов, карта инструкций и функции NCALL общие (только чтение).
+//
+// Общее состояние хоста (таблица файлов, каталоги, буфер ввода, журнал
+// записи/воспроизведения, stdout) защищено io_lock: после запуска первого
+// потока все VM группы исполняют инструкции ввода-вывода через обёртку,
+// захватывающую эту блокировку. Рост памяти сериализуется mem_lock, новый
+// размер публикуется во все VM группы до снятия блокировки, поэтому поток,
+// увидевший данные другого потока через атомарную операцию, видит и
+// выросшую память.
+
+#define MAX_THREADS 1024   // Предел одновременно запущенных потоков гостя
+#define FUTEX_POLL_NS 100000000  // Наибольший сон FUTEX_WAIT без пробуждения (100 мс)
+
+typedef struct VMThread {
+    pthread_t handle;
+    int joining;                    // THREAD_JOIN уже ожидает этот поток
+    VM vm;
+} VMThread;
+
+typedef struct ThreadGroup {
+    VM *root;                       // Исходная VM: владеет памятью и ресурсами хоста
+    pthread_mutex_t io_lock;        // Инструкции, обращающиеся к ресурсам хоста
+    pthread_mutex_t mem_lock;       // Рост памяти и список потоков
+    pthread_cond_t exited;          // Сигнал о присоединении очередного потока
+    VMThread **threads;             // Индекс + 1 — идентификатор потока, NULL — уже присоединён
+    uint32_t thread_count;          // Число занимавшихся слотов (не больше MAX_THREADS)
+    uint32_t thread_capacity;
+    uint32_t *free_ids;             // Идентификаторы присоединённых потоков для повторной выдачи
+    uint32_t free_id_count;
+    uint32_t live;                  // Число неприсоединённых потоков
+    instruction_fn base[256];       // Обработчики без блокировки
+    instruction_fn dispatch[256];   // Таблица группы: ввод-вывод через io_lock
+} ThreadGroup;
+
+// Рост памяти при запущенных потоках (вызывается из ensure_memory)
+void thread_ensure_memory(VM *vm, uint32_t required);
+
+// Остановка всех VM группы (превышение общей квоты)
+void thread_group_stop(VM *vm);
+
+// Ожидание всех потоков и освобождение группы (вызывается для исходной VM)
+void thread_join_all(VM *vm);
+void thread_group_free(VM *vm);
+
+// Обработчики инструкций
+void op_thread_start(VM *vm);
+void op_thread_join(VM *vm);
+void op_cas(VM *vm);
+void op_xadd(VM *vm);
+void op_xchg(VM *vm);
+void op_fence_acq(VM *vm);
+void op_fence_rel(VM *vm);
+void op_futex_wait(VM *vm);
+void op_futex_wake(VM *vm);
+
+#endif // THREADS_H
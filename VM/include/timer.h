@@ -0,0 +1,34 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#include "vm.h"
+
+// Время и ожидание событий (SLEEP_US, CLOCK_NS, EVENT_WAIT).
+//
+// Гость, ждущий таймера или ввода, не крутит цикл с опросом: SLEEP_US
+// засыпает в clock_nanosleep до абсолютного момента CLOCK_MONOTONIC,
+// EVENT_WAIT — в ppoll на дескрипторах хоста. Сон режется на отрезки не
+// длиннее TIMER_SLICE_NS, чтобы остановленная VM (квота, остановка группы
+// потоков, отладчик) не досыпала весь срок.
+//
+// Данные, уже лежащие в буфере ВМ (stdin) или stdio (файлы), считаются
+// готовыми: ppoll о них не знает, а READ вернёт их без ожидания.
+//
+// CLOCK_NS и результат EVENT_WAIT пишутся в журнал записи; при
+// воспроизведении значения берутся из журнала, а SLEEP_US и EVENT_WAIT не
+// ждут вовсе.
+
+#define TIMER_SLICE_NS 100000000ull   // Наибольший непрерывный сон (100 мс)
+#define TIMER_INFINITE UINT32_MAX     // Тайм-аут EVENT_WAIT без предела
+#define EVENT_WAIT_MAX 1024           // Наибольшее число дескрипторов в EVENT_WAIT
+
+// Монотонное время хоста в наносекундах
+uint64_t timer_now_ns(void);
+
+void op_sleep_us(VM *vm);
+void op_clock_ns(VM *vm);
+void op_event_wait(VM *vm);
+
+#endif // TIMER_H
@@ -0,0 +1,245 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "files.h"
+
+// Константы
+#define INIT_MEM_SIZE 655365    // Начальный размер памяти (64 КБ)
+#define STACK_SIZE 65536        // Глубина стека данных по умолчанию (в словах)
+#define CALL_STACK_SIZE 65536   // Глубина стека возвратов по умолчанию
+#define MAX_STACK_SIZE (1u << 26)  // Предел глубины стеков, задаваемой при запуске
+#define NUM_REGS 32             // 32 регистра (R0-R31)
+#define MAX_STR_LEN 1024        // Максимальная длина строки
+#define MEM_RESERVE_SIZE ((size_t)1 << 32)  // Резерв адресного пространства под память гостя
+
+// Опкоды
+typedef enum {
+    OP_NOP = 0x00,
+    OP_HALT = 0x01,
+    OP_JUMP = 0x02,
+    OP_CALL = 0x03,
+    OP_RET = 0x04,
+    OP_IF = 0x05,
+    OP_ENTER = 0x06,
+    OP_LEAVE = 0x07,
+    OP_SWITCH = 0x08,   // Переход по таблице: SWITCH reg, table, count, default
+    OP_JUMPR = 0x09,    // Переход по адресу из регистра
+    OP_CALLR = 0x0A,    // Вызов по адресу из регистра
+    OP_LOAD = 0x10,
+    OP_STORE = 0x11,
+    OP_MOVE = 0x12,
+    OP_PUSH = 0x13,
+    OP_POP = 0x14,
+    OP_LOADI = 0x15,
+    OP_LOADL = 0x16,
+    OP_STOREL = 0x17,
+    OP_PUSHM = 0x18,
+    OP_POPM = 0x19,
+    OP_ADD = 0x20,
+    OP_SUB = 0x21,
+    OP_MUL = 0x22,
+    OP_DIV = 0x23,
+    OP_AND = 0x24,
+    OP_OR = 0x25,
+    OP_XOR = 0x26,
+    OP_NOT = 0x27,
+    OP_CMP = 0x28,
+    OP_POPCNT = 0x29,
+    OP_CLZ = 0x2A,
+    OP_CTZ = 0x2B,
+    OP_BSWAP = 0x2C,
+    OP_ROL = 0x2D,
+    OP_ROR = 0x2E,
+    OP_SAR = 0x2F,
+    OP_FS_LIST = 0x34,
+    OP_DIR_OPEN = 0x35,
+    OP_DIR_NEXT = 0x36,
+    OP_DIR_CLOSE = 0x37,
+    OP_ENV_LIST = 0x42,
+    OP_PRINT = 0x50,
+    OP_INPUT = 0x51,
+    OP_PRINTS = 0x52,
+    OP_READINTS = 0x53,
+    OP_WRITEINTS = 0x54,
+    OP_READLINE = 0x55,
+    OP_SHL = 0x30,
+    OP_SHR = 0x31,
+    OP_BREAK = 0x32,
+    OP_SHLV = 0x38,
+    OP_SHRV = 0x39,
+    OP_SARV = 0x3A,
+    OP_MULW = 0x3B,
+    OP_SNAPSHOT = 0x60,
+    OP_RESTORE = 0x61,
+    OP_CHECKPOINT = 0x62,
+    OP_FILE_OPEN = 0x70,
+    OP_FILE_READ = 0x71,
+    OP_FILE_WRITE = 0x72,
+    OP_FILE_CLOSE = 0x73,
+    OP_FILE_SEEK = 0x74,
+    OP_FILE_PREAD = 0x75,
+    OP_FILE_PWRITE = 0x76,
+    OP_FILE_SYNC = 0x77,
+    OP_FILE_BUFFER = 0x78,
+    OP_FILE_SEEK64 = 0x79,
+    OP_NCALL = 0x80,
+    OP_CRC32C = 0x90,
+    OP_HASH64 = 0x91,
+    OP_SORT = 0x92,
+    OP_BSEARCH = 0x93,
+    OP_COUNTEQ = 0x94,
+    OP_THREAD_START = 0xA0,
+    OP_THREAD_JOIN = 0xA1,
+    OP_CAS = 0xA2,
+    OP_XADD = 0xA3,
+    OP_XCHG = 0xA4,
+    OP_FENCE_ACQ = 0xA5,
+    OP_FENCE_REL = 0xA6,
+    OP_FUTEX_WAIT = 0xA7,
+    OP_FUTEX_WAKE = 0xA8,
+    OP_ALLOC = 0xB0,
+    OP_FREE = 0xB1,
+    OP_REALLOC = 0xB2,
+    OP_ARENA_RESET = 0xB3,
+    OP_HEAP_STATS = 0xB4,
+    OP_MAP_NEW = 0xC0,
+    OP_MAP_PUT = 0xC1,
+    OP_MAP_GET = 0xC2,
+    OP_MAP_DEL = 0xC3,
+    OP_MAP_ITER = 0xC4,
+    OP_MAP_SNEW = 0xC5,
+    OP_MAP_SPUT = 0xC6,
+    OP_MAP_SGET = 0xC7,
+    OP_MAP_SDEL = 0xC8,
+    OP_MAP_FREE = 0xC9,
+    OP_SLEEP_US = 0xD0,
+    OP_CLOCK_NS = 0xD1,
+    OP_EVENT_WAIT = 0xD2,
+    OP_CHAN_OPEN = 0xD8,
+    OP_CHAN_SEND = 0xD9,
+    OP_CHAN_RECV = 0xDA,
+    OP_TRAP = 0xFD          // Точка останова отладчика (в программах не встречается)
+} Opcode;
+
+struct Replay;
+struct NativeEntry;
+struct InputBuffer;
+struct ThreadGroup;
+struct Debugger;
+struct Metrics;
+struct PipelineStage;
+struct VM;
+
+// Тип функции-инструкции
+typedef void (*instruction_fn)(struct VM *);
+
+// Вид символа в таблице символов программы
+typedef enum {
+    SYM_CODE = 0,   // Метка инструкции
+    SYM_DATA = 1    // Метка данных
+} SymbolKind;
+
+typedef struct {
+    uint32_t addr;
+    uint8_t kind;   // SymbolKind
+    char *name;
+} Symbol;
+
+// Соответствие адреса инструкции строке исходного текста
+typedef struct {
+    uint32_t addr;
+    uint32_t line;
+} LineEntry;
+
+typedef struct VM {
+    uint8_t *memory;         // Память для кода и данных (зарезервированный участок)
+    uint32_t memory_size;    // Текущий размер памяти
+    size_t memory_reserved;  // Размер зарезервированного адресного пространства
+    uint32_t program_size;   // Размер секции кода
+    uint32_t image_size;     // Конец образа программы (код, данные, BSS); за ним — куча
+    uint32_t heap_pinned;    // Блок кучи, который гость не может освободить (запись --stream), 0 — нет
+    uint32_t registers[NUM_REGS];  // Регистры R0-R31
+    uint32_t *stack;               // Стек данных (PUSH/POP и кадры ENTER/LEAVE)
+    uint32_t stack_size;           // Глубина стека данных
+    uint32_t sp;                   // Указатель стека
+    uint32_t fp;                   // Указатель кадра: индекс первой локальной переменной
+    uint32_t *rstack;              // Стек адресов возврата (CALL/RET)
+    uint32_t rstack_size;          // Глубина стека возвратов
+    uint32_t rsp;                  // Указатель стека возвратов
+    uint32_t ip;                   // Указатель инструкций
+    uint8_t flags;                 // Флаги: 0x01: EQ, 0x02: NE, 0x04: LT, 0x08: GT (GE)
+    int running;                   // Флаг выполнения
+    int failed;                    // Исполнение остановлено ошибкой (vm_error)
+    int debug;                     // Режим отладки
+    FILE *in;                      // Стандартные потоки гостя: потоки процесса
+    FILE *out;                     // или запроса демона (vm_set_streams)
+    FILE *err;
+    FileTable files;               // Таблица открытых файлов
+    int cwd_fd;                    // Каталог относительных путей гостя (AT_FDCWD — текущий)
+    char **env;                    // Окружение для ENV_LIST (NULL — окружение процесса)
+    void **dirs;                   // Открытые каталоги (DIR *), индекс — дескриптор
+    uint32_t dir_capacity;
+    struct Replay *replay;         // Журнал записи/воспроизведения (NULL — выключен)
+    const uint8_t *insn_map;       // Битовая карта начал проверенных инструкций (1 бит на байт кода)
+    void *insn_map_mapping;        // Отображение записи кеша, содержащей карту (NULL — карта в куче)
+    size_t insn_map_mapping_size;  // Размер отображения
+    Symbol *symbols;               // Таблица символов (из секции SYMTAB, может отсутствовать)
+    uint32_t symbol_count;
+    LineEntry *lines;              // Таблица строк (из секции LINES, может отсутствовать)
+    uint32_t line_count;
+    struct InputBuffer *input;     // Буфер stdin (создаётся при первом чтении)
+    struct NativeEntry *natives;   // Функции хоста для NCALL, индекс — идентификатор
+    uint32_t native_count;
+    struct ThreadGroup *threads;   // Группа потоков гостя (NULL — потоков не запускалось)
+    const instruction_fn *dispatch;  // Таблица обработчиков, по которой исполняется VM
+    struct Debugger *debugger;     // Подключённый отладчик GDB (NULL — нет)
+    struct Metrics *metrics;       // Метрики и учёт ресурсов для квот (NULL — выключены)
+    struct PipelineStage *stage;   // Стадия конвейера, владеющая каналами CHAN_* (NULL — вне конвейера)
+    uint32_t block_start;          // Начало текущего базового блока (для метрик)
+    uint64_t insn_pending;         // Инструкции потока, ещё не добавленные в счётчик
+    int stop_at_checkpoint;        // CHECKPOINT останавливает VM (шаблон для клонов)
+    int checkpoint_reg;            // Регистр CHECKPOINT, на которой VM остановилась (-1 — нет)
+    int template_fd;               // Снимок памяти шаблона для vm_clone (-1 — нет)
+} VM;
+
+// Память и ошибки
+size_t vm_page_size(void);
+void ensure_memory(VM *vm, uint32_t required);
+int vm_grow_memory(VM *vm, uint32_t required);
+void vm_memory_error(VM *vm, VM *root, uint32_t required);
+void vm_error(VM *vm, const char *message);
+void vm_errorf(VM *vm, const char *format, ...);
+
+// Чтение операндов
+uint32_t read_uint32(VM *vm);
+uint32_t read_uint32_at(VM *vm, uint32_t addr);
+void write_uint32(VM *vm, uint32_t offset, uint32_t value);
+uint8_t read_byte(VM *vm);
+uint32_t read_addr_operand(VM *vm);
+
+// Адресный операнд с регистром: маркер ADDR_MARKER, затем байт
+// (режим << ADDR_MODE_SHIFT) | регистр базы. Абсолютный адрес — 4 байта без
+// маркера.
+#define ADDR_MARKER 0xFF
+#define ADDR_MODE_SHIFT 5
+#define ADDR_REG_MASK 0x1F
+#define ADDR_MODE_REG 0         // [Rn]
+#define ADDR_MODE_OFFSET 1      // [Rn + imm]: далее 4 байта смещения
+#define ADDR_MODE_INDEX 2       // [Rn + Rm*scale]: далее байт (log2(scale) << 5) | Rm
+#define ADDR_MAX_SCALE_SHIFT 3  // Масштаб индекса: 1, 2, 4 или 8
+
+// Жизненный цикл и исполнение
+void vm_init(VM *vm);
+void vm_free(VM *vm);
+int vm_set_stack_size(VM *vm, uint32_t data_size, uint32_t call_size);
+void vm_set_streams(VM *vm, FILE *in, FILE *out, FILE *err);
+void vm_set_host_context(VM *vm, int cwd_fd, char **env);
+void vm_print_debug_state(VM *vm);
+void init_dispatch_table(instruction_fn table[256]);
+void vm_run(VM *vm);
+
+#endif // VM_H
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "vm.h"
+#include "bulkio.h"
+#include "native.h"
+#include "replay.h"
+#include "metrics.h"
+
+static InputBuffer *input_buffer(VM *vm) {
+    if (!vm->input) {
+        InputBuffer *b = calloc(1, sizeof(InputBuffer));
+        if (b && !(b->data = malloc(INPUT_BUFFER_SIZE))) {
+            free(b);
+            b = NULL;
+        }
+        if (!b) {
+            vm_error(vm, "Failed to allocate input buffer");
+            return NULL;
+        }
+        b->fd = fileno(vm->in);
+        b->metrics = vm->metrics;
+        vm->input = b;
+    }
+    return vm->input;
+}
+
+// Дочитывает данные из stdin гостя. read() возвращает то, что уже доступно,
+// поэтому интерактивный ввод не ждёт заполнения всего буфера.
+static int refill(InputBuffer *b) {
+    if (b->eof)
+        return 0;
+    ssize_t n;
+    do {
+        n = read(b->fd, b->data, INPUT_BUFFER_SIZE);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        b->eof = 1;
+        return 0;
+    }
+    b->pos = 0;
+    b->len = (uint32_t)n;
+    if (b->metrics)
+        __atomic_fetch_add(&b->metrics->page->counters[MET_BYTES_READ], (uint64_t)n, __ATOMIC_RELAXED);
+    return 1;
+}
+
+static inline int peek(InputBuffer *b) {
+    if (b->pos == b->len && !refill(b))
+        return -1;
+    return b->data[b->pos];
+}
+
+static inline int is_space(int c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Разбор [+-]цифры; переполнение отбрасывает старшие биты, как при приведении к uint32
+static int parse_int(InputBuffer *b, uint32_t *value) {
+    int c;
+    while ((c = peek(b)) >= 0 && is_space(c))
+        b->pos++;
+    int negative = 0;
+    if (c == '-' || c == '+') {
+        negative = c == '-';
+        b->pos++;
+        c = peek(b);
+    }
+    if (c < '0' || c > '9')
+        return 0;
+    uint32_t v = 0;
+    for (;;) {
+        // Цифры внутри буфера разбираются без повторных проверок границ
+        const uint8_t *p = b->data + b->pos;
+        const uint8_t *end = b->data + b->len;
+        while (p < end && *p >= '0' && *p <= '9')
+            v = v * 10 + (uint32_t)(*p++ - '0');
+        b->pos = (uint32_t)(p - b->data);
+        if (p < end || !refill(b))
+            break;
+    }
+    *value = negative ? 0u - v : v;
+    return 1;
+}
+
+int input_read_int(VM *vm, uint32_t *value) {
+    InputBuffer *b = input_buffer(vm);
+    return b ? parse_int(b, value) : 0;
+}
+
+uint32_t input_read_bytes(VM *vm, uint8_t *dst, uint32_t max) {
+    InputBuffer *b = input_buffer(vm);
+    uint32_t total = 0;
+    while (b && total < max && peek(b) >= 0) {
+        uint32_t n = b->len - b->pos;
+        if (n > max - total)
+            n = max - total;
+        memcpy(dst + total, b->data + b->pos, n);
+        b->pos += n;
+        total += n;
+    }
+    return total;
+}
+
+void input_buffer_free(VM *vm) {
+    if (vm->input) {
+        free(vm->input->data);
+        free(vm->input);
+        vm->input = NULL;
+    }
+}
+
+static int read_regs3(VM *vm, uint8_t *r, const char *op) {
+    for (int i = 0; i < 3; i++)
+        r[i] = read_byte(vm);
+    if (r[0] >= NUM_REGS || r[1] >= NUM_REGS || r[2] >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register in %s", op);
+        return -1;
+    }
+    return vm->running ? 0 : -1;
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// READINTS Ra, Rmax, Rd: читает до Rmax чисел в массив слов по адресу Ra.
+// Останавливается в конце ввода или на первом символе, не начинающем число.
+// Rd — число прочитанных значений.
+void op_readints(VM *vm) {
+    uint8_t r[3];
+    if (read_regs3(vm, r, "READINTS") != 0)
+        return;
+    uint32_t max = vm->registers[r[1]];
+    if ((uint64_t)max * 4 > UINT32_MAX) {
+        vm_error(vm, "Array too large in READINTS");
+        return;
+    }
+    uint8_t *dst = vm_guest_ptr(vm, vm->registers[r[0]], max * 4, 1);
+    if (!dst)
+        return;
+    uint32_t count = 0;
+    if (vm_replaying(vm)) {
+        uint32_t len;
+        const uint8_t *p = replay_take(vm, EV_READINTS, &len);
+        if (!p)
+            return;
+        if (len % 4 != 0 || len / 4 > max) {
+            vm_error(vm, "Corrupted replay event in READINTS");
+            return;
+        }
+        memcpy(dst, p, len);
+        count = len / 4;
+    } else {
+        InputBuffer *b = input_buffer(vm);
+        if (!b)
+            return;
+        uint32_t v;
+        while (count < max && parse_int(b, &v))
+            put_le32(dst + (size_t)count++ * 4, v);
+        if (vm_recording(vm))
+            replay_put(vm->replay, EV_READINTS, dst, count * 4);
+    }
+    vm->registers[r[2]] = count;
+}
+
+// Форматирование знакового числа; возвращает число записанных байт
+static int format_int(char *out, int32_t value) {
+    char tmp[12];
+    int n = 0;
+    uint32_t v = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    int len = 0;
+    if (value < 0)
+        out[len++] = '-';
+    while (n)
+        out[len++] = tmp[--n];
+    return len;
+}
+
+// WRITEINTS Ra, Rn, Rsep: выводит Rn слов массива как знаковые числа,
+// после каждого — байт-разделитель Rsep (например, 10 — перевод строки).
+void op_writeints(VM *vm) {
+    uint8_t r[3];
+    if (read_regs3(vm, r, "WRITEINTS") != 0)
+        return;
+    uint32_t n = vm->registers[r[1]];
+    char sep = (char)(vm->registers[r[2]] & 0xFF);
+    if ((uint64_t)n * 4 > UINT32_MAX) {
+        vm_error(vm, "Array too large in WRITEINTS");
+        return;
+    }
+    const uint8_t *src = vm_guest_ptr(vm, vm->registers[r[0]], n * 4, 0);
+    if (!src)
+        return;
+    char chunk[OUTPUT_CHUNK_SIZE];
+    size_t used = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (used > sizeof(chunk) - 16) {
+            fwrite(chunk, 1, used, vm->out);
+            metrics_add(vm, MET_BYTES_WRITTEN, used);
+            if (!vm->running)
+                return;
+            used = 0;
+        }
+        used += (size_t)format_int(chunk + used, (int32_t)get_le32(src + (size_t)i * 4));
+        chunk[used++] = sep;
+    }
+    if (used) {
+        fwrite(chunk, 1, used, vm->out);
+        metrics_add(vm, MET_BYTES_WRITTEN, used);
+    }
+}
+
+// READLINE Ra, Rmax, Rd: читает строку (без '\n') в буфер Ra размером Rmax
+// байт с завершающим нулём. Rd — длина или 0xFFFFFFFF в конце ввода.
+// Если строка длиннее Rmax-1, остаток достаётся следующему READLINE.
+void op_readline(VM *vm) {
+    uint8_t r[3];
+    if (read_regs3(vm, r, "READLINE") != 0)
+        return;
+    uint32_t max = vm->registers[r[1]];
+    if (max == 0) {
+        vm_error(vm, "Buffer size must be positive in READLINE");
+        return;
+    }
+    uint8_t *dst = vm_guest_ptr(vm, vm->registers[r[0]], max, 1);
+    if (!dst)
+        return;
+    uint32_t len = 0;
+    int at_eof = 0;
+    if (vm_replaying(vm)) {
+        uint32_t rec_len;
+        const uint8_t *p = replay_take(vm, EV_READLINE, &rec_len);
+        if (!p)
+            return;
+        if (rec_len == 0 || rec_len - 1 > max - 1) {
+            vm_error(vm, "Corrupted replay event in READLINE");
+            return;
+        }
+        at_eof = p[0];
+        len = rec_len - 1;
+        memcpy(dst, p + 1, len);
+    } else {
+        InputBuffer *b = input_buffer(vm);
+        if (!b)
+            return;
+        if (peek(b) < 0) {
+            at_eof = 1;
+        } else {
+            while (len < max - 1) {
+                if (peek(b) < 0)
+                    break;
+                uint32_t avail = b->len - b->pos;
+                if (avail > max - 1 - len)
+                    avail = max - 1 - len;
+                const uint8_t *start = b->data + b->pos;
+                const uint8_t *nl = memchr(start, '\n', avail);
+                uint32_t take = nl ? (uint32_t)(nl - start) : avail;
+                memcpy(dst + len, start, take);
+                len += take;
+                b->pos += take;
+                if (nl) {
+                    b->pos++;  // перевод строки не сохраняется
+                    break;
+                }
+            }
+        }
+        if (vm_recording(vm)) {
+            uint8_t *rec = malloc((size_t)len + 1);
+            if (!rec) {
+                vm_error(vm, "Failed to allocate replay record in READLINE");
+                return;
+            }
+            rec[0] = (uint8_t)at_eof;
+            memcpy(rec + 1, dst, len);
+            replay_put(vm->replay, EV_READLINE, rec, len + 1);
+            free(rec);
+        }
+    }
+    dst[len] = '\0';
+    vm->registers[r[2]] = at_eof ? UINT32_MAX : len;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "decode.h"
+#include "hash.h"
+
+#define CACHE_CHECKSUM_SEED 0x41495243ULL
+
+// Файл записи: CacheHeader, код программы, битовая карта начал инструкций.
+
+// Отпечаток правил проверки: формат и переходы всех опкодов из op_info
+// и версия остальных правил vm_verify
+static uint64_t cache_verifier(void) {
+    uint64_t h = air_hash64("AIRV", 4, VERIFY_RULES_VERSION);
+    for (int op = 0; op < 256; op++) {
+        const OpInfo *info = &op_info[op];
+        if (!info->name)
+            continue;
+        uint8_t rec[2 + MAX_OPERANDS];
+        rec[0] = (uint8_t)op;
+        rec[1] = info->flow;
+        memcpy(rec + 2, info->operands, MAX_OPERANDS);
+        h = air_hash64(rec, sizeof(rec), h);
+        h = air_hash64(info->name, strlen(info->name), h);
+    }
+    return h;
+}
+
+static void cache_path(char *buf, size_t len, const char *dir, uint64_t key) {
+    snprintf(buf, len, "%s/%016llx.airc", dir, (unsigned long long)key);
+}
+
+int cache_lookup(const char *dir, uint64_t key, const uint8_t *code, uint32_t size,
+                 uint32_t entry, CacheEntry *out) {
+    char path[4096];
+    cache_path(path, sizeof(path), dir, key);
+    memset(out, 0, sizeof(*out));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    size_t map_bytes = insn_map_bytes(size);
+    size_t expected = sizeof(CacheHeader) + size + map_bytes;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != expected) {
+        close(fd);
+        goto stale;
+    }
+    void *base = mmap(NULL, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return 0;
+
+    const CacheHeader *h = (const CacheHeader *)base;
+    const uint8_t *cached_code = (const uint8_t *)base + sizeof(CacheHeader);
+    const uint8_t *map = cached_code + size;
+    // Запись действительна, только если она построена этой версией ВМ
+    // по тем же правилам проверки для тех же байт кода и той же точки
+    // входа, и карта не повреждена.
+    if (memcmp(h->magic, CACHE_MAGIC, 4) != 0 || h->version != CACHE_VERSION ||
+        h->verifier != cache_verifier() ||
+        h->key != key || h->code_size != size || h->entry != entry ||
+        memcmp(cached_code, code, size) != 0 ||
+        air_hash64(map, map_bytes, CACHE_CHECKSUM_SEED) != h->checksum) {
+        munmap(base, expected);
+        goto stale;
+    }
+    out->base = base;
+    out->length = expected;
+    out->insn_map = map;
+    return 1;
+
+stale:
+    unlink(path);
+    return 0;
+}
+
+int cache_store(const char *dir, uint64_t key, const uint8_t *code, uint32_t size,
+                uint32_t entry, const uint8_t *insn_map) {
+    char path[4096], tmp[4096];
+    cache_path(path, sizeof(path), dir, key);
+    snprintf(tmp, sizeof(tmp), "%s/.%016llx.%ld.tmp", dir, (unsigned long long)key, (long)getpid());
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return -1;
+    FILE *f = fopen(tmp, "wb");
+    if (!f)
+        return -1;
+    size_t map_bytes = insn_map_bytes(size);
+    CacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CACHE_MAGIC, 4);
+    h.version = CACHE_VERSION;
+    h.key = key;
+    h.code_size = size;
+    h.entry = entry;
+    h.checksum = air_hash64(insn_map, map_bytes, CACHE_CHECKSUM_SEED);
+    h.verifier = cache_verifier();
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(code, 1, size, f) == size &&
+             fwrite(insn_map, 1, map_bytes, f) == map_bytes;
+    if (fclose(f) != 0)
+        ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void cache_release(CacheEntry *e) {
+    if (e->base)
+        munmap(e->base, e->length);
+    memset(e, 0, sizeof(*e));
+}
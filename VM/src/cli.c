@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "vm.h"
+#include "replay.h"
+#include "loader.h"
+#include "native.h"
+#include "cli.h"
+#include "debugger.h"
+#include "metrics.h"
+#include "bulkio.h"
+#include "clone.h"
+#include "serve.h"
+#include "stream.h"
+#include "pipeline.h"
+
+static void print_usage(const char *prog, int embedded) {
+    printf(embedded ? "Usage: %s [options]\n" : "Usage: %s [options] <program.bin>\n", prog);
+    printf("Options:\n");
+    printf("  --record <file>   Record all external inputs of the run to <file>\n");
+    printf("  --replay <file>   Replay external inputs from <file> instead of the host\n");
+    printf("  --cache-dir <dir> Cache verified programs in <dir> (default: $AIRVM_CACHE_DIR)\n");
+    printf("  --stack <n>       Data stack depth in words (default: %u)\n", STACK_SIZE);
+    printf("  --call-depth <n>  Return stack depth (default: %u)\n", CALL_STACK_SIZE);
+    printf("  --gdb <port>      Wait for GDB on 127.0.0.1:<port> (or unix:<path>) and run under it\n");
+    printf("  --metrics         Export live counters to " METRICS_DIR " for airvm-top (or $AIRVM_METRICS=1)\n");
+    printf("  --max-memory <n>  Limit guest memory to <n> bytes (suffixes K, M, G)\n");
+    printf("  --max-files <n>   Limit open files, including stdin/stdout/stderr\n");
+    printf("  --max-instructions <n> Stop the program after <n> instructions\n");
+    printf("  --max-output <n>  Limit bytes written to stdout and files (suffixes K, M, G)\n");
+    printf("  --clones <n>      Run up to CHECKPOINT, then continue in <n> forked copies (Rn = 1..n)\n");
+    printf("  --clone-input <f> Stdin of each copy from file <f>, %%u is replaced by the copy number\n");
+    printf("  --clone-output <f> Stdout of each copy to file <f>, %%u is replaced by the copy number\n");
+    printf("  --stream          Run the program once per stdin line (R0 = address, R1 = length)\n");
+    printf("  --stream-size <n> Run the program once per <n>-byte stdin record\n");
+    printf("  --stream-jobs <n> Split stream input across <n> VM copies running in parallel\n");
+    printf("  --list-natives    Print the native function manifest for the assembler and exit\n");
+    if (!embedded) {
+        printf("  --serve           Run as a daemon executing programs for airvm-run\n");
+        printf("  --socket <path>   Daemon socket (default: $" SERVE_SOCKET_ENV " or /tmp/airvm-<uid>.sock)\n");
+        printf("  --workers <n>     Daemon worker threads (default: number of CPUs)\n");
+        printf("  --pipeline <file> Run the program stages and channels described in <file>\n");
+    }
+}
+
+uint64_t cli_parse_size(const char *s) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 0);
+    int shift = 0;
+    if (*end == 'K' || *end == 'k')
+        shift = 10;
+    else if (*end == 'M' || *end == 'm')
+        shift = 20;
+    else if (*end == 'G' || *end == 'g')
+        shift = 30;
+    if (shift)
+        end++;
+    if (end == s || *end || *s == '-' || n > (UINT64_MAX >> shift))
+        return 0;
+    return (uint64_t)n << shift;
+}
+
+int cli_limit_option(const char *opt, const char *value, uint64_t limits[MET_COUNTERS]) {
+    MetricsCounter c;
+    if (strcmp(opt, "--max-memory") == 0)
+        c = MET_MEMORY_SIZE;
+    else if (strcmp(opt, "--max-files") == 0)
+        c = MET_OPEN_FILES;
+    else if (strcmp(opt, "--max-instructions") == 0)
+        c = MET_INSTRUCTIONS;
+    else if (strcmp(opt, "--max-output") == 0)
+        c = MET_BYTES_WRITTEN;
+    else
+        return 0;
+    if (!value || (limits[c] = cli_parse_size(value)) == 0)
+        return -1;
+    // Память гостя не бывает меньше начальной
+    if (c == MET_MEMORY_SIZE && limits[c] < INIT_MEM_SIZE) {
+        fprintf(stderr, "Error: --max-memory must be at least %u bytes\n", INIT_MEM_SIZE);
+        return -1;
+    }
+    return 1;
+}
+
+// Путь для клона: каждое %u в шаблоне заменяется номером
+static int clone_path(char *buf, size_t len, const char *pattern, uint32_t index) {
+    size_t pos = 0;
+    for (const char *p = pattern; *p; p++) {
+        int n;
+        if (p[0] == '%' && p[1] == 'u') {
+            n = snprintf(buf + pos, len - pos, "%u", index);
+            p++;
+        } else {
+            n = snprintf(buf + pos, len - pos, "%c", *p);
+        }
+        if (n < 0 || (size_t)n >= len - pos)
+            return -1;
+        pos += (size_t)n;
+    }
+    return 0;
+}
+
+// Процесс-клон: продолжение шаблона после CHECKPOINT
+static int run_clone(VM *vm, const CliProgram *embedded, uint32_t index,
+                     const char *input_pattern, const char *output_pattern) {
+    char path[4096];
+    if (input_pattern) {
+        if (clone_path(path, sizeof(path), input_pattern, index) != 0 || !freopen(path, "r", stdin)) {
+            fprintf(stderr, "Error: Cannot open input of clone %u: %s\n", index, path);
+            return 1;
+        }
+        // Буферизованный шаблоном ввод относится к прежнему stdin
+        input_buffer_free(vm);
+    }
+    if (output_pattern &&
+        (clone_path(path, sizeof(path), output_pattern, index) != 0 || !freopen(path, "w", stdout))) {
+        fprintf(stderr, "Error: Cannot open output of clone %u: %s\n", index, path);
+        return 1;
+    }
+    if (metrics_reattach(vm) != 0)
+        return 1;
+    vm_checkpoint_resume(vm, index);
+    if (embedded && embedded->run && !vm->metrics)
+        embedded->run(vm);
+    else
+        vm_run(vm);
+    int status = vm_limit_exceeded(vm) >= 0;
+    vm_free(vm);
+    return status;
+}
+
+// Клоны — процессы fork: память шаблона достаётся им с копированием при
+// записи. Одновременно работает не больше клонов, чем процессоров.
+static int run_clones(VM *vm, const CliProgram *embedded, uint32_t count,
+                      const char *input_pattern, const char *output_pattern) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t jobs = cpus > 0 ? (uint32_t)cpus : 1;
+    uint32_t started = 0, running = 0;
+    int failed = 0;
+    fflush(NULL);
+    while (started < count || running > 0) {
+        if (started < count && running < jobs) {
+            uint32_t index = ++started;
+            pid_t pid = fork();
+            if (pid == 0)
+                exit(run_clone(vm, embedded, index, input_pattern, output_pattern));
+            if (pid < 0) {
+                perror("Error starting clone");
+                failed = 1;
+                started = count;
+            } else {
+                running++;
+            }
+            continue;
+        }
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0)
+            break;
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Error: Clone process %ld failed\n", (long)pid);
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+// Конвейер стадий (--pipeline): время и сводка — как у одиночной программы
+static int run_pipeline(const char *path, const LoadOptions *load_opts, unsigned long stack_size,
+                        unsigned long call_depth, int metrics, const uint64_t limits[MET_COUNTERS]) {
+    if (!isatty(fileno(stdout)))
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    PipelineOptions opts = { *load_opts, stack_size > MAX_STACK_SIZE ? 0 : (uint32_t)stack_size,
+                             call_depth > MAX_STACK_SIZE ? 0 : (uint32_t)call_depth, metrics, { 0 } };
+    memcpy(opts.limits, limits, sizeof(opts.limits));
+    Pipeline p;
+    if (pipeline_load(&p, path, &opts) != 0) {
+        pipeline_free(&p);
+        return 1;
+    }
+    printf("Loaded pipeline of %u stages and %u channels\n", p.stage_count, p.channel_count);
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    int status = pipeline_run(&p);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double elapsed_time = (double)(end_time.tv_sec - start_time.tv_sec) +
+                          (double)(end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    printf("\nExecution time: %.6f seconds\n", elapsed_time);
+    pipeline_print_summary(&p, stdout);
+    pipeline_free(&p);
+    return status;
+}
+
+int vm_cli_main(int argc, char *argv[], const CliProgram *embedded) {
+    const char *program_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *gdb_endpoint = NULL;
+    LoadOptions load_opts = { getenv("AIRVM_CACHE_DIR") };
+    unsigned long stack_size = STACK_SIZE;
+    unsigned long call_depth = CALL_STACK_SIZE;
+    int list_natives = 0;
+    unsigned long clones = 0;
+    const char *clone_input = NULL;
+    const char *clone_output = NULL;
+    const char *metrics_env = getenv("AIRVM_METRICS");
+    int metrics = metrics_env && *metrics_env && strcmp(metrics_env, "0") != 0;
+    uint64_t limits[MET_COUNTERS] = { 0 };
+    int limit;
+    int serve = 0;
+    int stream = 0;
+    StreamOptions stream_opts = { 0, 0, NULL };
+    const char *socket_path = NULL;
+    unsigned long workers = 0;
+    const char *pipeline_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            load_opts.cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--stack") == 0 && i + 1 < argc) {
+            stack_size = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--call-depth") == 0 && i + 1 < argc) {
+            call_depth = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--gdb") == 0 && i + 1 < argc) {
+            gdb_endpoint = argv[++i];
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            metrics = 1;
+        } else if ((limit = cli_limit_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL, limits)) != 0) {
+            if (limit < 0) {
+                print_usage(argv[0], embedded != NULL);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--clones") == 0 && i + 1 < argc) {
+            clones = strtoul(argv[++i], NULL, 0);
+            if (clones == 0 || clones > UINT32_MAX) {
+                print_usage(argv[0], embedded != NULL);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--clone-input") == 0 && i + 1 < argc) {
+            clone_input = argv[++i];
+        } else if (strcmp(argv[i], "--clone-output") == 0 && i + 1 < argc) {
+            clone_output = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream = 1;
+        } else if ((strcmp(argv[i], "--stream-size") == 0 || strcmp(argv[i], "--stream-jobs") == 0) &&
+                   i + 1 < argc) {
+            int record_size = strcmp(argv[i], "--stream-size") == 0;
+            unsigned long n = strtoul(argv[i + 1], NULL, 0);
+            if (n == 0 || n > (record_size ? UINT32_MAX - 1 : 4096)) {
+                print_usage(argv[0], embedded != NULL);
+                return 1;
+            }
+            if (record_size)
+                stream_opts.record_size = (uint32_t)n;
+            else
+                stream_opts.jobs = (uint32_t)n;
+            stream = 1;
+            i++;
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc && !embedded) {
+            pipeline_path = argv[++i];
+        } else if (strcmp(argv[i], "--list-natives") == 0) {
+            list_natives = 1;
+        } else if (strcmp(argv[i], "--serve") == 0 && !embedded) {
+            serve = 1;
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc && !embedded) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc && !embedded) {
+            workers = strtoul(argv[++i], NULL, 0);
+            if (workers == 0 || workers > 4096) {
+                print_usage(argv[0], embedded != NULL);
+                return 1;
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            print_usage(argv[0], embedded != NULL);
+            return 1;
+        } else if (!program_path && !embedded) {
+            program_path = argv[i];
+        } else {
+            print_usage(argv[0], embedded != NULL);
+            return 1;
+        }
+    }
+    if (serve) {
+        // Квоты демона ограничивают каждый запрос, остальное задаёт клиент
+        if (program_path || record_path || replay_path || gdb_endpoint || clones || list_natives ||
+            stream || stack_size != STACK_SIZE || call_depth != CALL_STACK_SIZE) {
+            print_usage(argv[0], 0);
+            return 1;
+        }
+        char default_socket[SERVE_MAX_PATH];
+        ServeOptions opts = { socket_path, (unsigned)workers, load_opts, { 0 } };
+        if (!socket_path) {
+            serve_default_socket(default_socket, sizeof(default_socket));
+            opts.socket_path = default_socket;
+        }
+        memcpy(opts.limits, limits, sizeof(limits));
+        return vm_serve(&opts);
+    }
+    if (socket_path || workers) {
+        print_usage(argv[0], embedded != NULL);
+        return 1;
+    }
+    if (pipeline_path) {
+        if (program_path || record_path || replay_path || gdb_endpoint || clones || stream || list_natives) {
+            fprintf(stderr, "Error: --pipeline cannot be combined with a program, --record, --replay, --gdb, "
+                            "--clones or --stream\n");
+            return 1;
+        }
+        return run_pipeline(pipeline_path, &load_opts, stack_size, call_depth, metrics, limits);
+    }
+    if ((!program_path && !embedded && !list_natives) || (record_path && replay_path) ||
+        ((clone_input || clone_output) && !clones)) {
+        print_usage(argv[0], embedded != NULL);
+        return 1;
+    }
+    if (clones && (record_path || replay_path || gdb_endpoint)) {
+        fprintf(stderr, "Error: --clones cannot be combined with --record, --replay or --gdb\n");
+        return 1;
+    }
+    if (stream && (clones || record_path || replay_path || gdb_endpoint)) {
+        fprintf(stderr, "Error: --stream cannot be combined with --clones, --record, --replay or --gdb\n");
+        return 1;
+    }
+
+    // В конвейере вывод буферизуется крупными блоками
+    if (!isatty(fileno(stdout)))
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+    VM vm;
+    vm_init(&vm);
+    vm_register_builtin_natives(&vm);
+    if (list_natives) {
+        vm_write_native_manifest(&vm, stdout);
+        vm_free(&vm);
+        return 0;
+    }
+    if ((stack_size != STACK_SIZE || call_depth != CALL_STACK_SIZE) &&
+        vm_set_stack_size(&vm, stack_size > MAX_STACK_SIZE ? 0 : (uint32_t)stack_size,
+                          call_depth > MAX_STACK_SIZE ? 0 : (uint32_t)call_depth) != 0) {
+        vm_free(&vm);
+        return 1;
+    }
+
+    if ((embedded ? vm_load_image(&vm, embedded->image, embedded->image_size, &load_opts)
+                  : vm_load_program(&vm, program_path, &load_opts)) != 0) {
+        vm_free(&vm);
+        return 1;
+    }
+    printf("Loaded program of %u bytes\n", vm.program_size);
+
+    // Дальше ошибки идут через out: журнал закрывается вместе с VM
+    int status = 1;
+    Replay replay;
+    if (record_path) {
+        if (replay_open_record(&replay, record_path) != 0)
+            goto out;
+        vm.replay = &replay;
+    } else if (replay_path) {
+        if (replay_open_play(&replay, replay_path) != 0)
+            goto out;
+        vm.replay = &replay;
+    }
+
+    if (gdb_endpoint && debugger_attach(&vm, gdb_endpoint) != 0)
+        goto out;
+    if (metrics && metrics_attach(&vm, embedded ? argv[0] : program_path) != 0)
+        goto out;
+    for (int c = 0; c < MET_COUNTERS; c++) {
+        if (limits[c] && vm_set_limit(&vm, (MetricsCounter)c, limits[c]) != 0)
+            goto out;
+    }
+    vm.stop_at_checkpoint = clones > 0;
+
+    // Время по настенным часам: при потоках гостя процессорное время — сумма по ядрам
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    // Скомпилированный код не знает о точках останова и границах блоков:
+    // под отладчиком, с метриками и квотами — интерпретатор
+    status = 0;
+    if (stream) {
+        if (embedded && !vm.metrics)
+            stream_opts.run = embedded->run;
+        status = vm_stream_run(&vm, &stream_opts);
+    } else if (embedded && embedded->run && !vm.debugger && !vm.metrics) {
+        embedded->run(&vm);
+    } else {
+        vm_run(&vm);
+    }
+    if (clones) {
+        if (vm.checkpoint_reg < 0) {
+            fprintf(stderr, "Error: Program stopped before reaching CHECKPOINT\n");
+            status = 1;
+        } else {
+            status = run_clones(&vm, embedded, (uint32_t)clones, clone_input, clone_output);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double elapsed_time = (double)(end_time.tv_sec - start_time.tv_sec) +
+                          (double)(end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    printf("\nExecution time: %.6f seconds\n", elapsed_time);
+    if (vm.metrics)
+        metrics_print_summary(&vm, stdout);
+    if (vm_limit_exceeded(&vm) >= 0)
+        status = 1;
+
+    if (vm.replay) {
+        if (vm.replay->mode == REPLAY_RECORD)
+            fprintf(stderr, "Recorded %llu events to %s\n", (unsigned long long)replay.events, record_path);
+        else
+            fprintf(stderr, "Replayed %llu events from %s\n", (unsigned long long)replay.events, replay_path);
+    }
+out:
+    if (vm.replay) {
+        replay_close(&replay);
+        vm.replay = NULL;
+    }
+    vm_free(&vm);
+    return status;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "vm.h"
+#include "decode.h"
+#include "native.h"
+#include "bulkio.h"
+#include "threads.h"
+#include "clone.h"
+
+// Инструкция CHECKPOINT reg: точка, с которой продолжают клоны
+void op_checkpoint(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_error(vm, "Invalid register in CHECKPOINT");
+        return;
+    }
+    if (!vm->stop_at_checkpoint) {
+        vm->registers[reg] = 0;
+        return;
+    }
+    ThreadGroup *g = vm->threads;
+    if (g) {
+        pthread_mutex_lock(&g->mem_lock);
+        int busy = g->root != vm || g->live > 0;
+        pthread_mutex_unlock(&g->mem_lock);
+        if (busy) {
+            vm_error(vm, "CHECKPOINT with running guest threads");
+            return;
+        }
+    }
+    vm->checkpoint_reg = reg;
+    vm->running = 0;
+}
+
+void vm_checkpoint_resume(VM *vm, uint32_t index) {
+    if (vm->checkpoint_reg >= 0)
+        vm->registers[vm->checkpoint_reg] = index;
+    vm->checkpoint_reg = -1;
+    vm->stop_at_checkpoint = 0;
+    vm->running = 1;
+}
+
+void vm_template_release(VM *vm) {
+    if (vm->template_fd >= 0)
+        close(vm->template_fd);
+    vm->template_fd = -1;
+}
+
+static size_t committed_bytes(const VM *vm) {
+    size_t page = vm_page_size();
+    return ((size_t)vm->memory_size + page - 1) / page * page;
+}
+
+static int page_is_zero(const uint8_t *p, size_t len) {
+    const uint64_t *w = (const uint64_t *)p;
+    for (size_t i = 0; i < len / sizeof(uint64_t); i++) {
+        if (w[i])
+            return 0;
+    }
+    return 1;
+}
+
+// Снимок памяти шаблона в memfd. Нулевые страницы не записываются и
+// остаются дырами файла. Затем шаблон сам отображает снимок MAP_PRIVATE:
+// его закрытая копия страниц освобождается, а последующие записи шаблона
+// снимок не меняют.
+int vm_template_freeze(VM *vm) {
+    if (vm->template_fd >= 0)
+        return 0;
+    size_t len = committed_bytes(vm);
+    size_t page = vm_page_size();
+    int fd = memfd_create("airvm-template", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("Error creating template memory");
+        return -1;
+    }
+    if (ftruncate(fd, (off_t)len) != 0) {
+        perror("Error sizing template memory");
+        close(fd);
+        return -1;
+    }
+    for (size_t off = 0; off < len; off += page) {
+        if (page_is_zero(vm->memory + off, page))
+            continue;
+        if (pwrite(fd, vm->memory + off, page, (off_t)off) != (ssize_t)page) {
+            perror("Error writing template memory");
+            close(fd);
+            return -1;
+        }
+    }
+    if (mmap(vm->memory, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        perror("Error mapping template memory");
+        close(fd);
+        return -1;
+    }
+    vm->template_fd = fd;
+    return 0;
+}
+
+static int copy_tables(VM *clone, const VM *tmpl) {
+    if (tmpl->insn_map) {
+        size_t bytes = insn_map_bytes(tmpl->program_size);
+        uint8_t *map = malloc(bytes ? bytes : 1);
+        if (!map)
+            return -1;
+        memcpy(map, tmpl->insn_map, bytes);
+        clone->insn_map = map;
+    }
+    if (tmpl->symbol_count) {
+        // Имена лежат в одном блоке с массивом, как после загрузки
+        size_t size = tmpl->symbol_count * sizeof(Symbol);
+        for (uint32_t i = 0; i < tmpl->symbol_count; i++)
+            size += strlen(tmpl->symbols[i].name) + 1;
+        Symbol *syms = malloc(size);
+        if (!syms)
+            return -1;
+        char *name = (char *)(syms + tmpl->symbol_count);
+        for (uint32_t i = 0; i < tmpl->symbol_count; i++) {
+            size_t n = strlen(tmpl->symbols[i].name) + 1;
+            syms[i] = tmpl->symbols[i];
+            syms[i].name = memcpy(name, tmpl->symbols[i].name, n);
+            name += n;
+        }
+        clone->symbols = syms;
+        clone->symbol_count = tmpl->symbol_count;
+    }
+    if (tmpl->line_count) {
+        clone->lines = malloc(tmpl->line_count * sizeof(LineEntry));
+        if (!clone->lines)
+            return -1;
+        memcpy(clone->lines, tmpl->lines, tmpl->line_count * sizeof(LineEntry));
+        clone->line_count = tmpl->line_count;
+    }
+    for (uint32_t i = 0; i < tmpl->native_count; i++) {
+        const NativeEntry *e = &tmpl->natives[i];
+        if (e->fn && vm_register_native(clone, i, e->name, e->fn, e->ctx) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int vm_clone(VM *clone, VM *tmpl, uint32_t index) {
+    if (tmpl->threads && tmpl->threads->live > 0) {
+        fprintf(stderr, "Error: Cannot clone a VM with running guest threads\n");
+        return -1;
+    }
+    if (vm_template_freeze(tmpl) != 0)
+        return -1;
+    vm_init(clone);
+    size_t len = committed_bytes(tmpl);
+    if (len > clone->memory_reserved ||
+        mmap(clone->memory, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, tmpl->template_fd, 0) == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map template memory\n");
+        vm_free(clone);
+        return -1;
+    }
+    clone->memory_size = tmpl->memory_size;
+    if (vm_set_stack_size(clone, tmpl->stack_size, tmpl->rstack_size) != 0) {
+        vm_free(clone);
+        return -1;
+    }
+    memcpy(clone->stack, tmpl->stack, tmpl->sp * sizeof(uint32_t));
+    memcpy(clone->rstack, tmpl->rstack, tmpl->rsp * sizeof(uint32_t));
+    clone->sp = tmpl->sp;
+    clone->fp = tmpl->fp;
+    clone->rsp = tmpl->rsp;
+    memcpy(clone->registers, tmpl->registers, sizeof(clone->registers));
+    clone->ip = tmpl->ip;
+    clone->flags = tmpl->flags;
+    clone->debug = tmpl->debug;
+    clone->program_size = tmpl->program_size;
+    clone->image_size = tmpl->image_size;
+    if (copy_tables(clone, tmpl) != 0) {
+        fprintf(stderr, "Error: Failed to allocate clone tables\n");
+        vm_free(clone);
+        return -1;
+    }
+    clone->checkpoint_reg = tmpl->checkpoint_reg;
+    vm_checkpoint_resume(clone, index);
+    return 0;
+}
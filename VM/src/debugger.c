@@ -0,0 +1,1244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "vm.h"
+#include "decode.h"
+#include "debugger.h"
+
+#define MAX_WATCHES 16
+#define MAX_WATCH_LEN 64
+#define PACKET_SIZE 4096
+// Регистры в протоколе: R0-R31, ip, sp, fp, rsp, flags
+#define DBG_REGS (NUM_REGS + 5)
+
+enum { PENDING_WATCH = 1, PENDING_INTERRUPT = 2 };
+// Типы точек наблюдения совпадают с номерами пакетов Z2/Z3/Z4
+enum { WATCH_WRITE = 2, WATCH_READ = 3, WATCH_ACCESS = 4 };
+enum { COND_CONST, COND_REG, COND_MEM, COND_MEM_REG };
+enum { CMP_EQ, CMP_NE, CMP_LT, CMP_GT, CMP_LE, CMP_GE };
+
+typedef struct {
+    uint32_t addr;
+    uint8_t saved;      // Исходный байт опкода
+} Breakpoint;
+
+typedef struct {
+    uint32_t addr;
+    uint32_t len;
+    uint8_t type;
+    uint8_t old[MAX_WATCH_LEN];  // Значение при последней проверке
+} Watchpoint;
+
+typedef struct {
+    uint8_t kind;
+    uint32_t value;     // Константа, номер регистра или адрес
+} CondOperand;
+
+// Условие точки останова: «левое op правое», сравнение беззнаковое
+typedef struct {
+    uint32_t addr;
+    CondOperand lhs, rhs;
+    uint8_t op;
+} Condition;
+
+struct Debugger {
+    VM *vm;                        // Исходная VM, которую останавливает отладчик
+    int fd;                        // Соединение с GDB (-1 — отключён)
+    char *unix_path;
+    int no_ack;
+    pthread_mutex_t lock;          // Точки останова (их читают потоки гостя)
+    Breakpoint *bps;
+    uint32_t bp_count;
+    uint32_t bp_capacity;
+    Condition *conds;
+    uint32_t cond_count;
+    uint32_t cond_capacity;
+    Watchpoint watches[MAX_WATCHES];
+    uint32_t watch_count;
+    int protected;                 // Наблюдаемые страницы закрыты
+    instruction_fn base[256];      // Обработчики без обёрток
+    instruction_fn table[256];     // Таблица исходной VM под отладчиком
+    instruction_fn hook[256];      // Таблица-ловушка: все опкоды — op_debug_hook
+    const instruction_fn *outer;   // Таблица vm_run до подключения отладчика
+    const instruction_fn *resume;  // Таблица, вытесненная ловушкой
+    volatile int pending;          // PENDING_*, выставляются обработчиками сигналов
+    volatile uint32_t fault_addr;  // Адрес последнего обращения к наблюдаемой странице
+    int stepping;
+    int running;                   // Гость исполняется (SIGIO означает прерывание)
+    char stop_reply[64];
+    char packet[PACKET_SIZE + 1];
+    char rbuf[PACKET_SIZE];
+    size_t rpos, rlen;
+    char *xml;                     // Описание регистров для qXfer:features:read
+    struct sigaction old_segv;
+    struct sigaction old_io;
+};
+
+// Обработчики сигналов находят отладчик через этот указатель
+static Debugger *active_debugger;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static char *put_hex_bytes(char *out, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        *out++ = hex_digits[data[i] >> 4];
+        *out++ = hex_digits[data[i] & 15];
+    }
+    *out = '\0';
+    return out;
+}
+
+// Разбор hex-байтов; возвращает число байт или -1
+static long get_hex_bytes(const char *in, uint8_t *out, size_t max) {
+    size_t n = 0;
+    while (in[0] && in[1] && n < max) {
+        int hi = hex_value(in[0]), lo = hex_value(in[1]);
+        if (hi < 0 || lo < 0)
+            return -1;
+        out[n++] = (uint8_t)(hi << 4 | lo);
+        in += 2;
+    }
+    return (long)n;
+}
+
+static uint32_t get_hex(const char **p) {
+    uint32_t v = 0;
+    int d;
+    while ((d = hex_value(**p)) >= 0) {
+        v = v << 4 | (uint32_t)d;
+        (*p)++;
+    }
+    return v;
+}
+
+// ---------------------------------------------------------------------------
+// Транспорт: пакеты "$данные#сумма"
+// ---------------------------------------------------------------------------
+
+static void disconnect(Debugger *dbg);
+
+static int read_char(Debugger *dbg) {
+    if (dbg->rpos == dbg->rlen) {
+        ssize_t n;
+        do {
+            n = read(dbg->fd, dbg->rbuf, sizeof(dbg->rbuf));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            return -1;
+        dbg->rpos = 0;
+        dbg->rlen = (size_t)n;
+    }
+    return (unsigned char)dbg->rbuf[dbg->rpos++];
+}
+
+static int send_raw(Debugger *dbg, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(dbg->fd, data, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_packet(Debugger *dbg, const char *payload) {
+    if (dbg->fd < 0)
+        return -1;
+    size_t len = strlen(payload);
+    char *frame = malloc(len + 5);
+    if (!frame)
+        return -1;
+    uint8_t sum = 0;
+    frame[0] = '$';
+    for (size_t i = 0; i < len; i++) {
+        frame[i + 1] = payload[i];
+        sum += (uint8_t)payload[i];
+    }
+    frame[len + 1] = '#';
+    frame[len + 2] = hex_digits[sum >> 4];
+    frame[len + 3] = hex_digits[sum & 15];
+    int result = 0;
+    for (;;) {
+        if (send_raw(dbg, frame, len + 4) != 0) {
+            result = -1;
+            break;
+        }
+        if (dbg->no_ack)
+            break;
+        // Ctrl-C, пришедший до остановки, уже учтён — пропускается
+        int c;
+        do {
+            c = read_char(dbg);
+        } while (c >= 0 && c != '+' && c != '-');
+        if (c == '+')
+            break;
+        if (c < 0) {
+            result = -1;
+            break;
+        }
+    }
+    free(frame);
+    return result;
+}
+
+// Чтение следующего пакета в dbg->packet; -1 — соединение закрыто
+static int read_packet(Debugger *dbg) {
+    for (;;) {
+        int c;
+        // Байты вне пакета (подтверждения, Ctrl-C) пропускаются
+        do {
+            c = read_char(dbg);
+        } while (c >= 0 && c != '$');
+        if (c < 0)
+            return -1;
+        size_t len = 0;
+        uint8_t sum = 0;
+        while ((c = read_char(dbg)) >= 0 && c != '#') {
+            if (len < PACKET_SIZE)
+                dbg->packet[len++] = (char)c;
+            sum += (uint8_t)c;
+        }
+        int hi = read_char(dbg), lo = read_char(dbg);
+        if (c < 0 || hi < 0 || lo < 0)
+            return -1;
+        dbg->packet[len] = '\0';
+        if (dbg->no_ack)
+            return (int)len;
+        if (hex_value((char)hi) * 16 + hex_value((char)lo) == sum) {
+            send_raw(dbg, "+", 1);
+            return (int)len;
+        }
+        send_raw(dbg, "-", 1);
+    }
+}
+
+// SIGIO на сокете во время исполнения гостя — запрос прерывания от GDB
+static void set_async(Debugger *dbg, int on) {
+    if (dbg->fd < 0)
+        return;
+    int fl = fcntl(dbg->fd, F_GETFL);
+    if (fl >= 0)
+        fcntl(dbg->fd, F_SETFL, on ? fl | O_ASYNC : fl & ~O_ASYNC);
+}
+
+static int input_ready(Debugger *dbg) {
+    if (dbg->rpos < dbg->rlen)
+        return 1;
+    struct pollfd p = { dbg->fd, POLLIN, 0 };
+    return poll(&p, 1, 0) > 0;
+}
+
+// ---------------------------------------------------------------------------
+// Точки останова и наблюдения
+// ---------------------------------------------------------------------------
+
+static Breakpoint *find_bp(Debugger *dbg, uint32_t addr) {
+    for (uint32_t i = 0; i < dbg->bp_count; i++) {
+        if (dbg->bps[i].addr == addr)
+            return &dbg->bps[i];
+    }
+    return NULL;
+}
+
+static int bp_saved(Debugger *dbg, uint32_t addr, uint8_t *op) {
+    pthread_mutex_lock(&dbg->lock);
+    Breakpoint *bp = find_bp(dbg, addr);
+    if (bp)
+        *op = bp->saved;
+    pthread_mutex_unlock(&dbg->lock);
+    return bp != NULL;
+}
+
+static int bp_insert(Debugger *dbg, uint32_t addr) {
+    VM *vm = dbg->vm;
+    if (addr >= vm->program_size || !vm->insn_map || !insn_map_test(vm->insn_map, addr))
+        return -1;
+    if (find_bp(dbg, addr))
+        return 0;
+    if (dbg->bp_count == dbg->bp_capacity) {
+        uint32_t cap = dbg->bp_capacity ? dbg->bp_capacity * 2 : 16;
+        Breakpoint *grown = realloc(dbg->bps, cap * sizeof(Breakpoint));
+        if (!grown)
+            return -1;
+        dbg->bps = grown;
+        dbg->bp_capacity = cap;
+    }
+    pthread_mutex_lock(&dbg->lock);
+    dbg->bps[dbg->bp_count].addr = addr;
+    dbg->bps[dbg->bp_count].saved = vm->memory[addr];
+    dbg->bp_count++;
+    vm->memory[addr] = OP_TRAP;
+    pthread_mutex_unlock(&dbg->lock);
+    return 0;
+}
+
+static int bp_remove(Debugger *dbg, uint32_t addr) {
+    pthread_mutex_lock(&dbg->lock);
+    Breakpoint *bp = find_bp(dbg, addr);
+    if (bp) {
+        dbg->vm->memory[addr] = bp->saved;
+        *bp = dbg->bps[--dbg->bp_count];
+    }
+    pthread_mutex_unlock(&dbg->lock);
+    return bp ? 0 : -1;
+}
+
+static int page_watched(Debugger *dbg, uint32_t page_index) {
+    size_t page = vm_page_size();
+    for (uint32_t i = 0; i < dbg->watch_count; i++) {
+        const Watchpoint *w = &dbg->watches[i];
+        if (w->addr / page <= page_index && (w->addr + w->len - 1) / page >= page_index)
+            return 1;
+    }
+    return 0;
+}
+
+// Запись закрывает страницу на запись, чтение и доступ — полностью
+static int page_prot(Debugger *dbg, uint32_t page_index) {
+    size_t page = vm_page_size();
+    int prot = PROT_READ | PROT_WRITE;
+    for (uint32_t i = 0; i < dbg->watch_count; i++) {
+        const Watchpoint *w = &dbg->watches[i];
+        if (w->addr / page > page_index || (w->addr + w->len - 1) / page < page_index)
+            continue;
+        if (w->type == WATCH_WRITE)
+            prot &= ~PROT_WRITE;
+        else
+            prot = PROT_NONE;
+    }
+    return prot;
+}
+
+static void set_watch_protection(Debugger *dbg, int protect) {
+    size_t page = vm_page_size();
+    for (uint32_t i = 0; i < dbg->watch_count; i++) {
+        const Watchpoint *w = &dbg->watches[i];
+        for (uint32_t p = w->addr / page; p <= (w->addr + w->len - 1) / page; p++) {
+            mprotect(dbg->vm->memory + (size_t)p * page, page,
+                     protect ? page_prot(dbg, p) : PROT_READ | PROT_WRITE);
+        }
+    }
+    dbg->protected = protect && dbg->watch_count > 0;
+}
+
+static int watch_insert(Debugger *dbg, uint8_t type, uint32_t addr, uint32_t len) {
+    VM *vm = dbg->vm;
+    if (len == 0 || len > MAX_WATCH_LEN || dbg->watch_count == MAX_WATCHES ||
+        (uint64_t)addr + len > vm->memory_size)
+        return -1;
+    // Чтение кода самой VM открывало бы страницу раньше, чем программа
+    // обратится к данным, поэтому чтение наблюдается только вне страниц кода
+    size_t page = vm_page_size();
+    if (type != WATCH_WRITE && addr / page <= (vm->program_size - 1) / page)
+        return -1;
+    Watchpoint *w = &dbg->watches[dbg->watch_count++];
+    w->addr = addr;
+    w->len = len;
+    w->type = type;
+    memcpy(w->old, vm->memory + addr, len);
+    return 0;
+}
+
+static int watch_remove(Debugger *dbg, uint8_t type, uint32_t addr, uint32_t len) {
+    for (uint32_t i = 0; i < dbg->watch_count; i++) {
+        Watchpoint *w = &dbg->watches[i];
+        if (w->type == type && w->addr == addr && w->len == len) {
+            // Страницы открываются до удаления, пока известны их границы
+            set_watch_protection(dbg, 0);
+            *w = dbg->watches[--dbg->watch_count];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Точка наблюдения, сработавшая с последней проверки. Чтение определяется
+// по адресу обращения (слово гостя — 4 байта), запись — ещё и по изменению
+// значения, что покрывает инструкции, задевающие несколько страниц.
+static Watchpoint *watch_hit(Debugger *dbg, uint32_t fault) {
+    Watchpoint *hit = NULL;
+    VM *vm = dbg->vm;
+    for (uint32_t i = 0; i < dbg->watch_count; i++) {
+        Watchpoint *w = &dbg->watches[i];
+        int touched = fault != UINT32_MAX && (uint64_t)fault + 4 > w->addr &&
+                      fault < (uint64_t)w->addr + w->len;
+        int changed = memcmp(w->old, vm->memory + w->addr, w->len) != 0;
+        if (!hit && ((w->type == WATCH_WRITE && changed) ||
+                     (w->type == WATCH_READ && touched) ||
+                     (w->type == WATCH_ACCESS && (touched || changed))))
+            hit = w;
+        if (changed)
+            memcpy(w->old, vm->memory + w->addr, w->len);
+    }
+    return hit;
+}
+
+// ---------------------------------------------------------------------------
+// Условия точек останова
+// ---------------------------------------------------------------------------
+
+static Condition *find_cond(Debugger *dbg, uint32_t addr) {
+    for (uint32_t i = 0; i < dbg->cond_count; i++) {
+        if (dbg->conds[i].addr == addr)
+            return &dbg->conds[i];
+    }
+    return NULL;
+}
+
+static uint32_t cond_value(VM *vm, const CondOperand *o) {
+    uint32_t addr;
+    switch (o->kind) {
+    case COND_REG:
+        return vm->registers[o->value];
+    case COND_MEM:
+        addr = o->value;
+        break;
+    case COND_MEM_REG:
+        addr = vm->registers[o->value];
+        break;
+    default:
+        return o->value;
+    }
+    if ((uint64_t)addr + 4 > vm->memory_size)
+        return 0;
+    const uint8_t *p = vm->memory + addr;
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int cond_holds(Debugger *dbg, VM *vm, uint32_t addr) {
+    const Condition *c = find_cond(dbg, addr);
+    if (!c)
+        return 1;
+    uint32_t a = cond_value(vm, &c->lhs), b = cond_value(vm, &c->rhs);
+    switch (c->op) {
+    case CMP_EQ: return a == b;
+    case CMP_NE: return a != b;
+    case CMP_LT: return a < b;
+    case CMP_GT: return a > b;
+    case CMP_LE: return a <= b;
+    default:     return a >= b;
+    }
+}
+
+static const char *skip_spaces(const char *s) {
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return s;
+}
+
+// Операнд условия: Rn, [адрес], [Rn] или число
+static const char *parse_operand(const char *s, CondOperand *o) {
+    char *end;
+    int mem = 0;
+    s = skip_spaces(s);
+    if (*s == '[') {
+        mem = 1;
+        s = skip_spaces(s + 1);
+    }
+    if (*s == 'r' || *s == 'R') {
+        unsigned long reg = strtoul(s + 1, &end, 10);
+        if (end == s + 1 || reg >= NUM_REGS)
+            return NULL;
+        o->kind = mem ? COND_MEM_REG : COND_REG;
+        o->value = (uint32_t)reg;
+    } else {
+        unsigned long v = strtoul(s, &end, 0);
+        if (end == s)
+            return NULL;
+        o->kind = mem ? COND_MEM : COND_CONST;
+        o->value = (uint32_t)v;
+    }
+    s = skip_spaces(end);
+    if (mem) {
+        if (*s != ']')
+            return NULL;
+        s = skip_spaces(s + 1);
+    }
+    return s;
+}
+
+static int parse_condition(const char *s, Condition *c) {
+    static const char *const ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+    static const uint8_t codes[] = { CMP_EQ, CMP_NE, CMP_LE, CMP_GE, CMP_LT, CMP_GT };
+    s = parse_operand(s, &c->lhs);
+    if (!s)
+        return -1;
+    size_t i;
+    for (i = 0; i < sizeof(codes); i++) {
+        if (strncmp(s, ops[i], strlen(ops[i])) == 0)
+            break;
+    }
+    if (i == sizeof(codes))
+        return -1;
+    c->op = codes[i];
+    s = parse_operand(s + strlen(ops[i]), &c->rhs);
+    return s && *s == '\0' ? 0 : -1;
+}
+
+// ---------------------------------------------------------------------------
+// Исполнение под отладчиком
+// ---------------------------------------------------------------------------
+
+// Переключение исходной VM на таблицу-ловушку (в том числе из обработчика сигнала)
+static void arm(Debugger *dbg) {
+    VM *vm = dbg->vm;
+    if (vm->dispatch && vm->dispatch != dbg->hook) {
+        dbg->resume = vm->dispatch;
+        vm->dispatch = dbg->hook;
+    }
+}
+
+static void on_fault(int sig, siginfo_t *info, void *context) {
+    (void)context;
+    Debugger *dbg = active_debugger;
+    if (dbg && dbg->protected) {
+        VM *vm = dbg->vm;
+        uintptr_t a = (uintptr_t)info->si_addr, base = (uintptr_t)vm->memory;
+        size_t page = vm_page_size();
+        if (a >= base && a - base < vm->memory_reserved && page_watched(dbg, (uint32_t)((a - base) / page))) {
+            // Страница открывается до конца инструкции; закроет её op_debug_hook
+            mprotect(vm->memory + (a - base) / page * page, page, PROT_READ | PROT_WRITE);
+            dbg->fault_addr = (uint32_t)(a - base);
+            __atomic_fetch_or(&dbg->pending, PENDING_WATCH, __ATOMIC_RELAXED);
+            arm(dbg);
+            return;
+        }
+    }
+    // Чужая ошибка доступа: после возврата инструкция повторится и получит
+    // прежнюю реакцию на сигнал
+    if (dbg)
+        sigaction(sig, &dbg->old_segv, NULL);
+    else
+        signal(sig, SIG_DFL);
+}
+
+static void on_io(int sig) {
+    (void)sig;
+    Debugger *dbg = active_debugger;
+    if (dbg && dbg->running) {
+        __atomic_fetch_or(&dbg->pending, PENDING_INTERRUPT, __ATOMIC_RELAXED);
+        arm(dbg);
+    }
+}
+
+// Исполнение инструкции, опкод которой уже прочитан, в обход ловушки
+static void execute(Debugger *dbg, VM *vm, uint8_t opcode) {
+    const instruction_fn *table = vm->dispatch == dbg->hook ? dbg->resume : vm->dispatch;
+    instruction_fn fn = table[opcode];
+    if (fn)
+        fn(vm);
+    else if (opcode == 0xFF)
+        vm->running = 0;
+    else
+        vm_errorf(vm, "Unknown opcode: 0x%02x at IP: %u", opcode, vm->ip - 1);
+}
+
+static void command_loop(Debugger *dbg);
+
+// Остановка исходной VM: обмен с GDB до команды продолжения
+static void stop(Debugger *dbg, const char *reply, int notify) {
+    dbg->running = 0;
+    set_async(dbg, 0);
+    set_watch_protection(dbg, 0);
+    snprintf(dbg->stop_reply, sizeof(dbg->stop_reply), "%s", reply);
+    dbg->stepping = 0;
+    if (notify && send_packet(dbg, reply) != 0)
+        disconnect(dbg);
+    command_loop(dbg);
+    if (dbg->fd < 0)
+        return;
+    set_watch_protection(dbg, 1);
+    set_async(dbg, 1);
+    dbg->running = 1;
+    if (input_ready(dbg)) {
+        __atomic_fetch_or(&dbg->pending, PENDING_INTERRUPT, __ATOMIC_RELAXED);
+        arm(dbg);
+    }
+}
+
+// Продолжение после остановки: инструкция по адресу ip исполняется без
+// повторной остановки на точке останова в этом же адресе
+static void resume_at(Debugger *dbg, VM *vm) {
+    if (!vm->running || vm->ip >= vm->program_size)
+        return;
+    uint32_t addr = vm->ip;
+    vm->ip = addr + 1;
+    execute(dbg, vm, debugger_opcode_at(vm, addr));
+    if (dbg->stepping && vm->running)
+        arm(dbg);
+}
+
+static void op_debug_hook(VM *vm) {
+    Debugger *dbg = vm->debugger;
+    uint32_t addr = vm->ip - 1;
+    if (vm != dbg->vm) {
+        dbg->resume[vm->memory[addr]](vm);
+        return;
+    }
+    vm->dispatch = dbg->resume;
+    int pending = __atomic_exchange_n(&dbg->pending, 0, __ATOMIC_RELAXED);
+    char reply[64] = "";
+    if (pending & PENDING_WATCH) {
+        set_watch_protection(dbg, 0);
+        Watchpoint *w = watch_hit(dbg, dbg->fault_addr);
+        set_watch_protection(dbg, 1);
+        if (w) {
+            static const char *const kinds[] = { "", "", "watch", "rwatch", "awatch" };
+            snprintf(reply, sizeof(reply), "T05%s:%x;", kinds[w->type], w->addr);
+        }
+    }
+    if (!reply[0] && (pending & PENDING_INTERRUPT))
+        strcpy(reply, "T02");
+    if (!reply[0] && dbg->stepping)
+        strcpy(reply, "T05");
+    if (!reply[0]) {
+        execute(dbg, vm, vm->memory[addr]);
+        return;
+    }
+    vm->ip = addr;
+    stop(dbg, reply, 1);
+    resume_at(dbg, vm);
+}
+
+// Инструкции, передающие память гостя системным вызовам: на время вызова
+// наблюдаемые страницы открываются (иначе вызов вернул бы EFAULT), а запись
+// обнаруживается по изменению значения
+static const uint8_t syscall_opcodes[] = {
+    OP_FS_LIST, OP_DIR_OPEN, OP_DIR_NEXT, OP_ENV_LIST,
+    OP_PRINTS, OP_READINTS, OP_WRITEINTS, OP_READLINE,
+    OP_SNAPSHOT, OP_RESTORE,
+    OP_FILE_OPEN, OP_FILE_READ, OP_FILE_WRITE, OP_FILE_PREAD, OP_FILE_PWRITE,
+    OP_FUTEX_WAIT, OP_FUTEX_WAKE
+};
+
+static void op_watch_io(VM *vm) {
+    Debugger *dbg = vm->debugger;
+    uint8_t opcode = debugger_opcode_at(vm, vm->ip - 1);
+    if (!dbg->protected) {
+        dbg->base[opcode](vm);
+        return;
+    }
+    set_watch_protection(dbg, 0);
+    dbg->base[opcode](vm);
+    for (uint32_t i = 0; i < dbg->watch_count; i++) {
+        const Watchpoint *w = &dbg->watches[i];
+        if (w->type != WATCH_READ && memcmp(w->old, vm->memory + w->addr, w->len) != 0) {
+            dbg->fault_addr = UINT32_MAX;
+            __atomic_fetch_or(&dbg->pending, PENDING_WATCH, __ATOMIC_RELAXED);
+            arm(dbg);
+            break;
+        }
+    }
+    set_watch_protection(dbg, 1);
+}
+
+void debugger_patch_table(VM *vm, instruction_fn *table) {
+    if (!vm->debugger)
+        return;
+    for (size_t i = 0; i < sizeof(syscall_opcodes); i++)
+        table[syscall_opcodes[i]] = op_watch_io;
+}
+
+uint8_t debugger_opcode_at(VM *vm, uint32_t addr) {
+    uint8_t opcode = vm->memory[addr];
+    if (opcode == OP_TRAP && vm->debugger)
+        bp_saved(vm->debugger, addr, &opcode);
+    return opcode;
+}
+
+void op_trap(VM *vm) {
+    Debugger *dbg = vm->debugger;
+    uint32_t addr = vm->ip - 1;
+    uint8_t opcode;
+    if (!dbg || !bp_saved(dbg, addr, &opcode)) {
+        vm_errorf(vm, "Unknown opcode: 0x%02x at IP: %u", OP_TRAP, addr);
+        return;
+    }
+    if (vm == dbg->vm && dbg->fd >= 0 && cond_holds(dbg, vm, addr)) {
+        vm->ip = addr;
+        stop(dbg, "T05swbreak:;", 1);
+        resume_at(dbg, vm);
+        return;
+    }
+    execute(dbg, vm, opcode);
+}
+
+int debugger_break(VM *vm) {
+    Debugger *dbg = vm->debugger;
+    if (!dbg || vm != dbg->vm || dbg->fd < 0)
+        return -1;
+    stop(dbg, "T05", 1);
+    resume_at(dbg, vm);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Команды GDB
+// ---------------------------------------------------------------------------
+
+static uint32_t get_reg(VM *vm, int n) {
+    if (n < NUM_REGS)
+        return vm->registers[n];
+    switch (n - NUM_REGS) {
+    case 0: return vm->ip;
+    case 1: return vm->sp;
+    case 2: return vm->fp;
+    case 3: return vm->rsp;
+    default: return vm->flags;
+    }
+}
+
+static int set_reg(VM *vm, int n, uint32_t v) {
+    if (n < NUM_REGS) {
+        vm->registers[n] = v;
+        return 0;
+    }
+    switch (n - NUM_REGS) {
+    case 0:
+        vm->ip = v;
+        return 0;
+    case 1:
+        if (v > vm->stack_size)
+            return -1;
+        vm->sp = v;
+        return 0;
+    case 2:
+        vm->fp = v;
+        return 0;
+    case 3:
+        if (v > vm->rstack_size)
+            return -1;
+        vm->rsp = v;
+        return 0;
+    default:
+        vm->flags = (uint8_t)v;
+        return 0;
+    }
+}
+
+static void put_reg(char *out, uint32_t v) {
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    put_hex_bytes(out, b, 4);
+}
+
+static uint32_t parse_reg(const char *in) {
+    uint8_t b[4] = { 0 };
+    get_hex_bytes(in, b, 4);
+    return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static void reply_registers(Debugger *dbg) {
+    char out[DBG_REGS * 8 + 1];
+    for (int i = 0; i < DBG_REGS; i++)
+        put_reg(out + i * 8, get_reg(dbg->vm, i));
+    send_packet(dbg, out);
+}
+
+// Память в том виде, в каком её видит программа: на месте точек останова — исходные байты
+static void reply_memory(Debugger *dbg, const char *args) {
+    VM *vm = dbg->vm;
+    uint32_t addr = get_hex(&args);
+    uint32_t len = *args == ',' ? (args++, get_hex(&args)) : 0;
+    if (len > PACKET_SIZE / 2 - 8)
+        len = PACKET_SIZE / 2 - 8;
+    if ((uint64_t)addr + len > vm->memory_size) {
+        send_packet(dbg, "E01");
+        return;
+    }
+    uint8_t data[PACKET_SIZE / 2];
+    memcpy(data, vm->memory + addr, len);
+    for (uint32_t i = 0; i < dbg->bp_count; i++) {
+        if (dbg->bps[i].addr >= addr && dbg->bps[i].addr - addr < len)
+            data[dbg->bps[i].addr - addr] = dbg->bps[i].saved;
+    }
+    char out[PACKET_SIZE + 1];
+    put_hex_bytes(out, data, len);
+    send_packet(dbg, out);
+}
+
+static void write_memory(Debugger *dbg, const char *args) {
+    VM *vm = dbg->vm;
+    uint32_t addr = get_hex(&args);
+    uint32_t len = *args == ',' ? (args++, get_hex(&args)) : 0;
+    uint8_t data[PACKET_SIZE / 2];
+    if (*args != ':' || len > sizeof(data) || get_hex_bytes(args + 1, data, len) != (long)len ||
+        (uint64_t)addr + len > vm->memory_size) {
+        send_packet(dbg, "E01");
+        return;
+    }
+    pthread_mutex_lock(&dbg->lock);
+    memcpy(vm->memory + addr, data, len);
+    for (uint32_t i = 0; i < dbg->bp_count; i++) {
+        Breakpoint *bp = &dbg->bps[i];
+        if (bp->addr >= addr && bp->addr - addr < len) {
+            bp->saved = data[bp->addr - addr];
+            vm->memory[bp->addr] = OP_TRAP;
+        }
+    }
+    pthread_mutex_unlock(&dbg->lock);
+    send_packet(dbg, "OK");
+}
+
+static void handle_point(Debugger *dbg, int insert, const char *args) {
+    int type = args[0] - '0';
+    if (args[1] != ',') {
+        send_packet(dbg, "E01");
+        return;
+    }
+    args += 2;
+    uint32_t addr = get_hex(&args);
+    uint32_t kind = *args == ',' ? (args++, get_hex(&args)) : 0;
+    int r;
+    if (type == 0)
+        r = insert ? bp_insert(dbg, addr) : bp_remove(dbg, addr);
+    else if (type >= WATCH_WRITE && type <= WATCH_ACCESS)
+        r = insert ? watch_insert(dbg, (uint8_t)type, addr, kind)
+                   : watch_remove(dbg, (uint8_t)type, addr, kind);
+    else {
+        send_packet(dbg, "");
+        return;
+    }
+    send_packet(dbg, r == 0 ? "OK" : "E01");
+}
+
+static void monitor_output(Debugger *dbg, const char *text) {
+    char out[2 * 256 + 2] = "O";
+    size_t len = strlen(text);
+    if (len > 256)
+        len = 256;
+    put_hex_bytes(out + 1, (const uint8_t *)text, len);
+    send_packet(dbg, out);
+}
+
+// monitor cond <адрес> [<условие>] — условие точки останова (без условия — снять)
+static void handle_monitor(Debugger *dbg, const char *hex) {
+    char cmd[PACKET_SIZE / 2 + 1];
+    long n = get_hex_bytes(hex, (uint8_t *)cmd, sizeof(cmd) - 1);
+    if (n < 0) {
+        send_packet(dbg, "E01");
+        return;
+    }
+    cmd[n] = '\0';
+    const char *s = skip_spaces(cmd);
+    if (strncmp(s, "cond", 4) == 0 && (s[4] == ' ' || s[4] == '\0')) {
+        char *end;
+        unsigned long addr = strtoul(s + 4, &end, 0);
+        if (end == s + 4) {
+            monitor_output(dbg, "Usage: monitor cond <addr> [<lhs> <op> <rhs>]\n");
+            send_packet(dbg, "E01");
+            return;
+        }
+        s = skip_spaces(end);
+        Condition *c = find_cond(dbg, (uint32_t)addr);
+        if (*s == '\0') {
+            if (c)
+                *c = dbg->conds[--dbg->cond_count];
+            send_packet(dbg, "OK");
+            return;
+        }
+        Condition parsed;
+        if (parse_condition(s, &parsed) != 0) {
+            monitor_output(dbg, "Invalid condition, expected: Rn|[addr]|[Rn]|number op ... (== != < > <= >=)\n");
+            send_packet(dbg, "E01");
+            return;
+        }
+        parsed.addr = (uint32_t)addr;
+        if (!c) {
+            if (dbg->cond_count == dbg->cond_capacity) {
+                uint32_t cap = dbg->cond_capacity ? dbg->cond_capacity * 2 : 8;
+                Condition *grown = realloc(dbg->conds, cap * sizeof(Condition));
+                if (!grown) {
+                    send_packet(dbg, "E01");
+                    return;
+                }
+                dbg->conds = grown;
+                dbg->cond_capacity = cap;
+            }
+            c = &dbg->conds[dbg->cond_count++];
+        }
+        *c = parsed;
+        send_packet(dbg, "OK");
+        return;
+    }
+    monitor_output(dbg, "AirVM monitor commands:\n"
+                        "  cond <addr> <lhs> <op> <rhs>  stop at <addr> only if the condition holds\n"
+                        "  cond <addr>                   remove the condition\n");
+    send_packet(dbg, "OK");
+}
+
+static void build_target_xml(Debugger *dbg) {
+    static const char *const extra[] = { "ip", "sp", "fp", "rsp", "flags" };
+    size_t cap = 4096;
+    char *xml = malloc(cap);
+    if (!xml)
+        return;
+    int len = snprintf(xml, cap,
+                       "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+                       "<target version=\"1.0\"><feature name=\"org.airvm.core\">");
+    for (int i = 0; i < DBG_REGS; i++) {
+        char name[8];
+        if (i < NUM_REGS)
+            snprintf(name, sizeof(name), "r%d", i);
+        len += snprintf(xml + len, cap - (size_t)len,
+                        "<reg name=\"%s\" bitsize=\"32\" type=\"%s\" regnum=\"%d\"/>",
+                        i < NUM_REGS ? name : extra[i - NUM_REGS],
+                        i == NUM_REGS ? "code_ptr" : "uint32", i);
+    }
+    snprintf(xml + len, cap - (size_t)len, "</feature></target>");
+    dbg->xml = xml;
+}
+
+static void handle_xfer(Debugger *dbg, const char *args) {
+    const char *prefix = "features:read:target.xml:";
+    if (!dbg->xml || strncmp(args, prefix, strlen(prefix)) != 0) {
+        send_packet(dbg, "");
+        return;
+    }
+    args += strlen(prefix);
+    uint32_t off = get_hex(&args);
+    uint32_t len = *args == ',' ? (args++, get_hex(&args)) : 0;
+    size_t total = strlen(dbg->xml);
+    if (len > PACKET_SIZE - 2)
+        len = PACKET_SIZE - 2;
+    if (off > total)
+        off = (uint32_t)total;
+    size_t n = total - off < len ? total - off : len;
+    char out[PACKET_SIZE];
+    out[0] = off + n < total ? 'm' : 'l';
+    memcpy(out + 1, dbg->xml + off, n);
+    out[n + 1] = '\0';
+    send_packet(dbg, out);
+}
+
+static void handle_query(Debugger *dbg, const char *p) {
+    if (strncmp(p, "qSupported", 10) == 0)
+        send_packet(dbg, "PacketSize=1000;qXfer:features:read+;swbreak+;QStartNoAckMode+");
+    else if (strcmp(p, "QStartNoAckMode") == 0) {
+        send_packet(dbg, "OK");
+        dbg->no_ack = 1;
+    } else if (strncmp(p, "qXfer:", 6) == 0)
+        handle_xfer(dbg, p + 6);
+    else if (strncmp(p, "qRcmd,", 6) == 0)
+        handle_monitor(dbg, p + 6);
+    else if (strcmp(p, "qAttached") == 0)
+        send_packet(dbg, "1");
+    else if (strcmp(p, "qC") == 0)
+        send_packet(dbg, "QC1");
+    else if (strcmp(p, "qfThreadInfo") == 0)
+        send_packet(dbg, "m1");
+    else if (strcmp(p, "qsThreadInfo") == 0)
+        send_packet(dbg, "l");
+    else if (strncmp(p, "qSymbol", 7) == 0)
+        send_packet(dbg, "OK");
+    else
+        send_packet(dbg, "");
+}
+
+static void command_loop(Debugger *dbg) {
+    VM *vm = dbg->vm;
+    while (dbg->fd >= 0) {
+        if (read_packet(dbg) < 0) {
+            disconnect(dbg);
+            return;
+        }
+        const char *p = dbg->packet;
+        const char *args = p + 1;
+        switch (p[0]) {
+        case '?':
+            send_packet(dbg, dbg->stop_reply);
+            break;
+        case 'g':
+            reply_registers(dbg);
+            break;
+        case 'G': {
+            if (strlen(args) < DBG_REGS * 8) {
+                send_packet(dbg, "E01");
+                break;
+            }
+            int ok = 1;
+            for (int i = 0; i < DBG_REGS; i++)
+                ok &= set_reg(vm, i, parse_reg(args + i * 8)) == 0;
+            send_packet(dbg, ok ? "OK" : "E01");
+            break;
+        }
+        case 'p': {
+            uint32_t n = get_hex(&args);
+            char out[9];
+            if (n >= DBG_REGS) {
+                send_packet(dbg, "E01");
+                break;
+            }
+            put_reg(out, get_reg(vm, (int)n));
+            send_packet(dbg, out);
+            break;
+        }
+        case 'P': {
+            uint32_t n = get_hex(&args);
+            int ok = *args == '=' && n < DBG_REGS && set_reg(vm, (int)n, parse_reg(args + 1)) == 0;
+            send_packet(dbg, ok ? "OK" : "E01");
+            break;
+        }
+        case 'm':
+            reply_memory(dbg, args);
+            break;
+        case 'M':
+            write_memory(dbg, args);
+            break;
+        case 'c':
+        case 's':
+            if (*args)
+                vm->ip = get_hex(&args);
+            dbg->stepping = p[0] == 's';
+            return;
+        case 'Z':
+        case 'z':
+            handle_point(dbg, p[0] == 'Z', args);
+            break;
+        case 'k':
+            vm->running = 0;
+            disconnect(dbg);
+            return;
+        case 'D':
+            send_packet(dbg, "OK");
+            disconnect(dbg);
+            return;
+        case 'H':
+        case 'T':
+            send_packet(dbg, "OK");
+            break;
+        case 'q':
+        case 'Q':
+            handle_query(dbg, p);
+            break;
+        case 'v':
+            if (strcmp(p, "vKill;1") == 0 || strncmp(p, "vKill", 5) == 0) {
+                send_packet(dbg, "OK");
+                vm->running = 0;
+                disconnect(dbg);
+                return;
+            }
+            send_packet(dbg, "");
+            break;
+        default:
+            send_packet(dbg, "");
+            break;
+        }
+    }
+}
+
+// Отключение GDB: точки снимаются, дальше программа идёт без отладчика
+static void disconnect(Debugger *dbg) {
+    if (dbg->fd < 0)
+        return;
+    set_async(dbg, 0);
+    close(dbg->fd);
+    dbg->fd = -1;
+    dbg->running = 0;
+    set_watch_protection(dbg, 0);
+    dbg->watch_count = 0;
+    pthread_mutex_lock(&dbg->lock);
+    for (uint32_t i = 0; i < dbg->bp_count; i++)
+        dbg->vm->memory[dbg->bps[i].addr] = dbg->bps[i].saved;
+    dbg->bp_count = 0;
+    pthread_mutex_unlock(&dbg->lock);
+    dbg->cond_count = 0;
+    dbg->stepping = 0;
+}
+
+// ---------------------------------------------------------------------------
+// Подключение
+// ---------------------------------------------------------------------------
+
+static int open_listener(const char *endpoint, char **unix_path) {
+    int fd;
+    if (strncmp(endpoint, "unix:", 5) == 0) {
+        struct sockaddr_un sa;
+        const char *path = endpoint + 5;
+        if (!*path || strlen(path) >= sizeof(sa.sun_path)) {
+            fprintf(stderr, "Error: Invalid socket path %s\n", path);
+            return -1;
+        }
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        strcpy(sa.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+            perror("Error binding debugger socket");
+            close(fd);
+            return -1;
+        }
+        *unix_path = strdup(path);
+    } else {
+        char *end;
+        unsigned long port = strtoul(endpoint, &end, 10);
+        if (*end || port == 0 || port > 65535) {
+            fprintf(stderr, "Error: Invalid debugger port %s\n", endpoint);
+            return -1;
+        }
+        struct sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons((uint16_t)port);
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+            perror("Error binding debugger port");
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, 1) != 0) {
+        perror("Error listening for debugger");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int debugger_attach(VM *vm, const char *endpoint) {
+    if (active_debugger) {
+        fprintf(stderr, "Error: Debugger is already attached to another VM\n");
+        return -1;
+    }
+    Debugger *dbg = calloc(1, sizeof(Debugger));
+    if (!dbg) {
+        fprintf(stderr, "Error: Failed to allocate debugger\n");
+        return -1;
+    }
+    int listen_fd = open_listener(endpoint, &dbg->unix_path);
+    if (listen_fd < 0) {
+        free(dbg);
+        return -1;
+    }
+    fprintf(stderr, "Waiting for GDB connection on %s\n", endpoint);
+    do {
+        dbg->fd = accept(listen_fd, NULL, NULL);
+    } while (dbg->fd < 0 && errno == EINTR);
+    close(listen_fd);
+    if (dbg->fd < 0) {
+        perror("Error accepting debugger connection");
+        free(dbg->unix_path);
+        free(dbg);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(dbg->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(dbg->fd, F_SETOWN, getpid());
+
+    dbg->vm = vm;
+    pthread_mutex_init(&dbg->lock, NULL);
+    init_dispatch_table(dbg->base);
+    for (int i = 0; i < 256; i++)
+        dbg->hook[i] = op_debug_hook;
+    build_target_xml(dbg);
+    strcpy(dbg->stop_reply, "S05");
+    vm_page_size();  // Размер страницы вычисляется до первого обработчика сигнала
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = on_fault;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &dbg->old_segv);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_io;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGIO, &sa, &dbg->old_io);
+
+    active_debugger = dbg;
+    vm->debugger = dbg;
+    return 0;
+}
+
+void debugger_free(VM *vm) {
+    Debugger *dbg = vm->debugger;
+    if (!dbg)
+        return;
+    disconnect(dbg);
+    sigaction(SIGSEGV, &dbg->old_segv, NULL);
+    sigaction(SIGIO, &dbg->old_io, NULL);
+    active_debugger = NULL;
+    if (dbg->unix_path) {
+        unlink(dbg->unix_path);
+        free(dbg->unix_path);
+    }
+    pthread_mutex_destroy(&dbg->lock);
+    free(dbg->bps);
+    free(dbg->conds);
+    free(dbg->xml);
+    free(dbg);
+    vm->debugger = NULL;
+}
+
+void debugger_start(VM *vm) {
+    Debugger *dbg = vm->debugger;
+    if (vm != dbg->vm)
+        return;
+    dbg->outer = vm->dispatch;
+    memcpy(dbg->table, vm->dispatch, sizeof(dbg->table));
+    debugger_patch_table(vm, dbg->table);
+    vm->dispatch = dbg->table;
+    if (dbg->fd < 0)
+        return;
+    // Остановка перед первой инструкцией; GDB сам запросит причину пакетом '?'
+    stop(dbg, "S05", 0);
+    resume_at(dbg, vm);
+}
+
+void debugger_finish(VM *vm) {
+    Debugger *dbg = vm->debugger;
+    if (vm != dbg->vm)
+        return;
+    if (vm->dispatch == dbg->hook)
+        vm->dispatch = dbg->resume;
+    if (vm->dispatch == dbg->table)
+        vm->dispatch = dbg->outer;
+    dbg->running = 0;
+    if (dbg->fd >= 0) {
+        set_async(dbg, 0);
+        set_watch_protection(dbg, 0);
+        send_packet(dbg, "W00");
+        disconnect(dbg);
+    }
+}
+
+void debugger_protect(VM *vm) {
+    Debugger *dbg = vm->debugger;
+    if (dbg->protected)
+        set_watch_protection(dbg, 1);
+}
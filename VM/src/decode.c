@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "decode.h"
+
+#define R OPND_REG
+#define F OPND_FLAGS
+#define I OPND_IMM
+#define T OPND_TARGET
+#define A32 OPND_ADDR32
+#define A OPND_ADDR
+
+// Таблица форматов инструкций. Порядок операндов совпадает с порядком,
+// в котором их читает соответствующий обработчик op_*.
+const OpInfo op_info[256] = {
+    [OP_NOP]        = {"NOP",      FLOW_NEXT,   {0}},
+    [OP_HALT]       = {"HALT",     FLOW_HALT,   {0}},
+    [OP_JUMP]       = {"JUMP",     FLOW_JUMP,   {T}},
+    [OP_CALL]       = {"CALL",     FLOW_CALL,   {T}},
+    [OP_RET]        = {"RET",      FLOW_RET,    {0}},
+    [OP_IF]         = {"IF",       FLOW_BRANCH, {F, T}},
+    [OP_ENTER]      = {"ENTER",    FLOW_NEXT,   {I}},
+    [OP_LEAVE]      = {"LEAVE",    FLOW_NEXT,   {0}},
+    // Цели из таблицы проверяются по секции таблиц переходов, здесь — ветка default
+    [OP_SWITCH]     = {"SWITCH",   FLOW_JUMP,   {R, A32, I, T}},
+    [OP_JUMPR]      = {"JUMPR",    FLOW_INDIRECT, {R}},
+    [OP_CALLR]      = {"CALLR",    FLOW_NEXT,   {R}},
+    [OP_LOAD]       = {"LOAD",     FLOW_NEXT,   {R, A}},
+    [OP_STORE]      = {"STORE",    FLOW_NEXT,   {R, A}},
+    [OP_MOVE]       = {"MOVE",     FLOW_NEXT,   {R, R}},
+    [OP_PUSH]       = {"PUSH",     FLOW_NEXT,   {R}},
+    [OP_POP]        = {"POP",      FLOW_NEXT,   {R}},
+    [OP_LOADI]      = {"LOADI",    FLOW_NEXT,   {R, I}},
+    [OP_LOADL]      = {"LOADL",    FLOW_NEXT,   {R, I}},
+    [OP_STOREL]     = {"STOREL",   FLOW_NEXT,   {R, I}},
+    [OP_PUSHM]      = {"PUSHM",    FLOW_NEXT,   {I}},
+    [OP_POPM]       = {"POPM",     FLOW_NEXT,   {I}},
+    [OP_ADD]        = {"ADD",      FLOW_NEXT,   {R, R, R}},
+    [OP_SUB]        = {"SUB",      FLOW_NEXT,   {R, R, R}},
+    [OP_MUL]        = {"MUL",      FLOW_NEXT,   {R, R, R}},
+    [OP_DIV]        = {"DIV",      FLOW_NEXT,   {R, R, R}},
+    [OP_AND]        = {"AND",      FLOW_NEXT,   {R, R, R}},
+    [OP_OR]         = {"OR",       FLOW_NEXT,   {R, R, R}},
+    [OP_XOR]        = {"XOR",      FLOW_NEXT,   {R, R, R}},
+    [OP_NOT]        = {"NOT",      FLOW_NEXT,   {R, R}},
+    [OP_CMP]        = {"CMP",      FLOW_NEXT,   {R, I}},
+    [OP_READINTS]   = {"READINTS", FLOW_NEXT,   {R, R, R}},
+    [OP_WRITEINTS]  = {"WRITEINTS", FLOW_NEXT,  {R, R, R}},
+    [OP_READLINE]   = {"READLINE", FLOW_NEXT,   {R, R, R}},
+    [OP_SHL]        = {"SHL",      FLOW_NEXT,   {R, R, I}},
+    [OP_SHR]        = {"SHR",      FLOW_NEXT,   {R, R, I}},
+    [OP_POPCNT]     = {"POPCNT",   FLOW_NEXT,   {R, R}},
+    [OP_CLZ]        = {"CLZ",      FLOW_NEXT,   {R, R}},
+    [OP_CTZ]        = {"CTZ",      FLOW_NEXT,   {R, R}},
+    [OP_BSWAP]      = {"BSWAP",    FLOW_NEXT,   {R, R}},
+    [OP_ROL]        = {"ROL",      FLOW_NEXT,   {R, R, R}},
+    [OP_ROR]        = {"ROR",      FLOW_NEXT,   {R, R, R}},
+    [OP_SAR]        = {"SAR",      FLOW_NEXT,   {R, R, I}},
+    [OP_SHLV]       = {"SHLV",     FLOW_NEXT,   {R, R, R}},
+    [OP_SHRV]       = {"SHRV",     FLOW_NEXT,   {R, R, R}},
+    [OP_SARV]       = {"SARV",     FLOW_NEXT,   {R, R, R}},
+    [OP_MULW]       = {"MULW",     FLOW_NEXT,   {R, R, R}},
+    [OP_BREAK]      = {"BREAK",    FLOW_NEXT,   {0}},
+    [OP_FS_LIST]    = {"FS_LIST",  FLOW_NEXT,   {A32}},
+    [OP_DIR_OPEN]   = {"DIR_OPEN", FLOW_NEXT,   {R, R}},
+    [OP_DIR_NEXT]   = {"DIR_NEXT", FLOW_NEXT,   {R, R, R}},
+    [OP_DIR_CLOSE]  = {"DIR_CLOSE", FLOW_NEXT,  {R}},
+    [OP_ENV_LIST]   = {"ENV_LIST", FLOW_NEXT,   {A32}},
+    [OP_PRINT]      = {"PRINT",    FLOW_NEXT,   {R}},
+    [OP_INPUT]      = {"INPUT",    FLOW_NEXT,   {R}},
+    [OP_PRINTS]     = {"PRINTS",   FLOW_NEXT,   {A32}},
+    [OP_SNAPSHOT]   = {"SNAPSHOT", FLOW_NEXT,   {0}},
+    [OP_RESTORE]    = {"RESTORE",  FLOW_NEXT,   {0}},
+    [OP_CHECKPOINT] = {"CHECKPOINT", FLOW_NEXT, {R}},
+    [OP_FILE_OPEN]  = {"OPEN",     FLOW_NEXT,   {R, R, R}},
+    [OP_FILE_READ]  = {"READ",     FLOW_NEXT,   {R, R, R, R}},
+    [OP_FILE_WRITE] = {"WRITE",    FLOW_NEXT,   {R, R, R, R}},
+    [OP_FILE_CLOSE] = {"CLOSE",    FLOW_NEXT,   {R}},
+    [OP_FILE_SEEK]  = {"SEEK",     FLOW_NEXT,   {R, I, I, R}},
+    [OP_FILE_PREAD] = {"PREAD",    FLOW_NEXT,   {R, R, R, R, R}},
+    [OP_FILE_PWRITE] = {"PWRITE",  FLOW_NEXT,   {R, R, R, R, R}},
+    [OP_FILE_SYNC]  = {"FSYNC",    FLOW_NEXT,   {R, R}},
+    [OP_FILE_BUFFER] = {"FBUF",    FLOW_NEXT,   {R, R}},
+    [OP_FILE_SEEK64] = {"SEEK64",  FLOW_NEXT,   {R, R, R, R}},
+    [OP_NCALL]      = {"NCALL",    FLOW_NEXT,   {I}},
+    [OP_CRC32C]     = {"CRC32C",   FLOW_NEXT,   {R, R, R}},
+    [OP_HASH64]     = {"HASH64",   FLOW_NEXT,   {R, R, R}},
+    [OP_SORT]       = {"SORT",     FLOW_NEXT,   {R, R}},
+    [OP_BSEARCH]    = {"BSEARCH",  FLOW_NEXT,   {R, R, R, R}},
+    [OP_COUNTEQ]    = {"COUNTEQ",  FLOW_NEXT,   {R, R, R, R}},
+    // Точка входа потока проверяется как цель вызова
+    [OP_THREAD_START] = {"THREAD_START", FLOW_CALL, {R, T, R}},
+    [OP_THREAD_JOIN] = {"THREAD_JOIN", FLOW_NEXT, {R, R}},
+    [OP_CAS]        = {"CAS",      FLOW_NEXT,   {R, A, R}},
+    [OP_XADD]       = {"XADD",     FLOW_NEXT,   {R, A}},
+    [OP_XCHG]       = {"XCHG",     FLOW_NEXT,   {R, A}},
+    [OP_FENCE_ACQ]  = {"FENCE_ACQ", FLOW_NEXT,  {0}},
+    [OP_FENCE_REL]  = {"FENCE_REL", FLOW_NEXT,  {0}},
+    [OP_FUTEX_WAIT] = {"FUTEX_WAIT", FLOW_NEXT, {A, R}},
+    [OP_FUTEX_WAKE] = {"FUTEX_WAKE", FLOW_NEXT, {A, R}},
+    [OP_ALLOC]      = {"ALLOC",    FLOW_NEXT,   {R, R}},
+    [OP_FREE]       = {"FREE",     FLOW_NEXT,   {R}},
+    [OP_REALLOC]    = {"REALLOC",  FLOW_NEXT,   {R, R}},
+    [OP_ARENA_RESET] = {"ARENA_RESET", FLOW_NEXT, {0}},
+    [OP_HEAP_STATS] = {"HEAP_STATS", FLOW_NEXT, {R}},
+    [OP_MAP_NEW]    = {"MAP_NEW",  FLOW_NEXT,   {R, R}},
+    [OP_MAP_PUT]    = {"MAP_PUT",  FLOW_NEXT,   {R, R, R}},
+    [OP_MAP_GET]    = {"MAP_GET",  FLOW_NEXT,   {R, R, R}},
+    [OP_MAP_DEL]    = {"MAP_DEL",  FLOW_NEXT,   {R, R}},
+    [OP_MAP_ITER]   = {"MAP_ITER", FLOW_NEXT,   {R, R, R}},
+    [OP_MAP_SNEW]   = {"MAP_SNEW", FLOW_NEXT,   {R, R}},
+    [OP_MAP_SPUT]   = {"MAP_SPUT", FLOW_NEXT,   {R, R, R, R}},
+    [OP_MAP_SGET]   = {"MAP_SGET", FLOW_NEXT,   {R, R, R, R}},
+    [OP_MAP_SDEL]   = {"MAP_SDEL", FLOW_NEXT,   {R, R, R}},
+    [OP_MAP_FREE]   = {"MAP_FREE", FLOW_NEXT,   {R}},
+    [OP_SLEEP_US]   = {"SLEEP_US", FLOW_NEXT,   {R}},
+    [OP_CLOCK_NS]   = {"CLOCK_NS", FLOW_NEXT,   {R}},
+    [OP_EVENT_WAIT] = {"EVENT_WAIT", FLOW_NEXT, {R, R, R, R}},
+    [OP_CHAN_OPEN]  = {"CHAN_OPEN", FLOW_NEXT,  {R, R}},
+    [OP_CHAN_SEND]  = {"CHAN_SEND", FLOW_NEXT,  {R, R, R}},
+    [OP_CHAN_RECV]  = {"CHAN_RECV", FLOW_NEXT,  {R, R, R, R}},
+    // 0xFF — маркер конца кода, исполняется как остановка
+    [0xFF]          = {".END",     FLOW_HALT,   {0}},
+};
+
+#undef R
+#undef F
+#undef I
+#undef T
+#undef A32
+#undef A
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int decode_insn(const uint8_t *code, uint32_t size, uint32_t addr, Insn *out) {
+    if (addr >= size)
+        return DECODE_TRUNCATED;
+    uint8_t opcode = code[addr];
+    const OpInfo *info = &op_info[opcode];
+    if (!info->name)
+        return DECODE_UNKNOWN_OPCODE;
+
+    uint32_t pos = addr + 1;
+    out->addr = addr;
+    out->opcode = opcode;
+    out->count = 0;
+    for (int i = 0; i < MAX_OPERANDS && info->operands[i] != OPND_NONE; i++) {
+        Operand *op = &out->ops[out->count++];
+        op->kind = info->operands[i];
+        op->indirect = 0;
+        op->mode = 0;
+        op->reg = 0;
+        op->index = 0;
+        op->shift = 0;
+        op->value = 0;
+        switch (op->kind) {
+        case OPND_REG:
+        case OPND_FLAGS:
+            if (pos >= size)
+                return DECODE_TRUNCATED;
+            op->value = code[pos++];
+            if (op->kind == OPND_REG) {
+                if (op->value >= NUM_REGS)
+                    return DECODE_BAD_REGISTER;
+                op->reg = (uint8_t)op->value;
+            }
+            break;
+        case OPND_ADDR:
+            if (pos < size && code[pos] == ADDR_MARKER) {
+                if (pos + 1 >= size)
+                    return DECODE_TRUNCATED;
+                op->indirect = 1;
+                op->mode = code[pos + 1] >> ADDR_MODE_SHIFT;
+                op->reg = code[pos + 1] & ADDR_REG_MASK;
+                pos += 2;
+                if (op->mode == ADDR_MODE_OFFSET) {
+                    if ((uint64_t)pos + 4 > size)
+                        return DECODE_TRUNCATED;
+                    op->value = get_le32(&code[pos]);
+                    pos += 4;
+                } else if (op->mode == ADDR_MODE_INDEX) {
+                    if (pos >= size)
+                        return DECODE_TRUNCATED;
+                    op->index = code[pos] & ADDR_REG_MASK;
+                    op->shift = code[pos] >> ADDR_MODE_SHIFT;
+                    pos++;
+                    if (op->shift > ADDR_MAX_SCALE_SHIFT)
+                        return DECODE_BAD_ADDR_MODE;
+                } else if (op->mode != ADDR_MODE_REG) {
+                    return DECODE_BAD_ADDR_MODE;
+                }
+                break;
+            }
+            // иначе — 4-байтовый адрес
+            // fall through
+        case OPND_IMM:
+        case OPND_TARGET:
+        case OPND_ADDR32:
+            if ((uint64_t)pos + 4 > size)
+                return DECODE_TRUNCATED;
+            op->value = get_le32(&code[pos]);
+            pos += 4;
+            if (op->kind == OPND_TARGET && op->value >= size)
+                return DECODE_BAD_TARGET;
+            break;
+        default:
+            return DECODE_UNKNOWN_OPCODE;
+        }
+    }
+    out->length = (uint8_t)(pos - addr);
+    return DECODE_OK;
+}
+
+const char *decode_status_str(int status) {
+    switch (status) {
+    case DECODE_OK: return "ok";
+    case DECODE_UNKNOWN_OPCODE: return "unknown opcode";
+    case DECODE_TRUNCATED: return "instruction runs past end of code";
+    case DECODE_BAD_REGISTER: return "invalid register";
+    case DECODE_BAD_TARGET: return "jump target out of bounds";
+    case DECODE_BAD_ADDR_MODE: return "invalid address mode";
+    default: return "decode error";
+    }
+}
+
+int vm_verify(const uint8_t *code, uint32_t size, uint32_t entry,
+              const uint32_t *roots, size_t root_count, uint8_t *map,
+              char *err, size_t err_len) {
+    memset(map, 0, insn_map_bytes(size));
+    for (size_t i = 0; i < root_count; i++) {
+        if (roots[i] >= size) {
+            snprintf(err, err_len, "jump table target %u out of bounds", roots[i]);
+            return -1;
+        }
+    }
+    if (size == 0 || entry >= size)
+        return 0;
+
+    // Обход в глубину по достижимым инструкциям; байты, до которых нельзя
+    // дойти (данные после JUMP, строки и т.п.), не декодируются.
+    size_t cap = 256 + root_count, top = 0;
+    uint32_t *work = malloc(cap * sizeof(uint32_t));
+    if (!work) {
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    // Цели таблиц переходов — такие же корни обхода, как точка входа
+    for (size_t i = root_count; i > 0; i--)
+        work[top++] = roots[i - 1];
+    work[top++] = entry;
+    int result = 0;
+    while (top > 0) {
+        uint32_t addr = work[--top];
+        while (addr < size && !insn_map_test(map, addr)) {
+            Insn insn;
+            int status = decode_insn(code, size, addr, &insn);
+            if (status != DECODE_OK) {
+                snprintf(err, err_len, "%s at offset %u (opcode 0x%02x)",
+                         decode_status_str(status), addr, code[addr]);
+                result = -1;
+                goto done;
+            }
+            map[addr >> 3] |= (uint8_t)(1u << (addr & 7));
+
+            const OpInfo *info = &op_info[insn.opcode];
+            uint32_t next = addr + insn.length;
+            if (info->flow == FLOW_JUMP || info->flow == FLOW_BRANCH || info->flow == FLOW_CALL) {
+                uint32_t target = 0;
+                for (int i = 0; i < insn.count; i++) {
+                    if (insn.ops[i].kind == OPND_TARGET)
+                        target = insn.ops[i].value;
+                }
+                if (info->flow == FLOW_JUMP) {
+                    addr = target;
+                    continue;
+                }
+                if (top == cap) {
+                    uint32_t *grown = realloc(work, cap * 2 * sizeof(uint32_t));
+                    if (!grown) {
+                        snprintf(err, err_len, "out of memory");
+                        result = -1;
+                        goto done;
+                    }
+                    work = grown;
+                    cap *= 2;
+                }
+                work[top++] = target;
+            } else if (info->flow == FLOW_RET || info->flow == FLOW_HALT || info->flow == FLOW_INDIRECT) {
+                break;
+            }
+            addr = next;
+        }
+    }
+done:
+    free(work);
+    return result;
+}
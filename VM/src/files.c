@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "files.h"
+
+#define FILE_TABLE_INIT 16
+
+// Расширение таблицы: новые слоты добавляются в список свободных
+static int file_table_grow(FileTable *t) {
+    if (t->capacity >= MAX_FILES)
+        return -1;
+    uint32_t cap = t->capacity ? t->capacity * 2 : FILE_TABLE_INIT;
+    if (cap > MAX_FILES)
+        cap = MAX_FILES;
+    FileSlot *grown = realloc(t->slots, cap * sizeof(FileSlot));
+    if (!grown)
+        return -1;
+    for (uint32_t i = cap; i-- > t->capacity;) {
+        grown[i].fp = NULL;
+        grown[i].buf = NULL;
+        grown[i].next_free = t->free_head;
+        t->free_head = i;
+    }
+    t->slots = grown;
+    t->capacity = cap;
+    return 0;
+}
+
+int file_table_init(FileTable *t) {
+    t->slots = NULL;
+    t->capacity = 0;
+    t->free_head = FILE_NONE;
+    t->open = 0;
+    t->std[0] = t->std[1] = t->std[2] = NULL;
+    if (file_table_grow(t) != 0)
+        return -1;
+    // Стандартные потоки занимают дескрипторы 0-2
+    file_add(t, stdin);
+    file_add(t, stdout);
+    file_add(t, stderr);
+    return 0;
+}
+
+void file_set_std(FileTable *t, FILE *in, FILE *out, FILE *err) {
+    t->std[0] = in;
+    t->std[1] = out;
+    t->std[2] = err;
+    for (uint32_t i = 0; i < 3 && i < t->capacity; i++) {
+        if (t->slots[i].fp)
+            t->slots[i].fp = t->std[i];
+    }
+}
+
+uint32_t file_add(FileTable *t, FILE *fp) {
+    if (t->free_head == FILE_NONE && file_table_grow(t) != 0)
+        return FILE_NONE;
+    uint32_t h = t->free_head;
+    t->free_head = t->slots[h].next_free;
+    t->slots[h].fp = fp;
+    t->slots[h].buf = NULL;
+    t->open++;
+    return h;
+}
+
+int file_close(FileTable *t, uint32_t handle) {
+    FILE *fp = file_get(t, handle);
+    if (!fp)
+        return -1;
+    int rc = handle < 3 && fp == t->std[handle] ? fflush(fp) : fclose(fp);
+    FileSlot *s = &t->slots[handle];
+    free(s->buf);
+    s->fp = NULL;
+    s->buf = NULL;
+    s->next_free = t->free_head;
+    t->free_head = handle;
+    t->open--;
+    return rc;
+}
+
+int file_set_buffer(FileTable *t, uint32_t handle, uint32_t size) {
+    FILE *fp = file_get(t, handle);
+    if (!fp)
+        return -1;
+    FileSlot *s = &t->slots[handle];
+    char *buf = NULL;
+    if (size > 0 && !(buf = malloc(size)))
+        return -1;
+    if (setvbuf(fp, buf, size ? _IOFBF : _IONBF, size) != 0) {
+        free(buf);
+        return -1;
+    }
+    free(s->buf);
+    s->buf = buf;
+    return 0;
+}
+
+void file_table_reset(FileTable *t) {
+    for (uint32_t i = 0; i < t->capacity; i++) {
+        // Файл гостя мог занять освободившийся дескриптор стандартного потока
+        if (t->slots[i].fp && (i >= 3 || (t->std[i] && t->slots[i].fp != t->std[i])))
+            file_close(t, i);
+    }
+}
+
+// Буферы стандартных потоков не освобождаются: stdio использует их
+// до завершения процесса.
+void file_table_free(FileTable *t) {
+    file_table_reset(t);
+    free(t->slots);
+    t->slots = NULL;
+    t->capacity = 0;
+    t->free_head = FILE_NONE;
+}
@@ -0,0 +1,44 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hash.h"
+
+static uint64_t load_le64(const uint8_t *p) {
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) |
+           ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+           ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+uint64_t air_hash64(const void *data, size_t len, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + (len & ~(size_t)7);
+    uint64_t h = seed ^ (len * m);
+
+    while (p != end) {
+        uint64_t k = load_le64(p);
+        p += 8;
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+    case 7: h ^= (uint64_t)p[6] << 48; // fall through
+    case 6: h ^= (uint64_t)p[5] << 40; // fall through
+    case 5: h ^= (uint64_t)p[4] << 32; // fall through
+    case 4: h ^= (uint64_t)p[3] << 24; // fall through
+    case 3: h ^= (uint64_t)p[2] << 16; // fall through
+    case 2: h ^= (uint64_t)p[1] << 8;  // fall through
+    case 1: h ^= (uint64_t)p[0];
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "heap.h"
+#include "metrics.h"
+#include "native.h"
+
+#define TAG_USED 0xA1100000u   // Занятый блок; младший байт — класс
+#define TAG_FREE 0xF4EE0000u   // Свободный блок
+#define TAG_MASK 0xFFFF0000u
+#define CLASS_LARGE 0xFF
+
+#define HEAP_HEADER_SIZE ((uint32_t)((sizeof(HeapHeader) + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1)))
+
+// Слово памяти гостя. Адреса блоков выровнены на 16 байт, память гостя
+// little-endian, как и поддерживаемые хосты.
+static inline uint32_t *word(VM *vm, uint32_t addr) {
+    return (uint32_t *)(vm->memory + addr);
+}
+
+static inline uint32_t heap_base(VM *vm) {
+    return (vm->image_size + HEAP_ALIGN - 1) & ~(uint32_t)(HEAP_ALIGN - 1);
+}
+
+// Классы: 16..128 с шагом 16, далее по четыре класса на каждую степень двойки
+// (160, 192, 224, 256, 320, ...) до 4096. size — размер блока, кратный 16.
+static inline uint32_t size_class(uint32_t size) {
+    if (size <= 128)
+        return size / 16 - 1;
+    uint32_t b = 31 - (uint32_t)__builtin_clz(size - 1);
+    return 8 + (b - 7) * 4 + (((size - 1) >> (b - 2)) & 3);
+}
+
+static inline uint32_t class_size(uint32_t c) {
+    if (c < 8)
+        return (c + 1) * 16;
+    uint32_t g = (c - 8) / 4, i = (c - 8) % 4;
+    return (1u << (g + 7)) + (i + 1) * (1u << (g + 5));
+}
+
+// Метаданные кучи лежат в памяти гостя, и программа может их испортить.
+// Поэтому каждый блок из списков и пластин проверяется перед разыменованием
+// (как заголовок таблицы в map.c): начало выровнено и лежит в куче, блок
+// размера size не выходит за вершину.
+static int block_valid(VM *vm, const HeapHeader *h, uint32_t block, uint32_t size) {
+    return (block & (HEAP_ALIGN - 1)) == 0 && block >= heap_base(vm) + HEAP_HEADER_SIZE &&
+           size >= HEAP_ALIGN && (size & (HEAP_ALIGN - 1)) == 0 && (uint64_t)block + size <= h->top;
+}
+
+static void heap_corrupted(VM *vm, uint32_t block) {
+    vm_errorf(vm, "Corrupted heap (block %u)", block);
+}
+
+static void heap_reset(VM *vm, HeapHeader *h) {
+    uint32_t peak = h->magic == HEAP_MAGIC ? h->peak_bytes : 0;
+    uint32_t allocs = h->magic == HEAP_MAGIC ? h->alloc_count : 0;
+    uint32_t frees = h->magic == HEAP_MAGIC ? h->free_count : 0;
+    memset(h, 0, sizeof(*h));
+    h->magic = HEAP_MAGIC;
+    h->top = heap_base(vm) + HEAP_HEADER_SIZE;
+    h->peak_bytes = peak;
+    h->alloc_count = allocs;
+    h->free_count = frees;
+}
+
+// Заголовок кучи; создаётся при первом обращении
+static HeapHeader *heap_get(VM *vm) {
+    uint32_t base = heap_base(vm);
+    if (base < vm->image_size || (uint64_t)base + HEAP_HEADER_SIZE > UINT32_MAX) {
+        vm_error(vm, "No room for the heap after the program image");
+        return NULL;
+    }
+    ensure_memory(vm, base + HEAP_HEADER_SIZE);
+    if (!vm->running)
+        return NULL;
+    HeapHeader *h = (HeapHeader *)(vm->memory + base);
+    if (h->magic != HEAP_MAGIC || h->top < base + HEAP_HEADER_SIZE)
+        heap_reset(vm, h);
+    if ((h->top & (HEAP_ALIGN - 1)) || h->top > vm->memory_size) {
+        vm_errorf(vm, "Corrupted heap (top %u, memory size %u)", h->top, vm->memory_size);
+        return NULL;
+    }
+    return h;
+}
+
+// Выделение size байт с вершины кучи; 0 — адресное пространство исчерпано
+static uint32_t heap_take(VM *vm, HeapHeader *h, uint32_t size) {
+    uint64_t end = (uint64_t)h->top + size;
+    uint64_t limit = vm->memory_reserved < UINT32_MAX ? vm->memory_reserved : UINT32_MAX;
+    uint64_t quota = metrics_limit(vm, MET_MEMORY_SIZE);
+    if (quota && quota < limit)
+        limit = quota;
+    if (end > limit)
+        return 0;
+    ensure_memory(vm, (uint32_t)end);
+    if (!vm->running)
+        return 0;
+    uint32_t addr = h->top;
+    h->top = (uint32_t)end;
+    return addr;
+}
+
+static void account_alloc(HeapHeader *h, uint32_t block_size) {
+    h->bytes_in_use += block_size - HEAP_BLOCK_HEADER;
+    if (h->bytes_in_use > h->peak_bytes)
+        h->peak_bytes = h->bytes_in_use;
+    h->alloc_count++;
+}
+
+// Выделение блока под size байт; возвращает адрес данных или 0
+static uint32_t heap_alloc(VM *vm, HeapHeader *h, uint32_t size) {
+    if (size > UINT32_MAX - HEAP_BLOCK_HEADER - HEAP_ALIGN)
+        return 0;
+    uint32_t need = (size + HEAP_BLOCK_HEADER + HEAP_ALIGN - 1) & ~(uint32_t)(HEAP_ALIGN - 1);
+    uint32_t block, block_size, cls;
+    if (need <= HEAP_MAX_SMALL) {
+        cls = size_class(need);
+        block_size = class_size(cls);
+        block = h->free_list[cls];
+        uint32_t cur = h->slab_cur[cls], end = h->slab_end[cls];
+        if (block) {
+            if (!block_valid(vm, h, block, block_size)) {
+                heap_corrupted(vm, block);
+                return 0;
+            }
+            h->free_list[cls] = *word(vm, block + HEAP_BLOCK_HEADER);
+        } else if (cur && (!block_valid(vm, h, cur, HEAP_ALIGN) || end < cur || end > h->top)) {
+            heap_corrupted(vm, cur);
+            return 0;
+        } else if (cur && end - cur >= block_size) {
+            block = cur;
+            h->slab_cur[cls] += block_size;
+        } else {
+            block = heap_take(vm, h, HEAP_SLAB_SIZE);
+            if (!block)
+                return 0;
+            h->slab_cur[cls] = block + block_size;
+            h->slab_end[cls] = block + HEAP_SLAB_SIZE;
+        }
+    } else {
+        cls = CLASS_LARGE;
+        // Первый подходящий среди освобождённых крупных блоков
+        uint32_t *link = &h->large_free;
+        // Больше блоков, чем помещается в куче, бывает только в зацикленном списке
+        uint32_t steps = (h->top - heap_base(vm)) / HEAP_ALIGN;
+        block = 0;
+        while (*link) {
+            uint32_t b = *link;
+            if (!block_valid(vm, h, b, HEAP_ALIGN) || !block_valid(vm, h, b, *word(vm, b)) ||
+                steps-- == 0) {
+                heap_corrupted(vm, b);
+                return 0;
+            }
+            if (*word(vm, b) >= need) {
+                *link = *word(vm, b + HEAP_BLOCK_HEADER);
+                block = b;
+                break;
+            }
+            link = word(vm, b + HEAP_BLOCK_HEADER);
+        }
+        if (block) {
+            block_size = *word(vm, block);
+        } else {
+            block = heap_take(vm, h, need);
+            if (!block)
+                return 0;
+            block_size = need;
+        }
+    }
+    *word(vm, block) = block_size;
+    *word(vm, block + 4) = TAG_USED | cls;
+    account_alloc(h, block_size);
+    return block + HEAP_BLOCK_HEADER;
+}
+
+// Проверка адреса, полученного от ALLOC; возвращает начало блока или 0
+static uint32_t heap_block(VM *vm, HeapHeader *h, uint32_t addr, const char *op) {
+    uint32_t first = heap_base(vm) + HEAP_HEADER_SIZE + HEAP_BLOCK_HEADER;
+    if (addr < first || addr >= h->top || (addr & (HEAP_ALIGN - 1)) != HEAP_BLOCK_HEADER ||
+        (*word(vm, addr - 4) & TAG_MASK) != TAG_USED) {
+        vm_errorf(vm, "Invalid or already freed pointer %u in %s", addr, op);
+        return 0;
+    }
+    if (addr == vm->heap_pinned) {
+        vm_errorf(vm, "Pointer %u in %s is owned by the VM (stream record)", addr, op);
+        return 0;
+    }
+    uint32_t block = addr - HEAP_BLOCK_HEADER;
+    uint32_t size = *word(vm, block), cls = *word(vm, block + 4) & 0xFF;
+    if ((cls != CLASS_LARGE && (cls >= HEAP_CLASSES || size != class_size(cls))) ||
+        !block_valid(vm, h, block, size)) {
+        heap_corrupted(vm, block);
+        return 0;
+    }
+    return block;
+}
+
+static void heap_free(VM *vm, HeapHeader *h, uint32_t block) {
+    uint32_t block_size = *word(vm, block);
+    uint32_t cls = *word(vm, block + 4) & 0xFF;
+    *word(vm, block + 4) = TAG_FREE | cls;
+    if (cls == CLASS_LARGE) {
+        *word(vm, block + HEAP_BLOCK_HEADER) = h->large_free;
+        h->large_free = block;
+    } else {
+        *word(vm, block + HEAP_BLOCK_HEADER) = h->free_list[cls];
+        h->free_list[cls] = block;
+    }
+    h->bytes_in_use -= block_size - HEAP_BLOCK_HEADER;
+    h->free_count++;
+}
+
+uint32_t vm_heap_alloc(VM *vm, uint32_t size) {
+    HeapHeader *h = heap_get(vm);
+    return h ? heap_alloc(vm, h, size) : 0;
+}
+
+void vm_heap_free(VM *vm, uint32_t addr, const char *op) {
+    HeapHeader *h = heap_get(vm);
+    if (!h)
+        return;
+    uint32_t block = heap_block(vm, h, addr, op);
+    if (block)
+        heap_free(vm, h, block);
+}
+
+// Инструкция ALLOC: ALLOC reg_addr, reg_size
+// В reg_addr записывается адрес блока не меньше reg_size байт (выровнен на 8)
+// или 0, если память исчерпана. Содержимое блока не обнуляется.
+void op_alloc(VM *vm) {
+    uint8_t reg_addr = read_byte(vm);
+    uint8_t reg_size = read_byte(vm);
+    if (reg_addr >= NUM_REGS || reg_size >= NUM_REGS) {
+        vm_error(vm, "Invalid register in ALLOC");
+        return;
+    }
+    HeapHeader *h = heap_get(vm);
+    if (h)
+        vm->registers[reg_addr] = heap_alloc(vm, h, vm->registers[reg_size]);
+}
+
+// Инструкция FREE: FREE reg_addr (адрес 0 игнорируется)
+void op_free(VM *vm) {
+    uint8_t reg_addr = read_byte(vm);
+    if (reg_addr >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in FREE", reg_addr);
+        return;
+    }
+    uint32_t addr = vm->registers[reg_addr];
+    if (addr == 0)
+        return;
+    HeapHeader *h = heap_get(vm);
+    if (!h)
+        return;
+    uint32_t block = heap_block(vm, h, addr, "FREE");
+    if (block)
+        heap_free(vm, h, block);
+}
+
+// Инструкция REALLOC: REALLOC reg_addr, reg_size
+// Меняет размер блока reg_addr, сохраняя содержимое; новый адрес
+// записывается в reg_addr. Адрес 0 — как ALLOC, размер 0 — как FREE (результат 0).
+// Если памяти не хватает, в reg_addr записывается 0, а старый блок остаётся.
+void op_realloc(VM *vm) {
+    uint8_t reg_addr = read_byte(vm);
+    uint8_t reg_size = read_byte(vm);
+    if (reg_addr >= NUM_REGS || reg_size >= NUM_REGS) {
+        vm_error(vm, "Invalid register in REALLOC");
+        return;
+    }
+    uint32_t addr = vm->registers[reg_addr];
+    uint32_t size = vm->registers[reg_size];
+    HeapHeader *h = heap_get(vm);
+    if (!h)
+        return;
+    if (addr == 0) {
+        vm->registers[reg_addr] = heap_alloc(vm, h, size);
+        return;
+    }
+    uint32_t block = heap_block(vm, h, addr, "REALLOC");
+    if (!block)
+        return;
+    if (size == 0) {
+        heap_free(vm, h, block);
+        vm->registers[reg_addr] = 0;
+        return;
+    }
+    uint32_t block_size = *word(vm, block);
+    uint32_t capacity = block_size - HEAP_BLOCK_HEADER;
+    if (size <= capacity)
+        return;
+    // Крупный блок на вершине кучи растёт на месте
+    if ((*word(vm, block + 4) & 0xFF) == CLASS_LARGE && block + block_size == h->top &&
+        size <= UINT32_MAX - HEAP_BLOCK_HEADER - HEAP_ALIGN) {
+        uint32_t need = (size + HEAP_BLOCK_HEADER + HEAP_ALIGN - 1) & ~(uint32_t)(HEAP_ALIGN - 1);
+        if (heap_take(vm, h, need - block_size)) {
+            *word(vm, block) = need;
+            h->bytes_in_use += need - block_size;
+            if (h->bytes_in_use > h->peak_bytes)
+                h->peak_bytes = h->bytes_in_use;
+            return;
+        }
+        if (!vm->running)
+            return;
+    }
+    uint32_t moved = heap_alloc(vm, h, size);
+    if (!moved) {
+        vm->registers[reg_addr] = 0;
+        return;
+    }
+    memcpy(vm->memory + moved, vm->memory + addr, capacity);
+    heap_free(vm, h, block);
+    vm->registers[reg_addr] = moved;
+}
+
+// Инструкция ARENA_RESET: освобождает все блоки кучи разом.
+// Счётчики ALLOC/FREE и пиковый объём сохраняются.
+void op_arena_reset(VM *vm) {
+    if (vm->heap_pinned) {
+        vm_error(vm, "ARENA_RESET while the heap holds a stream record");
+        return;
+    }
+    HeapHeader *h = heap_get(vm);
+    if (h)
+        heap_reset(vm, h);
+}
+
+// Инструкция HEAP_STATS: HEAP_STATS reg_addr
+// Записывает по адресу reg_addr HEAP_STATS_WORDS слов: байт занято, пик,
+// число ALLOC, число FREE, размер кучи в байтах.
+void op_heap_stats(VM *vm) {
+    uint8_t reg_addr = read_byte(vm);
+    if (reg_addr >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in HEAP_STATS", reg_addr);
+        return;
+    }
+    HeapHeader *h = heap_get(vm);
+    if (!h)
+        return;
+    uint32_t stats[HEAP_STATS_WORDS] = {
+        h->bytes_in_use, h->peak_bytes, h->alloc_count, h->free_count,
+        h->top - heap_base(vm)
+    };
+    uint8_t *p = vm_guest_ptr(vm, vm->registers[reg_addr], sizeof(stats), 1);
+    if (!p)
+        return;
+    for (int i = 0; i < HEAP_STATS_WORDS; i++) {
+        p[i * 4] = (uint8_t)stats[i];
+        p[i * 4 + 1] = (uint8_t)(stats[i] >> 8);
+        p[i * 4 + 2] = (uint8_t)(stats[i] >> 16);
+        p[i * 4 + 3] = (uint8_t)(stats[i] >> 24);
+    }
+}
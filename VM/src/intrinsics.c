@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "vm.h"
+#include "intrinsics.h"
+#include "native.h"
+#include "hash.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define HAVE_SSE42_CRC 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u   // Отражённый полином Кастаньоли
+
+static inline uint32_t load_le32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline void store_le32(uint8_t *p, uint32_t v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    memcpy(p, &v, sizeof(v));
+}
+
+// Программная CRC32C: таблицы для обработки по 8 байт за шаг (slicing-by-8)
+// (заполняются один раз, в том числе при одновременном вызове из потоков гостя)
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = (c >> 1) ^ (CRC32C_POLY & (0u - (c & 1)));
+        crc_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            crc_table[t][i] = (crc_table[t - 1][i] >> 8) ^ crc_table[0][crc_table[t - 1][i] & 0xFF];
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t len) {
+    pthread_once(&crc_table_once, crc32c_init_table);
+    while (len >= 8) {
+        uint32_t lo = load_le32(p) ^ crc;
+        uint32_t hi = load_le32(p + 4);
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#ifdef HAVE_SSE42_CRC
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t len) {
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (len--)
+        c32 = _mm_crc32_u8(c32, *p++);
+    return c32;
+}
+#endif
+
+uint32_t air_crc32c(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+#ifdef HAVE_SSE42_CRC
+    static int has_sse42 = -1;
+    if (has_sse42 < 0)
+        has_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    if (has_sse42)
+        return ~crc32c_hw(crc, p, len);
+#endif
+    return ~crc32c_sw(crc, p, len);
+}
+
+// Чтение трёх или четырёх регистровых операндов с проверкой номеров
+static int read_regs(VM *vm, uint8_t *regs, int count, const char *name) {
+    for (int i = 0; i < count; i++)
+        regs[i] = read_byte(vm);
+    for (int i = 0; i < count; i++) {
+        if (regs[i] >= NUM_REGS) {
+            vm_errorf(vm, "Invalid register R%d in %s", regs[i], name);
+            return -1;
+        }
+    }
+    return vm->running ? 0 : -1;
+}
+
+// Проверенный указатель на массив из count слов
+static uint8_t *guest_words(VM *vm, uint32_t addr, uint32_t count, int writable) {
+    if ((uint64_t)count * 4 > UINT32_MAX) {
+        vm_errorf(vm, "Array of %u words does not fit in guest memory", count);
+        return NULL;
+    }
+    return vm_guest_ptr(vm, addr, count * 4, writable);
+}
+
+// CRC32C Rd, Ra, Rn: Rd = crc32c(Rd, mem[Ra .. Ra+Rn))
+void op_crc32c(VM *vm) {
+    uint8_t r[3];
+    if (read_regs(vm, r, 3, "CRC32C") != 0)
+        return;
+    uint32_t len = vm->registers[r[2]];
+    const uint8_t *p = vm_guest_ptr(vm, vm->registers[r[1]], len, 0);
+    if (!p)
+        return;
+    vm->registers[r[0]] = air_crc32c(vm->registers[r[0]], p, len);
+}
+
+// HASH64 Rd, Ra, Rn: 64-битный хеш диапазона; младшая половина в Rd, старшая в Rd+1
+void op_hash64(VM *vm) {
+    uint8_t r[3];
+    if (read_regs(vm, r, 3, "HASH64") != 0)
+        return;
+    if (r[0] + 1 >= NUM_REGS) {
+        vm_errorf(vm, "HASH64 needs a register pair, got R%d", r[0]);
+        return;
+    }
+    uint32_t len = vm->registers[r[2]];
+    const uint8_t *p = vm_guest_ptr(vm, vm->registers[r[1]], len, 0);
+    if (!p)
+        return;
+    uint64_t h = air_hash64(p, len, 0);
+    vm->registers[r[0]] = (uint32_t)h;
+    vm->registers[r[0] + 1] = (uint32_t)(h >> 32);
+}
+
+static void insertion_sort(uint32_t *a, uint32_t n) {
+    for (uint32_t i = 1; i < n; i++) {
+        uint32_t v = a[i];
+        uint32_t j = i;
+        while (j > 0 && a[j - 1] > v) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = v;
+    }
+}
+
+// Поразрядная сортировка по байтам (LSD): 4 прохода, время O(n)
+static void radix_sort(uint32_t *a, uint32_t *tmp, uint32_t n) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t count[257] = {0};
+        for (uint32_t i = 0; i < n; i++)
+            count[((a[i] >> shift) & 0xFF) + 1]++;
+        if (count[((a[0] >> shift) & 0xFF) + 1] == n)
+            continue;  // все элементы совпадают в этом байте
+        for (int b = 0; b < 256; b++)
+            count[b + 1] += count[b];
+        for (uint32_t i = 0; i < n; i++)
+            tmp[count[(a[i] >> shift) & 0xFF]++] = a[i];
+        memcpy(a, tmp, (size_t)n * sizeof(uint32_t));
+    }
+}
+
+// SORT Ra, Rn: сортировка по возрастанию массива из Rn слов uint32 по адресу Ra
+void op_sort(VM *vm) {
+    uint8_t r[2];
+    if (read_regs(vm, r, 2, "SORT") != 0)
+        return;
+    uint32_t n = vm->registers[r[1]];
+    uint8_t *p = guest_words(vm, vm->registers[r[0]], n, 1);
+    if (!p || n < 2)
+        return;
+    uint32_t *a = malloc((size_t)n * 2 * sizeof(uint32_t));
+    if (!a) {
+        vm_error(vm, "Failed to allocate sort buffer");
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++)
+        a[i] = load_le32(p + (size_t)i * 4);
+    if (n <= 32)
+        insertion_sort(a, n);
+    else
+        radix_sort(a, a + n, n);
+    for (uint32_t i = 0; i < n; i++)
+        store_le32(p + (size_t)i * 4, a[i]);
+    free(a);
+}
+
+// BSEARCH Rd, Ra, Rn, Rk: индекс Rk в отсортированном массиве (первое вхождение)
+// или 0xFFFFFFFF. Флаги: EQ — найдено, NE — нет.
+void op_bsearch(VM *vm) {
+    uint8_t r[4];
+    if (read_regs(vm, r, 4, "BSEARCH") != 0)
+        return;
+    uint32_t n = vm->registers[r[2]];
+    uint32_t key = vm->registers[r[3]];
+    const uint8_t *p = guest_words(vm, vm->registers[r[1]], n, 0);
+    if (!p)
+        return;
+    uint32_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (load_le32(p + (size_t)mid * 4) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    int found = lo < n && load_le32(p + (size_t)lo * 4) == key;
+    vm->registers[r[0]] = found ? lo : UINT32_MAX;
+    vm->flags = found ? 0x01 : 0x02;
+}
+
+// COUNTEQ Rd, Ra, Rn, Rk: число слов массива, равных Rk
+void op_counteq(VM *vm) {
+    uint8_t r[4];
+    if (read_regs(vm, r, 4, "COUNTEQ") != 0)
+        return;
+    uint32_t n = vm->registers[r[2]];
+    uint32_t key = vm->registers[r[3]];
+    const uint8_t *p = guest_words(vm, vm->registers[r[1]], n, 0);
+    if (!p)
+        return;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n; i++)
+        count += load_le32(p + (size_t)i * 4) == key;
+    vm->registers[r[0]] = count;
+}
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vm.h"
+#include "loader.h"
+#include "airbin.h"
+#include "decode.h"
+#include "cache.h"
+#include "hash.h"
+
+#define PROGRAM_HASH_SEED 0x41495256ULL
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Чтение файла программы целиком (если его нельзя отобразить в память)
+static uint8_t *read_file(int fd, size_t *size) {
+    size_t cap = 1 << 16, len = 0;
+    uint8_t *data = malloc(cap);
+    if (!data) {
+        fprintf(stderr, "Error: Failed to allocate program buffer\n");
+        return NULL;
+    }
+    for (;;) {
+        if (len == cap) {
+            uint8_t *grown = realloc(data, cap * 2);
+            if (!grown) {
+                fprintf(stderr, "Error: Failed to allocate program buffer\n");
+                free(data);
+                return NULL;
+            }
+            data = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, data + len, cap - len);
+        if (n < 0) {
+            perror("Error reading program file");
+            free(data);
+            return NULL;
+        }
+        if (n == 0)
+            break;
+        len += (size_t)n;
+    }
+    *size = len;
+    return data;
+}
+
+// Построение или получение из кеша карты начал инструкций
+static int attach_insn_map(VM *vm, uint64_t key, const uint32_t *roots, size_t root_count,
+                           const LoadOptions *opts) {
+    const uint8_t *code = vm->memory;
+    uint32_t size = vm->program_size;
+    uint32_t entry = vm->ip;
+
+    if (opts && opts->cache_dir) {
+        CacheEntry e;
+        if (cache_lookup(opts->cache_dir, key, code, size, entry, &e)) {
+            vm->insn_map = e.insn_map;
+            vm->insn_map_mapping = e.base;
+            vm->insn_map_mapping_size = e.length;
+            return 0;
+        }
+    }
+
+    uint8_t *map = malloc(insn_map_bytes(size) ? insn_map_bytes(size) : 1);
+    if (!map) {
+        fprintf(stderr, "Error: Failed to allocate instruction map\n");
+        return -1;
+    }
+    char err[256];
+    if (vm_verify(code, size, entry, roots, root_count, map, err, sizeof(err)) != 0) {
+        fprintf(stderr, "Error: Program verification failed: %s\n", err);
+        free(map);
+        return -1;
+    }
+    if (opts && opts->cache_dir && cache_store(opts->cache_dir, key, code, size, entry, map) != 0)
+        fprintf(stderr, "Warning: Failed to write cache entry to %s\n", opts->cache_dir);
+    vm->insn_map = map;
+    return 0;
+}
+
+// Старый формат: 4 байта размера кода, затем код
+static int load_legacy(VM *vm, const uint8_t *file, size_t file_size) {
+    uint32_t code_size;
+    if (file_size < sizeof(uint32_t)) {
+        fprintf(stderr, "Error reading code size header\n");
+        return -1;
+    }
+    code_size = get_le32(file);
+    if (code_size > file_size - sizeof(uint32_t)) {
+        fprintf(stderr, "Error reading program: expected %u bytes, got %zu\n",
+                code_size, file_size - sizeof(uint32_t));
+        return -1;
+    }
+    // Если код больше текущего размера памяти, расширяем его
+    ensure_memory(vm, code_size);
+    if (!vm->running)
+        return -1;
+    memcpy(vm->memory, file + sizeof(uint32_t), code_size);
+    vm->program_size = code_size;
+    vm->image_size = code_size;
+    return 0;
+}
+
+// Размещение загружаемой секции: целые страницы отображаются из файла
+// (копирование при записи), остаток копируется.
+static void place_section(VM *vm, int fd, const uint8_t *file, const AirbSection *s) {
+    size_t page = vm_page_size();
+    size_t mapped = 0;
+    if (fd >= 0 && s->size >= page && s->offset % page == 0 && s->vaddr % page == 0) {
+        size_t len = s->size / page * page;
+        void *p = mmap(vm->memory + s->vaddr, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_FIXED, fd, s->offset);
+        if (p != MAP_FAILED)
+            mapped = len;
+    }
+    memcpy(vm->memory + s->vaddr + mapped, file + s->offset + mapped, s->size - mapped);
+}
+
+static int load_symbols(VM *vm, const uint8_t *p, uint32_t size) {
+    uint32_t count = 0, names = 0, pos = 0;
+    while (pos < size) {
+        if (size - pos < 6 || size - pos - 6 < p[pos + 5]) {
+            fprintf(stderr, "Error: Corrupted symbol table\n");
+            return -1;
+        }
+        names += p[pos + 5] + 1;
+        pos += 6 + p[pos + 5];
+        count++;
+    }
+    if (count == 0)
+        return 0;
+    // Имена хранятся в том же блоке, что и массив символов
+    Symbol *syms = malloc(count * sizeof(Symbol) + names);
+    if (!syms) {
+        fprintf(stderr, "Error: Failed to allocate symbol table\n");
+        return -1;
+    }
+    char *name = (char *)(syms + count);
+    pos = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t len = p[pos + 5];
+        syms[i].addr = get_le32(p + pos);
+        syms[i].kind = p[pos + 4];
+        syms[i].name = name;
+        memcpy(name, p + pos + 6, len);
+        name[len] = '\0';
+        name += len + 1;
+        pos += 6 + len;
+    }
+    vm->symbols = syms;
+    vm->symbol_count = count;
+    return 0;
+}
+
+static int load_lines(VM *vm, const uint8_t *p, uint32_t size) {
+    if (size % 8 != 0) {
+        fprintf(stderr, "Error: Corrupted line table\n");
+        return -1;
+    }
+    uint32_t count = size / 8;
+    if (count == 0)
+        return 0;
+    LineEntry *lines = malloc(count * sizeof(LineEntry));
+    if (!lines) {
+        fprintf(stderr, "Error: Failed to allocate line table\n");
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        lines[i].addr = get_le32(p + i * 8);
+        lines[i].line = get_le32(p + i * 8 + 4);
+    }
+    vm->lines = lines;
+    vm->line_count = count;
+    return 0;
+}
+
+// Таблицы переходов: записи {uint32 addr, uint32 count}. Таблица должна
+// лежать в CODE или RODATA; её элементы (уже размещённые в памяти) становятся
+// корнями проверки, чтобы SWITCH и JUMPR/CALLR по ним проходили проверку
+// цели одним битом карты инструкций.
+static int load_jump_tables(VM *vm, const AirbSection *sect, int section_count,
+                            const uint8_t *p, uint32_t size,
+                            uint32_t **roots, size_t *root_count) {
+    if (size % 8 != 0) {
+        fprintf(stderr, "Error: Corrupted jump table section\n");
+        return -1;
+    }
+    size_t total = *root_count;
+    for (uint32_t pos = 0; pos < size; pos += 8) {
+        uint32_t addr = get_le32(p + pos);
+        uint64_t bytes = (uint64_t)get_le32(p + pos + 4) * 4;
+        int inside = 0;
+        for (int i = 0; i < section_count && !inside; i++) {
+            const AirbSection *s = &sect[i];
+            inside = (s->type == SECT_CODE || s->type == SECT_RODATA) &&
+                     addr >= s->vaddr && (uint64_t)addr + bytes <= (uint64_t)s->vaddr + s->size;
+        }
+        if (!inside) {
+            fprintf(stderr, "Error: Jump table at %u is outside code and read-only data\n", addr);
+            return -1;
+        }
+        total += (size_t)(bytes / 4);
+    }
+    if (total == *root_count)
+        return 0;
+    uint32_t *grown = realloc(*roots, total * sizeof(uint32_t));
+    if (!grown) {
+        fprintf(stderr, "Error: Failed to allocate jump table targets\n");
+        return -1;
+    }
+    *roots = grown;
+    for (uint32_t pos = 0; pos < size; pos += 8) {
+        uint32_t addr = get_le32(p + pos);
+        uint32_t count = get_le32(p + pos + 4);
+        for (uint32_t i = 0; i < count; i++)
+            grown[(*root_count)++] = get_le32(vm->memory + addr + (size_t)i * 4);
+    }
+    return 0;
+}
+
+static int is_placed(uint32_t type) {
+    return type == SECT_CODE || type == SECT_RODATA || type == SECT_BSS;
+}
+
+// Секционный формат AIRB
+static int load_container(VM *vm, int fd, const uint8_t *file, size_t file_size,
+                          uint32_t **roots, size_t *root_count) {
+    AirbHeader h;
+    if (file_size < sizeof(h)) {
+        fprintf(stderr, "Error: Truncated program header\n");
+        return -1;
+    }
+    memcpy(&h, file, sizeof(h));
+    if (h.version != AIRB_VERSION) {
+        fprintf(stderr, "Error: Unsupported program format version %u\n", h.version);
+        return -1;
+    }
+    if ((file_size - sizeof(h)) / sizeof(AirbSection) < h.section_count) {
+        fprintf(stderr, "Error: Truncated section table\n");
+        return -1;
+    }
+    AirbSection *sect = malloc((h.section_count ? h.section_count : 1) * sizeof(AirbSection));
+    if (!sect) {
+        fprintf(stderr, "Error: Failed to allocate section table\n");
+        return -1;
+    }
+    memcpy(sect, file + sizeof(h), h.section_count * sizeof(AirbSection));
+
+    int rc = -1;
+    int code = -1;
+    uint64_t end = 0;
+    for (int i = 0; i < h.section_count; i++) {
+        const AirbSection *s = &sect[i];
+        if (s->type != SECT_BSS && (uint64_t)s->offset + s->size > file_size) {
+            fprintf(stderr, "Error: Section %d extends past end of file\n", i);
+            goto out;
+        }
+        if (!is_placed(s->type))
+            continue;
+        if ((uint64_t)s->vaddr + s->size > UINT32_MAX) {
+            fprintf(stderr, "Error: Section %d does not fit in 32-bit address space\n", i);
+            goto out;
+        }
+        if (s->type == SECT_CODE) {
+            if (code >= 0 || s->vaddr != 0) {
+                fprintf(stderr, "Error: Program must have exactly one code section at address 0\n");
+                goto out;
+            }
+            code = i;
+        }
+        for (int j = 0; j < i; j++) {
+            const AirbSection *o = &sect[j];
+            if (is_placed(o->type) && s->size && o->size &&
+                s->vaddr < o->vaddr + o->size && o->vaddr < s->vaddr + s->size) {
+                fprintf(stderr, "Error: Sections %d and %d overlap\n", j, i);
+                goto out;
+            }
+        }
+        if ((uint64_t)s->vaddr + s->size > end)
+            end = (uint64_t)s->vaddr + s->size;
+    }
+    if (code < 0) {
+        fprintf(stderr, "Error: Program has no code section\n");
+        goto out;
+    }
+    if (h.entry >= sect[code].size && sect[code].size > 0) {
+        fprintf(stderr, "Error: Entry point %u is outside the code section\n", h.entry);
+        goto out;
+    }
+
+    // BSS не требует работы: новые страницы памяти уже нулевые
+    ensure_memory(vm, (uint32_t)end);
+    if (!vm->running)
+        goto out;
+    for (int i = 0; i < h.section_count; i++) {
+        const AirbSection *s = &sect[i];
+        if (s->type == SECT_CODE || s->type == SECT_RODATA) {
+            place_section(vm, fd, file, s);
+        } else if (s->type == SECT_SYMTAB && !vm->symbols) {
+            if (load_symbols(vm, file + s->offset, s->size) != 0)
+                goto out;
+        } else if (s->type == SECT_LINES && !vm->lines) {
+            if (load_lines(vm, file + s->offset, s->size) != 0)
+                goto out;
+        }
+    }
+    // Таблицы читаются из памяти после размещения всех секций
+    for (int i = 0; i < h.section_count; i++) {
+        const AirbSection *s = &sect[i];
+        if (s->type == SECT_JUMPTABLE &&
+            load_jump_tables(vm, sect, h.section_count, file + s->offset, s->size, roots, root_count) != 0)
+            goto out;
+    }
+    vm->program_size = sect[code].size;
+    vm->image_size = (uint32_t)end;
+    vm->ip = h.entry;
+    rc = 0;
+out:
+    free(sect);
+    return rc;
+}
+
+// Разбор образа (файла программы целиком), размещение и проверка.
+// fd — открытый файл образа для отображения страниц секций или -1.
+static int load_image(VM *vm, int fd, const uint8_t *file, size_t file_size, const LoadOptions *opts) {
+    int rc;
+    uint32_t *roots = NULL;
+    size_t root_count = 0;
+    if (file_size >= 4 && memcmp(file, AIRB_MAGIC, 4) == 0)
+        rc = load_container(vm, fd, file, file_size, &roots, &root_count);
+    else
+        rc = load_legacy(vm, file, file_size);
+    if (rc == 0) {
+        uint64_t key = 0;
+        if (opts && opts->cache_dir)
+            key = air_hash64(file, file_size, PROGRAM_HASH_SEED);
+        rc = attach_insn_map(vm, key, roots, root_count, opts);
+    }
+    free(roots);
+    return rc;
+}
+
+int vm_load_program(VM *vm, const char *path, const LoadOptions *opts) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening program file");
+        return -1;
+    }
+    struct stat st;
+    size_t file_size = 0;
+    uint8_t *file = NULL;
+    int mapped = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        file_size = (size_t)st.st_size;
+        file = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file == MAP_FAILED)
+            file = NULL;
+        else
+            mapped = 1;
+    }
+    if (!file) {
+        file = read_file(fd, &file_size);
+        if (!file) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    int rc = load_image(vm, mapped ? fd : -1, file, file_size, opts);
+    if (mapped)
+        munmap(file, file_size);
+    else
+        free(file);
+    close(fd);
+    return rc;
+}
+
+int vm_load_image(VM *vm, const uint8_t *image, size_t size, const LoadOptions *opts) {
+    return load_image(vm, -1, image, size, opts);
+}
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "heap.h"
+#include "hash.h"
+#include "native.h"
+#include "map.h"
+
+#define META_DIST 0xFFFFu           // Младшие 16 бит meta: расстояние + 1
+#define MAX_DIST 0xFFFEu
+#define KIND_ANY UINT32_MAX
+#define NOT_FOUND UINT32_MAX
+
+// Искомый ключ: слово или байты в памяти гостя
+typedef struct {
+    uint32_t hash;
+    uint32_t key;
+    const uint8_t *bytes;
+    uint32_t len;
+} MapKey;
+
+static inline uint32_t *word(VM *vm, uint32_t addr) {
+    return (uint32_t *)(vm->memory + addr);
+}
+
+// Финализатор MurmurHash3: биекция, поэтому разные ключи дают разные хеши
+static inline uint32_t hash_int(uint32_t k) {
+    k ^= k >> 16;
+    k *= 0x85EBCA6Bu;
+    k ^= k >> 13;
+    k *= 0xC2B2AE35u;
+    k ^= k >> 16;
+    return k;
+}
+
+static inline uint32_t hash_bytes(const uint8_t *p, uint32_t len) {
+    uint64_t h = air_hash64(p, len, MAP_MAGIC);
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static int read_regs(VM *vm, uint8_t *r, int n, const char *op) {
+    for (int i = 0; i < n; i++)
+        r[i] = read_byte(vm);
+    for (int i = 0; i < n; i++) {
+        if (r[i] >= NUM_REGS) {
+            vm_errorf(vm, "Invalid register in %s", op);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Проверенный заголовок таблицы; NULL — ошибка (VM остановлена)
+static MapHeader *map_get(VM *vm, uint32_t addr, uint32_t kind, const char *op) {
+    MapHeader *m = (addr & 3) == 0 && (uint64_t)addr + sizeof(MapHeader) <= vm->memory_size
+                       ? (MapHeader *)(vm->memory + addr) : NULL;
+    uint32_t cap = m ? m->capacity : 0;
+    if (!m || m->magic != MAP_MAGIC || cap < MAP_MIN_CAPACITY || (cap & (cap - 1)) ||
+        m->count >= cap || (m->slots & 3) ||
+        (uint64_t)m->slots + (uint64_t)cap * MAP_SLOT_WORDS * 4 > vm->memory_size) {
+        vm_errorf(vm, "Invalid map %u in %s", addr, op);
+        return NULL;
+    }
+    if (kind != KIND_ANY && m->kind != kind) {
+        vm_errorf(vm, "Wrong key type of map %u in %s", addr, op);
+        return NULL;
+    }
+    return m;
+}
+
+// Ключ байтовой таблицы хранится записью {длина, байты, 0}
+static const uint8_t *record_bytes(VM *vm, uint32_t rec, uint32_t *len) {
+    if ((uint64_t)rec + 4 > vm->memory_size)
+        return NULL;
+    *len = *word(vm, rec);
+    if ((uint64_t)rec + 4 + *len > vm->memory_size)
+        return NULL;
+    return vm->memory + rec + 4;
+}
+
+static uint32_t stored_hash(VM *vm, const MapHeader *m, uint32_t stored) {
+    if (m->kind == MAP_KIND_INT)
+        return hash_int(stored);
+    uint32_t len;
+    const uint8_t *p = record_bytes(vm, stored, &len);
+    return p ? hash_bytes(p, len) : 0;
+}
+
+static int key_equal(VM *vm, const MapHeader *m, uint32_t stored, const MapKey *k) {
+    if (m->kind == MAP_KIND_INT)
+        return stored == k->key;
+    uint32_t len;
+    const uint8_t *p = record_bytes(vm, stored, &len);
+    return p && len == k->len && memcmp(p, k->bytes, len) == 0;
+}
+
+static uint32_t map_find(VM *vm, const MapHeader *m, const MapKey *k) {
+    const uint32_t *s = word(vm, m->slots);
+    uint32_t mask = m->capacity - 1;
+    uint32_t i = k->hash & mask;
+    for (uint32_t dist = 0; dist <= mask; dist++, i = (i + 1) & mask) {
+        uint32_t meta = s[i * MAP_SLOT_WORDS];
+        // Пустой слот или слот ближе к своему началу: ключа нет
+        if (meta == 0 || (meta & META_DIST) - 1 < dist)
+            return NOT_FOUND;
+        if (((meta ^ k->hash) & ~META_DIST) == 0 && key_equal(vm, m, s[i * MAP_SLOT_WORDS + 1], k))
+            return i;
+    }
+    return NOT_FOUND;
+}
+
+// Вставка отсутствующего ключа: элемент, ушедший от своего начала дальше,
+// занимает слот, а вытесненный продолжает пробирование
+static int slot_insert(uint32_t *s, uint32_t mask, uint32_t hash, uint32_t key, uint32_t value) {
+    uint32_t tag = hash & ~META_DIST;
+    uint32_t i = hash & mask;
+    for (uint32_t dist = 0; dist <= MAX_DIST; dist++, i = (i + 1) & mask) {
+        uint32_t *slot = s + i * MAP_SLOT_WORDS;
+        if (slot[0] == 0) {
+            slot[0] = tag | (dist + 1);
+            slot[1] = key;
+            slot[2] = value;
+            return 0;
+        }
+        uint32_t d = (slot[0] & META_DIST) - 1;
+        if (d < dist) {
+            uint32_t t = slot[0], k = slot[1], v = slot[2];
+            slot[0] = tag | (dist + 1);
+            slot[1] = key;
+            slot[2] = value;
+            tag = t & ~META_DIST;
+            key = k;
+            value = v;
+            dist = d;
+        }
+    }
+    return -1;
+}
+
+// Удаление со сдвигом хвоста цепочки на слот назад
+static void slot_remove(uint32_t *s, uint32_t mask, uint32_t i) {
+    for (uint32_t n = 0; n <= mask; n++) {
+        uint32_t j = (i + 1) & mask;
+        uint32_t *next = s + j * MAP_SLOT_WORDS;
+        if (next[0] == 0 || (next[0] & META_DIST) == 1)
+            break;
+        s[i * MAP_SLOT_WORDS] = next[0] - 1;
+        s[i * MAP_SLOT_WORDS + 1] = next[1];
+        s[i * MAP_SLOT_WORDS + 2] = next[2];
+        i = j;
+    }
+    s[i * MAP_SLOT_WORDS] = 0;
+}
+
+// Новый массив слотов (обнулённый); 0 — память исчерпана
+static uint32_t slots_alloc(VM *vm, uint32_t capacity) {
+    if (capacity > UINT32_MAX / (MAP_SLOT_WORDS * 4))
+        return 0;
+    uint32_t bytes = capacity * MAP_SLOT_WORDS * 4;
+    uint32_t addr = vm_heap_alloc(vm, bytes);
+    if (addr)
+        memset(vm->memory + addr, 0, bytes);
+    return addr;
+}
+
+static int map_grow(VM *vm, MapHeader *m, const char *op) {
+    uint32_t capacity = m->capacity * 2;
+    uint32_t addr = capacity ? slots_alloc(vm, capacity) : 0;
+    if (!addr)
+        return -1;
+    const uint32_t *old = word(vm, m->slots);
+    uint32_t *s = word(vm, addr);
+    for (uint32_t i = 0; i < m->capacity; i++) {
+        const uint32_t *slot = old + i * MAP_SLOT_WORDS;
+        if (slot[0] && slot_insert(s, capacity - 1, stored_hash(vm, m, slot[1]), slot[1], slot[2]) != 0) {
+            vm_heap_free(vm, addr, op);
+            return -1;
+        }
+    }
+    vm_heap_free(vm, m->slots, op);
+    m->slots = addr;
+    m->capacity = capacity;
+    return 0;
+}
+
+// Флаги: EQ — ключ уже был (значение заменено), NE — добавлен
+static void map_put(VM *vm, MapHeader *m, const MapKey *k, uint32_t value, const char *op) {
+    uint32_t i = map_find(vm, m, k);
+    if (i != NOT_FOUND) {
+        word(vm, m->slots)[i * MAP_SLOT_WORDS + 2] = value;
+        vm->flags = 0x01;
+        return;
+    }
+    if ((uint64_t)(m->count + 1) * 8 > (uint64_t)m->capacity * 7 && map_grow(vm, m, op) != 0) {
+        if (vm->running)
+            vm_errorf(vm, "Out of memory in %s", op);
+        return;
+    }
+    uint32_t stored = k->key;
+    if (m->kind == MAP_KIND_BYTES) {
+        stored = k->len <= UINT32_MAX - 5 ? vm_heap_alloc(vm, k->len + 5) : 0;
+        if (!stored) {
+            if (vm->running)
+                vm_errorf(vm, "Out of memory in %s", op);
+            return;
+        }
+        *word(vm, stored) = k->len;
+        memcpy(vm->memory + stored + 4, k->bytes, k->len);
+        vm->memory[stored + 4 + k->len] = 0;
+    }
+    if (slot_insert(word(vm, m->slots), m->capacity - 1, k->hash, stored, value) != 0) {
+        vm_errorf(vm, "Too many colliding keys in %s", op);
+        return;
+    }
+    m->count++;
+    vm->flags = 0x02;
+}
+
+static void map_del(VM *vm, MapHeader *m, const MapKey *k, const char *op) {
+    uint32_t i = map_find(vm, m, k);
+    if (i == NOT_FOUND) {
+        vm->flags = 0x02;
+        return;
+    }
+    uint32_t stored = word(vm, m->slots)[i * MAP_SLOT_WORDS + 1];
+    slot_remove(word(vm, m->slots), m->capacity - 1, i);
+    m->count--;
+    if (m->kind == MAP_KIND_BYTES)
+        vm_heap_free(vm, stored, op);
+    vm->flags = 0x01;
+}
+
+static void map_new(VM *vm, uint32_t kind, const char *op) {
+    uint8_t r[2];
+    if (read_regs(vm, r, 2, op) != 0)
+        return;
+    uint32_t hint = vm->registers[r[1]];
+    vm->registers[r[0]] = 0;
+    uint64_t capacity = MAP_MIN_CAPACITY;
+    while (capacity * 7 < (uint64_t)hint * 8)
+        capacity *= 2;
+    if (capacity > UINT32_MAX / (MAP_SLOT_WORDS * 4))
+        return;
+    uint32_t addr = vm_heap_alloc(vm, sizeof(MapHeader));
+    if (!addr)
+        return;
+    uint32_t slots = slots_alloc(vm, (uint32_t)capacity);
+    if (!slots) {
+        if (vm->running)
+            vm_heap_free(vm, addr, op);
+        return;
+    }
+    MapHeader *m = (MapHeader *)(vm->memory + addr);
+    m->magic = MAP_MAGIC;
+    m->kind = kind;
+    m->count = 0;
+    m->capacity = (uint32_t)capacity;
+    m->slots = slots;
+    vm->registers[r[0]] = addr;
+}
+
+static int bytes_key(VM *vm, MapKey *k, uint32_t addr, uint32_t len) {
+    k->bytes = vm_guest_ptr(vm, addr, len, 0);
+    if (!k->bytes)
+        return -1;
+    k->len = len;
+    k->key = 0;
+    k->hash = hash_bytes(k->bytes, len);
+    return 0;
+}
+
+// MAP_NEW Rm, Rn: новая таблица с целыми ключами не меньше чем на Rn
+// элементов без роста; в Rm — её адрес или 0, если память исчерпана
+void op_map_new(VM *vm) {
+    map_new(vm, MAP_KIND_INT, "MAP_NEW");
+}
+
+// MAP_PUT Rm, Rk, Rv: table[Rk] = Rv
+void op_map_put(VM *vm) {
+    uint8_t r[3];
+    if (read_regs(vm, r, 3, "MAP_PUT") != 0)
+        return;
+    MapHeader *m = map_get(vm, vm->registers[r[0]], MAP_KIND_INT, "MAP_PUT");
+    if (!m)
+        return;
+    uint32_t key = vm->registers[r[1]];
+    MapKey k = { hash_int(key), key, NULL, 0 };
+    map_put(vm, m, &k, vm->registers[r[2]], "MAP_PUT");
+}
+
+// MAP_GET Rm, Rk, Rv: Rv = table[Rk]. Флаги: EQ — найдено, NE — нет (Rv = 0)
+void op_map_get(VM *vm) {
+    uint8_t r[3];
+    if (read_regs(vm, r, 3, "MAP_GET") != 0)
+        return;
+    MapHeader *m = map_get(vm, vm->registers[r[0]], MAP_KIND_INT, "MAP_GET");
+    if (!m)
+        return;
+    uint32_t key = vm->registers[r[1]];
+    MapKey k = { hash_int(key), key, NULL, 0 };
+    uint32_t i = map_find(vm, m, &k);
+    vm->registers[r[2]] = i != NOT_FOUND ? word(vm, m->slots)[i * MAP_SLOT_WORDS + 2] : 0;
+    vm->flags = i != NOT_FOUND ? 0x01 : 0x02;
+}
+
+// MAP_DEL Rm, Rk. Флаги: EQ — ключ удалён, NE — его не было
+void op_map_del(VM *vm) {
+    uint8_t r[2];
+    if (read_regs(vm, r, 2, "MAP_DEL") != 0)
+        return;
+    MapHeader *m = map_get(vm, vm->registers[r[0]], MAP_KIND_INT, "MAP_DEL");
+    if (!m)
+        return;
+    uint32_t key = vm->registers[r[1]];
+    MapKey k = { hash_int(key), key, NULL, 0 };
+    map_del(vm, m, &k, "MAP_DEL");
+}
+
+// MAP_ITER Rm, Rp, Rk: следующий элемент, начиная со слота Rp (вначале 0).
+// Rk — ключ (у байтовой таблицы — адрес байтов ключа, длина — слово перед
+// ними), R(k+1) — значение, Rp — позиция для следующего вызова.
+// Флаги: EQ — элемент найден, NE — обход закончен.
+void op_map_iter(VM *vm) {
+    uint8_t r[3];
+    if (read_regs(vm, r, 3, "MAP_ITER") != 0)
+        return;
+    if (r[2] + 1 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in MAP_ITER");
+        return;
+    }
+    MapHeader *m = map_get(vm, vm->registers[r[0]], KIND_ANY, "MAP_ITER");
+    if (!m)
+        return;
+    const uint32_t *s = word(vm, m->slots);
+    for (uint32_t i = vm->registers[r[1]]; i < m->capacity; i++) {
+        if (s[i * MAP_SLOT_WORDS]) {
+            uint32_t key = s[i * MAP_SLOT_WORDS + 1];
+            vm->registers[r[2]] = m->kind == MAP_KIND_BYTES ? key + 4 : key;
+            vm->registers[r[2] + 1] = s[i * MAP_SLOT_WORDS + 2];
+            vm->registers[r[1]] = i + 1;
+            vm->flags = 0x01;
+            return;
+        }
+    }
+    vm->registers[r[1]] = m->capacity;
+    vm->flags = 0x02;
+}
+
+// MAP_SNEW Rm, Rn: как MAP_NEW, но ключи — байтовые строки
+void op_map_snew(VM *vm) {
+    map_new(vm, MAP_KIND_BYTES, "MAP_SNEW");
+}
+
+// MAP_SPUT Rm, Ra, Rn, Rv: table[mem[Ra..Ra+Rn)] = Rv; новый ключ копируется в кучу
+void op_map_sput(VM *vm) {
+    uint8_t r[4];
+    if (read_regs(vm, r, 4, "MAP_SPUT") != 0)
+        return;
+    MapHeader *m = map_get(vm, vm->registers[r[0]], MAP_KIND_BYTES, "MAP_SPUT");
+    MapKey k;
+    if (!m || bytes_key(vm, &k, vm->registers[r[1]], vm->registers[r[2]]) != 0)
+        return;
+    map_put(vm, m, &k, vm->registers[r[3]], "MAP_SPUT");
+}
+
+// MAP_SGET Rm, Ra, Rn, Rv: Rv = table[mem[Ra..Ra+Rn)]. Флаги — как у MAP_GET
+void op_map_sget(VM *vm) {
+    uint8_t r[4];
+    if (read_regs(vm, r, 4, "MAP_SGET") != 0)
+        return;
+    MapHeader *m = map_get(vm, vm->registers[r[0]], MAP_KIND_BYTES, "MAP_SGET");
+    MapKey k;
+    if (!m || bytes_key(vm, &k, vm->registers[r[1]], vm->registers[r[2]]) != 0)
+        return;
+    uint32_t i = map_find(vm, m, &k);
+    vm->registers[r[3]] = i != NOT_FOUND ? word(vm, m->slots)[i * MAP_SLOT_WORDS + 2] : 0;
+    vm->flags = i != NOT_FOUND ? 0x01 : 0x02;
+}
+
+// MAP_SDEL Rm, Ra, Rn. Флаги — как у MAP_DEL
+void op_map_sdel(VM *vm) {
+    uint8_t r[3];
+    if (read_regs(vm, r, 3, "MAP_SDEL") != 0)
+        return;
+    MapHeader *m = map_get(vm, vm->registers[r[0]], MAP_KIND_BYTES, "MAP_SDEL");
+    MapKey k;
+    if (!m || bytes_key(vm, &k, vm->registers[r[1]], vm->registers[r[2]]) != 0)
+        return;
+    map_del(vm, m, &k, "MAP_SDEL");
+}
+
+// MAP_FREE Rm: освобождение таблицы (адрес 0 игнорируется)
+void op_map_free(VM *vm) {
+    uint8_t r;
+    if (read_regs(vm, &r, 1, "MAP_FREE") != 0)
+        return;
+    uint32_t addr = vm->registers[r];
+    if (addr == 0)
+        return;
+    MapHeader *m = map_get(vm, addr, KIND_ANY, "MAP_FREE");
+    if (!m)
+        return;
+    if (m->kind == MAP_KIND_BYTES) {
+        const uint32_t *s = word(vm, m->slots);
+        for (uint32_t i = 0; i < m->capacity && vm->running; i++) {
+            if (s[i * MAP_SLOT_WORDS])
+                vm_heap_free(vm, s[i * MAP_SLOT_WORDS + 1], "MAP_FREE");
+        }
+    }
+    vm_heap_free(vm, m->slots, "MAP_FREE");
+    m->magic = 0;
+    vm_heap_free(vm, addr, "MAP_FREE");
+}
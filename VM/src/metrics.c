@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "vm.h"
+#include "decode.h"
+#include "threads.h"
+#include "metrics.h"
+
+// Базовые блоки заканчиваются инструкциями, после которых исполнение может
+// продолжиться не со следующего адреса: HALT, JUMP, CALL, RET, IF, RESTORE
+
+static uint32_t block_index(const Metrics *m, const VM *vm, uint32_t addr) {
+    return m->insn_index[addr < vm->program_size ? addr : vm->program_size];
+}
+
+static void count_instructions(VM *vm, uint64_t n) {
+    Metrics *m = vm->metrics;
+    uint64_t *counter = &m->page->counters[MET_INSTRUCTIONS];
+    uint64_t total;
+    // Пока потоков гостя нет, счётчик пишет одна VM: хватает обычного
+    // сложения с relaxed-записью, без блокирующей шину операции
+    if (!vm->threads) {
+        total = __atomic_load_n(counter, __ATOMIC_RELAXED) + n;
+        __atomic_store_n(counter, total, __ATOMIC_RELAXED);
+    } else {
+        vm->insn_pending += n;
+        if (vm->insn_pending < METRICS_BATCH)
+            return;
+        total = __atomic_add_fetch(counter, vm->insn_pending, __ATOMIC_RELAXED);
+        vm->insn_pending = 0;
+    }
+    if (m->limits[MET_INSTRUCTIONS] && total > m->limits[MET_INSTRUCTIONS])
+        metrics_limit_error(vm, MET_INSTRUCTIONS);
+}
+
+// Завершение блока: длина блока от block_start до инструкции addr включительно
+static void retire_block(VM *vm, uint32_t addr) {
+    Metrics *m = vm->metrics;
+    uint32_t first = block_index(m, vm, vm->block_start);
+    uint32_t last = block_index(m, vm, addr);
+    // После перехода, заданного извне (отладчик), начало блока может оказаться дальше
+    count_instructions(vm, last >= first ? (uint64_t)(last - first) + 1 : 1);
+    vm->block_start = vm->ip;
+    // Положение в коде показывает исходная VM; потоки гостя не пишут в
+    // общую страницу на каждом блоке
+    if (!vm->threads || vm->threads->root == vm) {
+        __atomic_store_n(&m->page->ip, vm->ip, __ATOMIC_RELAXED);
+        __atomic_store_n(&m->page->call_depth, vm->rsp, __ATOMIC_RELAXED);
+    }
+}
+
+// Обёртка для каждой инструкции конца блока: исходный обработчик берётся
+// из m->base по известному опкоду, без чтения байта из памяти
+#define BLOCK_END(opcode)                          \
+    static void block_end_##opcode(VM *vm) {       \
+        uint32_t addr = vm->ip - 1;                \
+        vm->metrics->base[opcode](vm);             \
+        retire_block(vm, addr);                    \
+    }
+
+BLOCK_END(OP_HALT)
+BLOCK_END(OP_JUMP)
+BLOCK_END(OP_CALL)
+BLOCK_END(OP_RET)
+BLOCK_END(OP_IF)
+BLOCK_END(OP_SWITCH)
+BLOCK_END(OP_JUMPR)
+BLOCK_END(OP_CALLR)
+BLOCK_END(OP_RESTORE)
+
+void metrics_patch_table(VM *vm, instruction_fn *table) {
+    if (!vm->metrics)
+        return;
+    table[OP_HALT] = block_end_OP_HALT;
+    table[OP_JUMP] = block_end_OP_JUMP;
+    table[OP_CALL] = block_end_OP_CALL;
+    table[OP_RET] = block_end_OP_RET;
+    table[OP_IF] = block_end_OP_IF;
+    table[OP_SWITCH] = block_end_OP_SWITCH;
+    table[OP_JUMPR] = block_end_OP_JUMPR;
+    table[OP_CALLR] = block_end_OP_CALLR;
+    table[OP_RESTORE] = block_end_OP_RESTORE;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Файл METRICS_DIR/airvm-<pid>, для следующих VM процесса — airvm-<pid>-<n>
+static int create_page_file(char **path) {
+    static unsigned instance;
+    char name[128];
+    unsigned n = instance++;
+    if (n == 0)
+        snprintf(name, sizeof(name), METRICS_DIR "/" METRICS_PREFIX "%ld", (long)getpid());
+    else
+        snprintf(name, sizeof(name), METRICS_DIR "/" METRICS_PREFIX "%ld-%u", (long)getpid(), n);
+    int fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create metrics file %s: %s\n", name, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(MetricsPage)) != 0) {
+        fprintf(stderr, "Error: Cannot size metrics file %s: %s\n", name, strerror(errno));
+        close(fd);
+        unlink(name);
+        return -1;
+    }
+    *path = strdup(name);
+    return fd;
+}
+
+// Учёт со страницей счётчиков в памяти процесса
+static Metrics *metrics_create(VM *vm) {
+    Metrics *m = calloc(1, sizeof(Metrics));
+    uint32_t *index = m ? malloc(((size_t)vm->program_size + 1) * sizeof(uint32_t)) : NULL;
+    MetricsPage *page = index ? calloc(1, sizeof(MetricsPage)) : NULL;
+    if (!page) {
+        free(index);
+        free(m);
+        fprintf(stderr, "Error: Failed to allocate metrics\n");
+        return NULL;
+    }
+    // Префиксные суммы начал инструкций: длина блока — разность двух элементов
+    uint32_t count = 0;
+    for (uint32_t a = 0; a < vm->program_size; a++) {
+        index[a] = count;
+        if (vm->insn_map && insn_map_test(vm->insn_map, a))
+            count++;
+    }
+    index[vm->program_size] = count;
+    m->insn_index = index;
+    m->page = page;
+    m->page->pid = (uint32_t)getpid();
+    m->page->version = METRICS_VERSION;
+    m->exceeded = -1;
+    init_dispatch_table(m->base);
+    return m;
+}
+
+int metrics_enable(VM *vm) {
+    if (vm->metrics)
+        return 0;
+    vm->metrics = metrics_create(vm);
+    if (!vm->metrics)
+        return -1;
+    metrics_set(vm, MET_MEMORY_SIZE, vm->memory_size);
+    metrics_set(vm, MET_OPEN_FILES, vm->files.open);
+    return 0;
+}
+
+int metrics_attach(VM *vm, const char *program) {
+    if (metrics_enable(vm) != 0)
+        return -1;
+    Metrics *m = vm->metrics;
+    if (m->path)
+        return 0;
+    int fd = create_page_file(&m->path);
+    if (fd < 0)
+        return -1;
+    void *p = mmap(NULL, sizeof(MetricsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "Error: Cannot map metrics file %s\n", m->path);
+        unlink(m->path);
+        free(m->path);
+        m->path = NULL;
+        return -1;
+    }
+    // Счётчики, накопленные до создания файла, переходят в него
+    memcpy(p, m->page, sizeof(MetricsPage));
+    free(m->page);
+    m->page = p;
+    const char *base = program ? strrchr(program, '/') : NULL;
+    snprintf(m->page->program, sizeof(m->page->program), "%s",
+             base ? base + 1 : program ? program : "?");
+    // Признак готовой страницы записывается последним
+    __atomic_store_n(&m->page->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void release_page(Metrics *m) {
+    if (m->path)
+        munmap(m->page, sizeof(MetricsPage));
+    else
+        free(m->page);
+}
+
+void metrics_free(VM *vm) {
+    Metrics *m = vm->metrics;
+    if (!m)
+        return;
+    release_page(m);
+    if (m->path)
+        unlink(m->path);
+    free(m->path);
+    free(m->insn_index);
+    free(m);
+    vm->metrics = NULL;
+}
+
+int metrics_reattach(VM *vm) {
+    Metrics *m = vm->metrics;
+    if (!m)
+        return 0;
+    char program[sizeof(m->page->program)];
+    uint64_t limits[MET_COUNTERS];
+    int shared = m->path != NULL;
+    memcpy(program, m->page->program, sizeof(program));
+    memcpy(limits, m->limits, sizeof(limits));
+    // Файл родителя остаётся за ним; квоты действуют в процессе заново
+    release_page(m);
+    free(m->path);
+    free(m->insn_index);
+    free(m);
+    vm->metrics = NULL;
+    if ((shared ? metrics_attach(vm, program) : metrics_enable(vm)) != 0)
+        return -1;
+    memcpy(vm->metrics->limits, limits, sizeof(limits));
+    return 0;
+}
+
+void metrics_start(VM *vm) {
+    Metrics *m = vm->metrics;
+    if (vm->threads)
+        return;
+    m->outer = vm->dispatch;
+    memcpy(m->table, vm->dispatch, sizeof(m->table));
+    metrics_patch_table(vm, m->table);
+    vm->dispatch = m->table;
+    vm->block_start = vm->ip;
+    m->page->start_ns = monotonic_ns();
+    __atomic_store_n(&m->page->running, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_finish(VM *vm) {
+    Metrics *m = vm->metrics;
+    // Блок, прерванный ошибкой или концом кода: инструкции, начатые до ip
+    uint32_t first = block_index(m, vm, vm->block_start);
+    uint32_t last = block_index(m, vm, vm->ip);
+    if (last > first)
+        count_instructions(vm, last - first);
+    vm->block_start = vm->ip;
+    if (vm->insn_pending) {
+        __atomic_fetch_add(&m->page->counters[MET_INSTRUCTIONS], vm->insn_pending, __ATOMIC_RELAXED);
+        vm->insn_pending = 0;
+    }
+    // Поток гостя только сбрасывает свои инструкции; состояние — у исходной VM
+    if (vm->threads && vm->threads->root != vm)
+        return;
+    if (vm->dispatch == m->table)
+        vm->dispatch = m->outer;
+    __atomic_store_n(&m->page->ip, vm->ip, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->page->call_depth, vm->rsp, __ATOMIC_RELAXED);
+    __atomic_store_n(&m->page->running, 0, __ATOMIC_RELAXED);
+}
+
+int vm_set_limit(VM *vm, MetricsCounter c, uint64_t limit) {
+    if (c != MET_INSTRUCTIONS && c != MET_BYTES_WRITTEN && c != MET_MEMORY_SIZE && c != MET_OPEN_FILES) {
+        fprintf(stderr, "Error: Counter %d has no limit\n", (int)c);
+        return -1;
+    }
+    if (metrics_enable(vm) != 0)
+        return -1;
+    vm->metrics->limits[c] = limit;
+    return 0;
+}
+
+uint64_t vm_usage(const VM *vm, MetricsCounter c) {
+    if (vm->metrics) {
+        uint64_t n = __atomic_load_n(&vm->metrics->page->counters[c], __ATOMIC_RELAXED);
+        return c == MET_INSTRUCTIONS ? n + vm->insn_pending : n;
+    }
+    if (c == MET_MEMORY_SIZE)
+        return vm->memory_size;
+    if (c == MET_OPEN_FILES)
+        return vm->files.open;
+    return 0;
+}
+
+int vm_limit_exceeded(const VM *vm) {
+    return vm->metrics ? __atomic_load_n(&vm->metrics->exceeded, __ATOMIC_RELAXED) : -1;
+}
+
+void metrics_print_summary(const VM *vm, FILE *out) {
+    fprintf(out, "Instructions: %llu, memory: %llu bytes, open files: %llu, output: %llu bytes\n",
+            (unsigned long long)vm_usage(vm, MET_INSTRUCTIONS),
+            (unsigned long long)vm_usage(vm, MET_MEMORY_SIZE),
+            (unsigned long long)vm_usage(vm, MET_OPEN_FILES),
+            (unsigned long long)vm_usage(vm, MET_BYTES_WRITTEN));
+}
+
+void metrics_limit_error(VM *vm, MetricsCounter c) {
+    static const char *const names[MET_COUNTERS] = {
+        [MET_INSTRUCTIONS] = "Instruction",
+        [MET_BYTES_WRITTEN] = "Output",
+        [MET_MEMORY_SIZE] = "Memory",
+        [MET_OPEN_FILES] = "Open file",
+    };
+    int bytes = c == MET_BYTES_WRITTEN || c == MET_MEMORY_SIZE;
+    __atomic_store_n(&vm->metrics->exceeded, (int)c, __ATOMIC_RELAXED);
+    // Квоты общие для группы потоков: останавливаются все её VM
+    if (vm->threads)
+        thread_group_stop(vm);
+    vm_errorf(vm, "%s limit exceeded (limit: %llu%s)", names[c] ? names[c] : "Resource",
+              (unsigned long long)vm->metrics->limits[c], bytes ? " bytes" : "");
+}
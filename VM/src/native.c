@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "native.h"
+
+int vm_register_native(VM *vm, uint32_t id, const char *name, native_fn fn, void *ctx) {
+    if (id >= MAX_NATIVES || !fn || !name || !*name) {
+        fprintf(stderr, "Error: Invalid native function registration (id %u)\n", id);
+        return -1;
+    }
+    if (vm_native_id(vm, name) >= 0 || (id < vm->native_count && vm->natives[id].fn)) {
+        fprintf(stderr, "Error: Native function %u '%s' is already registered\n", id, name);
+        return -1;
+    }
+    if (id >= vm->native_count) {
+        NativeEntry *grown = realloc(vm->natives, (id + 1) * sizeof(NativeEntry));
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to allocate native function table\n");
+            return -1;
+        }
+        memset(grown + vm->native_count, 0, (id + 1 - vm->native_count) * sizeof(NativeEntry));
+        vm->natives = grown;
+        vm->native_count = id + 1;
+    }
+    char *copy = strdup(name);
+    if (!copy) {
+        fprintf(stderr, "Error: Failed to allocate native function table\n");
+        return -1;
+    }
+    vm->natives[id].fn = fn;
+    vm->natives[id].ctx = ctx;
+    vm->natives[id].name = copy;
+    return 0;
+}
+
+int vm_native_id(const VM *vm, const char *name) {
+    for (uint32_t i = 0; i < vm->native_count; i++) {
+        if (vm->natives[i].fn && strcmp(vm->natives[i].name, name) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+void vm_write_native_manifest(const VM *vm, FILE *out) {
+    fprintf(out, "# AirVM native functions: <id> <name>\n");
+    for (uint32_t i = 0; i < vm->native_count; i++) {
+        if (vm->natives[i].fn)
+            fprintf(out, "%u %s\n", i, vm->natives[i].name);
+    }
+}
+
+void vm_free_natives(VM *vm) {
+    for (uint32_t i = 0; i < vm->native_count; i++)
+        free(vm->natives[i].name);
+    free(vm->natives);
+    vm->natives = NULL;
+    vm->native_count = 0;
+}
+
+uint8_t *vm_guest_ptr(VM *vm, uint32_t addr, uint32_t len, int writable) {
+    uint64_t end = (uint64_t)addr + len;
+    if (writable && end <= UINT32_MAX)
+        ensure_memory(vm, (uint32_t)end);
+    if (!vm->running)
+        return NULL;
+    if (end > vm->memory_size) {
+        vm_errorf(vm, "Native memory access [%u, %llu) out of bounds (memory size: %u)",
+                  addr, (unsigned long long)end, vm->memory_size);
+        return NULL;
+    }
+    return vm->memory + addr;
+}
+
+// mem_copy: R1 — адрес назначения, R2 — источник, R3 — число байт
+static int native_mem_copy(VM *vm, void *ctx) {
+    (void)ctx;
+    uint32_t len = vm->registers[3];
+    uint8_t *dst = vm_guest_ptr(vm, vm->registers[1], len, 1);
+    uint8_t *src = vm_guest_ptr(vm, vm->registers[2], len, 0);
+    if (!dst || !src)
+        return -1;
+    memmove(dst, src, len);
+    return 0;
+}
+
+// mem_fill: R1 — адрес, R2 — значение байта, R3 — число байт
+static int native_mem_fill(VM *vm, void *ctx) {
+    (void)ctx;
+    uint8_t *dst = vm_guest_ptr(vm, vm->registers[1], vm->registers[3], 1);
+    if (!dst)
+        return -1;
+    memset(dst, (int)(vm->registers[2] & 0xFF), vm->registers[3]);
+    return 0;
+}
+
+// mem_compare: R1, R2 — адреса, R3 — число байт; R0 = 0 (равны), 1 (R1 > R2), 0xFFFFFFFF (R1 < R2)
+static int native_mem_compare(VM *vm, void *ctx) {
+    (void)ctx;
+    uint32_t len = vm->registers[3];
+    uint8_t *a = vm_guest_ptr(vm, vm->registers[1], len, 0);
+    uint8_t *b = vm_guest_ptr(vm, vm->registers[2], len, 0);
+    if (!a || !b)
+        return -1;
+    int c = memcmp(a, b, len);
+    vm->registers[0] = c < 0 ? UINT32_MAX : (c > 0 ? 1 : 0);
+    return 0;
+}
+
+// str_len: R1 — адрес строки с завершающим нулём; R0 = длина
+static int native_str_len(VM *vm, void *ctx) {
+    (void)ctx;
+    uint32_t addr = vm->registers[1];
+    if (addr >= vm->memory_size) {
+        vm_errorf(vm, "Native memory access at %u out of bounds (memory size: %u)", addr, vm->memory_size);
+        return -1;
+    }
+    const uint8_t *s = vm->memory + addr;
+    const uint8_t *nul = memchr(s, 0, vm->memory_size - addr);
+    if (!nul) {
+        vm_error(vm, "Unterminated string in str_len");
+        return -1;
+    }
+    vm->registers[0] = (uint32_t)(nul - s);
+    return 0;
+}
+
+void vm_register_builtin_natives(VM *vm) {
+    vm_register_native(vm, 0, "mem_copy", native_mem_copy, NULL);
+    vm_register_native(vm, 1, "mem_fill", native_mem_fill, NULL);
+    vm_register_native(vm, 2, "mem_compare", native_mem_compare, NULL);
+    vm_register_native(vm, 3, "str_len", native_str_len, NULL);
+}
@@ -0,0 +1,586 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "vm.h"
+#include "pipeline.h"
+#include "loader.h"
+#include "native.h"
+#include "metrics.h"
+#include "timer.h"
+#include "cli.h"
+
+static FILE *empty_input;   // stdin стадий, кроме первой
+
+// ---------------------------------------------------------------------------
+// Каналы
+// ---------------------------------------------------------------------------
+
+static inline int still_running(const VM *vm) {
+    return __atomic_load_n(&vm->running, __ATOMIC_RELAXED);
+}
+
+// Сон, пока слово по addr равно value, не дольше TIMER_SLICE_NS
+static void futex_sleep(uint32_t *addr, uint32_t value) {
+    struct timespec ts = { 0, (long)TIMER_SLICE_NS };
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, &ts, NULL, 0);
+}
+
+// Пробуждение другой стороны, если она объявила, что ждёт. Барьер
+// упорядочивает публикацию head/tail и чтение флага: иначе сторона,
+// проверившая кольцо до публикации, могла бы заснуть без пробуждения.
+static inline void wake_peer(uint32_t *waiting, uint32_t *seq) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(seq, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static inline uint32_t record_size(uint32_t len) {
+    return 4 + ((len + 3) & ~3u);
+}
+
+static void ring_write(Channel *c, uint64_t pos, const uint8_t *src, uint32_t len) {
+    uint32_t off = (uint32_t)pos & (c->capacity - 1);
+    uint32_t first = c->capacity - off < len ? c->capacity - off : len;
+    memcpy(c->data + off, src, first);
+    memcpy(c->data, src + first, len - first);
+}
+
+static void ring_read(const Channel *c, uint64_t pos, uint8_t *dst, uint32_t len) {
+    uint32_t off = (uint32_t)pos & (c->capacity - 1);
+    uint32_t first = c->capacity - off < len ? c->capacity - off : len;
+    memcpy(dst, c->data + off, first);
+    memcpy(dst + first, c->data, len - first);
+}
+
+static PipelineStage *chan_stage(VM *vm, const char *op) {
+    PipelineStage *s = vm->stage;
+    if (!s) {
+        vm_errorf(vm, "%s is only available in --pipeline mode", op);
+        return NULL;
+    }
+    // Кольцо рассчитано на одного отправителя и одного получателя
+    if (vm != &s->vm) {
+        vm_errorf(vm, "%s is only available to the main thread of a pipeline stage", op);
+        return NULL;
+    }
+    return s;
+}
+
+static Channel *chan_get(VM *vm, PipelineStage *s, uint32_t handle, int sending, const char *op) {
+    Pipeline *p = s->pipeline;
+    if (handle >= p->channel_count) {
+        vm_errorf(vm, "Invalid channel %u in %s", handle, op);
+        return NULL;
+    }
+    Channel *c = &p->channels[handle];
+    if ((sending ? c->from : c->to) != s->index) {
+        vm_errorf(vm, "Stage '%s' cannot %s channel '%s'", s->name, sending ? "send to" : "receive from", c->name);
+        return NULL;
+    }
+    return c;
+}
+
+static int read_regs(VM *vm, uint8_t *r, int n, const char *op) {
+    for (int i = 0; i < n; i++)
+        r[i] = read_byte(vm);
+    for (int i = 0; i < n; i++) {
+        if (r[i] >= NUM_REGS) {
+            vm_errorf(vm, "Invalid register R%d in %s", r[i], op);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Инструкция CHAN_OPEN: CHAN_OPEN reg_chan, reg_name
+// reg_name — адрес имени канала (с завершающим нулём); в reg_chan
+// записывается дескриптор канала, подключённого к этой стадии.
+void op_chan_open(VM *vm) {
+    uint8_t r[2];
+    if (read_regs(vm, r, 2, "CHAN_OPEN") != 0)
+        return;
+    PipelineStage *s = chan_stage(vm, "CHAN_OPEN");
+    if (!s)
+        return;
+    uint32_t addr = vm->registers[r[1]];
+    if (addr >= vm->memory_size || !memchr(vm->memory + addr, 0, vm->memory_size - addr)) {
+        vm_error(vm, "Invalid channel name address in CHAN_OPEN");
+        return;
+    }
+    const char *name = (const char *)vm->memory + addr;
+    Pipeline *p = s->pipeline;
+    for (uint32_t i = 0; i < p->channel_count; i++) {
+        const Channel *c = &p->channels[i];
+        if ((c->from == s->index || c->to == s->index) && strcmp(c->name, name) == 0) {
+            vm->registers[r[0]] = i;
+            return;
+        }
+    }
+    vm_errorf(vm, "Channel '%.64s' is not connected to stage '%s'", name, s->name);
+}
+
+// Ожидание места под need байт. 0 — место есть, -1 — VM остановлена.
+static int wait_space(VM *vm, PipelineStage *s, Channel *c, uint32_t need) {
+    uint64_t start = timer_now_ns();
+    int spins = 0;
+    for (;;) {
+        c->tail_cache = __atomic_load_n(&c->tail, __ATOMIC_ACQUIRE);
+        if (c->capacity - (c->head - c->tail_cache) >= need)
+            break;
+        if (__atomic_load_n(&c->abandoned, __ATOMIC_ACQUIRE)) {
+            vm_errorf(vm, "Receiver of channel '%s' has exited", c->name);
+            return -1;
+        }
+        if (!still_running(vm))
+            return -1;
+        if (spins < CHAN_SPIN + CHAN_YIELDS) {
+            // Другая сторона может ждать процессора: уступаем его, прежде
+            // чем засыпать на futex
+            if (spins++ >= CHAN_SPIN)
+                sched_yield();
+            continue;
+        }
+        uint32_t seq = __atomic_load_n(&c->space_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&c->send_waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        uint64_t tail = __atomic_load_n(&c->tail, __ATOMIC_ACQUIRE);
+        if (c->capacity - (c->head - tail) < need && !__atomic_load_n(&c->abandoned, __ATOMIC_ACQUIRE)) {
+            c->full_waits++;
+            futex_sleep(&c->space_seq, seq);
+        }
+        __atomic_store_n(&c->send_waiting, 0, __ATOMIC_RELAXED);
+    }
+    s->send_wait_ns += timer_now_ns() - start;
+    return 0;
+}
+
+// Ожидание сообщения. 0 — сообщение есть, 1 — канал закрыт и пуст,
+// -1 — VM остановлена.
+static int wait_data(VM *vm, PipelineStage *s, Channel *c) {
+    uint64_t start = timer_now_ns();
+    int spins = 0;
+    int rc = 0;
+    for (;;) {
+        // closed читается раньше head: после закрытия head уже не растёт
+        uint32_t closed = __atomic_load_n(&c->closed, __ATOMIC_ACQUIRE);
+        c->head_cache = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE);
+        if (c->head_cache != c->tail)
+            break;
+        if (closed) {
+            rc = 1;
+            break;
+        }
+        if (!still_running(vm))
+            return -1;
+        if (spins < CHAN_SPIN + CHAN_YIELDS) {
+            // Другая сторона может ждать процессора: уступаем его, прежде
+            // чем засыпать на futex
+            if (spins++ >= CHAN_SPIN)
+                sched_yield();
+            continue;
+        }
+        uint32_t seq = __atomic_load_n(&c->data_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&c->recv_waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&c->head, __ATOMIC_ACQUIRE) == c->tail &&
+            !__atomic_load_n(&c->closed, __ATOMIC_ACQUIRE)) {
+            c->empty_waits++;
+            futex_sleep(&c->data_seq, seq);
+        }
+        __atomic_store_n(&c->recv_waiting, 0, __ATOMIC_RELAXED);
+    }
+    s->recv_wait_ns += timer_now_ns() - start;
+    return rc;
+}
+
+// Инструкция CHAN_SEND: CHAN_SEND reg_chan, reg_addr, reg_len
+// Отправляет reg_len байт по адресу reg_addr; ждёт, если в кольце нет места.
+void op_chan_send(VM *vm) {
+    uint8_t r[3];
+    if (read_regs(vm, r, 3, "CHAN_SEND") != 0)
+        return;
+    PipelineStage *s = chan_stage(vm, "CHAN_SEND");
+    if (!s)
+        return;
+    Channel *c = chan_get(vm, s, vm->registers[r[0]], 1, "CHAN_SEND");
+    if (!c)
+        return;
+    uint32_t len = vm->registers[r[2]];
+    if (len > c->capacity - 4) {
+        vm_errorf(vm, "Message of %u bytes does not fit in channel '%s' (%u bytes)", len, c->name, c->capacity);
+        return;
+    }
+    const uint8_t *src = vm_guest_ptr(vm, vm->registers[r[1]], len, 0);
+    if (!src)
+        return;
+    uint32_t need = record_size(len);
+    if (c->capacity - (c->head - c->tail_cache) < need && wait_space(vm, s, c, need) != 0)
+        return;
+    uint64_t head = c->head;
+    memcpy(c->data + ((uint32_t)head & (c->capacity - 1)), &len, 4);
+    ring_write(c, head + 4, src, len);
+    __atomic_store_n(&c->head, head + need, __ATOMIC_RELEASE);
+    wake_peer(&c->recv_waiting, &c->data_seq);
+
+    if ((c->messages++ & CHAN_SAMPLE_MASK) == 0) {
+        uint64_t fill = head + need - __atomic_load_n(&c->tail, __ATOMIC_RELAXED);
+        c->fill_sum += fill;
+        c->fill_samples++;
+        if (fill > c->fill_max)
+            c->fill_max = fill;
+    }
+    c->bytes += len;
+    s->messages_out++;
+    s->bytes_out += len;
+}
+
+// Инструкция CHAN_RECV: CHAN_RECV reg_chan, reg_addr, reg_max, reg_len
+// Принимает сообщение в буфер reg_addr размером reg_max байт; в reg_len —
+// длина сообщения и флаг EQ, либо CHAN_CLOSED и флаг NE, если отправитель
+// завершился и сообщений больше нет.
+void op_chan_recv(VM *vm) {
+    uint8_t r[4];
+    if (read_regs(vm, r, 4, "CHAN_RECV") != 0)
+        return;
+    PipelineStage *s = chan_stage(vm, "CHAN_RECV");
+    if (!s)
+        return;
+    Channel *c = chan_get(vm, s, vm->registers[r[0]], 0, "CHAN_RECV");
+    if (!c)
+        return;
+    if (c->head_cache == c->tail) {
+        int rc = wait_data(vm, s, c);
+        if (rc < 0)
+            return;
+        if (rc > 0) {
+            vm->registers[r[3]] = CHAN_CLOSED;
+            vm->flags = 0x02;
+            return;
+        }
+    }
+    uint64_t tail = c->tail;
+    uint32_t len;
+    memcpy(&len, c->data + ((uint32_t)tail & (c->capacity - 1)), 4);
+    uint32_t max = vm->registers[r[2]];
+    if (len > max) {
+        vm_errorf(vm, "Message of %u bytes does not fit in a %u-byte buffer in CHAN_RECV", len, max);
+        return;
+    }
+    uint8_t *dst = vm_guest_ptr(vm, vm->registers[r[1]], len, 1);
+    if (!dst)
+        return;
+    ring_read(c, tail + 4, dst, len);
+    __atomic_store_n(&c->tail, tail + record_size(len), __ATOMIC_RELEASE);
+    wake_peer(&c->send_waiting, &c->space_seq);
+
+    s->messages_in++;
+    s->bytes_in += len;
+    vm->registers[r[3]] = len;
+    vm->flags = 0x01;
+}
+
+// Завершившаяся стадия закрывает исходящие каналы и бросает входящие
+static void stage_close_channels(PipelineStage *s) {
+    Pipeline *p = s->pipeline;
+    for (uint32_t i = 0; i < p->channel_count; i++) {
+        Channel *c = &p->channels[i];
+        if (c->from == s->index) {
+            __atomic_store_n(&c->closed, 1, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&c->data_seq, 1, __ATOMIC_RELEASE);
+            syscall(SYS_futex, &c->data_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+        if (c->to == s->index) {
+            __atomic_store_n(&c->abandoned, 1, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&c->space_seq, 1, __ATOMIC_RELEASE);
+            syscall(SYS_futex, &c->space_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Файл конвейера
+// ---------------------------------------------------------------------------
+
+static int find_stage(const Pipeline *p, const char *name) {
+    for (uint32_t i = 0; i < p->stage_count; i++) {
+        if (strcmp(p->stages[i].name, name) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+static int find_channel(const Pipeline *p, const char *name) {
+    for (uint32_t i = 0; i < p->channel_count; i++) {
+        if (strcmp(p->channels[i].name, name) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+static int add_stage(Pipeline *p, const char *name, const char *path, char *err, size_t err_len) {
+    if (p->stage_count == PIPELINE_MAX_STAGES) {
+        snprintf(err, err_len, "too many stages (at most %u)", PIPELINE_MAX_STAGES);
+        return -1;
+    }
+    if (find_stage(p, name) >= 0) {
+        snprintf(err, err_len, "duplicate stage '%s'", name);
+        return -1;
+    }
+    PipelineStage *grown = realloc(p->stages, (p->stage_count + 1) * sizeof(PipelineStage));
+    if (!grown) {
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    p->stages = grown;
+    PipelineStage *s = &p->stages[p->stage_count];
+    memset(s, 0, sizeof(*s));
+    s->index = p->stage_count++;
+    s->name = strdup(name);
+    s->path = strdup(path);
+    if (!s->name || !s->path) {
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    return 0;
+}
+
+static int add_channel(Pipeline *p, char **words, int n, char *err, size_t err_len) {
+    const char *name = words[1];
+    if (find_channel(p, name) >= 0) {
+        snprintf(err, err_len, "duplicate channel '%s'", name);
+        return -1;
+    }
+    int from = find_stage(p, words[2]), to = find_stage(p, words[3]);
+    if (from < 0 || to < 0) {
+        snprintf(err, err_len, "unknown stage '%s'", from < 0 ? words[2] : words[3]);
+        return -1;
+    }
+    if (from == to) {
+        snprintf(err, err_len, "channel '%s' connects stage '%s' to itself", name, words[2]);
+        return -1;
+    }
+    uint64_t size = n == 5 ? cli_parse_size(words[4]) : CHAN_DEFAULT_CAPACITY;
+    if (size == 0 || size > CHAN_MAX_CAPACITY) {
+        snprintf(err, err_len, "channel capacity must be between 1 and %u bytes", CHAN_MAX_CAPACITY);
+        return -1;
+    }
+    uint32_t capacity = CHAN_MIN_CAPACITY;
+    while (capacity < size)
+        capacity <<= 1;
+    Channel *grown = realloc(p->channels, (p->channel_count + 1) * sizeof(Channel));
+    if (!grown) {
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    p->channels = grown;
+    Channel *c = &p->channels[p->channel_count++];
+    memset(c, 0, sizeof(*c));
+    c->name = strdup(name);
+    c->data = malloc(capacity);
+    c->capacity = capacity;
+    c->from = (uint32_t)from;
+    c->to = (uint32_t)to;
+    if (!c->name || !c->data) {
+        snprintf(err, err_len, "out of memory");
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_line(Pipeline *p, char *line, char *err, size_t err_len) {
+    char *save = NULL;
+    char *words[6];
+    int n = 0;
+    for (char *w = strtok_r(line, " \t\r\n", &save); w && n < 6; w = strtok_r(NULL, " \t\r\n", &save))
+        words[n++] = w;
+    if (n == 0 || words[0][0] == '#')
+        return 0;
+    if (strcmp(words[0], "stage") == 0 && n == 3)
+        return add_stage(p, words[1], words[2], err, err_len);
+    if (strcmp(words[0], "channel") == 0 && (n == 4 || n == 5))
+        return add_channel(p, words, n, err, err_len);
+    snprintf(err, err_len, "expected 'stage <name> <program>' or 'channel <name> <from> <to> [capacity]'");
+    return -1;
+}
+
+// Относительные пути программ отсчитываются от каталога файла конвейера
+static char *stage_path(const char *config, const char *path) {
+    const char *slash = strrchr(config, '/');
+    if (path[0] == '/' || !slash)
+        return strdup(path);
+    size_t dir = (size_t)(slash - config) + 1;
+    char *full = malloc(dir + strlen(path) + 1);
+    if (full) {
+        memcpy(full, config, dir);
+        strcpy(full + dir, path);
+    }
+    return full;
+}
+
+static int parse_config(Pipeline *p, const char *config) {
+    FILE *f = fopen(config, "r");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot open pipeline file %s: %s\n", config, strerror(errno));
+        return -1;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    unsigned lineno = 0;
+    char err[256];
+    int rc = 0;
+    while (rc == 0 && getline(&line, &cap, f) >= 0) {
+        lineno++;
+        uint32_t stages = p->stage_count;
+        if (parse_line(p, line, err, sizeof(err)) != 0) {
+            fprintf(stderr, "Error: %s:%u: %s\n", config, lineno, err);
+            rc = -1;
+        } else if (p->stage_count > stages) {
+            PipelineStage *s = &p->stages[stages];
+            char *full = stage_path(config, s->path);
+            free(s->path);
+            if (!(s->path = full)) {
+                fprintf(stderr, "Error: Out of memory\n");
+                rc = -1;
+            }
+        }
+    }
+    free(line);
+    fclose(f);
+    if (rc == 0 && p->stage_count == 0) {
+        fprintf(stderr, "Error: Pipeline file %s defines no stages\n", config);
+        rc = -1;
+    }
+    return rc;
+}
+
+// ---------------------------------------------------------------------------
+// Исполнение
+// ---------------------------------------------------------------------------
+
+int pipeline_load(Pipeline *p, const char *config, const PipelineOptions *opts) {
+    memset(p, 0, sizeof(*p));
+    if (parse_config(p, config) != 0)
+        return -1;
+    if (p->stage_count > 1 && !empty_input && !(empty_input = fopen("/dev/null", "r"))) {
+        fprintf(stderr, "Error: Cannot open /dev/null: %s\n", strerror(errno));
+        return -1;
+    }
+    // Адреса стадий больше не меняются: VM можно связывать с ними
+    for (uint32_t i = 0; i < p->stage_count; i++) {
+        PipelineStage *s = &p->stages[i];
+        VM *vm = &s->vm;
+        s->pipeline = p;
+        vm_init(vm);
+        vm->stage = s;
+        vm_register_builtin_natives(vm);
+        if ((opts->stack_size != STACK_SIZE || opts->call_depth != CALL_STACK_SIZE) &&
+            vm_set_stack_size(vm, opts->stack_size, opts->call_depth) != 0)
+            return -1;
+        if (vm_load_program(vm, s->path, &opts->load) != 0) {
+            fprintf(stderr, "Error: Cannot load stage '%s'\n", s->name);
+            return -1;
+        }
+        if (i > 0)
+            vm_set_streams(vm, empty_input, vm->out, vm->err);
+        if (opts->metrics && metrics_attach(vm, s->path) != 0)
+            return -1;
+        for (int c = 0; c < MET_COUNTERS; c++) {
+            if (opts->limits[c] && vm_set_limit(vm, (MetricsCounter)c, opts->limits[c]) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static void *stage_main(void *arg) {
+    PipelineStage *s = arg;
+    s->start_ns = timer_now_ns();
+    vm_run(&s->vm);
+    s->end_ns = timer_now_ns();
+    s->failed = s->vm.failed || vm_limit_exceeded(&s->vm) >= 0;
+    stage_close_channels(s);
+    return NULL;
+}
+
+int pipeline_run(Pipeline *p) {
+    uint32_t started = 0;
+    int status = 0;
+    for (; started < p->stage_count; started++) {
+        PipelineStage *s = &p->stages[started];
+        if (pthread_create(&s->thread, NULL, stage_main, s) != 0) {
+            fprintf(stderr, "Error: Failed to start stage '%s'\n", s->name);
+            status = 1;
+            break;
+        }
+    }
+    // Стадии, которые не запустились, считаются завершёнными: их соседи
+    // увидят закрытые каналы вместо вечного ожидания
+    for (uint32_t i = started; i < p->stage_count; i++)
+        stage_close_channels(&p->stages[i]);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(p->stages[i].thread, NULL);
+        status |= p->stages[i].failed;
+    }
+    return status;
+}
+
+static double mb(uint64_t bytes) {
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+void pipeline_print_summary(const Pipeline *p, FILE *out) {
+    fprintf(out, "%-16s %9s %11s %11s %9s %9s %11s %8s %8s\n", "Stage", "Time, s", "Msgs in", "Msgs out",
+            "MB in", "MB out", "Msgs/s", "Send %", "Recv %");
+    for (uint32_t i = 0; i < p->stage_count; i++) {
+        const PipelineStage *s = &p->stages[i];
+        double t = s->end_ns > s->start_ns ? (double)(s->end_ns - s->start_ns) / 1e9 : 0;
+        uint64_t handled = s->messages_in > s->messages_out ? s->messages_in : s->messages_out;
+        // Доля времени в ожидании: у самой медленной стадии она наименьшая
+        fprintf(out, "%-16s %9.3f %11llu %11llu %9.1f %9.1f %11.0f %8.1f %8.1f\n", s->name, t,
+                (unsigned long long)s->messages_in, (unsigned long long)s->messages_out,
+                mb(s->bytes_in), mb(s->bytes_out), t > 0 ? (double)handled / t : 0,
+                t > 0 ? (double)s->send_wait_ns / 1e7 / t : 0, t > 0 ? (double)s->recv_wait_ns / 1e7 / t : 0);
+    }
+    if (p->channel_count == 0)
+        return;
+    fprintf(out, "%-16s %-24s %11s %9s %9s %9s %10s %11s\n", "Channel", "Stages", "Messages", "MB",
+            "Avg fill", "Max fill", "Full waits", "Empty waits");
+    for (uint32_t i = 0; i < p->channel_count; i++) {
+        const Channel *c = &p->channels[i];
+        char stages[64];
+        snprintf(stages, sizeof(stages), "%s -> %s", p->stages[c->from].name, p->stages[c->to].name);
+        double avg = c->fill_samples ? (double)c->fill_sum / (double)c->fill_samples : 0;
+        fprintf(out, "%-16s %-24s %11llu %9.1f %8.1f%% %8.1f%% %10llu %11llu\n", c->name, stages,
+                (unsigned long long)c->messages, mb(c->bytes), 100.0 * avg / c->capacity,
+                100.0 * (double)c->fill_max / c->capacity, (unsigned long long)c->full_waits,
+                (unsigned long long)c->empty_waits);
+    }
+}
+
+void pipeline_free(Pipeline *p) {
+    for (uint32_t i = 0; i < p->stage_count; i++) {
+        PipelineStage *s = &p->stages[i];
+        if (s->pipeline)
+            vm_free(&s->vm);
+        free(s->name);
+        free(s->path);
+    }
+    for (uint32_t i = 0; i < p->channel_count; i++) {
+        free(p->channels[i].name);
+        free(p->channels[i].data);
+    }
+    free(p->stages);
+    free(p->channels);
+    memset(p, 0, sizeof(*p));
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "replay.h"
+
+// Формат журнала: заголовок "AIRR" + версия (uint32 LE), затем события:
+// байт типа, длина полезной нагрузки (LEB128) и сами данные.
+
+#define REPLAY_OUT_BUFFER (1 << 16)
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int replay_open_record(Replay *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    r->out = fopen(path, "wb");
+    if (!r->out) {
+        perror("Error creating record file");
+        return -1;
+    }
+    setvbuf(r->out, NULL, _IOFBF, REPLAY_OUT_BUFFER);
+    uint8_t header[8];
+    memcpy(header, REPLAY_MAGIC, 4);
+    put_le32(header + 4, REPLAY_VERSION);
+    fwrite(header, 1, sizeof(header), r->out);
+    r->mode = REPLAY_RECORD;
+    return 0;
+}
+
+int replay_open_play(Replay *r, const char *path) {
+    memset(r, 0, sizeof(*r));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("Error opening replay file");
+        return -1;
+    }
+    // Журнал читается в память целиком: при воспроизведении события
+    // извлекаются простым сдвигом указателя, без обращений к stdio.
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size < 8) {
+        fprintf(stderr, "Error: Replay file is too short\n");
+        fclose(f);
+        return -1;
+    }
+    r->data = malloc((size_t)size);
+    if (!r->data) {
+        fprintf(stderr, "Error: Failed to allocate replay buffer\n");
+        fclose(f);
+        return -1;
+    }
+    size_t n = fread(r->data, 1, (size_t)size, f);
+    fclose(f);
+    if (n != (size_t)size || memcmp(r->data, REPLAY_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: Invalid replay file\n");
+        replay_close(r);
+        return -1;
+    }
+    if (get_le32(r->data + 4) != REPLAY_VERSION) {
+        fprintf(stderr, "Error: Unsupported replay file version %u\n", get_le32(r->data + 4));
+        replay_close(r);
+        return -1;
+    }
+    r->size = (size_t)size;
+    r->pos = 8;
+    r->mode = REPLAY_PLAY;
+    return 0;
+}
+
+void replay_close(Replay *r) {
+    if (r->out) {
+        fclose(r->out);
+        r->out = NULL;
+    }
+    free(r->data);
+    r->data = NULL;
+    r->size = r->pos = 0;
+}
+
+void replay_put(Replay *r, uint8_t type, const void *data, uint32_t len) {
+    uint8_t header[6];
+    int n = 0;
+    header[n++] = type;
+    uint32_t v = len;
+    do {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        header[n++] = b | (v ? 0x80 : 0);
+    } while (v);
+    fwrite(header, 1, n, r->out);
+    if (len)
+        fwrite(data, 1, len, r->out);
+    r->events++;
+}
+
+void replay_put_u32(Replay *r, uint8_t type, uint32_t value) {
+    uint8_t buf[4];
+    put_le32(buf, value);
+    replay_put(r, type, buf, sizeof(buf));
+}
+
+const uint8_t *replay_take(VM *vm, uint8_t type, uint32_t *len) {
+    Replay *r = vm->replay;
+    if (r->pos >= r->size) {
+        vm_errorf(vm, "Replay log exhausted at IP: %u", vm->ip);
+        return NULL;
+    }
+    uint8_t actual = r->data[r->pos++];
+    if (actual != type) {
+        vm_errorf(vm, "Replay diverged at IP: %u (expected event 0x%02x, got 0x%02x)", vm->ip, type, actual);
+        return NULL;
+    }
+    uint32_t v = 0;
+    int shift = 0;
+    for (;;) {
+        if (r->pos >= r->size || shift > 28) {
+            vm_error(vm, "Corrupted replay log");
+            return NULL;
+        }
+        uint8_t b = r->data[r->pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            break;
+        shift += 7;
+    }
+    if (v > r->size - r->pos) {
+        vm_error(vm, "Corrupted replay log");
+        return NULL;
+    }
+    const uint8_t *payload = r->data + r->pos;
+    r->pos += v;
+    r->events++;
+    *len = v;
+    return payload;
+}
+
+int replay_take_u32(VM *vm, uint8_t type, uint32_t *value) {
+    uint32_t len;
+    const uint8_t *p = replay_take(vm, type, &len);
+    if (!p)
+        return 0;
+    if (len != 4) {
+        vm_errorf(vm, "Corrupted replay event 0x%02x", type);
+        return 0;
+    }
+    *value = get_le32(p);
+    return 1;
+}
@@ -0,0 +1,565 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "vm.h"
+#include "loader.h"
+#include "native.h"
+#include "metrics.h"
+#include "clone.h"
+#include "serve.h"
+
+extern char **environ;
+
+// Загруженная программа. Запись, вытесненная из кеша или устаревшая (файл
+// изменился), освобождается, когда её отпустит последний исполнитель.
+typedef struct {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    VM vm;                  // Шаблон клонов: загруженная и замороженная программа
+    unsigned refs;
+    int cached;             // Запись в таблице кеша
+    uint64_t used;          // Момент последнего запроса (для вытеснения)
+} Program;
+
+typedef struct {
+    const ServeOptions *opts;
+    int listen_fd;
+    pthread_mutex_t lock;   // Кеш программ
+    pthread_mutex_t load_lock; // Загрузка программ (по одной, см. program_load)
+    Program *programs[SERVE_CACHE_SIZE];
+    uint64_t tick;
+} Server;
+
+void serve_default_socket(char *buf, size_t len) {
+    const char *env = getenv(SERVE_SOCKET_ENV);
+    if (env && *env)
+        snprintf(buf, len, "%s", env);
+    else
+        snprintf(buf, len, "/tmp/airvm-%u.sock", (unsigned)getuid());
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// --- Кеш программ ---
+
+static void program_free(Program *p) {
+    vm_free(&p->vm);
+    free(p->path);
+    free(p);
+}
+
+static void program_release(Server *s, Program *p) {
+    pthread_mutex_lock(&s->lock);
+    int last = --p->refs == 0 && !p->cached;
+    pthread_mutex_unlock(&s->lock);
+    if (last)
+        program_free(p);
+}
+
+// Удаление записи из таблицы; вызывается под lock
+static void cache_remove(Server *s, int i) {
+    Program *p = s->programs[i];
+    s->programs[i] = NULL;
+    p->cached = 0;
+    if (p->refs == 0)
+        program_free(p);
+}
+
+// Загрузка программы в новую запись; вызывается под load_lock, без lock:
+// исполнители, чьи программы уже в кеше, её не ждут. Загрузки идут по
+// одной: запись в кеш проверенных программ (--cache-dir) не рассчитана на
+// несколько писателей в одном процессе.
+static Program *program_load(Server *s, const char *path, const struct stat *st) {
+    Program *p = calloc(1, sizeof(Program));
+    if (!p || !(p->path = strdup(path))) {
+        free(p);
+        return NULL;
+    }
+    vm_init(&p->vm);
+    vm_register_builtin_natives(&p->vm);
+    if (vm_load_program(&p->vm, path, &s->opts->load) != 0 || vm_template_freeze(&p->vm) != 0) {
+        program_free(p);
+        return NULL;
+    }
+    p->dev = st->st_dev;
+    p->ino = st->st_ino;
+    p->size = st->st_size;
+    p->mtime = st->st_mtim;
+    return p;
+}
+
+// Поиск программы в кеше с захватом; вызывается под lock. Записи того же
+// пути с другим файлом удаляются: прежний образ доработает у тех, кто его
+// уже взял.
+static Program *cache_take(Server *s, const char *path, const struct stat *st) {
+    Program *p = NULL;
+    for (int i = 0; i < SERVE_CACHE_SIZE; i++) {
+        Program *c = s->programs[i];
+        if (!c || strcmp(c->path, path) != 0)
+            continue;
+        if (c->dev == st->st_dev && c->ino == st->st_ino && c->size == st->st_size &&
+            c->mtime.tv_sec == st->st_mtim.tv_sec && c->mtime.tv_nsec == st->st_mtim.tv_nsec)
+            p = c;
+        else
+            cache_remove(s, i);
+    }
+    if (p) {
+        p->refs++;
+        p->used = ++s->tick;
+    }
+    return p;
+}
+
+// Публикация загруженной программы в свободную или давно не нужную запись;
+// вызывается под lock
+static void cache_insert(Server *s, Program *p) {
+    int slot = -1;
+    for (int i = 0; i < SERVE_CACHE_SIZE && slot < 0; i++) {
+        if (!s->programs[i])
+            slot = i;
+    }
+    if (slot < 0) {
+        slot = 0;
+        for (int i = 1; i < SERVE_CACHE_SIZE; i++) {
+            if (s->programs[i]->used < s->programs[slot]->used)
+                slot = i;
+        }
+        cache_remove(s, slot);
+    }
+    p->cached = 1;
+    p->refs++;
+    p->used = ++s->tick;
+    s->programs[slot] = p;
+}
+
+// Программа из кеша (с загрузкой при промахе); NULL — ошибка, описанная в err
+static Program *program_acquire(Server *s, const char *path, FILE *err) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(err, "Error opening program file: %s\n", strerror(errno));
+        return NULL;
+    }
+    pthread_mutex_lock(&s->lock);
+    Program *p = cache_take(s, path, &st);
+    pthread_mutex_unlock(&s->lock);
+    if (p)
+        return p;
+
+    pthread_mutex_lock(&s->load_lock);
+    // Пока ждали load_lock, ту же программу мог загрузить другой исполнитель
+    pthread_mutex_lock(&s->lock);
+    p = cache_take(s, path, &st);
+    pthread_mutex_unlock(&s->lock);
+    if (!p && (p = program_load(s, path, &st)) != NULL) {
+        pthread_mutex_lock(&s->lock);
+        cache_insert(s, p);
+        pthread_mutex_unlock(&s->lock);
+    }
+    pthread_mutex_unlock(&s->load_lock);
+    if (!p)
+        fprintf(err, "Error: Cannot load program %s\n", path);
+    return p;
+}
+
+// --- Исполнение запроса ---
+
+// Запрос в разобранном виде: путь программы, дескрипторы клиента и его
+// окружение (массив строк блока env_block для ENV_LIST)
+typedef struct {
+    ServeRequest req;
+    char path[SERVE_MAX_PATH];
+    int fds[SERVE_FDS];
+    char *env_block;
+    char **env;
+} Request;
+
+static int run_request(Server *s, const Request *r, FILE *in, FILE *out, FILE *err) {
+    const ServeRequest *req = &r->req;
+    const char *path = r->path;
+    Program *p = program_acquire(s, path, err);
+    if (!p)
+        return 1;
+    VM vm;
+    int rc = vm_clone(&vm, &p->vm, 0);
+    program_release(s, p);
+    if (rc != 0) {
+        fprintf(err, "Error: Cannot start program %s\n", path);
+        return 1;
+    }
+    vm_set_streams(&vm, in, out, err);
+    vm_set_host_context(&vm, r->fds[3], r->env);
+    if (req->stack_size || req->call_depth) {
+        uint32_t data = req->stack_size ? req->stack_size : STACK_SIZE;
+        uint32_t call = req->call_depth ? req->call_depth : CALL_STACK_SIZE;
+        if (data > MAX_STACK_SIZE || call > MAX_STACK_SIZE) {
+            fprintf(err, "Error: Stack size must be between 1 and %u\n", MAX_STACK_SIZE);
+            vm_free(&vm);
+            return 1;
+        }
+        if (vm_set_stack_size(&vm, data, call) != 0) {
+            fprintf(err, "Error: Failed to allocate VM stacks\n");
+            vm_free(&vm);
+            return 1;
+        }
+    }
+    fprintf(out, "Loaded program of %u bytes\n", vm.program_size);
+    for (int c = 0; c < MET_COUNTERS; c++) {
+        uint64_t limit = req->limits[c];
+        uint64_t cap = s->opts->limits[c];
+        if (cap && (!limit || limit > cap))
+            limit = cap;
+        if (limit && vm_set_limit(&vm, (MetricsCounter)c, limit) != 0) {
+            vm_free(&vm);
+            return 1;
+        }
+    }
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    vm_run(&vm);
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double elapsed_time = (double)(end_time.tv_sec - start_time.tv_sec) +
+                          (double)(end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    fprintf(out, "\nExecution time: %.6f seconds\n", elapsed_time);
+    if (vm.metrics)
+        metrics_print_summary(&vm, out);
+    int status = vm_limit_exceeded(&vm) >= 0;
+    vm_free(&vm);
+    return status;
+}
+
+// Окружение клиента: строки с завершающим нулём подряд
+static char **env_split(char *block, uint32_t len) {
+    size_t count = 0;
+    for (uint32_t i = 0; i < len; i++)
+        count += block[i] == '\0';
+    char **env = calloc(count + 1, sizeof(char *));
+    if (!env)
+        return NULL;
+    size_t n = 0;
+    for (uint32_t i = 0; i < len; i += (uint32_t)strlen(block + i) + 1)
+        env[n++] = block + i;
+    return env;
+}
+
+// Заголовок запроса и дескрипторы клиента; путь и окружение читаются следом
+static int receive_request(int conn, Request *r) {
+    ServeRequest *req = &r->req;
+    int *fds = r->fds;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(SERVE_FDS * sizeof(int))];
+    } control;
+    struct iovec iov = { req, sizeof(*req) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n;
+    do {
+        n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return -1;
+    int got = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            continue;
+        int count = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int *received = (int *)CMSG_DATA(c);
+        for (int i = 0; i < count; i++) {
+            if (got < SERVE_FDS && !(msg.msg_flags & MSG_CTRUNC))
+                fds[got++] = received[i];
+            else
+                close(received[i]);
+        }
+    }
+    r->env_block = NULL;
+    r->env = NULL;
+    if (got != SERVE_FDS || read_full(conn, (uint8_t *)req + n, sizeof(*req) - (size_t)n) != 0 ||
+        req->magic != SERVE_MAGIC || req->path_len == 0 || req->path_len >= SERVE_MAX_PATH ||
+        req->env_len > SERVE_MAX_ENV || read_full(conn, r->path, req->path_len) != 0 ||
+        !(r->env_block = malloc(req->env_len + 1)) ||
+        read_full(conn, r->env_block, req->env_len) != 0 ||
+        (req->env_len && r->env_block[req->env_len - 1] != '\0') ||
+        !(r->env = env_split(r->env_block, req->env_len))) {
+        free(r->env_block);
+        for (int i = 0; i < got; i++)
+            close(fds[i]);
+        return -1;
+    }
+    r->path[req->path_len] = '\0';
+    return 0;
+}
+
+static void serve_connection(Server *s, int conn) {
+    Request r;
+    int *fds = r.fds;
+    if (receive_request(conn, &r) != 0)
+        return;
+    FILE *in = fdopen(fds[0], "r");
+    FILE *out = fdopen(fds[1], "w");
+    FILE *err = fdopen(fds[2], "w");
+    ServeReply reply = { SERVE_MAGIC, 1 };
+    if (in && out && err) {
+        // Как у AirVM: в конвейере вывод буферизуется крупными блоками,
+        // stderr не буферизуется
+        if (!isatty(fds[1]))
+            setvbuf(out, NULL, _IOFBF, 1 << 20);
+        setvbuf(err, NULL, _IONBF, 0);
+        reply.status = run_request(s, &r, in, out, err);
+    }
+    // Вывод дописывается до ответа: клиент завершается сразу после него
+    FILE *streams[3] = { in, out, err };
+    for (int i = 0; i < 3; i++) {
+        if (streams[i])
+            fclose(streams[i]);
+        else
+            close(fds[i]);
+    }
+    close(fds[3]);
+    free(r.env);
+    free(r.env_block);
+    write_full(conn, &reply, sizeof(reply));
+}
+
+static void *worker_main(void *arg) {
+    Server *s = arg;
+    for (;;) {
+        int conn = accept4(s->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno != EINTR && errno != ECONNABORTED)
+                perror("Error accepting connection");
+            continue;
+        }
+        serve_connection(s, conn);
+        close(conn);
+    }
+    return NULL;
+}
+
+static int socket_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Удаление сокета демона; файл другого типа на этом пути не трогается
+static void unlink_socket(const char *path) {
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+}
+
+static int serve_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (socket_address(&addr, path) != 0)
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return -1;
+    }
+    // Сокет, к которому никто не подключён, остался от завершившегося демона
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "Error: AirVM daemon is already listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    // Путь --socket мог по ошибке назвать обычный файл: удаляется только сокет
+    struct stat st;
+    if (lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "Error: %s is in use and is not a socket\n", path);
+        close(fd);
+        return -1;
+    }
+    unlink_socket(path);
+    // Сокет доступен только владельцу: запрос исполняется с правами демона
+    mode_t old_mask = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (rc != 0 || listen(fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int vm_serve(const ServeOptions *opts) {
+    static Server server;
+    Server *s = &server;
+    s->opts = opts;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_mutex_init(&s->load_lock, NULL);
+    s->listen_fd = serve_listen(opts->socket_path);
+    if (s->listen_fd < 0)
+        return 1;
+    // Клиент может уйти до конца исполнения: запись в его потоки вернёт EPIPE
+    signal(SIGPIPE, SIG_IGN);
+    // Сигналы завершения принимает только этот поток
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop, NULL);
+
+    unsigned workers = opts->workers;
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    unsigned started = 0;
+    for (; started < workers; started++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker_main, s) != 0)
+            break;
+        pthread_detach(t);
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: Failed to start worker threads\n");
+        close(s->listen_fd);
+        unlink_socket(opts->socket_path);
+        return 1;
+    }
+    printf("AirVM serving on %s with %u workers\n", opts->socket_path, started);
+    fflush(stdout);
+
+    int sig;
+    sigwait(&stop, &sig);
+    // Исполняемые запросы обрываются вместе с процессом: их клиенты
+    // получат ошибку соединения. Сокет остаётся открытым до выхода, чтобы
+    // исполнители не увидели закрытый дескриптор в accept.
+    unlink_socket(opts->socket_path);
+    return 0;
+}
+
+// --- Клиент ---
+
+int serve_run(const char *socket_path, const ServeRequest *req, const char *program) {
+    struct sockaddr_un addr;
+    if (socket_address(&addr, socket_path) != 0)
+        return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Error: Cannot connect to AirVM daemon at %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    // Гость разрешает относительные пути от каталога клиента
+    int cwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0) {
+        perror("Error opening current directory");
+        close(fd);
+        return -1;
+    }
+    size_t env_len = 0;
+    for (char **e = environ; *e; e++)
+        env_len += strlen(*e) + 1;
+    char *env = env_len <= SERVE_MAX_ENV ? malloc(env_len + 1) : NULL;
+    if (!env) {
+        fprintf(stderr, "Error: Cannot pass environment of %zu bytes to AirVM daemon\n", env_len);
+        close(cwd);
+        close(fd);
+        return -1;
+    }
+    env_len = 0;
+    for (char **e = environ; *e; e++) {
+        size_t len = strlen(*e) + 1;
+        memcpy(env + env_len, *e, len);
+        env_len += len;
+    }
+    ServeRequest header = *req;
+    header.magic = SERVE_MAGIC;
+    header.path_len = (uint32_t)strlen(program);
+    header.env_len = (uint32_t)env_len;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(SERVE_FDS * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov[2] = {
+        { &header, sizeof(header) },
+        { (void *)program, header.path_len },
+    };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(SERVE_FDS * sizeof(int));
+    int client_fds[SERVE_FDS] = { 0, 1, 2, cwd };
+    memcpy(CMSG_DATA(c), client_fds, sizeof(client_fds));
+
+    ServeReply reply;
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    close(cwd);
+    int sent = n == (ssize_t)(sizeof(header) + header.path_len) &&
+               write_full(fd, env, env_len) == 0;
+    free(env);
+    if (!sent || read_full(fd, &reply, sizeof(reply)) != 0 || reply.magic != SERVE_MAGIC) {
+        fprintf(stderr, "Error: Lost connection to AirVM daemon at %s\n", socket_path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return reply.status;
+}
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vm.h"
+#include "heap.h"
+#include "bulkio.h"
+#include "metrics.h"
+#include "clone.h"
+#include "stream.h"
+
+#define STREAM_BLOCK_SIZE (1u << 20)   // Порция чтения входа
+
+// Источник записей: отображённый файл или буфер, дочитываемый порциями.
+// Данные следующей записи — data[pos..size).
+typedef struct {
+    int fd;
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    int eof;             // Дальше данных нет
+    uint8_t *buf;        // Буфер чтения (NULL — data указывает в отображение)
+    size_t cap;
+    void *map;
+    size_t map_size;
+} StreamInput;
+
+// Участок входа для одного клона при --stream-jobs
+typedef struct {
+    VM vm;
+    StreamInput input;
+    FILE *out;           // Вывод клона до сборки в общий
+    uint32_t index;
+    uint32_t entry;
+    const StreamOptions *opts;
+    int status;
+    pthread_t thread;
+} StreamJob;
+
+// Дочитывание порции: непрочитанный остаток переносится в начало буфера,
+// буфер растёт, если в нём не помещается одна запись
+static int input_refill(StreamInput *in) {
+    if (in->pos > 0) {
+        memmove(in->buf, in->buf + in->pos, in->size - in->pos);
+        in->size -= in->pos;
+        in->pos = 0;
+    }
+    if (in->size == in->cap) {
+        uint8_t *grown = realloc(in->buf, in->cap * 2);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to allocate stream buffer\n");
+            return -1;
+        }
+        in->buf = grown;
+        in->cap *= 2;
+    }
+    in->data = in->buf;
+    ssize_t n;
+    do {
+        n = read(in->fd, in->buf + in->size, in->cap - in->size);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        perror("Error reading stream input");
+        return -1;
+    }
+    if (n == 0)
+        in->eof = 1;
+    in->size += (size_t)n;
+    return 0;
+}
+
+// whole — прочитать вход целиком (для деления на участки)
+static int input_open(StreamInput *in, int fd, int whole) {
+    memset(in, 0, sizeof(*in));
+    in->fd = fd;
+    struct stat st;
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+            in->map = p;
+            in->map_size = (size_t)st.st_size;
+            in->data = (const uint8_t *)p + offset;
+            in->size = (size_t)(st.st_size - offset);
+            in->eof = 1;
+            return 0;
+        }
+    }
+    in->buf = malloc(STREAM_BLOCK_SIZE);
+    if (!in->buf) {
+        fprintf(stderr, "Error: Failed to allocate stream buffer\n");
+        return -1;
+    }
+    in->cap = STREAM_BLOCK_SIZE;
+    in->data = in->buf;
+    while (whole && !in->eof) {
+        if (input_refill(in) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+static void input_close(StreamInput *in) {
+    if (in->map)
+        munmap(in->map, in->map_size);
+    free(in->buf);
+}
+
+// Следующая запись: 1 — есть (указатель действует до следующего вызова),
+// 0 — вход кончился, -1 — ошибка чтения
+static int input_next(StreamInput *in, uint32_t record_size, const uint8_t **rec, size_t *len) {
+    for (;;) {
+        const uint8_t *p = in->data + in->pos;
+        size_t avail = in->size - in->pos;
+        if (record_size) {
+            if (avail >= record_size || (in->eof && avail > 0)) {
+                *len = avail < record_size ? avail : record_size;
+                *rec = p;
+                in->pos += *len;
+                return 1;
+            }
+        } else {
+            const uint8_t *nl = memchr(p, '\n', avail);
+            if (nl) {
+                *len = (size_t)(nl - p);
+                *rec = p;
+                in->pos += *len + 1;
+                return 1;
+            }
+            // Последняя строка без перевода строки — тоже запись
+            if (in->eof && avail > 0) {
+                *len = avail;
+                *rec = p;
+                in->pos += avail;
+                return 1;
+            }
+        }
+        if (in->eof)
+            return 0;
+        if (input_refill(in) != 0)
+            return -1;
+    }
+}
+
+// Исполнение программы от точки входа для одной записи (rec == NULL — итоговый
+// запуск после конца входа). 0 — программа дошла до HALT, -1 — ошибка.
+static int stream_step(VM *vm, const StreamOptions *opts, uint32_t entry,
+                       const uint8_t *rec, size_t len, uint32_t index, uint32_t shard) {
+    memset(vm->registers, 0, sizeof(vm->registers));
+    vm->ip = entry;
+    vm->sp = 0;
+    vm->fp = 0;
+    vm->rsp = 0;
+    vm->flags = 0;
+    vm->running = 1;
+    uint32_t addr = 0;
+    if (rec) {
+        addr = len < UINT32_MAX ? vm_heap_alloc(vm, (uint32_t)len + 1) : 0;
+        if (!addr) {
+            if (vm->running)
+                vm_errorf(vm, "Record %u of %zu bytes does not fit in guest memory", index, len);
+            return -1;
+        }
+        memcpy(vm->memory + addr, rec, len);
+        vm->memory[addr + len] = 0;
+        vm->heap_pinned = addr;
+        metrics_add(vm, MET_BYTES_READ, len);
+    }
+    vm->registers[0] = addr;
+    vm->registers[1] = (uint32_t)len;
+    vm->registers[2] = index;
+    vm->registers[3] = shard;
+    if (opts->run)
+        opts->run(vm);
+    else
+        vm_run(vm);
+    vm->heap_pinned = 0;
+    if (vm->failed || vm_limit_exceeded(vm) >= 0)
+        return -1;
+    if (addr) {
+        vm->running = 1;
+        vm_heap_free(vm, addr, "stream record");
+        if (vm->failed)
+            return -1;
+    }
+    return 0;
+}
+
+static int stream_input(VM *vm, const StreamOptions *opts, StreamInput *in, uint32_t entry, uint32_t shard) {
+    const uint8_t *rec;
+    size_t len;
+    uint32_t count = 0;
+    int rc;
+    while ((rc = input_next(in, opts->record_size, &rec, &len)) > 0) {
+        if (stream_step(vm, opts, entry, rec, len, ++count, shard) != 0)
+            return 1;
+    }
+    if (rc < 0)
+        return 1;
+    return stream_step(vm, opts, entry, NULL, 0, count, shard) != 0;
+}
+
+static void *job_main(void *arg) {
+    StreamJob *j = arg;
+    j->status = stream_input(&j->vm, j->opts, &j->input, j->entry, j->index);
+    return NULL;
+}
+
+// Граница участка рядом с pos: начало записи
+static size_t record_boundary(const StreamInput *in, uint32_t record_size, size_t pos) {
+    if (pos == 0 || pos >= in->size)
+        return pos < in->size ? pos : in->size;
+    if (record_size)
+        return pos / record_size * record_size;
+    const uint8_t *nl = memchr(in->data + pos - 1, '\n', in->size - (pos - 1));
+    return nl ? (size_t)(nl - in->data) + 1 : in->size;
+}
+
+// Учёт клонов переносится в счётчики исходной VM для сводки и airvm-top
+static void merge_usage(VM *vm, const VM *clone) {
+    static const MetricsCounter summed[] = {
+        MET_INSTRUCTIONS, MET_BYTES_READ, MET_BYTES_WRITTEN, MET_SNAPSHOTS
+    };
+    for (size_t i = 0; i < sizeof(summed) / sizeof(summed[0]); i++)
+        metrics_set(vm, summed[i], vm_usage(vm, summed[i]) + vm_usage(clone, summed[i]));
+    if (vm_usage(clone, MET_MEMORY_SIZE) > vm_usage(vm, MET_MEMORY_SIZE))
+        metrics_set(vm, MET_MEMORY_SIZE, vm_usage(clone, MET_MEMORY_SIZE));
+}
+
+static int stream_jobs(VM *vm, const StreamOptions *opts, uint32_t entry, int fd, FILE *empty) {
+    StreamInput all;
+    if (input_open(&all, fd, 1) != 0) {
+        input_close(&all);
+        return 1;
+    }
+    StreamJob *jobs = calloc(opts->jobs, sizeof(StreamJob));
+    if (!jobs) {
+        fprintf(stderr, "Error: Failed to allocate stream jobs\n");
+        input_close(&all);
+        return 1;
+    }
+    // Клоны создаются до запуска потоков: vm_clone читает шаблон
+    uint32_t ready = 0;
+    size_t start = 0;
+    int status = 0;
+    for (; ready < opts->jobs; ready++) {
+        StreamJob *j = &jobs[ready];
+        size_t end = ready + 1 == opts->jobs ? all.size
+                   : record_boundary(&all, opts->record_size, all.size / opts->jobs * (ready + 1));
+        if (end < start)
+            end = start;
+        j->input.fd = -1;
+        j->input.data = all.data + start;
+        j->input.size = end - start;
+        j->input.eof = 1;
+        start = end;
+        j->index = ready + 1;
+        j->entry = entry;
+        j->opts = opts;
+        if (vm_clone(&j->vm, vm, 0) != 0) {
+            status = 1;
+            break;
+        }
+        if (vm->metrics) {
+            if (metrics_enable(&j->vm) != 0) {
+                vm_free(&j->vm);
+                status = 1;
+                break;
+            }
+            memcpy(j->vm.metrics->limits, vm->metrics->limits, sizeof(j->vm.metrics->limits));
+        }
+        j->out = tmpfile();
+        if (!j->out) {
+            perror("Error creating stream output");
+            vm_free(&j->vm);
+            status = 1;
+            break;
+        }
+        setvbuf(j->out, NULL, _IOFBF, STREAM_BLOCK_SIZE);
+        vm_set_streams(&j->vm, empty, j->out, vm->err);
+    }
+    uint32_t started = 0;
+    for (; status == 0 && started < ready; started++) {
+        if (pthread_create(&jobs[started].thread, NULL, job_main, &jobs[started]) != 0) {
+            fprintf(stderr, "Error: Failed to start stream thread\n");
+            status = 1;
+            break;
+        }
+    }
+    // Вывод участков — в порядке входа
+    char chunk[65536];
+    for (uint32_t i = 0; i < ready; i++) {
+        StreamJob *j = &jobs[i];
+        if (i < started) {
+            pthread_join(j->thread, NULL);
+            status |= j->status;
+            fflush(j->out);
+            rewind(j->out);
+            size_t n;
+            while ((n = fread(chunk, 1, sizeof(chunk), j->out)) > 0)
+                fwrite(chunk, 1, n, vm->out);
+        }
+        fclose(j->out);
+        merge_usage(vm, &j->vm);
+        if (vm_limit_exceeded(&j->vm) >= 0 && vm->metrics)
+            vm->metrics->exceeded = vm_limit_exceeded(&j->vm);
+        vm_free(&j->vm);
+    }
+    free(jobs);
+    input_close(&all);
+    return status;
+}
+
+int vm_stream_run(VM *vm, const StreamOptions *opts) {
+    uint32_t entry = vm->ip;
+    // stdin целиком уходит на записи: INPUT и чтение дескриптора 0 гостем
+    // видят пустой вход
+    FILE *in_stream = vm->in;
+    FILE *empty = fopen("/dev/null", "r");
+    if (!empty) {
+        fprintf(stderr, "Error: Cannot open /dev/null: %s\n", strerror(errno));
+        return 1;
+    }
+    int status;
+    if (opts->jobs > 1) {
+        status = stream_jobs(vm, opts, entry, fileno(in_stream), empty);
+    } else {
+        StreamInput in;
+        vm_set_streams(vm, empty, vm->out, vm->err);
+        status = input_open(&in, fileno(in_stream), 0) != 0 ||
+                 stream_input(vm, opts, &in, entry, 0) != 0;
+        input_close(&in);
+        input_buffer_free(vm);
+        vm_set_streams(vm, in_stream, vm->out, vm->err);
+    }
+    fclose(empty);
+    return status;
+}
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "vm.h"
+#include "threads.h"
+#include "debugger.h"
+#include "metrics.h"
+
+// Инструкции, работающие с общими ресурсами хоста и кучей гостя
+static const uint8_t io_opcodes[] = {
+    OP_ALLOC, OP_FREE, OP_REALLOC, OP_ARENA_RESET, OP_HEAP_STATS,
+    // Таблицы MAP_* выделяют память в общей куче
+    OP_MAP_NEW, OP_MAP_PUT, OP_MAP_GET, OP_MAP_DEL, OP_MAP_ITER,
+    OP_MAP_SNEW, OP_MAP_SPUT, OP_MAP_SGET, OP_MAP_SDEL, OP_MAP_FREE,
+    OP_BREAK, OP_FS_LIST, OP_DIR_OPEN, OP_DIR_NEXT, OP_DIR_CLOSE, OP_ENV_LIST,
+    OP_PRINT, OP_INPUT, OP_PRINTS, OP_READINTS, OP_WRITEINTS, OP_READLINE,
+    OP_SNAPSHOT, OP_RESTORE,
+    OP_FILE_OPEN, OP_FILE_READ, OP_FILE_WRITE, OP_FILE_CLOSE, OP_FILE_SEEK,
+    OP_FILE_PREAD, OP_FILE_PWRITE, OP_FILE_SYNC, OP_FILE_BUFFER, OP_FILE_SEEK64
+};
+
+// Исполнение инструкции ввода-вывода под io_lock. Ресурсы хоста принадлежат
+// исходной VM: поток получает их на время инструкции и возвращает изменения.
+static void op_locked(VM *vm) {
+    ThreadGroup *g = vm->threads;
+    VM *root = g->root;
+    uint8_t opcode = debugger_opcode_at(vm, vm->ip - 1);
+    pthread_mutex_lock(&g->io_lock);
+    if (vm != root) {
+        vm->files = root->files;
+        vm->dirs = root->dirs;
+        vm->dir_capacity = root->dir_capacity;
+        vm->input = root->input;
+    }
+    g->base[opcode](vm);
+    if (vm != root) {
+        root->files = vm->files;
+        root->dirs = vm->dirs;
+        root->dir_capacity = vm->dir_capacity;
+        root->input = vm->input;
+    }
+    pthread_mutex_unlock(&g->io_lock);
+}
+
+// Группа создаётся при запуске первого потока; вызывается только из
+// единственного на тот момент потока исходной VM
+static ThreadGroup *thread_group(VM *vm) {
+    if (vm->threads)
+        return vm->threads;
+    ThreadGroup *g = calloc(1, sizeof(ThreadGroup));
+    if (!g) {
+        vm_error(vm, "Failed to allocate thread group");
+        return NULL;
+    }
+    g->root = vm;
+    pthread_mutex_init(&g->io_lock, NULL);
+    pthread_mutex_init(&g->mem_lock, NULL);
+    pthread_cond_init(&g->exited, NULL);
+    init_dispatch_table(g->base);
+    debugger_patch_table(vm, g->base);
+    metrics_patch_table(vm, g->base);
+    memcpy(g->dispatch, g->base, sizeof(g->dispatch));
+    for (size_t i = 0; i < sizeof(io_opcodes); i++)
+        g->dispatch[io_opcodes[i]] = op_locked;
+    vm->threads = g;
+    vm->dispatch = g->dispatch;
+    return g;
+}
+
+void thread_ensure_memory(VM *vm, uint32_t required) {
+    ThreadGroup *g = vm->threads;
+    VM *root = g->root;
+    pthread_mutex_lock(&g->mem_lock);
+    int ok = required <= root->memory_size || vm_grow_memory(root, required) == 0;
+    if (ok) {
+        // Страницы уже открыты; новый размер получают все VM группы
+        uint32_t size = root->memory_size;
+        for (uint32_t i = 0; i < g->thread_count; i++) {
+            if (g->threads[i])
+                __atomic_store_n(&g->threads[i]->vm.memory_size, size, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&g->mem_lock);
+    if (!ok)
+        vm_memory_error(vm, root, required);
+}
+
+void thread_group_stop(VM *vm) {
+    ThreadGroup *g = vm->threads;
+    pthread_mutex_lock(&g->mem_lock);
+    __atomic_store_n(&g->root->running, 0, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < g->thread_count; i++) {
+        if (g->threads[i])
+            __atomic_store_n(&g->threads[i]->vm.running, 0, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&g->mem_lock);
+}
+
+static void *thread_main(void *arg) {
+    VMThread *t = arg;
+    vm_run(&t->vm);
+    return NULL;
+}
+
+// Ожидание потока, заранее помеченного joining, и освобождение его VM.
+// Возвращает R0 потока на момент остановки.
+static uint32_t join_thread(ThreadGroup *g, uint32_t id, VMThread *t) {
+    pthread_join(t->handle, NULL);
+    uint32_t result = t->vm.registers[0];
+    pthread_mutex_lock(&g->mem_lock);
+    g->threads[id - 1] = NULL;
+    g->free_ids[g->free_id_count++] = id;
+    g->live--;
+    pthread_cond_broadcast(&g->exited);
+    pthread_mutex_unlock(&g->mem_lock);
+    free(t->vm.stack);
+    free(t->vm.rstack);
+    free(t);
+    return result;
+}
+
+// Инструкция THREAD_START: THREAD_START reg_id, addr, reg_arg
+// Запускает поток с адреса addr; в новом потоке все регистры нулевые,
+// кроме R0 = reg_arg. Поток завершается на HALT (или по ошибке), его
+// идентификатор (начиная с 1) записывается в reg_id.
+void op_thread_start(VM *vm) {
+    uint8_t reg_id = read_byte(vm);
+    uint32_t addr = read_uint32(vm);
+    uint8_t reg_arg = read_byte(vm);
+    if (reg_id >= NUM_REGS || reg_arg >= NUM_REGS) {
+        vm_error(vm, "Invalid register in THREAD_START");
+        return;
+    }
+    if (addr >= vm->program_size) {
+        vm_errorf(vm, "Thread entry %u out of bounds (program size: %u)", addr, vm->program_size);
+        return;
+    }
+    ThreadGroup *g = thread_group(vm);
+    if (!g)
+        return;
+    VMThread *t = calloc(1, sizeof(VMThread));
+    uint32_t *stack = calloc(vm->stack_size, sizeof(uint32_t));
+    uint32_t *rstack = calloc(vm->rstack_size, sizeof(uint32_t));
+    if (!t || !stack || !rstack) {
+        free(t);
+        free(stack);
+        free(rstack);
+        vm_error(vm, "Failed to allocate thread state");
+        return;
+    }
+    memcpy(&t->vm, vm, sizeof(VM));
+    memset(t->vm.registers, 0, sizeof(t->vm.registers));
+    t->vm.registers[0] = vm->registers[reg_arg];
+    t->vm.stack = stack;
+    t->vm.rstack = rstack;
+    t->vm.sp = 0;
+    t->vm.fp = 0;
+    t->vm.rsp = 0;
+    t->vm.ip = addr;
+    t->vm.block_start = addr;
+    t->vm.insn_pending = 0;
+    t->vm.flags = 0;
+    t->vm.running = 1;
+    t->vm.dispatch = g->dispatch;
+
+    pthread_mutex_lock(&g->mem_lock);
+    const char *err = NULL;
+    if (g->live >= MAX_THREADS) {
+        err = "Too many threads in THREAD_START";
+    } else if (!g->free_id_count && g->thread_count == g->thread_capacity) {
+        uint32_t cap = g->thread_capacity ? g->thread_capacity * 2 : 16;
+        VMThread **grown = realloc(g->threads, cap * sizeof(VMThread *));
+        if (grown)
+            g->threads = grown;
+        uint32_t *ids = grown ? realloc(g->free_ids, cap * sizeof(uint32_t)) : NULL;
+        if (ids) {
+            g->free_ids = ids;
+            g->thread_capacity = cap;
+        } else {
+            err = "Failed to allocate thread table";
+        }
+    }
+    // Идентификаторы присоединённых потоков выдаются заново, поэтому таблица,
+    // которую обходят рост памяти и остановка, не длиннее MAX_THREADS
+    uint32_t id = 0;
+    if (!err) {
+        // Размер памяти берётся под mem_lock: дальнейший рост будет опубликован потоку
+        t->vm.memory_size = g->root->memory_size;
+        if (pthread_create(&t->handle, NULL, thread_main, t) != 0) {
+            err = "Failed to start thread";
+        } else {
+            id = g->free_id_count ? g->free_ids[--g->free_id_count] : ++g->thread_count;
+            g->threads[id - 1] = t;
+            g->live++;
+        }
+    }
+    pthread_mutex_unlock(&g->mem_lock);
+    if (err) {
+        free(stack);
+        free(rstack);
+        free(t);
+        vm_error(vm, err);
+        return;
+    }
+    vm->registers[reg_id] = id;
+}
+
+// Инструкция THREAD_JOIN: THREAD_JOIN reg_result, reg_id
+// Ожидает завершения потока и записывает его R0 в reg_result.
+void op_thread_join(VM *vm) {
+    uint8_t reg_result = read_byte(vm);
+    uint8_t reg_id = read_byte(vm);
+    if (reg_result >= NUM_REGS || reg_id >= NUM_REGS) {
+        vm_error(vm, "Invalid register in THREAD_JOIN");
+        return;
+    }
+    uint32_t id = vm->registers[reg_id];
+    ThreadGroup *g = vm->threads;
+    VMThread *t = NULL;
+    if (g) {
+        pthread_mutex_lock(&g->mem_lock);
+        if (id >= 1 && id <= g->thread_count)
+            t = g->threads[id - 1];
+        if (t && !t->joining && &t->vm != vm)
+            t->joining = 1;
+        else
+            t = NULL;
+        pthread_mutex_unlock(&g->mem_lock);
+    }
+    if (!t) {
+        vm_errorf(vm, "Invalid thread id %u in THREAD_JOIN", id);
+        return;
+    }
+    vm->registers[reg_result] = join_thread(g, id, t);
+}
+
+void thread_join_all(VM *vm) {
+    ThreadGroup *g = vm->threads;
+    if (!g || g->root != vm)
+        return;
+    pthread_mutex_lock(&g->mem_lock);
+    while (g->live > 0) {
+        uint32_t id = 0;
+        for (uint32_t i = 0; i < g->thread_count && !id; i++) {
+            if (g->threads[i] && !g->threads[i]->joining)
+                id = i + 1;
+        }
+        if (!id) {
+            // Оставшиеся потоки присоединяют другие потоки
+            pthread_cond_wait(&g->exited, &g->mem_lock);
+            continue;
+        }
+        VMThread *t = g->threads[id - 1];
+        t->joining = 1;
+        pthread_mutex_unlock(&g->mem_lock);
+        join_thread(g, id, t);
+        pthread_mutex_lock(&g->mem_lock);
+    }
+    pthread_mutex_unlock(&g->mem_lock);
+}
+
+void thread_group_free(VM *vm) {
+    ThreadGroup *g = vm->threads;
+    if (!g || g->root != vm)
+        return;
+    thread_join_all(vm);
+    pthread_mutex_destroy(&g->io_lock);
+    pthread_mutex_destroy(&g->mem_lock);
+    pthread_cond_destroy(&g->exited);
+    free(g->threads);
+    free(g->free_ids);
+    free(g);
+    vm->threads = NULL;
+    vm->dispatch = NULL;
+}
+
+// Слово памяти гостя для атомарной операции: адрес выровнен на 4 байта.
+// Память гостя — little-endian, как и поддерживаемые хосты, поэтому слово
+// совпадает с тем, что читают LOAD/STORE.
+static uint32_t *atomic_word(VM *vm, uint32_t addr, const char *op) {
+    if (addr & 3) {
+        vm_errorf(vm, "Unaligned address %u in %s", addr, op);
+        return NULL;
+    }
+    if (addr > UINT32_MAX - 4) {
+        vm_errorf(vm, "Address %u out of bounds in %s", addr, op);
+        return NULL;
+    }
+    ensure_memory(vm, addr + 4);
+    if (!vm->running)
+        return NULL;
+    return (uint32_t *)(vm->memory + addr);
+}
+
+// Инструкция CAS: CAS reg_expected, addr, reg_new
+// Если слово по addr равно reg_expected, записывает reg_new и ставит EQ;
+// иначе ставит NE. В reg_expected записывается прежнее значение слова.
+void op_cas(VM *vm) {
+    uint8_t reg_expected = read_byte(vm);
+    uint32_t addr = read_addr_operand(vm);
+    uint8_t reg_new = read_byte(vm);
+    if (reg_expected >= NUM_REGS || reg_new >= NUM_REGS) {
+        vm_error(vm, "Invalid register in CAS");
+        return;
+    }
+    uint32_t *p = atomic_word(vm, addr, "CAS");
+    if (!p)
+        return;
+    uint32_t expected = vm->registers[reg_expected];
+    int ok = __atomic_compare_exchange_n(p, &expected, vm->registers[reg_new], 0,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    vm->registers[reg_expected] = expected;
+    vm->flags = ok ? 0x01 : 0x02;
+}
+
+// Инструкция XADD: XADD reg, addr — атомарно прибавляет reg к слову,
+// в reg записывается прежнее значение
+void op_xadd(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    uint32_t addr = read_addr_operand(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in XADD", reg);
+        return;
+    }
+    uint32_t *p = atomic_word(vm, addr, "XADD");
+    if (p)
+        vm->registers[reg] = __atomic_fetch_add(p, vm->registers[reg], __ATOMIC_SEQ_CST);
+}
+
+// Инструкция XCHG: XCHG reg, addr — атомарный обмен регистра и слова
+void op_xchg(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    uint32_t addr = read_addr_operand(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in XCHG", reg);
+        return;
+    }
+    uint32_t *p = atomic_word(vm, addr, "XCHG");
+    if (p)
+        vm->registers[reg] = __atomic_exchange_n(p, vm->registers[reg], __ATOMIC_SEQ_CST);
+}
+
+void op_fence_acq(VM *vm) {
+    (void)vm;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+void op_fence_rel(VM *vm) {
+    (void)vm;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// Инструкция FUTEX_WAIT: FUTEX_WAIT addr, reg_value
+// Засыпает, пока слово по addr равно reg_value и поток не разбужен
+// FUTEX_WAKE. Возможны ложные пробуждения: гость перепроверяет условие.
+// Сон ограничен FUTEX_POLL_NS, чтобы поток остановленной группы
+// (thread_group_stop) не ждал вечно пробуждения от уже завершённых.
+void op_futex_wait(VM *vm) {
+    uint32_t addr = read_addr_operand(vm);
+    uint8_t reg_value = read_byte(vm);
+    if (reg_value >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in FUTEX_WAIT", reg_value);
+        return;
+    }
+    uint32_t *p = atomic_word(vm, addr, "FUTEX_WAIT");
+    if (!p)
+        return;
+    struct timespec timeout = { 0, FUTEX_POLL_NS };
+    if (syscall(SYS_futex, p, FUTEX_WAIT_PRIVATE, vm->registers[reg_value], &timeout, NULL, 0) != 0 &&
+        errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+        vm_errorf(vm, "FUTEX_WAIT failed: %s", strerror(errno));
+}
+
+// Инструкция FUTEX_WAKE: FUTEX_WAKE addr, reg_count
+// Будит до reg_count потоков, ждущих на addr; в reg_count записывается
+// число разбуженных.
+void op_futex_wake(VM *vm) {
+    uint32_t addr = read_addr_operand(vm);
+    uint8_t reg_count = read_byte(vm);
+    if (reg_count >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in FUTEX_WAKE", reg_count);
+        return;
+    }
+    uint32_t *p = atomic_word(vm, addr, "FUTEX_WAKE");
+    if (!p)
+        return;
+    uint32_t count = vm->registers[reg_count];
+    long woken = syscall(SYS_futex, p, FUTEX_WAKE_PRIVATE, count > INT32_MAX ? INT32_MAX : (int)count,
+                         NULL, NULL, 0);
+    if (woken < 0) {
+        vm_errorf(vm, "FUTEX_WAKE failed: %s", strerror(errno));
+        return;
+    }
+    vm->registers[reg_count] = (uint32_t)woken;
+}
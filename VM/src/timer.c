@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "vm.h"
+#include "timer.h"
+#include "bulkio.h"
+#include "native.h"
+#include "replay.h"
+#include "threads.h"
+
+uint64_t timer_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline struct timespec to_timespec(uint64_t ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    return ts;
+}
+
+static inline int still_running(const VM *vm) {
+    return __atomic_load_n(&vm->running, __ATOMIC_RELAXED);
+}
+
+// Таблица файлов, буфер ввода и журнал принадлежат исходной VM группы
+// потоков; обращаться к ним можно только под io_lock (см. threads.h)
+static void host_lock(VM *vm) {
+    if (vm->threads)
+        pthread_mutex_lock(&vm->threads->io_lock);
+}
+
+static void host_unlock(VM *vm) {
+    if (vm->threads)
+        pthread_mutex_unlock(&vm->threads->io_lock);
+}
+
+// Сон до момента deadline (CLOCK_MONOTONIC) отрезками по TIMER_SLICE_NS
+static void sleep_until(VM *vm, uint64_t deadline) {
+    while (still_running(vm)) {
+        uint64_t now = timer_now_ns();
+        if (now >= deadline)
+            return;
+        uint64_t wake = deadline - now > TIMER_SLICE_NS ? now + TIMER_SLICE_NS : deadline;
+        struct timespec ts = to_timespec(wake);
+        int rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        if (rc != 0 && rc != EINTR) {
+            vm_errorf(vm, "SLEEP_US failed: %s", strerror(rc));
+            return;
+        }
+    }
+}
+
+// Инструкция SLEEP_US: SLEEP_US reg — сон на reg микросекунд
+void op_sleep_us(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in SLEEP_US", reg);
+        return;
+    }
+    if (vm_replaying(vm))
+        return;
+    sleep_until(vm, timer_now_ns() + (uint64_t)vm->registers[reg] * 1000);
+}
+
+// Инструкция CLOCK_NS: CLOCK_NS reg — монотонное время в наносекундах,
+// младшая половина в reg, старшая в reg+1
+void op_clock_ns(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in CLOCK_NS", reg);
+        return;
+    }
+    if (reg + 1 >= NUM_REGS) {
+        vm_errorf(vm, "CLOCK_NS needs a register pair, got R%d", reg);
+        return;
+    }
+    uint64_t t = 0;
+    if (vm->replay) {
+        host_lock(vm);
+        if (vm_replaying(vm)) {
+            uint32_t len;
+            const uint8_t *p = replay_take(vm, EV_CLOCK, &len);
+            if (p && len != sizeof(t))
+                vm_error(vm, "Corrupted replay event in CLOCK_NS");
+            else if (p)
+                for (int i = 0; i < 8; i++)
+                    t |= (uint64_t)p[i] << (8 * i);
+        } else {
+            t = timer_now_ns();
+            uint8_t buf[8];
+            for (int i = 0; i < 8; i++)
+                buf[i] = (uint8_t)(t >> (8 * i));
+            replay_put(vm->replay, EV_CLOCK, buf, sizeof(buf));
+        }
+        host_unlock(vm);
+        if (!vm->running)
+            return;
+    } else {
+        t = timer_now_ns();
+    }
+    vm->registers[reg] = (uint32_t)t;
+    vm->registers[reg + 1] = (uint32_t)(t >> 32);
+}
+
+// Есть ли в буфере stdio файла непрочитанные данные
+static int stdio_buffered(FILE *fp) {
+#ifdef __GLIBC__
+    return fp->_IO_read_ptr < fp->_IO_read_end;
+#else
+    (void)fp;
+    return 0;
+#endif
+}
+
+// Заполнение pollfd для дескрипторов гостя. Возвращает индекс дескриптора,
+// чтение которого уже не заблокируется, UINT32_MAX — ждать нужно всех,
+// -1 в *bad — неверный дескриптор (его номер в *bad_handle).
+static uint32_t collect_fds(VM *host, const uint8_t *handles, uint32_t count,
+                            struct pollfd *fds, int *bad, uint32_t *bad_handle) {
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *p = handles + 4 * i;
+        uint32_t h = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        FILE *fp = file_get(&host->files, h);
+        if (!fp) {
+            *bad = -1;
+            *bad_handle = h;
+            return UINT32_MAX;
+        }
+        // stdin читается через общий буфер ввода ВМ (см. bulkio.h)
+        if (h == 0 && host->input) {
+            const InputBuffer *b = host->input;
+            if (b->pos < b->len || b->eof)
+                return i;
+        } else if (stdio_buffered(fp) || feof(fp)) {
+            return i;
+        }
+        int fd = fileno(fp);
+        // Потоки в памяти (fmemopen, open_memstream) читаются без ожидания
+        if (fd < 0)
+            return i;
+        fds[i].fd = fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    return UINT32_MAX;
+}
+
+// Ожидание готовности дескрипторов отрезками по TIMER_SLICE_NS.
+// timeout_us == TIMER_INFINITE — без предела.
+static uint32_t poll_fds(VM *vm, struct pollfd *fds, uint32_t count, uint32_t timeout_us) {
+    uint64_t deadline = timer_now_ns() + (uint64_t)timeout_us * 1000;
+    for (;;) {
+        uint64_t slice = TIMER_SLICE_NS;
+        if (timeout_us != TIMER_INFINITE) {
+            uint64_t now = timer_now_ns();
+            uint64_t left = now < deadline ? deadline - now : 0;
+            if (left < slice)
+                slice = left;
+        }
+        struct timespec ts = to_timespec(slice);
+        int n = ppoll(fds, count, &ts, NULL);
+        if (n < 0 && errno != EINTR) {
+            vm_errorf(vm, "EVENT_WAIT failed: %s", strerror(errno));
+            return UINT32_MAX;
+        }
+        // Ошибка и конец данных тоже готовность: READ вернёт их без ожидания
+        for (uint32_t i = 0; n > 0 && i < count; i++) {
+            if (fds[i].revents)
+                return i;
+        }
+        if (!still_running(vm))
+            return UINT32_MAX;
+        if (timeout_us != TIMER_INFINITE && timer_now_ns() >= deadline)
+            return UINT32_MAX;
+    }
+}
+
+// Инструкция EVENT_WAIT: EVENT_WAIT reg_result, reg_addr, reg_count, reg_timeout
+// Ждёт, пока один из reg_count дескрипторов гостя (массив слов по адресу
+// reg_addr) не станет готов к чтению, но не дольше reg_timeout микросекунд
+// (TIMER_INFINITE — без предела, 0 — только проверка). В reg_result
+// записывается номер первого готового дескриптора в массиве и ставится
+// флаг EQ; по истечении тайм-аута — TIMER_INFINITE и флаг NE.
+void op_event_wait(VM *vm) {
+    uint8_t r[4];
+    for (int i = 0; i < 4; i++)
+        r[i] = read_byte(vm);
+    for (int i = 0; i < 4; i++) {
+        if (r[i] >= NUM_REGS) {
+            vm_errorf(vm, "Invalid register R%d in EVENT_WAIT", r[i]);
+            return;
+        }
+    }
+    uint32_t count = vm->registers[r[2]];
+    uint32_t timeout_us = vm->registers[r[3]];
+    if (count > EVENT_WAIT_MAX) {
+        vm_errorf(vm, "EVENT_WAIT supports at most %u handles, got %u", EVENT_WAIT_MAX, count);
+        return;
+    }
+    if (count == 0 && timeout_us == TIMER_INFINITE) {
+        vm_error(vm, "EVENT_WAIT with no handles and no timeout would never return");
+        return;
+    }
+    const uint8_t *handles = vm_guest_ptr(vm, vm->registers[r[1]], count * 4, 0);
+    if (!handles)
+        return;
+
+    uint32_t ready = UINT32_MAX;
+    if (vm_replaying(vm)) {
+        host_lock(vm);
+        int ok = replay_take_u32(vm, EV_EVENT_WAIT, &ready);
+        host_unlock(vm);
+        if (!ok)
+            return;
+        if (ready != UINT32_MAX && ready >= count) {
+            vm_error(vm, "Corrupted replay event in EVENT_WAIT");
+            return;
+        }
+    } else {
+        struct pollfd fds[EVENT_WAIT_MAX];
+        int bad = 0;
+        uint32_t bad_handle = 0;
+        host_lock(vm);
+        ready = collect_fds(vm->threads ? vm->threads->root : vm, handles, count, fds, &bad, &bad_handle);
+        host_unlock(vm);
+        if (bad) {
+            vm_errorf(vm, "Invalid file handle %u in EVENT_WAIT", bad_handle);
+            return;
+        }
+        // Блокировка не удерживается во время ожидания: другие потоки гостя
+        // продолжают ввод-вывод
+        if (ready == UINT32_MAX)
+            ready = poll_fds(vm, fds, count, timeout_us);
+        if (!vm->running)
+            return;
+        if (vm_recording(vm)) {
+            host_lock(vm);
+            replay_put_u32(vm->replay, EV_EVENT_WAIT, ready);
+            host_unlock(vm);
+        }
+    }
+    vm->registers[r[0]] = ready;
+    vm->flags = ready != UINT32_MAX ? 0x01 : 0x02;
+}
@@ -0,0 +1,1830 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vm.h"
+#include "replay.h"
+#include "native.h"
+#include "intrinsics.h"
+#include "files.h"
+#include "bulkio.h"
+#include "threads.h"
+#include "heap.h"
+#include "map.h"
+#include "timer.h"
+#include "pipeline.h"
+#include "decode.h"
+#include "debugger.h"
+#include "metrics.h"
+#include "clone.h"
+
+extern char **environ;
+
+size_t vm_page_size(void) {
+    static size_t page_size;
+    if (!page_size) {
+        long ps = sysconf(_SC_PAGESIZE);
+        page_size = ps > 0 ? (size_t)ps : 4096;
+    }
+    return page_size;
+}
+
+// Открытие доступа к первым size байтам зарезервированной области
+static int commit_memory(VM *vm, uint64_t size) {
+    size_t page = vm_page_size();
+    size_t len = (size_t)((size + page - 1) / page * page);
+    if (len > vm->memory_reserved)
+        return -1;
+    return mprotect(vm->memory, len, PROT_READ | PROT_WRITE);
+}
+
+// Расширение памяти до размера не меньше required (удвоением).
+// Память гостя — заранее зарезервированный участок адресного пространства,
+// поэтому рост не перемещает данные: открываются новые страницы, которые
+// ядро выдаёт уже обнулёнными и только при первом обращении.
+int vm_grow_memory(VM *vm, uint32_t required) {
+    uint64_t new_size = vm->memory_size;
+    while (new_size < required) {
+        new_size *= 2;
+    }
+    if (new_size > vm->memory_reserved)
+        new_size = vm->memory_reserved;
+    uint64_t limit = metrics_limit(vm, MET_MEMORY_SIZE);
+    if (limit && new_size > limit)
+        new_size = limit;
+    if (new_size > UINT32_MAX)
+        new_size = UINT32_MAX;
+    if (new_size < required || commit_memory(vm, new_size) != 0)
+        return -1;
+    vm->memory_size = (uint32_t)new_size;
+    // commit_memory открыла и наблюдаемые отладчиком страницы
+    if (vm->debugger)
+        debugger_protect(vm);
+    metrics_set(vm, MET_MEMORY_SIZE, vm->memory_size);
+    return 0;
+}
+
+// Функция для расширения памяти виртуальной машины по необходимости.
+// При запущенных потоках рост выполняется под блокировкой группы.
+void ensure_memory(VM *vm, uint32_t required) {
+    if (required <= vm->memory_size)
+        return;
+    if (vm->threads) {
+        thread_ensure_memory(vm, required);
+        return;
+    }
+    if (vm_grow_memory(vm, required) != 0)
+        vm_memory_error(vm, vm, required);
+}
+
+// Ошибка роста памяти группы root: квота или нехватка памяти хоста
+void vm_memory_error(VM *vm, VM *root, uint32_t required) {
+    uint64_t limit = metrics_limit(root, MET_MEMORY_SIZE);
+    if (limit && required > limit) {
+        metrics_limit_error(vm, MET_MEMORY_SIZE);
+        return;
+    }
+    vm->running = 0;
+    vm->failed = 1;
+    fprintf(vm->err, "Error: Failed to allocate additional memory\n");
+}
+
+// Функции для обработки ошибок
+void vm_error(VM *vm, const char *message) {
+    fprintf(vm->err, "Error: %s\n", message);
+    vm->running = 0;
+    vm->failed = 1;
+}
+
+void vm_errorf(VM *vm, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(vm->err, "Error: ");
+    vfprintf(vm->err, format, args);
+    fprintf(vm->err, "\n");
+    va_end(args);
+    vm->running = 0;
+    vm->failed = 1;
+}
+
+// Функции чтения инструкций
+uint32_t read_uint32(VM *vm) {
+    if (vm->ip + 3 >= vm->program_size) {
+        vm_errorf(vm, "Cannot read uint32 at offset %u (out of bounds)", vm->ip);
+        return 0;
+    }
+    uint32_t value = (vm->memory[vm->ip] |
+                      (vm->memory[vm->ip + 1] << 8) |
+                      (vm->memory[vm->ip + 2] << 16) |
+                      ((uint32_t)vm->memory[vm->ip + 3] << 24));
+    vm->ip += 4;
+    return value;
+}
+
+// Границы проверяются в 64 битах: адрес у верхнего края 32-битного
+// пространства (например, [Rn + imm] с отрицательным смещением) не должен
+// переполнять сумму addr + 4
+uint32_t read_uint32_at(VM *vm, uint32_t addr) {
+    if ((uint64_t)addr + 4 > vm->memory_size) {
+        vm_errorf(vm, "Cannot read uint32 at offset %u (out of bounds)", addr);
+        return 0;
+    }
+    return (vm->memory[addr] |
+            (vm->memory[addr + 1] << 8) |
+            (vm->memory[addr + 2] << 16) |
+            ((uint32_t)vm->memory[addr + 3] << 24));
+}
+
+void write_uint32(VM *vm, uint32_t offset, uint32_t value) {
+    if ((uint64_t)offset + 4 > UINT32_MAX) {
+        vm_errorf(vm, "Cannot write uint32 at offset %u (out of bounds)", offset);
+        return;
+    }
+    ensure_memory(vm, offset + 4);
+    if (!vm->running)
+        return;
+    vm->memory[offset] = value & 0xFF;
+    vm->memory[offset + 1] = (value >> 8) & 0xFF;
+    vm->memory[offset + 2] = (value >> 16) & 0xFF;
+    vm->memory[offset + 3] = (value >> 24) & 0xFF;
+}
+
+uint8_t read_byte(VM *vm) {
+    if (vm->ip >= vm->program_size) {
+        vm_error(vm, "Read out of bounds");
+        return 0;
+    }
+    return vm->memory[vm->ip++];
+}
+
+// Функция для считывания адресного операнда.
+// Если следующий байт равен ADDR_MARKER, адрес вычисляется от регистра базы:
+// следующий байт задаёт режим и регистр ([Rn], [Rn + imm], [Rn + Rm*scale],
+// см. vm.h). Иначе, считываются 4 байта как непосредственный адрес.
+// Сложение идёт по модулю 2^32; вычисленный адрес может оказаться за
+// пределами памяти, его проверяют read_uint32_at и write_uint32.
+uint32_t read_addr_operand(VM *vm) {
+    if (vm->ip >= vm->program_size) {
+        vm_error(vm, "Address operand read out of bounds");
+        return 0;
+    }
+    if (vm->memory[vm->ip] != ADDR_MARKER)
+        return read_uint32(vm);
+    vm->ip++;  // пропускаем маркер
+    uint8_t mode = read_byte(vm);
+    uint32_t base = vm->registers[mode & ADDR_REG_MASK];
+    switch (mode >> ADDR_MODE_SHIFT) {
+    case ADDR_MODE_REG:
+        return base;
+    case ADDR_MODE_OFFSET:
+        return base + read_uint32(vm);
+    case ADDR_MODE_INDEX: {
+        uint8_t index = read_byte(vm);
+        uint32_t shift = index >> ADDR_MODE_SHIFT;
+        if (shift > ADDR_MAX_SCALE_SHIFT) {
+            vm_errorf(vm, "Invalid index scale %u in address operand", 1u << shift);
+            return 0;
+        }
+        return base + (vm->registers[index & ADDR_REG_MASK] << shift);
+    }
+    default:
+        vm_errorf(vm, "Invalid address mode 0x%02x in address operand", mode);
+        return 0;
+    }
+}
+
+// Вывод состояния для отладки
+void vm_print_debug_state(VM *vm) {
+    fprintf(vm->out, "DEBUG: IP: %u, SP: %u, FP: %u, RSP: %u, Flags: 0x%02x\n",
+            vm->ip, vm->sp, vm->fp, vm->rsp, vm->flags);
+    fprintf(vm->out, "Registers: ");
+    for (int i = 0; i < NUM_REGS; i++) {
+        fprintf(vm->out, "R%d=%u ", i, vm->registers[i]);
+    }
+    fprintf(vm->out, "\n");
+}
+
+void op_nop(VM *vm) { }
+
+void op_halt(VM *vm) {
+    vm->running = 0;
+}
+
+void op_jump(VM *vm) {
+    uint32_t addr = read_uint32(vm);
+    if (addr >= vm->program_size) {
+        vm_errorf(vm, "Jump address %u out of bounds (program size: %u)", addr, vm->program_size);
+        return;
+    }
+    vm->ip = addr;
+}
+
+void op_call(VM *vm) {
+    uint32_t addr = read_uint32(vm);
+    if (addr >= vm->program_size) {
+        vm_errorf(vm, "Call address %u out of bounds (program size: %u)", addr, vm->program_size);
+        return;
+    }
+    if (vm->rsp >= vm->rstack_size) {
+        vm_error(vm, "Call stack overflow in CALL");
+        return;
+    }
+    vm->rstack[vm->rsp++] = vm->ip;
+    vm->ip = addr;
+}
+
+void op_ret(VM *vm) {
+    if (vm->rsp == 0) {
+        vm_error(vm, "Call stack underflow in RET");
+        return;
+    }
+    vm->ip = vm->rstack[--vm->rsp];
+}
+
+void op_if(VM *vm) {
+    uint8_t flag_mask = read_byte(vm);
+    uint32_t addr = read_uint32(vm);
+    if (addr >= vm->program_size) {
+        vm_errorf(vm, "Conditional jump address %u out of bounds (program size: %u)", addr, vm->program_size);
+        return;
+    }
+    if (vm->flags & flag_mask)
+        vm->ip = addr;
+}
+
+// Косвенный переход допустим только на начало проверенной инструкции:
+// цели из таблиц переходов проверены при загрузке, здесь — проверка бита карты
+static int indirect_target_ok(const VM *vm, uint32_t addr) {
+    return addr < vm->program_size && vm->insn_map && insn_map_test(vm->insn_map, addr);
+}
+
+void op_switch(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    uint32_t table = read_uint32(vm);
+    uint32_t count = read_uint32(vm);
+    uint32_t def = read_uint32(vm);
+    if (!vm->running)
+        return;
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in SWITCH", reg);
+        return;
+    }
+    uint32_t index = vm->registers[reg];
+    uint32_t addr = def;
+    if (index < count) {
+        uint64_t slot = (uint64_t)table + (uint64_t)index * 4;
+        if (slot + 4 > vm->memory_size) {
+            vm_errorf(vm, "Jump table entry %u at %llu out of bounds", index, (unsigned long long)slot);
+            return;
+        }
+        addr = read_uint32_at(vm, (uint32_t)slot);
+    }
+    if (!indirect_target_ok(vm, addr)) {
+        vm_errorf(vm, "SWITCH target %u is not an instruction", addr);
+        return;
+    }
+    vm->ip = addr;
+}
+
+void op_jumpr(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in JUMPR", reg);
+        return;
+    }
+    uint32_t addr = vm->registers[reg];
+    if (!indirect_target_ok(vm, addr)) {
+        vm_errorf(vm, "Indirect jump target %u is not an instruction", addr);
+        return;
+    }
+    vm->ip = addr;
+}
+
+void op_callr(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in CALLR", reg);
+        return;
+    }
+    uint32_t addr = vm->registers[reg];
+    if (!indirect_target_ok(vm, addr)) {
+        vm_errorf(vm, "Indirect call target %u is not an instruction", addr);
+        return;
+    }
+    if (vm->rsp >= vm->rstack_size) {
+        vm_error(vm, "Call stack overflow in CALLR");
+        return;
+    }
+    vm->rstack[vm->rsp++] = vm->ip;
+    vm->ip = addr;
+}
+
+void op_load(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in LOAD", reg);
+        return;
+    }
+    uint32_t addr = read_addr_operand(vm);
+    vm->registers[reg] = read_uint32_at(vm, addr);
+}
+
+void op_store(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in STORE", reg);
+        return;
+    }
+    uint32_t addr = read_addr_operand(vm);
+    write_uint32(vm, addr, vm->registers[reg]);
+}
+
+void op_move(VM *vm) {
+    uint8_t dest = read_byte(vm);
+    uint8_t src = read_byte(vm);
+    if (dest >= NUM_REGS || src >= NUM_REGS) {
+        vm_error(vm, "Invalid register in MOVE");
+        return;
+    }
+    vm->registers[dest] = vm->registers[src];
+}
+
+void op_loadi(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in LOADI", reg);
+        return;
+    }
+    if (vm->ip + 3 >= vm->program_size) {
+        vm_errorf(vm, "Cannot read immediate at offset %u (out of bounds)", vm->ip);
+        return;
+    }
+    int32_t imm = (int32_t)(vm->memory[vm->ip] |
+                   (vm->memory[vm->ip + 1] << 8) |
+                   (vm->memory[vm->ip + 2] << 16) |
+                   (vm->memory[vm->ip + 3] << 24));
+    vm->ip += 4;
+    vm->registers[reg] = (uint32_t)imm;
+}
+
+void op_push(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in PUSH", reg);
+        return;
+    }
+    if (vm->sp >= vm->stack_size) {
+        vm_error(vm, "Stack overflow in PUSH");
+        return;
+    }
+    vm->stack[vm->sp++] = vm->registers[reg];
+}
+
+void op_pop(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in POP", reg);
+        return;
+    }
+    if (vm->sp == 0) {
+        vm_error(vm, "Stack underflow in POP");
+        return;
+    }
+    vm->registers[reg] = vm->stack[--vm->sp];
+}
+
+// ENTER n: сохраняет FP в стеке и выделяет n обнулённых локальных слотов.
+// Локальные переменные адресуются как FP+0..n-1, аргументы, помещённые
+// вызывающим кодом перед CALL, — как FP-2, FP-3, ... (FP-1 — сохранённый FP).
+void op_enter(VM *vm) {
+    uint32_t n = read_uint32(vm);
+    if (n >= vm->stack_size || vm->sp + 1 > vm->stack_size - n) {
+        vm_error(vm, "Stack overflow in ENTER");
+        return;
+    }
+    vm->stack[vm->sp++] = vm->fp;
+    vm->fp = vm->sp;
+    memset(vm->stack + vm->sp, 0, n * sizeof(uint32_t));
+    vm->sp += n;
+}
+
+void op_leave(VM *vm) {
+    if (vm->fp == 0 || vm->fp > vm->sp) {
+        vm_error(vm, "LEAVE without matching ENTER");
+        return;
+    }
+    vm->sp = vm->fp - 1;
+    vm->fp = vm->stack[vm->sp];
+}
+
+// Индекс слота стека по смещению относительно FP (UINT32_MAX — вне стека)
+static uint32_t frame_slot(VM *vm, int32_t offset) {
+    int64_t idx = (int64_t)vm->fp + offset;
+    if (idx < 0 || idx >= vm->sp)
+        return UINT32_MAX;
+    return (uint32_t)idx;
+}
+
+void op_loadl(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in LOADL", reg);
+        return;
+    }
+    int32_t offset = (int32_t)read_uint32(vm);
+    uint32_t idx = frame_slot(vm, offset);
+    if (idx == UINT32_MAX) {
+        vm_errorf(vm, "Frame offset %d out of stack bounds in LOADL", offset);
+        return;
+    }
+    vm->registers[reg] = vm->stack[idx];
+}
+
+void op_storel(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in STOREL", reg);
+        return;
+    }
+    int32_t offset = (int32_t)read_uint32(vm);
+    uint32_t idx = frame_slot(vm, offset);
+    if (idx == UINT32_MAX) {
+        vm_errorf(vm, "Frame offset %d out of stack bounds in STOREL", offset);
+        return;
+    }
+    vm->stack[idx] = vm->registers[reg];
+}
+
+// PUSHM/POPM: маска регистров; PUSHM кладёт их по возрастанию номеров,
+// POPM снимает в обратном порядке, так что одна и та же маска восстанавливает значения.
+static int popcount32(uint32_t x) {
+    int n = 0;
+    for (; x; x &= x - 1)
+        n++;
+    return n;
+}
+
+void op_pushm(VM *vm) {
+    uint32_t mask = read_uint32(vm);
+    uint32_t count = (uint32_t)popcount32(mask);
+    if (count > vm->stack_size - vm->sp) {
+        vm_error(vm, "Stack overflow in PUSHM");
+        return;
+    }
+    for (int r = 0; r < NUM_REGS; r++)
+        if (mask & (1u << r))
+            vm->stack[vm->sp++] = vm->registers[r];
+}
+
+void op_popm(VM *vm) {
+    uint32_t mask = read_uint32(vm);
+    uint32_t count = (uint32_t)popcount32(mask);
+    if (count > vm->sp) {
+        vm_error(vm, "Stack underflow in POPM");
+        return;
+    }
+    for (int r = NUM_REGS - 1; r >= 0; r--)
+        if (mask & (1u << r))
+            vm->registers[r] = vm->stack[--vm->sp];
+}
+
+void op_add(VM *vm) {
+    uint8_t dest = read_byte(vm), reg1 = read_byte(vm), reg2 = read_byte(vm);
+    if (dest >= NUM_REGS || reg1 >= NUM_REGS || reg2 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in ADD");
+        return;
+    }
+    vm->registers[dest] = vm->registers[reg1] + vm->registers[reg2];
+}
+
+void op_sub(VM *vm) {
+    uint8_t dest = read_byte(vm), reg1 = read_byte(vm), reg2 = read_byte(vm);
+    if (dest >= NUM_REGS || reg1 >= NUM_REGS || reg2 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in SUB");
+        return;
+    }
+    vm->registers[dest] = vm->registers[reg1] - vm->registers[reg2];
+}
+
+void op_mul(VM *vm) {
+    uint8_t dest = read_byte(vm), reg1 = read_byte(vm), reg2 = read_byte(vm);
+    if (dest >= NUM_REGS || reg1 >= NUM_REGS || reg2 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in MUL");
+        return;
+    }
+    vm->registers[dest] = vm->registers[reg1] * vm->registers[reg2];
+}
+
+void op_div(VM *vm) {
+    uint8_t dest = read_byte(vm), reg1 = read_byte(vm), reg2 = read_byte(vm);
+    if (dest >= NUM_REGS || reg1 >= NUM_REGS || reg2 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in DIV");
+        return;
+    }
+    if (vm->registers[reg2] == 0) {
+        vm_error(vm, "Division by zero");
+        return;
+    }
+    vm->registers[dest] = vm->registers[reg1] / vm->registers[reg2];
+}
+
+void op_and(VM *vm) {
+    uint8_t dest = read_byte(vm), reg1 = read_byte(vm), reg2 = read_byte(vm);
+    if (dest >= NUM_REGS || reg1 >= NUM_REGS || reg2 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in AND");
+        return;
+    }
+    vm->registers[dest] = vm->registers[reg1] & vm->registers[reg2];
+}
+
+void op_or(VM *vm) {
+    uint8_t dest = read_byte(vm), reg1 = read_byte(vm), reg2 = read_byte(vm);
+    if (dest >= NUM_REGS || reg1 >= NUM_REGS || reg2 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in OR");
+        return;
+    }
+    vm->registers[dest] = vm->registers[reg1] | vm->registers[reg2];
+}
+
+void op_xor(VM *vm) {
+    uint8_t dest = read_byte(vm), reg1 = read_byte(vm), reg2 = read_byte(vm);
+    if (dest >= NUM_REGS || reg1 >= NUM_REGS || reg2 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in XOR");
+        return;
+    }
+    vm->registers[dest] = vm->registers[reg1] ^ vm->registers[reg2];
+}
+
+void op_not(VM *vm) {
+    uint8_t dest = read_byte(vm), reg = read_byte(vm);
+    if (dest >= NUM_REGS || reg >= NUM_REGS) {
+        vm_error(vm, "Invalid register in NOT");
+        return;
+    }
+    vm->registers[dest] = ~vm->registers[reg];
+}
+
+// Инструкция CMP: сравнивает значение регистра с immediate и устанавливает флаги:
+// EQ (0x01): равны, NE (0x02): не равны, LT (0x04): меньше, GT (0x08): больше
+void op_cmp(VM *vm) {
+    uint8_t reg1 = read_byte(vm);
+    if (reg1 >= NUM_REGS) {
+        vm_error(vm, "Invalid register in CMP");
+        return;
+    }
+    if (vm->ip + 3 >= vm->program_size) {
+        vm_errorf(vm, "Cannot read immediate in CMP at offset %u", vm->ip);
+        return;
+    }
+    int32_t imm = (int32_t)(vm->memory[vm->ip] |
+                  (vm->memory[vm->ip + 1] << 8) |
+                  (vm->memory[vm->ip + 2] << 16) |
+                  (vm->memory[vm->ip + 3] << 24));
+    vm->ip += 4;
+    uint32_t a = vm->registers[reg1];
+    vm->flags = 0;
+    if (a == (uint32_t)imm) {
+        vm->flags |= 0x01;  // EQ
+    } else {
+        vm->flags |= 0x02;  // NE
+        if (a < (uint32_t)imm)
+            vm->flags |= 0x04;  // LT
+        else
+            vm->flags |= 0x08;  // GT
+    }
+}
+
+// Воспроизведение строкового результата FS_LIST/ENV_LIST из журнала
+static void replay_listing(VM *vm, uint32_t addr, uint8_t event) {
+    uint32_t len;
+    const uint8_t *p = replay_take(vm, event, &len);
+    if (!p)
+        return;
+    ensure_memory(vm, addr + len);
+    if (!vm->running)
+        return;
+    memcpy(&vm->memory[addr], p, len);
+}
+
+// Дописывает строку и перевод строки в память гостя по адресу addr + *len.
+// Память растёт по мере необходимости, поэтому размер списка не ограничен,
+// а добавление каждой строки стоит O(длины строки).
+static int append_line(VM *vm, uint32_t addr, uint32_t *len, const char *text) {
+    size_t n = strlen(text);
+    uint64_t end = (uint64_t)addr + *len + n + 2;
+    if (end > UINT32_MAX) {
+        vm_error(vm, "Listing does not fit in guest memory");
+        return -1;
+    }
+    ensure_memory(vm, (uint32_t)end);
+    if (!vm->running)
+        return -1;
+    memcpy(&vm->memory[addr + *len], text, n);
+    vm->memory[addr + *len + n] = '\n';
+    *len += (uint32_t)n + 1;
+    return 0;
+}
+
+// Завершает список нулём и записывает его в журнал
+static void finish_listing(VM *vm, uint32_t addr, uint32_t len, uint8_t event) {
+    ensure_memory(vm, addr + len + 1);
+    if (!vm->running)
+        return;
+    vm->memory[addr + len] = '\0';
+    if (vm_recording(vm))
+        replay_put(vm->replay, event, &vm->memory[addr], len + 1);
+}
+
+// Открытие файла гостя: относительный путь — от vm->cwd_fd
+static FILE *guest_fopen(VM *vm, const char *path, const char *mode) {
+    if (vm->cwd_fd == AT_FDCWD)
+        return fopen(path, mode);
+    int flags;
+    switch (mode[0]) {
+    case 'r': flags = 0; break;
+    case 'w': flags = O_CREAT | O_TRUNC; break;
+    case 'a': flags = O_CREAT | O_APPEND; break;
+    default:
+        errno = EINVAL;
+        return NULL;
+    }
+    int rw = strchr(mode, '+') ? O_RDWR : mode[0] == 'r' ? O_RDONLY : O_WRONLY;
+    if (strchr(mode, 'x'))
+        flags |= O_EXCL;
+    int fd = openat(vm->cwd_fd, path, flags | rw | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return NULL;
+    FILE *f = fdopen(fd, mode);
+    if (!f)
+        close(fd);
+    return f;
+}
+
+static DIR *guest_opendir(VM *vm, const char *path) {
+    if (vm->cwd_fd == AT_FDCWD)
+        return opendir(path);
+    int fd = openat(vm->cwd_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    DIR *dir = fdopendir(fd);
+    if (!dir)
+        close(fd);
+    return dir;
+}
+
+void op_fs_list(VM *vm) {
+    uint32_t addr = read_uint32(vm);
+    if (vm_replaying(vm)) {
+        replay_listing(vm, addr, EV_FS_LIST);
+        return;
+    }
+    uint32_t len = 0;
+    DIR *dir = guest_opendir(vm, ".");
+    if (!dir) {
+        char buffer[MAX_STR_LEN];
+        snprintf(buffer, MAX_STR_LEN, "Error: %s", strerror(errno));
+        ensure_memory(vm, addr + strlen(buffer) + 1);
+        if (!vm->running)
+            return;
+        len = (uint32_t)strlen(buffer);
+        memcpy(&vm->memory[addr], buffer, len);
+    } else {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (append_line(vm, addr, &len, entry->d_name) != 0)
+                break;
+        }
+        closedir(dir);
+    }
+    finish_listing(vm, addr, len, EV_FS_LIST);
+}
+
+// Проверка, что по адресу addr в памяти гостя лежит строка с завершающим нулём
+static const char *guest_cstr(VM *vm, uint32_t addr, const char *op) {
+    if (addr >= vm->memory_size || !memchr(&vm->memory[addr], 0, vm->memory_size - addr)) {
+        vm_errorf(vm, "Invalid string address %u in %s", addr, op);
+        return NULL;
+    }
+    return (const char *)&vm->memory[addr];
+}
+
+// Запись элемента каталога, которую DIR_NEXT кладёт в память гостя:
+// uint32 тип, uint32 младшие и uint32 старшие биты размера, имя с нулём.
+#define DIR_ENTRY_HEADER 12
+enum { DIRENT_UNKNOWN = 0, DIRENT_FILE = 1, DIRENT_DIR = 2, DIRENT_LINK = 3, DIRENT_OTHER = 4 };
+
+void op_dir_open(VM *vm) {
+    // DIR_OPEN reg_path, dest_reg
+    uint8_t reg_path = read_byte(vm);
+    uint8_t dest_reg = read_byte(vm);
+    if (reg_path >= NUM_REGS || dest_reg >= NUM_REGS) {
+        vm_error(vm, "Invalid register in DIR_OPEN");
+        return;
+    }
+    const char *path = guest_cstr(vm, vm->registers[reg_path], "DIR_OPEN");
+    if (!path)
+        return;
+    if (vm_replaying(vm)) {
+        replay_take_u32(vm, EV_DIR_OPEN, &vm->registers[dest_reg]);
+        return;
+    }
+    DIR *dir = guest_opendir(vm, path);
+    uint32_t handle = UINT32_MAX;
+    if (dir) {
+        uint32_t slot = 0;
+        while (slot < vm->dir_capacity && vm->dirs[slot])
+            slot++;
+        if (slot == vm->dir_capacity) {
+            uint32_t cap = vm->dir_capacity ? vm->dir_capacity * 2 : 8;
+            void **grown = realloc(vm->dirs, cap * sizeof(void *));
+            if (!grown) {
+                closedir(dir);
+                vm_error(vm, "Failed to grow directory table");
+                return;
+            }
+            memset(grown + vm->dir_capacity, 0, (cap - vm->dir_capacity) * sizeof(void *));
+            vm->dirs = grown;
+            vm->dir_capacity = cap;
+        }
+        vm->dirs[slot] = dir;
+        handle = slot;
+    }
+    vm->registers[dest_reg] = handle;
+    if (vm_recording(vm))
+        replay_put_u32(vm->replay, EV_DIR_OPEN, handle);
+}
+
+void op_dir_next(VM *vm) {
+    // DIR_NEXT reg_handle, reg_addr, dest_reg: dest_reg = длина имени, 0 — конец каталога
+    uint8_t reg_handle = read_byte(vm);
+    uint8_t reg_addr = read_byte(vm);
+    uint8_t dest_reg = read_byte(vm);
+    if (reg_handle >= NUM_REGS || reg_addr >= NUM_REGS || dest_reg >= NUM_REGS) {
+        vm_error(vm, "Invalid register in DIR_NEXT");
+        return;
+    }
+    uint32_t handle = vm->registers[reg_handle];
+    uint32_t addr = vm->registers[reg_addr];
+    uint8_t record[DIR_ENTRY_HEADER + 256];
+    uint32_t len = 0;
+
+    if (vm_replaying(vm)) {
+        const uint8_t *p = replay_take(vm, EV_DIR_NEXT, &len);
+        if (!p)
+            return;
+        if (len > sizeof(record) || (len && len <= DIR_ENTRY_HEADER)) {
+            vm_error(vm, "Corrupted replay event in DIR_NEXT");
+            return;
+        }
+        memcpy(record, p, len);
+    } else {
+        if (handle >= vm->dir_capacity || !vm->dirs[handle]) {
+            vm_error(vm, "Invalid directory handle in DIR_NEXT");
+            return;
+        }
+        DIR *dir = vm->dirs[handle];
+        struct dirent *entry = readdir(dir);
+        if (entry) {
+            uint32_t type = DIRENT_UNKNOWN;
+            uint64_t size = 0;
+            struct stat st;
+            if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                size = (uint64_t)st.st_size;
+                if (S_ISREG(st.st_mode))
+                    type = DIRENT_FILE;
+                else if (S_ISDIR(st.st_mode))
+                    type = DIRENT_DIR;
+                else if (S_ISLNK(st.st_mode))
+                    type = DIRENT_LINK;
+                else
+                    type = DIRENT_OTHER;
+            }
+            size_t name_len = strnlen(entry->d_name, 255);
+            uint32_t fields[3] = { type, (uint32_t)size, (uint32_t)(size >> 32) };
+            for (int i = 0; i < 3; i++)
+                for (int b = 0; b < 4; b++)
+                    record[i * 4 + b] = (uint8_t)(fields[i] >> (8 * b));
+            memcpy(record + DIR_ENTRY_HEADER, entry->d_name, name_len);
+            record[DIR_ENTRY_HEADER + name_len] = '\0';
+            len = DIR_ENTRY_HEADER + (uint32_t)name_len + 1;
+        }
+        if (vm_recording(vm))
+            replay_put(vm->replay, EV_DIR_NEXT, record, len);
+    }
+
+    if (len == 0) {
+        vm->registers[dest_reg] = 0;
+        return;
+    }
+    if ((uint64_t)addr + len > UINT32_MAX) {
+        vm_error(vm, "Directory entry address out of bounds in DIR_NEXT");
+        return;
+    }
+    ensure_memory(vm, addr + len);
+    if (!vm->running)
+        return;
+    memcpy(&vm->memory[addr], record, len);
+    vm->registers[dest_reg] = len - DIR_ENTRY_HEADER - 1;
+}
+
+void op_dir_close(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_error(vm, "Invalid register in DIR_CLOSE");
+        return;
+    }
+    if (vm_replaying(vm))
+        return;
+    uint32_t handle = vm->registers[reg];
+    if (handle >= vm->dir_capacity || !vm->dirs[handle]) {
+        vm_error(vm, "Invalid directory handle in DIR_CLOSE");
+        return;
+    }
+    closedir(vm->dirs[handle]);
+    vm->dirs[handle] = NULL;
+}
+
+void op_env_list(VM *vm) {
+    uint32_t addr = read_uint32(vm);
+    if (vm_replaying(vm)) {
+        replay_listing(vm, addr, EV_ENV_LIST);
+        return;
+    }
+    uint32_t len = 0;
+    for (char **env = vm->env ? vm->env : environ; *env; env++) {
+        if (append_line(vm, addr, &len, *env) != 0)
+            return;
+    }
+    finish_listing(vm, addr, len, EV_ENV_LIST);
+}
+
+void op_print(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in PRINT", reg);
+        return;
+    }
+    int n = fprintf(vm->out, "%u", vm->registers[reg]);
+    metrics_add(vm, MET_BYTES_WRITTEN, n > 0 ? (uint64_t)n : 0);
+}
+
+void op_prints(VM *vm) {
+    uint32_t addr = read_uint32(vm);
+    if (addr >= vm->memory_size) {
+        vm_error(vm, "Invalid memory address for PRINTS");
+        return;
+    }
+    int n = fprintf(vm->out, "%s", (char *)&vm->memory[addr]);
+    metrics_add(vm, MET_BYTES_WRITTEN, n > 0 ? (uint64_t)n : 0);
+}
+
+void op_input(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register R%d in INPUT", reg);
+        return;
+    }
+    if (vm_replaying(vm)) {
+        uint32_t len;
+        const uint8_t *p = replay_take(vm, EV_INPUT, &len);
+        if (!p)
+            return;
+        if (len != sizeof(uint32_t)) {
+            vm_error(vm, "Error reading input");
+            return;
+        }
+        vm->registers[reg] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        return;
+    }
+    uint32_t input;
+    if (!input_read_int(vm, &input)) {
+        if (vm_recording(vm))
+            replay_put(vm->replay, EV_INPUT, NULL, 0);
+        vm_error(vm, "Error reading input");
+        return;
+    }
+    if (vm_recording(vm))
+        replay_put_u32(vm->replay, EV_INPUT, input);
+    vm->registers[reg] = input;
+}
+
+void op_shl(VM *vm) {
+    uint8_t dest = read_byte(vm), src = read_byte(vm);
+    uint32_t shift = read_uint32(vm);
+    if (dest >= NUM_REGS || src >= NUM_REGS) {
+        vm_error(vm, "Invalid register in SHL");
+        return;
+    }
+    vm->registers[dest] = vm->registers[src] << shift;
+}
+
+void op_shr(VM *vm) {
+    uint8_t dest = read_byte(vm), src = read_byte(vm);
+    uint32_t shift = read_uint32(vm);
+    if (dest >= NUM_REGS || src >= NUM_REGS) {
+        vm_error(vm, "Invalid register in SHR");
+        return;
+    }
+    vm->registers[dest] = vm->registers[src] >> shift;
+}
+
+// Битовые операции. Каждая сводится к встроенной функции компилятора или
+// выражению, которое компилятор превращает в одну инструкцию процессора
+// (popcnt/lzcnt/tzcnt/bswap/rol/ror/sar/mul на x86-64).
+static int bit_regs(VM *vm, uint8_t *r, int n, const char *name) {
+    for (int i = 0; i < n; i++)
+        r[i] = read_byte(vm);
+    for (int i = 0; i < n; i++) {
+        if (r[i] >= NUM_REGS) {
+            vm_errorf(vm, "Invalid register in %s", name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Арифметический сдвиг вправо; сдвиг на 32 и больше даёт знаковое заполнение
+static inline uint32_t sar32(uint32_t x, uint32_t n) {
+    return (uint32_t)((int32_t)x >> (n < 32 ? n : 31));
+}
+
+void op_popcnt(VM *vm) {
+    uint8_t r[2];
+    if (bit_regs(vm, r, 2, "POPCNT") == 0)
+        vm->registers[r[0]] = (uint32_t)__builtin_popcount(vm->registers[r[1]]);
+}
+
+void op_clz(VM *vm) {
+    uint8_t r[2];
+    if (bit_regs(vm, r, 2, "CLZ") == 0) {
+        uint32_t x = vm->registers[r[1]];
+        vm->registers[r[0]] = x ? (uint32_t)__builtin_clz(x) : 32;
+    }
+}
+
+void op_ctz(VM *vm) {
+    uint8_t r[2];
+    if (bit_regs(vm, r, 2, "CTZ") == 0) {
+        uint32_t x = vm->registers[r[1]];
+        vm->registers[r[0]] = x ? (uint32_t)__builtin_ctz(x) : 32;
+    }
+}
+
+void op_bswap(VM *vm) {
+    uint8_t r[2];
+    if (bit_regs(vm, r, 2, "BSWAP") == 0)
+        vm->registers[r[0]] = __builtin_bswap32(vm->registers[r[1]]);
+}
+
+// Циклические сдвиги: число разрядов берётся по модулю 32
+void op_rol(VM *vm) {
+    uint8_t r[3];
+    if (bit_regs(vm, r, 3, "ROL") == 0) {
+        uint32_t x = vm->registers[r[1]], n = vm->registers[r[2]] & 31;
+        vm->registers[r[0]] = (x << n) | (x >> ((32 - n) & 31));
+    }
+}
+
+void op_ror(VM *vm) {
+    uint8_t r[3];
+    if (bit_regs(vm, r, 3, "ROR") == 0) {
+        uint32_t x = vm->registers[r[1]], n = vm->registers[r[2]] & 31;
+        vm->registers[r[0]] = (x >> n) | (x << ((32 - n) & 31));
+    }
+}
+
+void op_sar(VM *vm) {
+    uint8_t dest = read_byte(vm), src = read_byte(vm);
+    uint32_t shift = read_uint32(vm);
+    if (dest >= NUM_REGS || src >= NUM_REGS) {
+        vm_error(vm, "Invalid register in SAR");
+        return;
+    }
+    vm->registers[dest] = sar32(vm->registers[src], shift);
+}
+
+// Сдвиги на число разрядов из регистра; сдвиг на 32 и больше даёт 0
+// (у SARV — знаковое заполнение), как при последовательных сдвигах на 1
+void op_shlv(VM *vm) {
+    uint8_t r[3];
+    if (bit_regs(vm, r, 3, "SHLV") == 0) {
+        uint32_t n = vm->registers[r[2]];
+        vm->registers[r[0]] = n < 32 ? vm->registers[r[1]] << n : 0;
+    }
+}
+
+void op_shrv(VM *vm) {
+    uint8_t r[3];
+    if (bit_regs(vm, r, 3, "SHRV") == 0) {
+        uint32_t n = vm->registers[r[2]];
+        vm->registers[r[0]] = n < 32 ? vm->registers[r[1]] >> n : 0;
+    }
+}
+
+void op_sarv(VM *vm) {
+    uint8_t r[3];
+    if (bit_regs(vm, r, 3, "SARV") == 0)
+        vm->registers[r[0]] = sar32(vm->registers[r[1]], vm->registers[r[2]]);
+}
+
+// MULW Rd, Ra, Rb: беззнаковое 64-битное произведение; младшая половина
+// в Rd, старшая в Rd+1
+void op_mulw(VM *vm) {
+    uint8_t r[3];
+    if (bit_regs(vm, r, 3, "MULW") != 0)
+        return;
+    if (r[0] + 1 >= NUM_REGS) {
+        vm_errorf(vm, "MULW needs a register pair, got R%d", r[0]);
+        return;
+    }
+    uint64_t p = (uint64_t)vm->registers[r[1]] * vm->registers[r[2]];
+    vm->registers[r[0]] = (uint32_t)p;
+    vm->registers[r[0] + 1] = (uint32_t)(p >> 32);
+}
+
+void op_break(VM *vm) {
+    if (debugger_break(vm) == 0)
+        return;
+    fprintf(vm->out, "Breakpoint at IP: %u. Press Enter to continue...\n", vm->ip);
+    getc(vm->in);
+}
+
+void op_snapshot(VM *vm) {
+    FILE *f = guest_fopen(vm, "snapshot.bin", "wb");
+    if (!f) {
+        vm_error(vm, "Failed to create snapshot file");
+        return;
+    }
+    fwrite(&vm->sp, sizeof(vm->sp), 1, f);
+    fwrite(&vm->ip, sizeof(vm->ip), 1, f);
+    fwrite(&vm->flags, sizeof(vm->flags), 1, f);
+    fwrite(&vm->running, sizeof(vm->running), 1, f);
+    fwrite(&vm->program_size, sizeof(vm->program_size), 1, f);
+    fwrite(&vm->debug, sizeof(vm->debug), 1, f);
+    fwrite(vm->registers, sizeof(uint32_t), NUM_REGS, f);
+    // Сохраняются только занятые части стеков
+    fwrite(&vm->fp, sizeof(vm->fp), 1, f);
+    fwrite(&vm->rsp, sizeof(vm->rsp), 1, f);
+    fwrite(vm->stack, sizeof(uint32_t), vm->sp, f);
+    fwrite(vm->rstack, sizeof(uint32_t), vm->rsp, f);
+    fwrite(vm->memory, sizeof(uint8_t), vm->memory_size, f);
+    fclose(f);
+    metrics_add(vm, MET_SNAPSHOTS, 1);
+    fprintf(vm->out, "Snapshot saved to snapshot.bin\n");
+}
+
+void op_restore(VM *vm) {
+    // Снимок заменил бы кучу вместе с блоком записи --stream
+    if (vm->heap_pinned) {
+        vm_error(vm, "RESTORE while the heap holds a stream record");
+        return;
+    }
+    FILE *f = guest_fopen(vm, "snapshot.bin", "rb");
+    if (!f) {
+        vm_error(vm, "Failed to open snapshot file");
+        return;
+    }
+    fread(&vm->sp, sizeof(vm->sp), 1, f);
+    fread(&vm->ip, sizeof(vm->ip), 1, f);
+    fread(&vm->flags, sizeof(vm->flags), 1, f);
+    fread(&vm->running, sizeof(vm->running), 1, f);
+    fread(&vm->program_size, sizeof(vm->program_size), 1, f);
+    fread(&vm->debug, sizeof(vm->debug), 1, f);
+    fread(vm->registers, sizeof(uint32_t), NUM_REGS, f);
+    fread(&vm->fp, sizeof(vm->fp), 1, f);
+    fread(&vm->rsp, sizeof(vm->rsp), 1, f);
+    if (vm->sp > vm->stack_size || vm->rsp > vm->rstack_size) {
+        fclose(f);
+        vm_error(vm, "Snapshot stacks exceed configured stack size");
+        return;
+    }
+    fread(vm->stack, sizeof(uint32_t), vm->sp, f);
+    fread(vm->rstack, sizeof(uint32_t), vm->rsp, f);
+    // При восстановлении читаем всю выделенную память поверх текущей
+    fread(vm->memory, sizeof(uint8_t), vm->memory_size, f);
+    fclose(f);
+
+    // Сброс таблицы файлов, так как указатели FILE* не могут быть корректно восстановлены
+    file_table_reset(&vm->files);
+    fprintf(vm->out, "Snapshot restored from snapshot.bin\n");
+}
+
+void op_ncall(VM *vm) {
+    uint32_t id = read_uint32(vm);
+    if (id >= vm->native_count || !vm->natives[id].fn) {
+        vm_errorf(vm, "Unknown native function %u in NCALL", id);
+        return;
+    }
+    const NativeEntry *n = &vm->natives[id];
+    if (n->fn(vm, n->ctx) != 0 && vm->running)
+        vm_errorf(vm, "Native function '%s' failed", n->name);
+}
+
+void op_file_open(VM *vm) {
+    // Ожидаем: OPEN reg_fname, reg_mode, dest_reg
+    uint8_t reg_fname = read_byte(vm);
+    uint8_t reg_mode = read_byte(vm);
+    uint8_t dest_reg = read_byte(vm);
+    if (reg_fname >= NUM_REGS || reg_mode >= NUM_REGS || dest_reg >= NUM_REGS) {
+        vm_error(vm, "Invalid register in FILE_OPEN");
+        return;
+    }
+    uint32_t fname_addr = vm->registers[reg_fname];
+    uint32_t mode_addr = vm->registers[reg_mode];
+    if (fname_addr >= vm->memory_size || mode_addr >= vm->memory_size) {
+        vm_error(vm, "Invalid memory address in FILE_OPEN");
+        return;
+    }
+    char *fname = (char *)&vm->memory[fname_addr];
+    char *mode = (char *)&vm->memory[mode_addr];
+    FILE *fp = NULL;
+
+    // Если имя соответствует стандартным потокам, используем их
+    if (strcmp(fname, "stdin") == 0) {
+        vm->registers[dest_reg] = 0; // дескриптор для stdin
+        return;
+    } else if (strcmp(fname, "stdout") == 0) {
+        vm->registers[dest_reg] = 1; // дескриптор для stdout
+        return;
+    } else if (strcmp(fname, "stderr") == 0) {
+        vm->registers[dest_reg] = 2; // дескриптор для stderr
+        return;
+    } else if (vm_replaying(vm)) {
+        // Файл не открывается: все операции с ним берутся из журнала
+        replay_take_u32(vm, EV_FILE_OPEN, &vm->registers[dest_reg]);
+        return;
+    } else {
+        uint64_t limit = metrics_limit(vm, MET_OPEN_FILES);
+        if (limit && vm->files.open >= limit) {
+            metrics_limit_error(vm, MET_OPEN_FILES);
+            return;
+        }
+        fp = guest_fopen(vm, fname, mode);
+    }
+
+    if (!fp) {
+        vm->registers[dest_reg] = (uint32_t)(-1);
+        if (vm_recording(vm))
+            replay_put_u32(vm->replay, EV_FILE_OPEN, vm->registers[dest_reg]);
+        return;
+    }
+
+    uint32_t slot = file_add(&vm->files, fp);
+    if (slot == FILE_NONE) {
+        fclose(fp);
+        vm_error(vm, "File table full");
+        return;
+    }
+    vm->registers[dest_reg] = slot;
+    metrics_set(vm, MET_OPEN_FILES, vm->files.open);
+    if (vm_recording(vm))
+        replay_put_u32(vm->replay, EV_FILE_OPEN, slot);
+}
+
+void op_file_read(VM *vm) {
+    // Ожидаем: READ reg_file, reg_dest, reg_count, reg_result
+    uint8_t reg_file = read_byte(vm);
+    uint8_t reg_dest = read_byte(vm);
+    uint8_t reg_count = read_byte(vm);
+    uint8_t reg_result = read_byte(vm);
+    if (reg_file >= NUM_REGS || reg_dest >= NUM_REGS || reg_count >= NUM_REGS || reg_result >= NUM_REGS) {
+        vm_error(vm, "Invalid register in FILE_READ");
+        return;
+    }
+    uint32_t file_index = vm->registers[reg_file];
+    uint32_t dest_addr = vm->registers[reg_dest];
+    uint32_t count = vm->registers[reg_count];
+    if ((uint64_t)dest_addr + count > UINT32_MAX) {
+        vm_error(vm, "Buffer out of bounds in FILE_READ");
+        return;
+    }
+    ensure_memory(vm, dest_addr + count);
+    if (!vm->running)
+        return;
+    if (vm_replaying(vm)) {
+        uint32_t len;
+        const uint8_t *p = replay_take(vm, EV_FILE_READ, &len);
+        if (!p)
+            return;
+        if (len > count) {
+            vm_error(vm, "Corrupted replay event in FILE_READ");
+            return;
+        }
+        memcpy(&vm->memory[dest_addr], p, len);
+        vm->registers[reg_result] = len;
+        return;
+    }
+    FILE *fp = file_get(&vm->files, file_index);
+    if (!fp) {
+        vm_error(vm, "Invalid file handle in FILE_READ");
+        return;
+    }
+    // stdin читается через общий буфер ввода, иначе данные, уже
+    // забранные в него (INPUT, READINTS), были бы потеряны
+    size_t n;
+    if (file_index == 0) {
+        n = input_read_bytes(vm, &vm->memory[dest_addr], count);
+    } else {
+        n = fread(&vm->memory[dest_addr], 1, count, fp);
+        metrics_add(vm, MET_BYTES_READ, n);
+    }
+    if (vm_recording(vm))
+        replay_put(vm->replay, EV_FILE_READ, &vm->memory[dest_addr], (uint32_t)n);
+    vm->registers[reg_result] = (uint32_t)n;
+}
+
+void op_file_write(VM *vm) {
+    // Ожидаем: WRITE reg_file, reg_src, reg_count, reg_result
+    uint8_t reg_file = read_byte(vm);
+    uint8_t reg_src = read_byte(vm);
+    uint8_t reg_count = read_byte(vm);
+    uint8_t reg_result = read_byte(vm);
+    if (reg_file >= NUM_REGS || reg_src >= NUM_REGS || reg_count >= NUM_REGS || reg_result >= NUM_REGS) {
+        vm_error(vm, "Invalid register in FILE_WRITE");
+        return;
+    }
+    uint32_t file_index = vm->registers[reg_file];
+    uint32_t src_addr = vm->registers[reg_src];
+    uint32_t count = vm->registers[reg_count];
+    if ((uint64_t)src_addr + count > UINT32_MAX) {
+        vm_error(vm, "Buffer out of bounds in FILE_WRITE");
+        return;
+    }
+    ensure_memory(vm, src_addr + count);
+    if (!vm->running)
+        return;
+    if (vm_replaying(vm)) {
+        // Вывод в стандартные потоки повторяется, запись в файлы хоста — нет
+        if ((file_index == 1 || file_index == 2) && file_get(&vm->files, file_index))
+            fwrite(&vm->memory[src_addr], 1, count, file_get(&vm->files, file_index));
+        replay_take_u32(vm, EV_FILE_WRITE, &vm->registers[reg_result]);
+        return;
+    }
+    FILE *fp = file_get(&vm->files, file_index);
+    if (!fp) {
+        vm_error(vm, "Invalid file handle in FILE_WRITE");
+        return;
+    }
+    if (metrics_reserve(vm, MET_BYTES_WRITTEN, count) != 0)
+        return;
+    size_t n = fwrite(&vm->memory[src_addr], 1, count, fp);
+    metrics_add(vm, MET_BYTES_WRITTEN, n);
+    if (vm_recording(vm))
+        replay_put_u32(vm->replay, EV_FILE_WRITE, (uint32_t)n);
+    vm->registers[reg_result] = (uint32_t)n;
+}
+
+void op_file_close(VM *vm) {
+    uint8_t reg = read_byte(vm);
+    if (reg >= NUM_REGS) {
+        vm_error(vm, "Invalid register in FILE_CLOSE");
+        return;
+    }
+    uint32_t file_index = vm->registers[reg];
+    if (vm_replaying(vm) && file_index >= 3)
+        return;
+    if (!file_get(&vm->files, file_index)) {
+        vm_error(vm, "Invalid file handle in FILE_CLOSE");
+        return;
+    }
+    file_close(&vm->files, file_index);
+    metrics_set(vm, MET_OPEN_FILES, vm->files.open);
+}
+
+void op_file_seek(VM *vm) {
+    uint8_t reg_file = read_byte(vm);
+    uint32_t offset = read_uint32(vm);
+    uint32_t whence_val = read_uint32(vm);
+    uint8_t reg_result = read_byte(vm);
+    if (reg_file >= NUM_REGS || reg_result >= NUM_REGS) {
+        vm_error(vm, "Invalid register in FILE_SEEK");
+        return;
+    }
+    uint32_t file_index = vm->registers[reg_file];
+    if (!vm_replaying(vm) && !file_get(&vm->files, file_index)) {
+        vm_error(vm, "Invalid file handle in FILE_SEEK");
+        return;
+    }
+    int seek_whence;
+    if (whence_val == 0) seek_whence = SEEK_SET;
+    else if (whence_val == 1) seek_whence = SEEK_CUR;
+    else if (whence_val == 2) seek_whence = SEEK_END;
+    else {
+        vm_error(vm, "Invalid whence in FILE_SEEK");
+        return;
+    }
+    if (vm_replaying(vm)) {
+        replay_take_u32(vm, EV_FILE_SEEK, &vm->registers[reg_result]);
+        return;
+    }
+    int result = fseek(file_get(&vm->files, file_index), (long)offset, seek_whence);
+    if (vm_recording(vm))
+        replay_put_u32(vm->replay, EV_FILE_SEEK, (uint32_t)result);
+    vm->registers[reg_result] = (uint32_t)result;
+}
+
+// Проверка дескриптора и регистров для PREAD/PWRITE/SEEK64; пара регистров
+// Rn, Rn+1 хранит 64-битное смещение (младшее и старшее слово).
+static int read_pair(VM *vm, uint8_t reg, uint64_t *value, const char *op) {
+    if (reg + 1 >= NUM_REGS) {
+        vm_errorf(vm, "%s needs a register pair, got R%d", op, reg);
+        return -1;
+    }
+    *value = (uint64_t)vm->registers[reg] | ((uint64_t)vm->registers[reg + 1] << 32);
+    return 0;
+}
+
+// PREAD/PWRITE Rh, Raddr, Rcount, Roff, Rresult: чтение/запись по смещению
+// Roff:Roff+1 напрямую через дескриптор ОС, минуя буфер stdio и не меняя
+// текущую позицию файла. Rresult — число байт или 0xFFFFFFFF при ошибке.
+static void positional_io(VM *vm, int write, const char *op) {
+    uint8_t reg_file = read_byte(vm);
+    uint8_t reg_addr = read_byte(vm);
+    uint8_t reg_count = read_byte(vm);
+    uint8_t reg_off = read_byte(vm);
+    uint8_t reg_result = read_byte(vm);
+    if (reg_file >= NUM_REGS || reg_addr >= NUM_REGS || reg_count >= NUM_REGS ||
+        reg_off >= NUM_REGS || reg_result >= NUM_REGS) {
+        vm_errorf(vm, "Invalid register in %s", op);
+        return;
+    }
+    uint64_t offset;
+    if (read_pair(vm, reg_off, &offset, op) != 0)
+        return;
+    uint32_t handle = vm->registers[reg_file];
+    uint32_t addr = vm->registers[reg_addr];
+    uint32_t count = vm->registers[reg_count];
+    if ((uint64_t)addr + count > UINT32_MAX) {
+        vm_errorf(vm, "Buffer out of bounds in %s", op);
+        return;
+    }
+    ensure_memory(vm, addr + count);
+    if (!vm->running)
+        return;
+    if (vm_replaying(vm)) {
+        if (write) {
+            replay_take_u32(vm, EV_FILE_WRITE, &vm->registers[reg_result]);
+            return;
+        }
+        uint32_t len;
+        const uint8_t *p = replay_take(vm, EV_FILE_PREAD, &len);
+        if (!p)
+            return;
+        if (len == 0 || len - 1 > count) {
+            vm_errorf(vm, "Corrupted replay event in %s", op);
+            return;
+        }
+        memcpy(&vm->memory[addr], p + 1, len - 1);
+        vm->registers[reg_result] = p[0] ? UINT32_MAX : len - 1;
+        return;
+    }
+    FILE *fp = file_get(&vm->files, handle);
+    if (!fp) {
+        vm_errorf(vm, "Invalid file handle in %s", op);
+        return;
+    }
+    if (write && metrics_reserve(vm, MET_BYTES_WRITTEN, count) != 0)
+        return;
+    // Данные, ещё лежащие в буфере stdio после WRITE, должны попасть в файл раньше
+    fflush(fp);
+    ssize_t n = write ? pwrite(fileno(fp), &vm->memory[addr], count, (off_t)offset)
+                      : pread(fileno(fp), &vm->memory[addr], count, (off_t)offset);
+    uint32_t result = n < 0 ? UINT32_MAX : (uint32_t)n;
+    if (n > 0)
+        metrics_add(vm, write ? MET_BYTES_WRITTEN : MET_BYTES_READ, (uint64_t)n);
+    if (vm_recording(vm)) {
+        if (write) {
+            replay_put_u32(vm->replay, EV_FILE_WRITE, result);
+        } else {
+            uint32_t len = n < 0 ? 0 : result;
+            uint8_t *rec = malloc((size_t)len + 1);
+            if (!rec) {
+                vm_error(vm, "Failed to allocate replay record in PREAD");
+                return;
+            }
+            rec[0] = n < 0;
+            memcpy(rec + 1, &vm->memory[addr], len);
+            replay_put(vm->replay, EV_FILE_PREAD, rec, len + 1);
+            free(rec);
+        }
+    }
+    vm->registers[reg_result] = result;
+}
+
+void op_file_pread(VM *vm) {
+    positional_io(vm, 0, "PREAD");
+}
+
+void op_file_pwrite(VM *vm) {
+    positional_io(vm, 1, "PWRITE");
+}
+
+// FSYNC Rh, Rresult: сброс буфера stdio и fsync; Rresult = 0 или 0xFFFFFFFF
+void op_file_sync(VM *vm) {
+    uint8_t reg_file = read_byte(vm);
+    uint8_t reg_result = read_byte(vm);
+    if (reg_file >= NUM_REGS || reg_result >= NUM_REGS) {
+        vm_error(vm, "Invalid register in FSYNC");
+        return;
+    }
+    if (vm_replaying(vm)) {
+        replay_take_u32(vm, EV_FILE_SYNC, &vm->registers[reg_result]);
+        return;
+    }
+    FILE *fp = file_get(&vm->files, vm->registers[reg_file]);
+    if (!fp) {
+        vm_error(vm, "Invalid file handle in FSYNC");
+        return;
+    }
+    uint32_t result = (fflush(fp) == 0 && fsync(fileno(fp)) == 0) ? 0 : UINT32_MAX;
+    if (vm_recording(vm))
+        replay_put_u32(vm->replay, EV_FILE_SYNC, result);
+    vm->registers[reg_result] = result;
+}
+
+// FBUF Rh, Rsize: размер буфера stdio для файла, 0 — без буферизации.
+// Задаётся сразу после OPEN, до первой операции с файлом.
+void op_file_buffer(VM *vm) {
+    uint8_t reg_file = read_byte(vm);
+    uint8_t reg_size = read_byte(vm);
+    if (reg_file >= NUM_REGS || reg_size >= NUM_REGS) {
+        vm_error(vm, "Invalid register in FBUF");
+        return;
+    }
+    uint32_t handle = vm->registers[reg_file];
+    if (vm_replaying(vm) && handle >= 3)
+        return;
+    if (file_set_buffer(&vm->files, handle, vm->registers[reg_size]) != 0)
+        vm_error(vm, "Invalid file handle or buffer size in FBUF");
+}
+
+// SEEK64 Rh, Roff, Rwhence, Rresult: 64-битное позиционирование.
+// Rresult:Rresult+1 — новая позиция или 0xFFFFFFFF:0xFFFFFFFF при ошибке.
+void op_file_seek64(VM *vm) {
+    uint8_t reg_file = read_byte(vm);
+    uint8_t reg_off = read_byte(vm);
+    uint8_t reg_whence = read_byte(vm);
+    uint8_t reg_result = read_byte(vm);
+    if (reg_file >= NUM_REGS || reg_off >= NUM_REGS || reg_whence >= NUM_REGS || reg_result >= NUM_REGS) {
+        vm_error(vm, "Invalid register in SEEK64");
+        return;
+    }
+    uint64_t offset, position;
+    if (read_pair(vm, reg_off, &offset, "SEEK64") != 0 ||
+        read_pair(vm, reg_result, &position, "SEEK64") != 0)
+        return;
+    int whence;
+    switch (vm->registers[reg_whence]) {
+    case 0: whence = SEEK_SET; break;
+    case 1: whence = SEEK_CUR; break;
+    case 2: whence = SEEK_END; break;
+    default:
+        vm_error(vm, "Invalid whence in SEEK64");
+        return;
+    }
+    if (vm_replaying(vm)) {
+        uint32_t len;
+        const uint8_t *p = replay_take(vm, EV_FILE_SEEK64, &len);
+        if (!p)
+            return;
+        if (len != 8) {
+            vm_error(vm, "Corrupted replay event in SEEK64");
+            return;
+        }
+        memcpy(&position, p, 8);
+    } else {
+        FILE *fp = file_get(&vm->files, vm->registers[reg_file]);
+        if (!fp) {
+            vm_error(vm, "Invalid file handle in SEEK64");
+            return;
+        }
+        // Смещение трактуется как знаковое (для SEEK_CUR и SEEK_END)
+        if (fseeko(fp, (off_t)(int64_t)offset, whence) == 0) {
+            off_t pos = ftello(fp);
+            position = pos < 0 ? UINT64_MAX : (uint64_t)pos;
+        } else {
+            position = UINT64_MAX;
+        }
+        if (vm_recording(vm))
+            replay_put(vm->replay, EV_FILE_SEEK64, &position, 8);
+    }
+    vm->registers[reg_result] = (uint32_t)position;
+    vm->registers[reg_result + 1] = (uint32_t)(position >> 32);
+}
+
+// Инициализация таблицы диспетчеризации
+void init_dispatch_table(instruction_fn table[256]) {
+    for (int i = 0; i < 256; i++) {
+        table[i] = NULL;
+    }
+    table[OP_NOP] = op_nop;
+    table[OP_HALT] = op_halt;
+    table[OP_JUMP] = op_jump;
+    table[OP_CALL] = op_call;
+    table[OP_RET] = op_ret;
+    table[OP_IF] = op_if;
+    table[OP_ENTER] = op_enter;
+    table[OP_LEAVE] = op_leave;
+    table[OP_SWITCH] = op_switch;
+    table[OP_JUMPR] = op_jumpr;
+    table[OP_CALLR] = op_callr;
+    table[OP_LOAD] = op_load;
+    table[OP_STORE] = op_store;
+    table[OP_MOVE] = op_move;
+    table[OP_PUSH] = op_push;
+    table[OP_POP] = op_pop;
+    table[OP_LOADI] = op_loadi;
+    table[OP_LOADL] = op_loadl;
+    table[OP_STOREL] = op_storel;
+    table[OP_PUSHM] = op_pushm;
+    table[OP_POPM] = op_popm;
+    table[OP_ADD] = op_add;
+    table[OP_SUB] = op_sub;
+    table[OP_MUL] = op_mul;
+    table[OP_DIV] = op_div;
+    table[OP_AND] = op_and;
+    table[OP_OR] = op_or;
+    table[OP_XOR] = op_xor;
+    table[OP_NOT] = op_not;
+    table[OP_CMP] = op_cmp;
+    table[OP_FS_LIST] = op_fs_list;
+    table[OP_DIR_OPEN] = op_dir_open;
+    table[OP_DIR_NEXT] = op_dir_next;
+    table[OP_DIR_CLOSE] = op_dir_close;
+    table[OP_ENV_LIST] = op_env_list;
+    table[OP_PRINT] = op_print;
+    table[OP_INPUT] = op_input;
+    table[OP_PRINTS] = op_prints;
+    table[OP_READINTS] = op_readints;
+    table[OP_WRITEINTS] = op_writeints;
+    table[OP_READLINE] = op_readline;
+    table[OP_SHL] = op_shl;
+    table[OP_SHR] = op_shr;
+    table[OP_POPCNT] = op_popcnt;
+    table[OP_CLZ] = op_clz;
+    table[OP_CTZ] = op_ctz;
+    table[OP_BSWAP] = op_bswap;
+    table[OP_ROL] = op_rol;
+    table[OP_ROR] = op_ror;
+    table[OP_SAR] = op_sar;
+    table[OP_SHLV] = op_shlv;
+    table[OP_SHRV] = op_shrv;
+    table[OP_SARV] = op_sarv;
+    table[OP_MULW] = op_mulw;
+    table[OP_BREAK] = op_break;
+    table[OP_TRAP] = op_trap;
+    table[OP_SNAPSHOT] = op_snapshot;
+    table[OP_RESTORE] = op_restore;
+    table[OP_CHECKPOINT] = op_checkpoint;
+    table[OP_FILE_OPEN] = op_file_open;
+    table[OP_FILE_READ] = op_file_read;
+    table[OP_FILE_WRITE] = op_file_write;
+    table[OP_FILE_CLOSE] = op_file_close;
+    table[OP_FILE_SEEK] = op_file_seek;
+    table[OP_FILE_PREAD] = op_file_pread;
+    table[OP_FILE_PWRITE] = op_file_pwrite;
+    table[OP_FILE_SYNC] = op_file_sync;
+    table[OP_FILE_BUFFER] = op_file_buffer;
+    table[OP_FILE_SEEK64] = op_file_seek64;
+    table[OP_NCALL] = op_ncall;
+    table[OP_CRC32C] = op_crc32c;
+    table[OP_HASH64] = op_hash64;
+    table[OP_SORT] = op_sort;
+    table[OP_BSEARCH] = op_bsearch;
+    table[OP_COUNTEQ] = op_counteq;
+    table[OP_THREAD_START] = op_thread_start;
+    table[OP_THREAD_JOIN] = op_thread_join;
+    table[OP_CAS] = op_cas;
+    table[OP_XADD] = op_xadd;
+    table[OP_XCHG] = op_xchg;
+    table[OP_FENCE_ACQ] = op_fence_acq;
+    table[OP_FENCE_REL] = op_fence_rel;
+    table[OP_FUTEX_WAIT] = op_futex_wait;
+    table[OP_FUTEX_WAKE] = op_futex_wake;
+    table[OP_ALLOC] = op_alloc;
+    table[OP_FREE] = op_free;
+    table[OP_REALLOC] = op_realloc;
+    table[OP_ARENA_RESET] = op_arena_reset;
+    table[OP_HEAP_STATS] = op_heap_stats;
+    table[OP_MAP_NEW] = op_map_new;
+    table[OP_MAP_PUT] = op_map_put;
+    table[OP_MAP_GET] = op_map_get;
+    table[OP_MAP_DEL] = op_map_del;
+    table[OP_MAP_ITER] = op_map_iter;
+    table[OP_MAP_SNEW] = op_map_snew;
+    table[OP_MAP_SPUT] = op_map_sput;
+    table[OP_MAP_SGET] = op_map_sget;
+    table[OP_MAP_SDEL] = op_map_sdel;
+    table[OP_MAP_FREE] = op_map_free;
+    table[OP_SLEEP_US] = op_sleep_us;
+    table[OP_CLOCK_NS] = op_clock_ns;
+    table[OP_EVENT_WAIT] = op_event_wait;
+    table[OP_CHAN_OPEN] = op_chan_open;
+    table[OP_CHAN_SEND] = op_chan_send;
+    table[OP_CHAN_RECV] = op_chan_recv;
+}
+
+// Исполнение до остановки. Таблица обработчиков читается из vm->dispatch
+// на каждой инструкции: THREAD_START заменяет её таблицей группы потоков.
+void vm_run(VM *vm) {
+    instruction_fn dispatch[256];
+    if (!vm->threads) {
+        init_dispatch_table(dispatch);
+        vm->dispatch = dispatch;
+    }
+    // Шаблон, продолжающий работу, меняет память: клоны получат новый снимок
+    vm_template_release(vm);
+    if (vm->metrics)
+        metrics_start(vm);
+    if (vm->debugger)
+        debugger_start(vm);
+    while (vm->running) {
+        if (vm->ip >= vm->program_size)
+            break;
+        uint8_t opcode = read_byte(vm);
+        instruction_fn fn = vm->dispatch[opcode];
+        if (fn) {
+            fn(vm);
+        } else if (opcode == 0xFF) {
+            // Если встречаем 0xFF, считаем, что достигнут конец кода.
+            vm->running = 0;
+        } else {
+            vm_errorf(vm, "Unknown opcode: 0x%02x at IP: %u", opcode, vm->ip - 1);
+        }
+        if (vm->debug)
+            vm_print_debug_state(vm);
+    }
+    if (vm->debugger)
+        debugger_finish(vm);
+    if (vm->metrics)
+        metrics_finish(vm);
+    if (vm->dispatch == dispatch)
+        vm->dispatch = NULL;
+    // Исходная VM дожидается всех запущенных потоков
+    thread_join_all(vm);
+}
+
+// Инициализация виртуальной машины
+void vm_init(VM *vm) {
+    // Резервируем адресное пространство под всю 32-битную память гостя
+    // (на системах с меньшим адресным пространством — сколько удастся)
+    size_t reserve = MEM_RESERVE_SIZE;
+    void *mem = MAP_FAILED;
+    while (reserve >= (size_t)INIT_MEM_SIZE * 2) {
+        mem = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem != MAP_FAILED)
+            break;
+        reserve /= 2;
+    }
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "Failed to allocate VM memory\n");
+        exit(1);
+    }
+    vm->memory = mem;
+    vm->memory_reserved = reserve;
+    if (commit_memory(vm, INIT_MEM_SIZE) != 0) {
+        fprintf(stderr, "Failed to allocate VM memory\n");
+        exit(1);
+    }
+    vm->memory_size = INIT_MEM_SIZE;
+    memset(vm->registers, 0, NUM_REGS * sizeof(uint32_t));
+    vm->stack = NULL;
+    vm->rstack = NULL;
+    vm->dirs = NULL;
+    vm->dir_capacity = 0;
+    if (vm_set_stack_size(vm, STACK_SIZE, CALL_STACK_SIZE) != 0) {
+        fprintf(stderr, "Failed to allocate VM stacks\n");
+        exit(1);
+    }
+    vm->ip = 0;
+    vm->flags = 0;
+    vm->running = 1;
+    vm->failed = 0;
+    vm->program_size = 0;
+    vm->image_size = 0;
+    vm->heap_pinned = 0;
+    vm->debug = 0;
+    vm->in = stdin;
+    vm->out = stdout;
+    vm->err = stderr;
+    vm->cwd_fd = AT_FDCWD;
+    vm->env = NULL;
+    // Инициализация стандартных потоков
+    if (file_table_init(&vm->files) != 0) {
+        fprintf(stderr, "Failed to allocate file table\n");
+        exit(1);
+    }
+    vm->replay = NULL;
+    vm->insn_map = NULL;
+    vm->insn_map_mapping = NULL;
+    vm->insn_map_mapping_size = 0;
+    vm->symbols = NULL;
+    vm->symbol_count = 0;
+    vm->lines = NULL;
+    vm->line_count = 0;
+    vm->input = NULL;
+    vm->natives = NULL;
+    vm->native_count = 0;
+    vm->threads = NULL;
+    vm->dispatch = NULL;
+    vm->debugger = NULL;
+    vm->metrics = NULL;
+    vm->stage = NULL;
+    vm->block_start = 0;
+    vm->insn_pending = 0;
+    vm->stop_at_checkpoint = 0;
+    vm->checkpoint_reg = -1;
+    vm->template_fd = -1;
+}
+
+// Задание глубины стека данных и стека возвратов. Вызывается до запуска
+// программы: содержимое стеков сбрасывается.
+int vm_set_stack_size(VM *vm, uint32_t data_size, uint32_t call_size) {
+    if (data_size == 0 || call_size == 0 || data_size > MAX_STACK_SIZE || call_size > MAX_STACK_SIZE) {
+        fprintf(stderr, "Error: Stack size must be between 1 and %u\n", MAX_STACK_SIZE);
+        return -1;
+    }
+    uint32_t *stack = calloc(data_size, sizeof(uint32_t));
+    uint32_t *rstack = calloc(call_size, sizeof(uint32_t));
+    if (!stack || !rstack) {
+        fprintf(stderr, "Error: Failed to allocate VM stacks\n");
+        free(stack);
+        free(rstack);
+        return -1;
+    }
+    free(vm->stack);
+    free(vm->rstack);
+    vm->stack = stack;
+    vm->stack_size = data_size;
+    vm->rstack = rstack;
+    vm->rstack_size = call_size;
+    vm->sp = 0;
+    vm->fp = 0;
+    vm->rsp = 0;
+    return 0;
+}
+
+// Стандартные потоки гостя: вывод PRINT/PRINTS/WRITEINTS, ошибки VM, ввод
+// INPUT/READINTS/READLINE и дескрипторы 0-2 таблицы файлов. Вызывается до
+// запуска программы; потоки остаются за вызывающим, vm_free их не закрывает.
+void vm_set_streams(VM *vm, FILE *in, FILE *out, FILE *err) {
+    vm->in = in;
+    vm->out = out;
+    vm->err = err;
+    file_set_std(&vm->files, in, out, err);
+}
+
+// Текущий каталог и окружение гостя: относительные пути FILE_OPEN,
+// DIR_OPEN, FS_LIST и снимков разрешаются от cwd_fd (AT_FDCWD — от каталога
+// процесса), ENV_LIST выводит env (NULL — окружение процесса). Как и
+// потоки, остаются за вызывающим.
+void vm_set_host_context(VM *vm, int cwd_fd, char **env) {
+    vm->cwd_fd = cwd_fd;
+    vm->env = env;
+}
+
+// Освобождение ресурсов виртуальной машины
+void vm_free(VM *vm) {
+    thread_group_free(vm);
+    debugger_free(vm);
+    metrics_free(vm);
+    vm_template_release(vm);
+    file_table_free(&vm->files);
+    for (uint32_t i = 0; i < vm->dir_capacity; i++) {
+        if (vm->dirs[i])
+            closedir(vm->dirs[i]);
+    }
+    free(vm->dirs);
+    vm->dirs = NULL;
+    vm->dir_capacity = 0;
+    free(vm->stack);
+    free(vm->rstack);
+    vm->stack = NULL;
+    vm->rstack = NULL;
+    if (vm->memory)
+        munmap(vm->memory, vm->memory_reserved);
+    vm->memory = NULL;
+    vm->memory_size = 0;
+    free(vm->symbols);
+    vm->symbols = NULL;
+    vm->symbol_count = 0;
+    free(vm->lines);
+    vm->lines = NULL;
+    vm->line_count = 0;
+    if (vm->insn_map_mapping)
+        munmap(vm->insn_map_mapping, vm->insn_map_mapping_size);
+    else
+        free((void *)vm->insn_map);
+    vm->insn_map = NULL;
+    vm->insn_map_mapping = NULL;
+    vm_free_natives(vm);
+    input_buffer_free(vm);
+}
@@ -0,0 +1,505 @@
+// airvm-aot: трансляция программы AirVM в C.
+//
+// Программа загружается и проверяется так же, как перед исполнением, затем
+// каждая достижимая инструкция превращается в фрагмент функции aot_run с
+// меткой L_<адрес>. Регистры гостя — локальные переменные r0..r31, флаги —
+// локальная flags. Арифметика, пересылки, LOAD/STORE, стек и переходы
+// транслируются напрямую; остальные инструкции (ввод-вывод, файлы, потоки,
+// куча, встроенные операции) вызывают обработчик интерпретатора из
+// libairvm.a с синхронизацией регистров. Косвенные переходы (RET, RESTORE,
+// SWITCH, JUMPR, CALLR) идут через switch по адресам возврата и элементам
+// таблиц SWITCH; неизвестный адрес дорабатывает интерпретатор, поэтому
+// поведение совпадает с AirVM.
+//
+// Получившийся файл собирается вместе с библиотекой ВМ:
+//   airvm-aot program.bin program.c
+//   gcc -O2 -IVM/include program.c VM/bin/libairvm.a -pthread -o program
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "loader.h"
+#include "decode.h"
+#include "airbin.h"
+
+static uint8_t *read_all(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("Error opening program file");
+        return NULL;
+    }
+    size_t cap = 1 << 16, len = 0;
+    uint8_t *data = malloc(cap);
+    while (data) {
+        if (len == cap) {
+            uint8_t *grown = realloc(data, cap * 2);
+            if (!grown) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            cap *= 2;
+        }
+        size_t n = fread(data + len, 1, cap - len, f);
+        if (n == 0)
+            break;
+        len += n;
+    }
+    if (!data)
+        fprintf(stderr, "Error: Failed to allocate program buffer\n");
+    fclose(f);
+    *size = len;
+    return data;
+}
+
+static uint32_t ld_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Выражение адресного операнда
+static void addr_expr(char *buf, size_t len, const Operand *op) {
+    if (!op->indirect)
+        snprintf(buf, len, "%uu", op->value);
+    else if (op->mode == ADDR_MODE_OFFSET)
+        snprintf(buf, len, "r%u + %uu", op->reg, op->value);
+    else if (op->mode == ADDR_MODE_INDEX)
+        snprintf(buf, len, "r%u + (r%u << %u)", op->reg, op->index, op->shift);
+    else
+        snprintf(buf, len, "r%u", op->reg);
+}
+
+static inline void map_set(uint8_t *map, uint32_t addr) {
+    map[addr >> 3] |= (uint8_t)(1u << (addr & 7));
+}
+
+// Переход к следующей инструкции, если она не идёт сразу за текущей.
+// Цели goto отмечаются в labels: метки ставятся только на них и на адреса
+// switch диспетчеризации, иначе сгенерированный код не чист под -Wextra.
+static void emit_next(FILE *out, const VM *vm, uint8_t *labels, uint32_t next, uint32_t following) {
+    if (next >= vm->program_size) {
+        fprintf(out, "    ip = %uu; goto done;\n", next);
+    } else if (next != following) {
+        fprintf(out, "    goto L_%u;\n", next);
+        map_set(labels, next);
+    }
+}
+
+// Ошибка с тем же сообщением, что у обработчика интерпретатора
+static void emit_error(FILE *out, uint32_t next, const char *message) {
+    fprintf(out, "        vm->ip = %uu; vm_error(vm, \"%s\"); goto stop;\n", next, message);
+}
+
+// Регистры, с которыми работает обработчик: операнды-регистры (и следующий
+// за каждым — для пар), регистры косвенных адресов. NCALL, PUSHM/POPM,
+// снимки и CHECKPOINT (состояние клонов) обращаются ко всем регистрам.
+static uint32_t fallback_regs(const Insn *insn) {
+    switch (insn->opcode) {
+    case OP_NCALL:
+    case OP_PUSHM:
+    case OP_POPM:
+    case OP_SNAPSHOT:
+    case OP_RESTORE:
+    case OP_CHECKPOINT:
+        return UINT32_MAX;
+    }
+    uint32_t mask = 0;
+    for (int i = 0; i < insn->count; i++) {
+        const Operand *op = &insn->ops[i];
+        if (op->kind == OPND_REG)
+            mask |= 3u << op->reg;
+        else if (op->kind == OPND_ADDR && op->indirect)
+            mask |= 1u << op->reg | (op->mode == ADDR_MODE_INDEX ? 1u << op->index : 0);
+    }
+    return mask;
+}
+
+static void emit_sync(FILE *out, uint32_t mask, int in) {
+    if (mask == UINT32_MAX) {
+        fprintf(out, in ? " SYNC_IN();" : " SYNC_OUT();");
+        return;
+    }
+    for (int r = 0; r < NUM_REGS; r++) {
+        if (mask & (1u << r))
+            fprintf(out, in ? " r%d = vm->registers[%d];" : " vm->registers[%d] = r%d;", r, r);
+    }
+    fprintf(out, in ? " flags = vm->flags;" : " vm->flags = flags;");
+}
+
+static void emit_fallback(FILE *out, const Insn *insn, uint32_t next) {
+    uint32_t mask = fallback_regs(insn);
+    fprintf(out, "   ");
+    emit_sync(out, mask, 0);
+    fprintf(out, "\n    vm->ip = %uu; vm->dispatch[0x%02x](vm);\n   ", insn->addr + 1, insn->opcode);
+    emit_sync(out, mask, 1);
+    fprintf(out, "\n    if (!vm->running) goto out;\n");
+    fprintf(out, "    if (vm->ip != %uu) { ip = vm->ip; goto dispatch; }\n", next);
+}
+
+// Ошибку косвенного перехода сообщает обработчик интерпретатора: он
+// повторяет проверки с тем же состоянием и тем же текстом ошибки
+static void emit_indirect_error(FILE *out, const Insn *insn) {
+    fprintf(out, " SYNC_OUT(); vm->ip = %uu; vm->dispatch[0x%02x](vm); goto out; }\n",
+            insn->addr + 1, insn->opcode);
+}
+
+// Переход по вычисленному адресу: цель — начало проверенной инструкции
+// (один бит карты), дальше — через switch диспетчеризации
+static void emit_indirect(FILE *out, const Insn *insn, const char *target) {
+    char reg[8];
+    if (!target) {
+        snprintf(reg, sizeof(reg), "r%u", insn->ops[0].reg);
+        target = reg;
+    }
+    fprintf(out, "    if (%s >= vm->program_size || !insn_map_test(vm->insn_map, %s)) {", target, target);
+    if (insn->opcode == OP_CALLR)
+        fprintf(out, " vm->rsp--;");
+    emit_indirect_error(out, insn);
+    fprintf(out, "    ip = %s; goto dispatch;%s\n", target, insn->opcode == OP_SWITCH ? " }" : "");
+}
+
+static void emit_insn(FILE *out, const VM *vm, uint8_t *labels, const Insn *insn, uint32_t following) {
+    const Operand *o = insn->ops;
+    uint32_t next = insn->addr + insn->length;
+    char a[32];
+    if (insn_map_test(labels, insn->addr))
+        fprintf(out, "L_%u:\n", insn->addr);
+    switch (insn->opcode) {
+    case OP_NOP:
+        break;
+    case OP_HALT:
+        fprintf(out, "    vm->running = 0; vm->ip = %uu; goto stop;\n", next);
+        return;
+    case 0xFF:
+        fprintf(out, "    vm->running = 0; vm->ip = %uu; goto stop;\n", insn->addr + 1);
+        return;
+    case OP_JUMP:
+        fprintf(out, "    goto L_%u;\n", o[0].value);
+        map_set(labels, o[0].value);
+        return;
+    case OP_CALL:
+        fprintf(out, "    if (vm->rsp >= vm->rstack_size) {\n");
+        emit_error(out, next, "Call stack overflow in CALL");
+        fprintf(out, "    }\n    vm->rstack[vm->rsp++] = %uu;\n    goto L_%u;\n", next, o[0].value);
+        map_set(labels, o[0].value);
+        return;
+    case OP_RET:
+        fprintf(out, "    if (vm->rsp == 0) {\n");
+        emit_error(out, next, "Call stack underflow in RET");
+        fprintf(out, "    }\n    ip = vm->rstack[--vm->rsp];\n    goto dispatch;\n");
+        return;
+    case OP_IF:
+        fprintf(out, "    if (flags & 0x%02x) goto L_%u;\n", o[0].value, o[1].value);
+        map_set(labels, o[1].value);
+        break;
+    case OP_SWITCH:
+        fprintf(out, "    { uint32_t t = %uu;\n", o[3].value);
+        // Пустая таблица: всегда ветка default
+        if (o[2].value) {
+            fprintf(out, "      if (r%u < %uu) {\n", o[0].reg, o[2].value);
+            fprintf(out, "        uint64_t a = %uu + (uint64_t)r%u * 4;\n", o[1].value, o[0].reg);
+            fprintf(out, "        if (a + 4 > vm->memory_size) {");
+            emit_indirect_error(out, insn);
+            fprintf(out, "        t = ld32(mem + a);\n      }\n");
+        }
+        emit_indirect(out, insn, "t");
+        return;
+    case OP_JUMPR:
+        emit_indirect(out, insn, NULL);
+        return;
+    case OP_CALLR:
+        fprintf(out, "    if (vm->rsp >= vm->rstack_size) {");
+        emit_indirect_error(out, insn);
+        fprintf(out, "    vm->rstack[vm->rsp++] = %uu;\n", next);
+        emit_indirect(out, insn, NULL);
+        return;
+    case OP_LOAD:
+        addr_expr(a, sizeof(a), &o[1]);
+        fprintf(out, "    { uint32_t a = %s;\n", a);
+        fprintf(out, "      if ((uint64_t)a + 4 <= vm->memory_size) r%u = ld32(mem + a);\n", o[0].reg);
+        fprintf(out, "      else { r%u = read_uint32_at(vm, a); if (!vm->running) { vm->ip = %uu; goto stop; } } }\n",
+                o[0].reg, next);
+        break;
+    case OP_STORE:
+        addr_expr(a, sizeof(a), &o[1]);
+        fprintf(out, "    { uint32_t a = %s;\n", a);
+        fprintf(out, "      if ((uint64_t)a + 4 <= vm->memory_size) st32(mem + a, r%u);\n", o[0].reg);
+        fprintf(out, "      else { write_uint32(vm, a, r%u); if (!vm->running) { vm->ip = %uu; goto stop; } } }\n",
+                o[0].reg, next);
+        break;
+    case OP_MOVE:
+        fprintf(out, "    r%u = r%u;\n", o[0].reg, o[1].reg);
+        break;
+    case OP_PUSH:
+        fprintf(out, "    if (vm->sp >= vm->stack_size) {\n");
+        emit_error(out, next, "Stack overflow in PUSH");
+        fprintf(out, "    }\n    vm->stack[vm->sp++] = r%u;\n", o[0].reg);
+        break;
+    case OP_POP:
+        fprintf(out, "    if (vm->sp == 0) {\n");
+        emit_error(out, next, "Stack underflow in POP");
+        fprintf(out, "    }\n    r%u = vm->stack[--vm->sp];\n", o[0].reg);
+        break;
+    case OP_LOADI:
+        fprintf(out, "    r%u = %uu;\n", o[0].reg, o[1].value);
+        break;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_AND: case OP_OR: case OP_XOR: {
+        static const char ops[] = {
+            [OP_ADD - OP_ADD] = '+', [OP_SUB - OP_ADD] = '-', [OP_MUL - OP_ADD] = '*',
+            [OP_AND - OP_ADD] = '&', [OP_OR - OP_ADD] = '|', [OP_XOR - OP_ADD] = '^'
+        };
+        fprintf(out, "    r%u = r%u %c r%u;\n", o[0].reg, o[1].reg, ops[insn->opcode - OP_ADD], o[2].reg);
+        break;
+    }
+    case OP_DIV:
+        fprintf(out, "    if (r%u == 0) {\n", o[2].reg);
+        emit_error(out, next, "Division by zero");
+        fprintf(out, "    }\n    r%u = r%u / r%u;\n", o[0].reg, o[1].reg, o[2].reg);
+        break;
+    case OP_NOT:
+        fprintf(out, "    r%u = ~r%u;\n", o[0].reg, o[1].reg);
+        break;
+    case OP_CMP:
+        // С нулём беззнаковое «меньше» всегда ложно
+        if (o[1].value == 0)
+            fprintf(out, "    flags = r%u == 0u ? 0x01 : 0x0A;\n", o[0].reg);
+        else
+            fprintf(out, "    flags = r%u == %uu ? 0x01 : r%u < %uu ? 0x06 : 0x0A;\n",
+                    o[0].reg, o[1].value, o[0].reg, o[1].value);
+        break;
+    case OP_SHL:
+    case OP_SHR:
+        // Сдвиг на 32 и больше в C не определён: его выполняет обработчик
+        if (o[2].value < 32) {
+            fprintf(out, "    r%u = r%u %s %u;\n", o[0].reg, o[1].reg,
+                    insn->opcode == OP_SHL ? "<<" : ">>", o[2].value);
+        } else {
+            emit_fallback(out, insn, next);
+        }
+        break;
+    case OP_POPCNT:
+        fprintf(out, "    r%u = (uint32_t)__builtin_popcount(r%u);\n", o[0].reg, o[1].reg);
+        break;
+    case OP_CLZ:
+    case OP_CTZ:
+        fprintf(out, "    r%u = r%u ? (uint32_t)__builtin_%s(r%u) : 32u;\n", o[0].reg, o[1].reg,
+                insn->opcode == OP_CLZ ? "clz" : "ctz", o[1].reg);
+        break;
+    case OP_BSWAP:
+        fprintf(out, "    r%u = __builtin_bswap32(r%u);\n", o[0].reg, o[1].reg);
+        break;
+    case OP_ROL:
+    case OP_ROR: {
+        const char *a = insn->opcode == OP_ROL ? "<<" : ">>", *b = insn->opcode == OP_ROL ? ">>" : "<<";
+        fprintf(out, "    { uint32_t n = r%u & 31u; r%u = (r%u %s n) | (r%u %s ((32u - n) & 31u)); }\n",
+                o[2].reg, o[0].reg, o[1].reg, a, o[1].reg, b);
+        break;
+    }
+    case OP_SAR:
+        fprintf(out, "    r%u = (uint32_t)((int32_t)r%u >> %u);\n", o[0].reg, o[1].reg,
+                o[2].value < 32 ? o[2].value : 31);
+        break;
+    case OP_SHLV:
+    case OP_SHRV:
+        fprintf(out, "    r%u = r%u < 32u ? r%u %s r%u : 0u;\n", o[0].reg, o[2].reg, o[1].reg,
+                insn->opcode == OP_SHLV ? "<<" : ">>", o[2].reg);
+        break;
+    case OP_SARV:
+        fprintf(out, "    r%u = (uint32_t)((int32_t)r%u >> (r%u < 32u ? r%u : 31u));\n",
+                o[0].reg, o[1].reg, o[2].reg, o[2].reg);
+        break;
+    case OP_MULW:
+        // Ошибку про пару регистров выдаёт обработчик
+        if (o[0].reg + 1 < NUM_REGS) {
+            fprintf(out, "    { uint64_t p = (uint64_t)r%u * r%u; r%u = (uint32_t)p; r%u = (uint32_t)(p >> 32); }\n",
+                    o[1].reg, o[2].reg, o[0].reg, o[0].reg + 1);
+        } else {
+            emit_fallback(out, insn, next);
+        }
+        break;
+    default:
+        emit_fallback(out, insn, next);
+        break;
+    }
+    emit_next(out, vm, labels, next, following);
+}
+
+// Адрес для switch диспетчеризации: только начала инструкций
+static void mark_case(const VM *vm, uint8_t *cased, uint32_t addr) {
+    if (addr < vm->program_size && insn_map_test(vm->insn_map, addr))
+        map_set(cased, addr);
+}
+
+// Элементы таблиц переходов из секции SECT_JUMPTABLE (цели JUMPR и CALLR);
+// загрузчик уже проверил, что таблицы лежат в образе
+static void mark_jump_table_cases(const VM *vm, uint8_t *cased,
+                                  const uint8_t *image, size_t image_size) {
+    AirbHeader h;
+    if (image_size < sizeof(h) || memcmp(image, AIRB_MAGIC, 4) != 0)
+        return;
+    memcpy(&h, image, sizeof(h));
+    for (uint16_t i = 0; i < h.section_count; i++) {
+        AirbSection s;
+        memcpy(&s, image + sizeof(h) + (size_t)i * sizeof(s), sizeof(s));
+        if (s.type != SECT_JUMPTABLE)
+            continue;
+        for (uint32_t pos = 0; pos + 8 <= s.size; pos += 8) {
+            uint32_t table = ld_le32(image + s.offset + pos);
+            uint32_t count = ld_le32(image + s.offset + pos + 4);
+            for (uint32_t k = 0; k < count; k++)
+                mark_case(vm, cased, ld_le32(vm->memory + table + (size_t)k * 4));
+        }
+    }
+}
+
+static int translate(VM *vm, const uint8_t *image, size_t image_size, FILE *out) {
+    uint32_t size = vm->program_size;
+    uint32_t count = 0;
+    for (uint32_t addr = 0; addr < size; addr++)
+        count += insn_map_test(vm->insn_map, addr);
+    Insn *insns = malloc((count ? count : 1) * sizeof(Insn));
+    if (!insns) {
+        fprintf(stderr, "Error: Failed to allocate instruction list\n");
+        return -1;
+    }
+    uint32_t n = 0;
+    for (uint32_t addr = 0; addr < size; addr++) {
+        if (!insn_map_test(vm->insn_map, addr))
+            continue;
+        if (decode_insn(vm->memory, size, addr, &insns[n]) != DECODE_OK) {
+            fprintf(stderr, "Error: Failed to decode instruction at %u\n", addr);
+            free(insns);
+            return -1;
+        }
+        n++;
+    }
+
+    fprintf(out, "// Сгенерировано airvm-aot. Собирается с libairvm.a.\n");
+    fprintf(out, "#include <stdint.h>\n\n#include \"vm.h\"\n#include \"decode.h\"\n#include \"cli.h\"\n#include \"threads.h\"\n\n");
+    fprintf(out, "static const uint8_t program_image[%zu] = {", image_size ? image_size : 1);
+    for (size_t i = 0; i < image_size; i++)
+        fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n    ", image[i]);
+    fprintf(out, "\n};\n\n");
+    fprintf(out,
+            "static inline uint32_t ld32(const uint8_t *p) {\n"
+            "    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);\n"
+            "}\n\n"
+            "static inline void st32(uint8_t *p, uint32_t v) {\n"
+            "    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);\n"
+            "}\n\n");
+    fprintf(out, "#define SYNC_OUT() do {");
+    for (int i = 0; i < NUM_REGS; i++)
+        fprintf(out, "%s vm->registers[%d] = r%d;", i % 8 ? "" : " \\\n   ", i, i);
+    fprintf(out, " \\\n    vm->flags = flags; } while (0)\n");
+    fprintf(out, "#define SYNC_IN() do {");
+    for (int i = 0; i < NUM_REGS; i++)
+        fprintf(out, "%s r%d = vm->registers[%d];", i % 8 ? "" : " \\\n   ", i, i);
+    fprintf(out, " \\\n    flags = vm->flags; } while (0)\n\n");
+
+    fprintf(out, "static void aot_run(VM *vm) {\n");
+    fprintf(out, "    instruction_fn table[256];\n");
+    fprintf(out, "    if (!vm->threads) {\n        init_dispatch_table(table);\n        vm->dispatch = table;\n    }\n");
+    fprintf(out, "    uint8_t *mem = vm->memory;\n");
+    for (int i = 0; i < NUM_REGS; i++)
+        fprintf(out, "%sr%d%s", i % 8 ? ", " : "    uint32_t ", i, i % 8 == 7 ? ";\n" : "");
+    fprintf(out, "    uint8_t flags;\n    uint32_t ip = vm->ip;\n    SYNC_IN();\n    (void)mem;\n");
+    fprintf(out, "    goto dispatch;\n\n");
+
+    // Адреса, на которые возможен косвенный переход: вход, адреса возврата,
+    // продолжение после CHECKPOINT (с него стартуют клоны), ветка default и
+    // элементы таблиц SWITCH и .JUMPTABLE (по содержимому образа)
+    size_t map_bytes = insn_map_bytes(size) ? insn_map_bytes(size) : 1;
+    uint8_t *cased = calloc(map_bytes, 1);
+    uint8_t *labels = calloc(map_bytes, 1);
+    FILE *scratch = fopen("/dev/null", "w");
+    if (!cased || !labels || !scratch) {
+        fprintf(stderr, "Error: Failed to allocate dispatch map\n");
+        free(cased);
+        free(labels);
+        if (scratch)
+            fclose(scratch);
+        free(insns);
+        return -1;
+    }
+    mark_case(vm, cased, vm->ip);
+    for (uint32_t i = 0; i < n; i++) {
+        const Insn *insn = &insns[i];
+        uint32_t next = insn->addr + insn->length;
+        if (insn->opcode == OP_CALL || insn->opcode == OP_CALLR || insn->opcode == OP_CHECKPOINT)
+            mark_case(vm, cased, next);
+        if (insn->opcode == OP_SWITCH) {
+            uint32_t table = insn->ops[1].value;
+            for (uint32_t k = 0; k < insn->ops[2].value &&
+                 (uint64_t)table + (uint64_t)k * 4 + 4 <= vm->image_size; k++)
+                mark_case(vm, cased, ld_le32(vm->memory + table + (size_t)k * 4));
+            mark_case(vm, cased, insn->ops[3].value);
+        }
+    }
+    mark_jump_table_cases(vm, cased, image, image_size);
+
+    // Первый проход только собирает цели goto; метки — они и адреса switch
+    memcpy(labels, cased, map_bytes);
+    for (uint32_t i = 0; i < n; i++)
+        emit_insn(scratch, vm, labels, &insns[i], i + 1 < n ? insns[i + 1].addr : size);
+    fclose(scratch);
+    for (uint32_t i = 0; i < n; i++)
+        emit_insn(out, vm, labels, &insns[i], i + 1 < n ? insns[i + 1].addr : size);
+
+    fprintf(out, "\ndispatch:\n    switch (ip) {\n");
+    for (uint32_t i = 0; i < n; i++) {
+        if (insn_map_test(cased, insns[i].addr))
+            fprintf(out, "    case %uu: goto L_%u;\n", insns[i].addr, insns[i].addr);
+    }
+    free(cased);
+    free(labels);
+    fprintf(out, "    default:\n");
+    fprintf(out, "        if (ip >= vm->program_size) goto done;\n");
+    fprintf(out, "        // Прочие адреса дорабатывает интерпретатор\n");
+    fprintf(out, "        SYNC_OUT();\n        vm->ip = ip;\n");
+    fprintf(out, "        if (vm->dispatch == table)\n            vm->dispatch = NULL;\n");
+    fprintf(out, "        vm_run(vm);\n        return;\n    }\n\n");
+    fprintf(out, "done:\n    vm->ip = ip;\n");
+    fprintf(out, "stop:\n    SYNC_OUT();\n");
+    fprintf(out, "out:\n    if (vm->dispatch == table)\n        vm->dispatch = NULL;\n");
+    fprintf(out, "    thread_join_all(vm);\n}\n\n");
+
+    fprintf(out, "int main(int argc, char *argv[]) {\n");
+    fprintf(out, "    CliProgram program = { program_image, sizeof(program_image), aot_run };\n");
+    fprintf(out, "    return vm_cli_main(argc, argv, &program);\n}\n");
+    free(insns);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("Usage: %s <program.bin> <output.c>\n", argv[0]);
+        return 1;
+    }
+    size_t image_size;
+    uint8_t *image = read_all(argv[1], &image_size);
+    if (!image)
+        return 1;
+    VM vm;
+    vm_init(&vm);
+    if (vm_load_image(&vm, image, image_size, NULL) != 0) {
+        free(image);
+        vm_free(&vm);
+        return 1;
+    }
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        perror("Error creating output file");
+        free(image);
+        vm_free(&vm);
+        return 1;
+    }
+    int rc = translate(&vm, image, image_size, out);
+    if (fclose(out) != 0)
+        rc = -1;
+    free(image);
+    vm_free(&vm);
+    return rc == 0 ? 0 : 1;
+}
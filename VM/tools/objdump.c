@@ -0,0 +1,774 @@
+// airvm-objdump: статический разбор программы AirVM.
+//
+// Программа загружается и проверяется так же, как перед исполнением, после
+// чего каждая достижимая инструкция декодируется по общей таблице op_info
+// (src/decode.c). Инструмент печатает дизассемблированный код с метками и
+// строками исходника, делит его на базовые блоки (границы — те же, что у
+// счётчика инструкций --metrics) и строит граф переходов. По графу считаются
+// статический состав инструкций, число загрузок констант во временные
+// регистры R30/R31, которые ассемблер вставляет перед арифметикой с
+// непосредственным операндом, и циклы: длина тела и оценка числа
+// диспетчеризаций за итерацию (самый короткий путь от заголовка обратно к
+// нему). Граф выводится и в формате Graphviz.
+//
+//   airvm-objdump [-d] [-s] [--dot] [--loops <n>] <program.bin>
+//   airvm-objdump --dot program.bin | dot -Tsvg > program.svg
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vm.h"
+#include "loader.h"
+#include "decode.h"
+#include "airbin.h"
+
+#define DEFAULT_LOOPS 10
+
+// Вид дуги графа переходов
+typedef enum {
+    EDGE_FALL,       // Следующая инструкция
+    EDGE_JUMP,       // JUMP или ветка default у SWITCH
+    EDGE_BRANCH,     // Переход IF
+    EDGE_TABLE,      // Элемент таблицы SWITCH
+    EDGE_INDIRECT,   // JUMPR: возможная цель из таблиц переходов
+    EDGE_CALL        // Вызов: в циклах не учитывается
+} EdgeKind;
+
+typedef struct {
+    uint32_t from, to;   // Номера блоков
+    uint8_t kind;        // EdgeKind
+} Edge;
+
+typedef struct {
+    uint32_t first;      // Номер первой инструкции блока
+    uint32_t count;      // Число инструкций
+    uint32_t out, out_count;   // Исходящие дуги (отрезок массива edges)
+} Block;
+
+typedef struct {
+    uint32_t header;     // Блок-заголовок
+    uint32_t blocks;     // Блоков в теле
+    uint32_t insns;      // Инструкций в теле
+    uint32_t iteration;  // Инструкций на кратчайшем пути одной итерации
+    uint32_t expansions; // Из них LOADI R30/R31 во всём теле
+    uint32_t calls;      // Вызовов в теле
+} Loop;
+
+typedef struct {
+    VM *vm;
+    Insn *insns;
+    uint32_t insn_count;
+    Block *blocks;
+    uint32_t block_count;
+    Edge *edges;
+    uint32_t edge_count, edge_cap;
+    uint32_t *targets;   // Элементы таблиц переходов
+    uint32_t target_count;
+    const Symbol **symbols;   // Символы, упорядоченные по адресу
+    uint32_t symbol_count;
+} Program;
+
+static uint8_t *read_all(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror("Error opening program file");
+        return NULL;
+    }
+    size_t cap = 1 << 16, len = 0;
+    uint8_t *data = malloc(cap);
+    while (data) {
+        if (len == cap) {
+            uint8_t *grown = realloc(data, cap * 2);
+            if (!grown) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            cap *= 2;
+        }
+        size_t n = fread(data + len, 1, cap - len, f);
+        if (n == 0)
+            break;
+        len += n;
+    }
+    if (!data)
+        fprintf(stderr, "Error: Failed to allocate program buffer\n");
+    fclose(f);
+    *size = len;
+    return data;
+}
+
+static void *xcalloc(size_t count, size_t size) {
+    void *p = calloc(count ? count : 1, size);
+    if (!p) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint32_t ld_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int is_code(const Program *p, uint32_t addr) {
+    return addr < p->vm->program_size && insn_map_test(p->vm->insn_map, addr);
+}
+
+// Инструкции, которыми заканчивается блок: те же, что обёртывает metrics.c,
+// и маркер конца кода
+static int ends_block(uint8_t opcode) {
+    switch (opcode) {
+    case OP_HALT: case OP_JUMP: case OP_CALL: case OP_RET: case OP_IF:
+    case OP_SWITCH: case OP_JUMPR: case OP_CALLR: case OP_RESTORE: case 0xFF:
+        return 1;
+    }
+    return 0;
+}
+
+// Загрузка константы во временный регистр ассемблера
+static int is_expansion(const Insn *insn) {
+    return insn->opcode == OP_LOADI && insn->ops[0].reg >= NUM_REGS - 2;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    const Symbol *x = *(const Symbol *const *)a, *y = *(const Symbol *const *)b;
+    if (x->addr != y->addr)
+        return x->addr < y->addr ? -1 : 1;
+    return (int)x->kind - (int)y->kind;   // метка кода раньше метки данных
+}
+
+// Первый символ с адресом не меньше addr
+static uint32_t symbol_lower_bound(const Program *p, uint32_t addr) {
+    uint32_t lo = 0, hi = p->symbol_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (p->symbols[mid]->addr < addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static const char *symbol_at(const Program *p, uint32_t addr) {
+    uint32_t i = symbol_lower_bound(p, addr);
+    return i < p->symbol_count && p->symbols[i]->addr == addr ? p->symbols[i]->name : NULL;
+}
+
+static uint32_t source_line(const VM *vm, uint32_t addr) {
+    uint32_t lo = 0, hi = vm->line_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (vm->lines[mid].addr < addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < vm->line_count && vm->lines[lo].addr == addr ? vm->lines[lo].line : 0;
+}
+
+static uint32_t block_of(const Program *p, uint32_t addr) {
+    uint32_t lo = 0, hi = p->block_count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (p->insns[p->blocks[mid].first].addr <= addr)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void add_edge(Program *p, uint32_t from, uint32_t to_addr, EdgeKind kind) {
+    if (!is_code(p, to_addr))
+        return;
+    uint32_t to = block_of(p, to_addr);
+    for (uint32_t i = p->blocks[from].out; i < p->edge_count; i++) {
+        if (p->edges[i].to == to && p->edges[i].kind == kind)
+            return;
+    }
+    if (p->edge_count == p->edge_cap) {
+        p->edge_cap = p->edge_cap ? p->edge_cap * 2 : 256;
+        p->edges = realloc(p->edges, p->edge_cap * sizeof(Edge));
+        if (!p->edges) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    p->edges[p->edge_count++] = (Edge){from, to, (uint8_t)kind};
+}
+
+static void add_target(Program *p, uint32_t *cap, uint32_t addr) {
+    if (!is_code(p, addr))
+        return;
+    if (p->target_count == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        p->targets = realloc(p->targets, *cap * sizeof(uint32_t));
+        if (!p->targets) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+    }
+    p->targets[p->target_count++] = addr;
+}
+
+// Элементы таблиц из секции SECT_JUMPTABLE; загрузчик уже проверил, что
+// таблицы лежат в образе
+static void collect_jump_tables(Program *p, const uint8_t *image, size_t image_size) {
+    uint32_t cap = 0;
+    AirbHeader h;
+    if (image_size < sizeof(h) || memcmp(image, AIRB_MAGIC, 4) != 0)
+        return;
+    memcpy(&h, image, sizeof(h));
+    for (uint16_t i = 0; i < h.section_count; i++) {
+        AirbSection s;
+        memcpy(&s, image + sizeof(h) + (size_t)i * sizeof(s), sizeof(s));
+        if (s.type != SECT_JUMPTABLE)
+            continue;
+        for (uint32_t pos = 0; pos + 8 <= s.size; pos += 8) {
+            uint32_t table = ld_le32(image + s.offset + pos);
+            uint32_t count = ld_le32(image + s.offset + pos + 4);
+            for (uint32_t k = 0; k < count; k++)
+                add_target(p, &cap, ld_le32(p->vm->memory + table + (size_t)k * 4));
+        }
+    }
+}
+
+// Декодирование, базовые блоки и дуги
+static int build(Program *p, const uint8_t *image, size_t image_size) {
+    VM *vm = p->vm;
+    uint32_t size = vm->program_size;
+    for (uint32_t addr = 0; addr < size; addr++)
+        p->insn_count += insn_map_test(vm->insn_map, addr);
+    p->insns = xcalloc(p->insn_count, sizeof(Insn));
+    uint32_t n = 0;
+    for (uint32_t addr = 0; addr < size; addr++) {
+        if (!insn_map_test(vm->insn_map, addr))
+            continue;
+        if (decode_insn(vm->memory, size, addr, &p->insns[n]) != DECODE_OK) {
+            fprintf(stderr, "Error: Failed to decode instruction at %u\n", addr);
+            return -1;
+        }
+        n++;
+    }
+    collect_jump_tables(p, image, image_size);
+
+    p->symbol_count = vm->symbol_count;
+    p->symbols = xcalloc(vm->symbol_count, sizeof(Symbol *));
+    for (uint32_t i = 0; i < vm->symbol_count; i++)
+        p->symbols[i] = &vm->symbols[i];
+    qsort(p->symbols, p->symbol_count, sizeof(Symbol *), compare_symbols);
+
+    // Начала блоков: точка входа, цели переходов и таблиц, инструкция после
+    // конца блока и после разрыва в коде
+    uint8_t *leader = xcalloc(insn_map_bytes(size), 1);
+#define MARK(a) do { if (is_code(p, (a))) leader[(a) >> 3] |= (uint8_t)(1u << ((a) & 7)); } while (0)
+    MARK(vm->ip);
+    for (uint32_t i = 0; i < p->target_count; i++)
+        MARK(p->targets[i]);
+    for (uint32_t i = 0; i < p->insn_count; i++) {
+        const Insn *insn = &p->insns[i];
+        uint32_t next = insn->addr + insn->length;
+        for (int k = 0; k < insn->count; k++) {
+            if (insn->ops[k].kind == OPND_TARGET)
+                MARK(insn->ops[k].value);
+        }
+        if (ends_block(insn->opcode) || i + 1 == p->insn_count || p->insns[i + 1].addr != next)
+            MARK(next);
+    }
+#undef MARK
+    p->blocks = xcalloc(p->insn_count, sizeof(Block));
+    for (uint32_t i = 0; i < p->insn_count; i++) {
+        if (i == 0 || insn_map_test(leader, p->insns[i].addr))
+            p->blocks[p->block_count++].first = i;
+        p->blocks[p->block_count - 1].count++;
+    }
+    free(leader);
+
+    for (uint32_t b = 0; b < p->block_count; b++) {
+        Block *blk = &p->blocks[b];
+        const Insn *last = &p->insns[blk->first + blk->count - 1];
+        const Operand *o = last->ops;
+        uint32_t next = last->addr + last->length;
+        blk->out = p->edge_count;
+        switch (last->opcode) {
+        case OP_HALT: case OP_RET: case OP_RESTORE: case 0xFF:
+            break;
+        case OP_JUMP:
+            add_edge(p, b, o[0].value, EDGE_JUMP);
+            break;
+        case OP_IF:
+            add_edge(p, b, o[1].value, EDGE_BRANCH);
+            add_edge(p, b, next, EDGE_FALL);
+            break;
+        case OP_CALL:
+            add_edge(p, b, o[0].value, EDGE_CALL);
+            add_edge(p, b, next, EDGE_FALL);
+            break;
+        case OP_SWITCH:
+            for (uint32_t k = 0; k < o[2].value &&
+                 (uint64_t)o[1].value + (uint64_t)k * 4 + 4 <= vm->image_size; k++)
+                add_edge(p, b, ld_le32(vm->memory + o[1].value + (size_t)k * 4), EDGE_TABLE);
+            add_edge(p, b, o[3].value, EDGE_JUMP);
+            break;
+        case OP_JUMPR:
+            for (uint32_t k = 0; k < p->target_count; k++)
+                add_edge(p, b, p->targets[k], EDGE_INDIRECT);
+            break;
+        default:
+            add_edge(p, b, next, EDGE_FALL);
+            break;
+        }
+        blk->out_count = p->edge_count - blk->out;
+    }
+    return 0;
+}
+
+// Текст инструкции: мнемоника и операнды
+static void format_insn(const Program *p, const Insn *insn, char *buf, size_t len) {
+    size_t pos = (size_t)snprintf(buf, len, "%s", op_info[insn->opcode].name);
+    for (int i = 0; i < insn->count && pos < len; i++) {
+        const Operand *op = &insn->ops[i];
+        char text[160];
+        const char *name;
+        switch (op->kind) {
+        case OPND_REG:
+            snprintf(text, sizeof(text), "R%u", op->reg);
+            break;
+        case OPND_FLAGS: {
+            static const char *const flag_names[] = {"EQ", "NE", "LT", "GT"};
+            size_t t = 0;
+            text[0] = '\0';
+            for (int f = 0; f < 4; f++) {
+                if (op->value & (1u << f))
+                    t += (size_t)snprintf(text + t, sizeof(text) - t, "%s%s", t ? "|" : "", flag_names[f]);
+            }
+            if (op->value & ~0x0Fu || t == 0)
+                snprintf(text + t, sizeof(text) - t, "%s0x%02x", t ? "|" : "", op->value & (t ? ~0x0Fu : 0xFFu));
+            break;
+        }
+        case OPND_ADDR:
+            if (op->indirect) {
+                if (op->mode == ADDR_MODE_OFFSET && (int32_t)op->value < 0)
+                    snprintf(text, sizeof(text), "[R%u - %u]", op->reg, 0u - op->value);
+                else if (op->mode == ADDR_MODE_OFFSET)
+                    snprintf(text, sizeof(text), "[R%u + %u]", op->reg, op->value);
+                else if (op->mode == ADDR_MODE_INDEX && op->shift)
+                    snprintf(text, sizeof(text), "[R%u + R%u*%u]", op->reg, op->index, 1u << op->shift);
+                else if (op->mode == ADDR_MODE_INDEX)
+                    snprintf(text, sizeof(text), "[R%u + R%u]", op->reg, op->index);
+                else
+                    snprintf(text, sizeof(text), "[R%u]", op->reg);
+                break;
+            }
+            // fall through
+        case OPND_TARGET:
+        case OPND_ADDR32:
+            name = symbol_at(p, op->value);
+            if (name)
+                snprintf(text, sizeof(text), "%.150s", name);
+            else
+                snprintf(text, sizeof(text), "0x%x", op->value);
+            break;
+        default:
+            snprintf(text, sizeof(text), "%d", (int32_t)op->value);
+            break;
+        }
+        pos += (size_t)snprintf(buf + pos, len - pos, "%s%s", i ? ", " : " ", text);
+    }
+}
+
+// Байты, не являющиеся проверенными инструкциями: данные внутри кода
+static void print_data(const Program *p, uint32_t start, uint32_t end) {
+    uint32_t s = symbol_lower_bound(p, start);
+    while (start < end) {
+        uint32_t stop = end;
+        while (s < p->symbol_count && p->symbols[s]->addr <= start) {
+            if (p->symbols[s]->addr == start)
+                printf("%s:\n", p->symbols[s]->name);
+            s++;
+        }
+        if (s < p->symbol_count && p->symbols[s]->addr < stop)
+            stop = p->symbols[s]->addr;
+        printf("  %08x  <%u byte%s of data>\n", start, stop - start, stop - start == 1 ? "" : "s");
+        start = stop;
+    }
+}
+
+static void disassemble(const Program *p) {
+    const VM *vm = p->vm;
+    uint32_t pos = 0;
+    char text[512];
+    printf("Entry point: 0x%x, code: %u bytes, %u instructions, %u blocks\n",
+           vm->ip, vm->program_size, p->insn_count, p->block_count);
+    for (uint32_t b = 0; b < p->block_count; b++) {
+        const Block *blk = &p->blocks[b];
+        for (uint32_t i = blk->first; i < blk->first + blk->count; i++) {
+            const Insn *insn = &p->insns[i];
+            if (insn->addr > pos)
+                print_data(p, pos, insn->addr);
+            if (i == blk->first)
+                printf("\n");
+            for (uint32_t s = symbol_lower_bound(p, insn->addr);
+                 s < p->symbol_count && p->symbols[s]->addr == insn->addr; s++)
+                printf("%s:\n", p->symbols[s]->name);
+            char bytes[3 * 8 + 1];
+            size_t n = 0;
+            for (uint32_t k = 0; k < insn->length && k < 8; k++)
+                n += (size_t)snprintf(bytes + n, sizeof(bytes) - n, "%02x ", vm->memory[insn->addr + k]);
+            format_insn(p, insn, text, sizeof(text));
+            uint32_t line = source_line(vm, insn->addr);
+            printf("  %08x  %-24s%s%s", insn->addr, bytes, insn->length > 8 ? "+ " : "  ", text);
+            if (line)
+                printf("%*s; line %u", (int)(text[0] && strlen(text) < 32 ? 32 - strlen(text) : 1), "", line);
+            printf("\n");
+            pos = insn->addr + insn->length;
+        }
+    }
+    if (pos < vm->program_size)
+        print_data(p, pos, vm->program_size);
+}
+
+// Циклы: обратные дуги обхода в глубину по графу без дуг вызова; тело —
+// блоки, из которых конец обратной дуги достижим, не проходя заголовок
+static uint32_t find_loops(const Program *p, Loop **out) {
+    uint32_t nb = p->block_count;
+    uint8_t *state = xcalloc(nb, 1);          // 0 — не посещён, 1 — в стеке, 2 — обработан
+    uint32_t *stack = xcalloc(nb, sizeof(uint32_t));
+    uint32_t *edge_pos = xcalloc(nb, sizeof(uint32_t));
+    uint8_t *is_header = xcalloc(nb, 1);
+    uint8_t *back = xcalloc(p->edge_count, 1);
+
+    for (uint32_t root = 0; root < nb; root++) {
+        if (state[root])
+            continue;
+        uint32_t top = 0;
+        stack[top++] = root;
+        state[root] = 1;
+        edge_pos[root] = 0;
+        while (top > 0) {
+            uint32_t b = stack[top - 1];
+            const Block *blk = &p->blocks[b];
+            if (edge_pos[b] == blk->out_count) {
+                state[b] = 2;
+                top--;
+                continue;
+            }
+            uint32_t e = blk->out + edge_pos[b]++;
+            const Edge *edge = &p->edges[e];
+            if (edge->kind == EDGE_CALL)
+                continue;
+            if (state[edge->to] == 1) {
+                back[e] = 1;
+                is_header[edge->to] = 1;
+            } else if (state[edge->to] == 0) {
+                state[edge->to] = 1;
+                edge_pos[edge->to] = 0;
+                stack[top++] = edge->to;
+            }
+        }
+    }
+
+    // Обратные дуги для поиска тела
+    uint32_t *pred_count = xcalloc(nb + 1, sizeof(uint32_t));
+    for (uint32_t e = 0; e < p->edge_count; e++) {
+        if (p->edges[e].kind != EDGE_CALL)
+            pred_count[p->edges[e].to + 1]++;
+    }
+    for (uint32_t b = 0; b < nb; b++)
+        pred_count[b + 1] += pred_count[b];
+    uint32_t *preds = xcalloc(pred_count[nb], sizeof(uint32_t));
+    uint32_t *fill = xcalloc(nb, sizeof(uint32_t));
+    for (uint32_t e = 0; e < p->edge_count; e++) {
+        const Edge *edge = &p->edges[e];
+        if (edge->kind != EDGE_CALL)
+            preds[pred_count[edge->to] + fill[edge->to]++] = edge->from;
+    }
+
+    uint32_t loop_count = 0;
+    for (uint32_t h = 0; h < nb; h++)
+        loop_count += is_header[h];
+    Loop *loops = xcalloc(loop_count, sizeof(Loop));
+    uint8_t *in_body = xcalloc(nb, 1);
+    uint32_t *dist = xcalloc(nb, sizeof(uint32_t));
+    uint8_t *done = xcalloc(nb, 1);
+    uint32_t li = 0;
+    for (uint32_t h = 0; h < nb; h++) {
+        if (!is_header[h])
+            continue;
+        Loop *loop = &loops[li++];
+        loop->header = h;
+        memset(in_body, 0, nb);
+        in_body[h] = 1;
+        uint32_t top = 0;
+        for (uint32_t e = 0; e < p->edge_count; e++) {
+            if (back[e] && p->edges[e].to == h && !in_body[p->edges[e].from]) {
+                in_body[p->edges[e].from] = 1;
+                stack[top++] = p->edges[e].from;
+            }
+        }
+        while (top > 0) {
+            uint32_t b = stack[--top];
+            for (uint32_t k = pred_count[b]; k < pred_count[b + 1]; k++) {
+                if (!in_body[preds[k]]) {
+                    in_body[preds[k]] = 1;
+                    stack[top++] = preds[k];
+                }
+            }
+        }
+        for (uint32_t b = 0; b < nb; b++) {
+            if (!in_body[b])
+                continue;
+            const Block *blk = &p->blocks[b];
+            loop->blocks++;
+            loop->insns += blk->count;
+            for (uint32_t i = blk->first; i < blk->first + blk->count; i++) {
+                loop->expansions += is_expansion(&p->insns[i]);
+                loop->calls += p->insns[i].opcode == OP_CALL || p->insns[i].opcode == OP_CALLR;
+            }
+        }
+        // Кратчайшая итерация: Дейкстра по телу, вес блока — число его
+        // инструкций (каждая — одна диспетчеризация)
+        for (uint32_t b = 0; b < nb; b++) {
+            dist[b] = UINT32_MAX;
+            done[b] = 0;
+        }
+        dist[h] = p->blocks[h].count;
+        uint32_t best = UINT32_MAX;
+        for (;;) {
+            uint32_t b = UINT32_MAX;
+            for (uint32_t k = 0; k < nb; k++) {
+                if (in_body[k] && !done[k] && dist[k] != UINT32_MAX && (b == UINT32_MAX || dist[k] < dist[b]))
+                    b = k;
+            }
+            if (b == UINT32_MAX || dist[b] >= best)
+                break;
+            done[b] = 1;
+            const Block *blk = &p->blocks[b];
+            for (uint32_t e = blk->out; e < blk->out + blk->out_count; e++) {
+                const Edge *edge = &p->edges[e];
+                if (edge->kind == EDGE_CALL || !in_body[edge->to])
+                    continue;
+                if (edge->to == h) {
+                    if (dist[b] < best)
+                        best = dist[b];
+                } else if (dist[b] + p->blocks[edge->to].count < dist[edge->to]) {
+                    dist[edge->to] = dist[b] + p->blocks[edge->to].count;
+                }
+            }
+        }
+        loop->iteration = best == UINT32_MAX ? 0 : best;
+    }
+
+    free(state);
+    free(stack);
+    free(edge_pos);
+    free(is_header);
+    free(back);
+    free(pred_count);
+    free(preds);
+    free(fill);
+    free(in_body);
+    free(dist);
+    free(done);
+    *out = loops;
+    return loop_count;
+}
+
+static int compare_loops(const void *a, const void *b) {
+    const Loop *x = a, *y = b;
+    if (x->insns != y->insns)
+        return x->insns > y->insns ? -1 : 1;
+    return x->header < y->header ? -1 : x->header > y->header;
+}
+
+static const uint32_t *mix_counts;
+
+static int compare_mix(const void *a, const void *b) {
+    uint8_t x = *(const uint8_t *)a, y = *(const uint8_t *)b;
+    if (mix_counts[x] != mix_counts[y])
+        return mix_counts[x] > mix_counts[y] ? -1 : 1;
+    return (int)x - (int)y;
+}
+
+static void block_name(const Program *p, uint32_t b, char *buf, size_t len) {
+    uint32_t addr = p->insns[p->blocks[b].first].addr;
+    const char *name = symbol_at(p, addr);
+    if (name)
+        snprintf(buf, len, "%s (0x%x)", name, addr);
+    else
+        snprintf(buf, len, "0x%x", addr);
+}
+
+static void print_stats(const Program *p, uint32_t max_loops) {
+    uint32_t counts[256] = {0};
+    uint32_t expansions = 0, code_bytes = 0;
+    for (uint32_t i = 0; i < p->insn_count; i++) {
+        counts[p->insns[i].opcode]++;
+        expansions += is_expansion(&p->insns[i]);
+        code_bytes += p->insns[i].length;
+    }
+    uint32_t total = p->insn_count ? p->insn_count : 1;
+    printf("\nSummary\n");
+    printf("  instructions:      %u (%u bytes; %u bytes of data in code)\n",
+           p->insn_count, code_bytes, p->vm->program_size - code_bytes);
+    printf("  basic blocks:      %u, average %.1f instructions\n",
+           p->block_count, p->block_count ? (double)p->insn_count / p->block_count : 0.0);
+    printf("  edges:             %u\n", p->edge_count);
+    printf("  LOADI R30/R31:     %u (%.1f%% of instructions)\n", expansions, 100.0 * expansions / total);
+
+    uint8_t order[256];
+    uint32_t used = 0;
+    for (int op = 0; op < 256; op++) {
+        if (counts[op])
+            order[used++] = (uint8_t)op;
+    }
+    mix_counts = counts;
+    qsort(order, used, 1, compare_mix);
+    printf("\nInstruction mix\n");
+    for (uint32_t i = 0; i < used; i++) {
+        uint8_t op = order[i];
+        printf("  %-14s %8u  %5.1f%%", op_info[op].name, counts[op], 100.0 * counts[op] / total);
+        if (op == OP_LOADI)
+            printf("  (%u into R30/R31)", expansions);
+        printf("\n");
+    }
+
+    Loop *loops;
+    uint32_t loop_count = find_loops(p, &loops);
+    qsort(loops, loop_count, sizeof(Loop), compare_loops);
+    printf("\nLoops: %u", loop_count);
+    if (loop_count > max_loops)
+        printf(" (largest %u shown)", max_loops);
+    printf("\n");
+    if (loop_count) {
+        printf("  %-32s %7s %7s %10s %12s %6s\n", "header", "blocks", "insns", "dispatches", "LOADI R30/31", "calls");
+    }
+    for (uint32_t i = 0; i < loop_count && i < max_loops; i++) {
+        const Loop *l = &loops[i];
+        char name[160];
+        block_name(p, l->header, name, sizeof(name));
+        printf("  %-32s %7u %7u %10u %12u %6u\n", name, l->blocks, l->insns, l->iteration, l->expansions, l->calls);
+    }
+    if (loop_count)
+        printf("  (dispatches: instructions on the shortest path through the header; calls not included)\n");
+    free(loops);
+}
+
+// Строка для метки Graphviz: кавычки и обратная косая черта экранируются
+static void dot_escape(const char *s) {
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        putchar(*s);
+    }
+}
+
+static void print_dot(const Program *p) {
+    static const char *const styles[] = {
+        [EDGE_FALL] = "",
+        [EDGE_JUMP] = "",
+        [EDGE_BRANCH] = " [color=darkgreen]",
+        [EDGE_TABLE] = " [color=blue]",
+        [EDGE_INDIRECT] = " [style=dotted]",
+        [EDGE_CALL] = " [style=dashed]"
+    };
+    char text[512];
+    printf("digraph airvm {\n");
+    printf("    node [shape=box fontname=\"monospace\" fontsize=10];\n");
+    for (uint32_t b = 0; b < p->block_count; b++) {
+        const Block *blk = &p->blocks[b];
+        printf("    b%u [label=\"", b);
+        const char *name = symbol_at(p, p->insns[blk->first].addr);
+        if (name) {
+            dot_escape(name);
+            printf(":\\l");
+        }
+        for (uint32_t i = blk->first; i < blk->first + blk->count; i++) {
+            format_insn(p, &p->insns[i], text, sizeof(text));
+            printf("%08x  ", p->insns[i].addr);
+            dot_escape(text);
+            printf("\\l");
+        }
+        printf("\"%s];\n", p->insns[blk->first].addr == p->vm->ip ? " penwidth=2" : "");
+    }
+    for (uint32_t e = 0; e < p->edge_count; e++)
+        printf("    b%u -> b%u%s;\n", p->edges[e].from, p->edges[e].to, styles[p->edges[e].kind]);
+    printf("}\n");
+}
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] <program.bin>\n", prog);
+    printf("Options:\n");
+    printf("  -d, --disassemble Print disassembly with labels and source lines\n");
+    printf("  -s, --stats       Print instruction mix, immediate expansions and loops\n");
+    printf("  --dot             Print the control-flow graph in Graphviz format\n");
+    printf("  --loops <n>       Number of loops to list (default: %u)\n", DEFAULT_LOOPS);
+    printf("Without -d, -s or --dot both disassembly and statistics are printed.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    int disasm = 0, stats = 0, dot = 0;
+    uint32_t max_loops = DEFAULT_LOOPS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--disassemble") == 0) {
+            disasm = 1;
+        } else if (strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "--dot") == 0) {
+            dot = 1;
+        } else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+            max_loops = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (argv[i][0] == '-' || path) {
+            print_usage(argv[0]);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!disasm && !stats && !dot)
+        disasm = stats = 1;
+
+    size_t image_size;
+    uint8_t *image = read_all(path, &image_size);
+    if (!image)
+        return 1;
+    VM vm;
+    vm_init(&vm);
+    if (vm_load_image(&vm, image, image_size, NULL) != 0) {
+        free(image);
+        vm_free(&vm);
+        return 1;
+    }
+    Program p;
+    memset(&p, 0, sizeof(p));
+    p.vm = &vm;
+    int rc = vm.program_size == 0 ? 0 : build(&p, image, image_size);
+    if (rc == 0 && vm.program_size) {
+        if (dot) {
+            print_dot(&p);
+        } else {
+            if (disasm)
+                disassemble(&p);
+            if (stats)
+                print_stats(&p, max_loops);
+        }
+    }
+    free(p.insns);
+    free(p.blocks);
+    free(p.edges);
+    free(p.targets);
+    free(p.symbols);
+    free(image);
+    vm_free(&vm);
+    return rc != 0;
+}
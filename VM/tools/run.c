@@ -0,0 +1,90 @@
+// airvm-run: исполнение программы резидентным AirVM (AirVM --serve).
+//
+// Принимает те же опции исполнения, что и AirVM, и отдаёт демону путь
+// программы вместе со своими stdin, stdout и stderr: вывод и код возврата
+// совпадают с AirVM <program.bin>, но программа не загружается и не
+// проверяется заново, если демон уже исполнял её.
+//
+//   airvm-run [--socket <path>] [--stack <n>] [--call-depth <n>] [--max-*] <program.bin>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "vm.h"
+#include "cli.h"
+#include "serve.h"
+
+static void print_usage(const char *prog) {
+    printf("Usage: %s [options] <program.bin>\n", prog);
+    printf("Options:\n");
+    printf("  --socket <path>   Daemon socket (default: $" SERVE_SOCKET_ENV " or /tmp/airvm-<uid>.sock)\n");
+    printf("  --stack <n>       Data stack depth in words (default: %u)\n", STACK_SIZE);
+    printf("  --call-depth <n>  Return stack depth (default: %u)\n", CALL_STACK_SIZE);
+    printf("  --max-memory <n>  Limit guest memory to <n> bytes (suffixes K, M, G)\n");
+    printf("  --max-files <n>   Limit open files, including stdin/stdout/stderr\n");
+    printf("  --max-instructions <n> Stop the program after <n> instructions\n");
+    printf("  --max-output <n>  Limit bytes written to stdout and files (suffixes K, M, G)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *program_path = NULL;
+    const char *socket_path = NULL;
+    ServeRequest req;
+    memset(&req, 0, sizeof(req));
+    int limit;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if ((strcmp(argv[i], "--stack") == 0 || strcmp(argv[i], "--call-depth") == 0) && i + 1 < argc) {
+            int stack = strcmp(argv[i], "--stack") == 0;
+            unsigned long n = strtoul(argv[i + 1], NULL, 0);
+            // 0 в запросе — глубина по умолчанию, поэтому ошибку ловим здесь
+            if (n == 0 || n > MAX_STACK_SIZE) {
+                fprintf(stderr, "Error: Stack size must be between 1 and %u\n", MAX_STACK_SIZE);
+                return 1;
+            }
+            if (stack)
+                req.stack_size = (uint32_t)n;
+            else
+                req.call_depth = (uint32_t)n;
+            i++;
+        } else if ((limit = cli_limit_option(argv[i], i + 1 < argc ? argv[i + 1] : NULL, req.limits)) != 0) {
+            if (limit < 0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            i++;
+        } else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            print_usage(argv[0]);
+            return 1;
+        } else if (!program_path) {
+            program_path = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!program_path) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Демон работает в своём каталоге: путь программы передаётся абсолютным
+    char program[PATH_MAX];
+    if (!realpath(program_path, program)) {
+        perror("Error opening program file");
+        return 1;
+    }
+    char default_socket[SERVE_MAX_PATH];
+    if (!socket_path) {
+        serve_default_socket(default_socket, sizeof(default_socket));
+        socket_path = default_socket;
+    }
+    fflush(stdout);
+    int status = serve_run(socket_path, &req, program);
+    return status < 0 ? 1 : status;
+}
@@ -0,0 +1,185 @@
+// airvm-top: просмотр метрик запущенных VM.
+//
+// Читает файлы METRICS_DIR/airvm-*, которые создают VM, запущенные с
+// --metrics, и печатает по строке на экземпляр. Файлы отображаются только
+// для чтения, работающая VM при этом ничего не ждёт. Скорость (IPS)
+// считается по разности двух последовательных опросов; при первом опросе —
+// в среднем с момента запуска.
+//
+//   airvm-top [-d <секунды>] [-n <число опросов>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "metrics.h"
+
+#define MAX_INSTANCES 256
+
+typedef struct {
+    char name[256];
+    uint64_t instructions;
+    uint64_t sampled_ns;
+} Previous;
+
+static Previous previous[MAX_INSTANCES];
+static size_t previous_count;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Отображение файла метрик; NULL, если файл не от AirVM или процесса уже нет
+static const MetricsPage *map_page(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == (off_t)sizeof(MetricsPage))
+        p = mmap(NULL, sizeof(MetricsPage), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return NULL;
+    const MetricsPage *page = p;
+    if (__atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC ||
+        page->version != METRICS_VERSION || kill((pid_t)page->pid, 0) != 0) {
+        munmap(p, sizeof(MetricsPage));
+        return NULL;
+    }
+    return page;
+}
+
+// Число с суффиксом K/M/G/T
+static void human(char *buf, size_t len, double v) {
+    static const char suffix[] = " KMGT";
+    int i = 0;
+    while (v >= 1000.0 && i < 4) {
+        v /= 1000.0;
+        i++;
+    }
+    if (i == 0)
+        snprintf(buf, len, "%.0f", v);
+    else
+        snprintf(buf, len, "%.1f%c", v, suffix[i]);
+}
+
+static double rate(const char *name, uint64_t instructions, uint64_t start_ns, uint64_t now,
+                   Previous *next, size_t *next_count) {
+    uint64_t base = 0, since = start_ns;
+    for (size_t i = 0; i < previous_count; i++) {
+        if (strcmp(previous[i].name, name) == 0 && previous[i].instructions <= instructions) {
+            base = previous[i].instructions;
+            since = previous[i].sampled_ns;
+            break;
+        }
+    }
+    if (*next_count < MAX_INSTANCES) {
+        Previous *p = &next[(*next_count)++];
+        snprintf(p->name, sizeof(p->name), "%s", name);
+        p->instructions = instructions;
+        p->sampled_ns = now;
+    }
+    if (now <= since)
+        return 0.0;
+    return (double)(instructions - base) * 1e9 / (double)(now - since);
+}
+
+static void sample(void) {
+    DIR *dir = opendir(METRICS_DIR);
+    if (!dir) {
+        perror("Error opening " METRICS_DIR);
+        exit(1);
+    }
+    static Previous next[MAX_INSTANCES];
+    size_t next_count = 0;
+    size_t shown = 0;
+    printf("%-8s %-20s %-5s %10s %9s %9s %5s %9s %9s %5s %8s %5s\n",
+           "PID", "PROGRAM", "STATE", "INSTR", "IPS", "MEM", "FILES", "READ", "WRITTEN",
+           "SNAPS", "IP", "DEPTH");
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        if (strncmp(e->d_name, METRICS_PREFIX, strlen(METRICS_PREFIX)) != 0)
+            continue;
+        char path[512];
+        snprintf(path, sizeof(path), METRICS_DIR "/%s", e->d_name);
+        const MetricsPage *page = map_page(path);
+        if (!page)
+            continue;
+        uint64_t now = monotonic_ns();
+        uint64_t c[MET_COUNTERS];
+        for (int i = 0; i < MET_COUNTERS; i++)
+            c[i] = __atomic_load_n(&page->counters[i], __ATOMIC_RELAXED);
+        int running = (int)__atomic_load_n(&page->running, __ATOMIC_RELAXED);
+        double ips = running ? rate(e->d_name, c[MET_INSTRUCTIONS], page->start_ns, now, next, &next_count) : 0.0;
+
+        char instr[16], speed[16], mem[16], read[16], written[16];
+        human(instr, sizeof(instr), (double)c[MET_INSTRUCTIONS]);
+        human(speed, sizeof(speed), ips);
+        human(mem, sizeof(mem), (double)c[MET_MEMORY_SIZE]);
+        human(read, sizeof(read), (double)c[MET_BYTES_READ]);
+        human(written, sizeof(written), (double)c[MET_BYTES_WRITTEN]);
+        printf("%-8u %-20.20s %-5s %10s %9s %9s %5llu %9s %9s %5llu %08x %5u\n",
+               page->pid, page->program, running ? "run" : "done", instr, speed, mem,
+               (unsigned long long)c[MET_OPEN_FILES], read, written,
+               (unsigned long long)c[MET_SNAPSHOTS],
+               __atomic_load_n(&page->ip, __ATOMIC_RELAXED),
+               __atomic_load_n(&page->call_depth, __ATOMIC_RELAXED));
+        munmap((void *)page, sizeof(MetricsPage));
+        shown++;
+    }
+    closedir(dir);
+    if (shown == 0)
+        printf("(no AirVM instances with --metrics)\n");
+    memcpy(previous, next, next_count * sizeof(Previous));
+    previous_count = next_count;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-d <seconds>] [-n <count>]\n", prog);
+    fprintf(stderr, "  -d <seconds>  Delay between samples (default: 1)\n");
+    fprintf(stderr, "  -n <count>    Number of samples, 0 for unlimited (default: 0)\n");
+}
+
+int main(int argc, char *argv[]) {
+    double delay = 1.0;
+    long count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            delay = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            count = strtol(argv[++i], NULL, 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (delay <= 0.0) {
+        usage(argv[0]);
+        return 1;
+    }
+    int tty = isatty(fileno(stdout));
+    for (long n = 0; count == 0 || n < count; n++) {
+        if (n > 0) {
+            struct timespec ts = { (time_t)delay, (long)((delay - (double)(time_t)delay) * 1e9) };
+            nanosleep(&ts, NULL);
+        }
+        if (tty)
+            printf("\033[H\033[2J");
+        else if (n > 0)
+            printf("\n");
+        sample();
+        fflush(stdout);
+    }
+    return 0;
+}